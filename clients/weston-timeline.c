@@ -0,0 +1,367 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Converts the 'timeline-binary' debug stream into the JSON of the
+ * 'timeline' stream, for wesgr:
+ *
+ *   weston-debug timeline-binary > log.bin
+ *   weston-timeline -o log.json log.bin
+ *
+ * or prints the latency distributions from input to client commit, plane
+ * assignment, KMS commit and present of the recording:
+ *
+ *   weston-timeline --latency log.bin
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+
+#include "shared/helpers.h"
+#include "shared/timeline-binary.h"
+#include "shared/timeline-latency.h"
+
+struct timeline_converter {
+	FILE *in;
+	FILE *out;
+
+	/* Analyse instead of converting, if set */
+	struct timeline_latency *latency;
+
+	struct timeline_binary_names names;
+};
+
+static void
+print_quoted_string(FILE *out, const char *str)
+{
+	if (!str[0]) {
+		fprintf(out, "null");
+		return;
+	}
+
+	fprintf(out, "\"%s\"", str);
+}
+
+static void
+print_point(struct timeline_converter *conv,
+	    const struct timeline_binary_parsed *rec)
+{
+	const struct timeline_binary_point *point = rec->point;
+	uint32_t i;
+
+	fprintf(conv->out, "{ \"T\":[%" PRId64 ", %ld], \"N\":\"%s\"",
+		point->tv_sec, (long)point->tv_nsec,
+		rec->name ? rec->name : "unknown");
+
+	for (i = 0; i < rec->n_args; i++) {
+		const struct timeline_binary_arg *arg = &point->args[i];
+
+		switch (arg->type) {
+		case TIMELINE_BINARY_ARG_OUTPUT:
+			fprintf(conv->out, ", \"wo\":%u", arg->value);
+			break;
+		case TIMELINE_BINARY_ARG_SURFACE:
+			fprintf(conv->out, ", \"ws\":%u", arg->value);
+			break;
+		case TIMELINE_BINARY_ARG_VBLANK:
+			fprintf(conv->out, ", \"vblank_monotonic\":[%" PRId64
+				", %ld]", arg->tv_sec, (long)arg->value);
+			break;
+		case TIMELINE_BINARY_ARG_GPU:
+			fprintf(conv->out, ", \"gpu\":[%" PRId64 ", %ld]",
+				arg->tv_sec, (long)arg->value);
+			break;
+		case TIMELINE_BINARY_ARG_SERIAL:
+			fprintf(conv->out, ", \"serial\":%u", arg->value);
+			break;
+		case TIMELINE_BINARY_ARG_INPUT:
+			fprintf(conv->out, ", \"input_monotonic\":[%" PRId64
+				", %ld]", arg->tv_sec, (long)arg->value);
+			break;
+		default:
+			break;
+		}
+	}
+
+	fprintf(conv->out, " }\n");
+}
+
+static int
+convert_record(struct timeline_converter *conv,
+	       const struct timeline_binary_record *rec, const void *payload)
+{
+	struct timeline_binary_parsed parsed;
+
+	if (timeline_binary_parse_record(&conv->names, rec, payload,
+					 &parsed) < 0)
+		return -1;
+
+	switch (parsed.type) {
+	case TIMELINE_BINARY_OUTPUT:
+		fprintf(conv->out, "{ \"id\":%u, \"type\":\"weston_output\", "
+			"\"name\":", parsed.id);
+		print_quoted_string(conv->out, parsed.string);
+		fprintf(conv->out, " }\n");
+		break;
+	case TIMELINE_BINARY_SURFACE:
+		fprintf(conv->out, "{ \"id\":%u, \"type\":\"weston_surface\", "
+			"\"desc\":", parsed.id);
+		print_quoted_string(conv->out, parsed.string);
+		if (parsed.main_surface)
+			fprintf(conv->out, ", \"main_surface\":%u",
+				parsed.main_surface);
+		fprintf(conv->out, " }\n");
+		break;
+	case TIMELINE_BINARY_POINT:
+		print_point(conv, &parsed);
+		break;
+	default:
+		/* Names are kept by the parser, unknown records from newer
+		 * versions are skipped. */
+		break;
+	}
+
+	return 0;
+}
+
+static int
+convert(struct timeline_converter *conv)
+{
+	struct timeline_binary_header header;
+	struct timeline_binary_record rec;
+	/* Records are at most 64 kB, keep the payload 8 byte aligned. */
+	uint64_t payload[65536 / sizeof(uint64_t)];
+	int ret;
+
+	if (fread(&header, sizeof(header), 1, conv->in) != 1 ||
+	    header.magic != TIMELINE_BINARY_MAGIC) {
+		fprintf(stderr, "Error: not a binary timeline stream.\n");
+		return -1;
+	}
+
+	if (header.version != TIMELINE_BINARY_VERSION) {
+		fprintf(stderr, "Error: unsupported binary timeline version "
+			"%u.\n", header.version);
+		return -1;
+	}
+
+	while (fread(&rec, sizeof(rec), 1, conv->in) == 1) {
+		if (rec.size < sizeof(rec) || rec.size % 8 != 0) {
+			fprintf(stderr, "Error: corrupt record.\n");
+			return -1;
+		}
+
+		if (rec.size > sizeof(rec) &&
+		    fread(payload, rec.size - sizeof(rec), 1, conv->in) != 1) {
+			/* The compositor was stopped in the middle. */
+			fprintf(stderr, "Warning: truncated stream.\n");
+			break;
+		}
+
+		if (conv->latency)
+			ret = timeline_latency_add_record(conv->latency, &rec,
+							  payload);
+		else
+			ret = convert_record(conv, &rec, payload);
+		if (ret < 0) {
+			fprintf(stderr, "Error: corrupt record.\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static const struct timeline_latency_samples *
+event_samples(const struct timeline_latency_event *ev, size_t offset)
+{
+	return (const void *)((const char *)ev + offset);
+}
+
+static void
+print_latency_table(struct timeline_converter *conv, const char *title,
+		    size_t offset)
+{
+	const struct timeline_latency_event *ev;
+	const struct timeline_latency_samples *s;
+	bool any = false;
+	unsigned int i;
+
+	/* Stages only some backends have */
+	for (i = 0; (ev = timeline_latency_get_event(conv->latency, i)); i++)
+		any = any || event_samples(ev, offset)->count > 0;
+	if (!any)
+		return;
+
+	fprintf(conv->out, "%s (ms):\n", title);
+	fprintf(conv->out, "  %-20s %7s %9s %9s %9s %9s %9s\n", "event",
+		"count", "min", "median", "p90", "p99", "max");
+
+	for (i = 0; (ev = timeline_latency_get_event(conv->latency, i)); i++) {
+		s = event_samples(ev, offset);
+		if (s->count == 0)
+			continue;
+
+		fprintf(conv->out, "  %-20s %7u %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+			ev->name, s->count, s->nsec[0] / 1e6,
+			timeline_latency_percentile(s->nsec, s->count, 50) / 1e6,
+			timeline_latency_percentile(s->nsec, s->count, 90) / 1e6,
+			timeline_latency_percentile(s->nsec, s->count, 99) / 1e6,
+			s->nsec[s->count - 1] / 1e6);
+	}
+}
+
+static void
+print_latency(struct timeline_converter *conv)
+{
+	print_latency_table(conv, "Input to client commit",
+			    offsetof(struct timeline_latency_event, to_commit));
+	print_latency_table(conv, "Input to plane assignment",
+			    offsetof(struct timeline_latency_event, to_plane));
+	print_latency_table(conv, "Input to KMS commit",
+			    offsetof(struct timeline_latency_event, to_kms));
+	print_latency_table(conv, "Input to present",
+			    offsetof(struct timeline_latency_event, to_present));
+	fprintf(conv->out, "%u events got no response within a second.\n",
+		timeline_latency_get_dropped(conv->latency));
+}
+
+static void
+print_help(void)
+{
+	fprintf(stderr,
+		"Usage: weston-timeline [options] [FILE]\n"
+		"Converts a 'timeline-binary' debug stream read from FILE,\n"
+		"or stdin if not given, into 'timeline' JSON for wesgr.\n"
+		"Where options may be:\n"
+		"  -h, --help\n"
+		"     This help text, and exit with success.\n"
+		"  -l, --latency\n"
+		"     Print input latency distributions per input event type\n"
+		"     and stage instead of JSON.\n"
+		"  -o FILE, --output FILE\n"
+		"     Write the output to file named FILE instead of stdout.\n"
+		);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const struct option opts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "latency", no_argument, NULL, 'l' },
+		{ "output", required_argument, NULL, 'o' },
+		{ 0 }
+	};
+	static const char optstr[] = "hlo:";
+	struct timeline_converter conv = {};
+	const char *output = NULL;
+	bool latency = false;
+	int ret = 1;
+	int c;
+
+	while ((c = getopt_long(argc, argv, optstr, opts, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			print_help();
+			return 0;
+		case 'l':
+			latency = true;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			print_help();
+			return 1;
+		}
+	}
+
+	if (optind < argc - 1) {
+		print_help();
+		return 1;
+	}
+
+	conv.in = stdin;
+	if (optind < argc) {
+		conv.in = fopen(argv[optind], "rb");
+		if (!conv.in) {
+			fprintf(stderr, "Error: cannot open '%s': %s\n",
+				argv[optind], strerror(errno));
+			return 1;
+		}
+	}
+
+	conv.out = stdout;
+	if (output) {
+		conv.out = fopen(output, "w");
+		if (!conv.out) {
+			fprintf(stderr, "Error: cannot open '%s': %s\n",
+				output, strerror(errno));
+			goto out;
+		}
+	}
+
+	if (latency) {
+		conv.latency = timeline_latency_create();
+		if (!conv.latency) {
+			fprintf(stderr, "Error: out of memory.\n");
+			goto out_close;
+		}
+	}
+
+	if (convert(&conv) == 0) {
+		if (conv.latency)
+			print_latency(&conv);
+		ret = 0;
+	}
+
+out_close:
+	if (conv.out != stdout && fclose(conv.out) != 0) {
+		fprintf(stderr, "Error: writing '%s': %s\n", output,
+			strerror(errno));
+		ret = 1;
+	}
+
+out:
+	if (conv.in != stdin)
+		fclose(conv.in);
+
+	if (conv.latency)
+		timeline_latency_destroy(conv.latency);
+
+	timeline_binary_names_fini(&conv.names);
+
+	return ret;
+}
@@ -69,6 +69,10 @@
 #define WINDOW_TITLE "Weston Compositor"
 /* flight recorder size (in bytes) */
 #define DEFAULT_FLIGHT_REC_SIZE (5 * 1024 * 1024)
+/* asynchronous log buffer size (in bytes) */
+#define DEFAULT_ASYNC_LOG_SIZE (1024 * 1024)
+/* upper limit of pixman-threads, a sanity check only */
+#define MAX_PIXMAN_THREADS 64
 
 struct wet_output_config {
 	int width;
@@ -194,6 +198,60 @@ weston_log_file_open(const char *filename)
 	return true;
 }
 
+static void
+on_crash_signal(int signo)
+{
+	weston_log_async_flush_on_crash();
+
+	signal(signo, SIG_DFL);
+	raise(signo);
+}
+
+/* The asynchronous log writer may be behind when the compositor crashes,
+ * write out what it has not written yet. */
+static void
+catch_crash_signals(void)
+{
+	static const int signos[] = { SIGSEGV, SIGBUS, SIGABRT, SIGFPE, SIGILL };
+	struct sigaction action = { 0 };
+	unsigned int i;
+
+	action.sa_handler = on_crash_signal;
+	action.sa_flags = SA_RESETHAND;
+	sigemptyset(&action.sa_mask);
+
+	for (i = 0; i < ARRAY_LENGTH(signos); i++)
+		sigaction(signos[i], &action, NULL);
+}
+
+static struct weston_log_subscriber *
+create_logger(const char *log_async)
+{
+	enum weston_log_async_policy policy;
+	struct weston_log_subscriber *logger;
+
+	if (!log_async)
+		return weston_log_subscriber_create_log(weston_logfile);
+
+	if (strcmp(log_async, "drop") == 0) {
+		policy = WESTON_LOG_ASYNC_DROP;
+	} else if (strcmp(log_async, "block") == 0) {
+		policy = WESTON_LOG_ASYNC_BLOCK;
+	} else {
+		fprintf(stderr, "Invalid --log-async policy '%s', "
+			"expected 'drop' or 'block'.\n", log_async);
+		return NULL;
+	}
+
+	logger = weston_log_subscriber_create_log_async(weston_logfile,
+							DEFAULT_ASYNC_LOG_SIZE,
+							policy);
+	if (logger)
+		catch_crash_signals();
+
+	return logger;
+}
+
 static void
 weston_log_file_close(void)
 {
@@ -656,6 +714,9 @@ usage(int error_code)
 #endif
 		"  --modules\t\tLoad the comma-separated list of modules\n"
 		"  --log=FILE\t\tLog to the given file\n"
+		"  --log-async=POLICY\tWrite the log from a thread of its own,\n"
+			"\t\t\tdropping messages when it falls behind if\n"
+			"\t\t\tPOLICY is 'drop', or waiting if it is 'block'\n"
 		"  -c, --config=FILE\tConfig file to load, defaults to weston.ini\n"
 		"  --no-config\t\tDo not read weston.ini\n"
 		"  --wait-for-debugger\tRaise SIGSTOP on start-up\n"
@@ -673,7 +734,7 @@ usage(int error_code)
 		"Options for drm-backend.so:\n\n"
 		"  --seat=SEAT\t\tThe seat that weston should run on, instead of the seat defined in XDG_SEAT\n"
 		"  --tty=TTY\t\tThe tty to use\n"
-		"  --drm-device=CARD\tThe DRM device to use, e.g. \"card0\".\n"
+		"  --drm-device=CARD\tThe DRM device to use, e.g. \"card0\", or the path\n\t\t\tof its device node\n"
 		"  --use-pixman\t\tUse the pixman (CPU) renderer\n"
 		"  --current-mode\tPrefer current KMS mode over EDID preferred mode\n"
 		"  --continue-without-input\tAllow the compositor to start without input devices\n\n");
@@ -1086,6 +1147,10 @@ weston_compositor_init_config(struct weston_compositor *ec,
 	struct xkb_rule_names xkb_names;
 	struct weston_config_section *s;
 	int repaint_msec;
+	int occluded_frame_msec;
+	int pixman_threads;
+	int percentile;
+	int margin_usec;
 	bool color_management;
 	bool cal;
 
@@ -1123,8 +1188,61 @@ weston_compositor_init_config(struct weston_compositor *ec,
 	} else {
 		ec->repaint_msec = repaint_msec;
 	}
-	weston_log("Output repaint window is %d ms maximum.\n",
-		   ec->repaint_msec);
+	weston_config_section_get_int(s, "repaint-window-percentile",
+				      &percentile, 0);
+	weston_config_section_get_int(s, "repaint-window-margin",
+				      &margin_usec,
+				      ec->repaint_window_margin_usec);
+	if (percentile < 0 || percentile > 100) {
+		weston_log("Invalid repaint-window-percentile value in config: %d\n",
+			   percentile);
+	} else if (margin_usec < 0 || margin_usec > 1000000) {
+		weston_log("Invalid repaint-window-margin value in config: %d\n",
+			   margin_usec);
+	} else {
+		ec->repaint_window_percentile = percentile;
+		ec->repaint_window_margin_usec = margin_usec;
+	}
+
+	if (ec->repaint_window_percentile > 0)
+		weston_log("Output repaint window adapts to repaint time "
+			   "percentile %d plus %d us, %d ms until measured.\n",
+			   ec->repaint_window_percentile,
+			   ec->repaint_window_margin_usec, ec->repaint_msec);
+	else
+		weston_log("Output repaint window is %d ms maximum.\n",
+			   ec->repaint_msec);
+
+	weston_config_section_get_int(s, "occluded-frame-interval",
+				      &occluded_frame_msec, 0);
+	if (occluded_frame_msec < 0 || occluded_frame_msec > 10000) {
+		weston_log("Invalid occluded-frame-interval value in config: %d\n",
+			   occluded_frame_msec);
+	} else {
+		ec->occluded_frame_msec = occluded_frame_msec;
+	}
+	if (ec->occluded_frame_msec > 0)
+		weston_log("Occluded surfaces get frame callbacks every %d ms.\n",
+			   ec->occluded_frame_msec);
+
+	weston_config_section_get_int(s, "pixman-threads",
+				      &pixman_threads, 1);
+	ec->pixman_threads = MAX(1, MIN(pixman_threads, MAX_PIXMAN_THREADS));
+	if (ec->pixman_threads != pixman_threads)
+		weston_log("pixman-threads value %d in config out of range, "
+			   "using %d (1 to %d).\n",
+			   pixman_threads, ec->pixman_threads,
+			   MAX_PIXMAN_THREADS);
+	weston_config_section_get_bool(s, "gl-immediate-draws",
+				       &ec->gl_immediate_draws, false);
+	weston_config_section_get_string(s, "gl-shader-cache",
+					 &ec->gl_shader_cache_dir, NULL);
+	if (ec->gl_shader_cache_dir && ec->gl_shader_cache_dir[0] == '\0') {
+		free(ec->gl_shader_cache_dir);
+		ec->gl_shader_cache_dir = NULL;
+	}
+	weston_config_section_get_bool(s, "gl-shader-prewarm",
+				       &ec->gl_shader_prewarm, false);
 
 	weston_config_section_get_bool(s, "color-management",
 				       &color_management, false);
@@ -2582,6 +2700,8 @@ load_drm_backend(struct weston_compositor *c,
 	                               &config.pageflip_timeout, 0);
 	weston_config_section_get_bool(section, "pixman-shadow",
 				       &config.use_pixman_shadow, true);
+	weston_config_section_get_bool(section, "kms-thread",
+				       &config.use_kms_thread, false);
 	if (without_input)
 		c->require_input = !without_input;
 
@@ -3176,6 +3296,7 @@ wet_main(int argc, char *argv[], const struct weston_testsuite_data *test_data)
 	char *modules = NULL;
 	char *option_modules = NULL;
 	char *log = NULL;
+	char *log_async = NULL;
 	char *log_scopes = NULL;
 	char *flight_rec_scopes = NULL;
 	char *server_socket = NULL;
@@ -3211,6 +3332,7 @@ wet_main(int argc, char *argv[], const struct weston_testsuite_data *test_data)
 #endif
 		{ WESTON_OPTION_STRING, "modules", 0, &option_modules },
 		{ WESTON_OPTION_STRING, "log", 0, &log },
+		{ WESTON_OPTION_STRING, "log-async", 0, &log_async },
 		{ WESTON_OPTION_BOOLEAN, "help", 'h', &help },
 		{ WESTON_OPTION_BOOLEAN, "version", 0, &version },
 		{ WESTON_OPTION_BOOLEAN, "no-config", 0, &noconfig },
@@ -3254,7 +3376,9 @@ wet_main(int argc, char *argv[], const struct weston_testsuite_data *test_data)
 
 	weston_log_set_handler(vlog, vlog_continue);
 
-	logger = weston_log_subscriber_create_log(weston_logfile);
+	logger = create_logger(log_async);
+	if (!logger)
+		return EXIT_FAILURE;
 	flight_rec = weston_log_subscriber_create_flight_rec(DEFAULT_FLIGHT_REC_SIZE);
 
 	weston_log_subscribe_to_scopes(log_ctx, logger, flight_rec,
@@ -3493,6 +3617,7 @@ out_display:
 	free(socket_name);
 	free(option_modules);
 	free(log);
+	free(log_async);
 	free(modules);
 
 	return ret;
@@ -79,8 +79,23 @@ struct shared_output {
 
 	int cache_dirty;
 	pixman_image_t *cache_image;
-	uint32_t *tmp_data;
-	size_t tmp_data_size;
+
+	/* struct ss_capture::link, oldest first */
+	struct wl_list capture_list;
+	/* Damage of the read backs which failed, in output coordinates */
+	pixman_region32_t missed_damage;
+};
+
+/* The damaged pixels of one output frame, being read back */
+struct ss_capture {
+	struct shared_output *so; /* NULL once the shared output is gone */
+	struct wl_list link; /* shared_output::capture_list */
+	pixman_region32_t damage; /* in output coordinates */
+	pixman_region32_t buffer_damage; /* in buffer coordinates */
+	int cache_width, cache_height;
+	uint32_t *pixels; /* the rectangles of buffer_damage */
+	int pending; /* read backs not done yet */
+	bool failed;
 };
 
 struct ss_seat {
@@ -576,42 +591,6 @@ output_compute_transform(struct weston_output *output,
 static void
 shared_output_destroy(struct shared_output *so);
 
-static int
-shared_output_ensure_tmp_data(struct shared_output *so,
-			      pixman_region32_t *region)
-{
-	pixman_box32_t *ext;
-	size_t size;
-
-	if (!pixman_region32_not_empty(region))
-		return 0;
-
-	ext = pixman_region32_extents(region);
-
-	/* Damage is in output coordinates.
-	 *
-	 * We are multiplying by 4 because the temporary data needs to be able
-	 * to store an 32 bit-per-pixel buffer.
-	 */
-	size = 4 * (ext->x2 - ext->x1) * (ext->y2 - ext->y1)
-		 * so->output->current_scale * so->output->current_scale;
-
-	if (so->tmp_data != NULL && size <= so->tmp_data_size)
-		return 0;
-
-	free(so->tmp_data);
-	so->tmp_data = malloc(size);
-	if (so->tmp_data == NULL) {
-		so->tmp_data_size = 0;
-		errno = ENOMEM;
-		return -1;
-	}
-
-	so->tmp_data_size = size;
-
-	return 0;
-}
-
 static void
 shared_output_update(struct shared_output *so);
 
@@ -816,81 +795,63 @@ struct zwp_fullscreen_shell_mode_feedback_v1_listener mode_feedback_listener = {
 };
 
 static void
-shared_output_repainted(struct wl_listener *listener, void *data)
+ss_capture_destroy(struct ss_capture *capture)
+{
+	wl_list_remove(&capture->link);
+	pixman_region32_fini(&capture->damage);
+	pixman_region32_fini(&capture->buffer_damage);
+	free(capture->pixels);
+	free(capture);
+}
+
+/* Put the read back pixels into the cache image */
+static int
+ss_capture_apply(struct shared_output *so, struct ss_capture *capture)
 {
-	struct shared_output *so =
-		container_of(listener, struct shared_output, frame_listener);
-	pixman_region32_t damage;
-	pixman_region32_t *current_damage = data;
 	struct ss_shm_buffer *sb;
-	int32_t x, y, width, height, stride;
-	int i, nrects, do_yflip, y_orig;
 	pixman_box32_t *r;
 	pixman_image_t *damaged_image;
 	pixman_transform_t transform;
-
-	width = so->output->current_mode->width;
-	height = so->output->current_mode->height;
-	stride = width;
+	uint32_t *pixels = capture->pixels;
+	int32_t x, y, width, height;
+	int i, nrects, do_yflip;
 
 	if (!so->cache_image ||
-	    pixman_image_get_width(so->cache_image) != width ||
-	    pixman_image_get_height(so->cache_image) != height) {
+	    pixman_image_get_width(so->cache_image) != capture->cache_width ||
+	    pixman_image_get_height(so->cache_image) != capture->cache_height) {
 		if (so->cache_image)
 			pixman_image_unref(so->cache_image);
 
 		so->cache_image =
 			pixman_image_create_bits(PIXMAN_a8r8g8b8,
-						 width, height, NULL,
-						 stride);
+						 capture->cache_width,
+						 capture->cache_height, NULL,
+						 capture->cache_width);
 		if (!so->cache_image)
-			goto err_shared_output;
-
-		pixman_region32_init_rect(&damage, 0, 0, width, height);
-	} else {
-		/* Damage in output coordinates */
-		pixman_region32_init(&damage);
-		pixman_region32_intersect(&damage, &so->output->region, current_damage);
-		pixman_region32_translate(&damage, -so->output->x, -so->output->y);
+			return -1;
 	}
 
 	/* Apply damage to all buffers */
 	wl_list_for_each(sb, &so->shm.buffers, link)
-		pixman_region32_union(&sb->damage, &sb->damage, &damage);
-
-	/* Transform to buffer coordinates */
-	weston_transformed_region(so->output->width, so->output->height,
-				  so->output->transform,
-				  so->output->current_scale,
-				  &damage, &damage);
-
-	if (shared_output_ensure_tmp_data(so, &damage) < 0)
-		goto err_pixman_init;
+		pixman_region32_union(&sb->damage, &sb->damage,
+				      &capture->damage);
 
 	do_yflip = !!(so->output->compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
 
-	r = pixman_region32_rectangles(&damage, &nrects);
+	r = pixman_region32_rectangles(&capture->buffer_damage, &nrects);
 	for (i = 0; i < nrects; ++i) {
 		x = r[i].x1;
 		y = r[i].y1;
 		width = r[i].x2 - r[i].x1;
 		height = r[i].y2 - r[i].y1;
 
-		if (do_yflip)
-			y_orig = so->output->current_mode->height - r[i].y2;
-		else
-			y_orig = y;
-
-		so->output->compositor->renderer->read_pixels(
-			so->output, PIXMAN_a8r8g8b8, so->tmp_data,
-			x, y_orig, width, height);
-
 		damaged_image = pixman_image_create_bits(PIXMAN_a8r8g8b8,
 							 width, height,
-							 so->tmp_data,
+							 pixels,
 				(PIXMAN_FORMAT_BPP(PIXMAN_a8r8g8b8) / 8) * width);
 		if (!damaged_image)
-			goto err_pixman_init;
+			return -1;
+		pixels += width * height;
 
 		if (do_yflip) {
 			pixman_transform_init_scale(&transform,
@@ -917,13 +878,166 @@ shared_output_repainted(struct wl_listener *listener, void *data)
 
 	so->cache_dirty = 1;
 
-	pixman_region32_fini(&damage);
-	shared_output_update(so);
+	return 0;
+}
+
+/* Apply the frames that have been read back, in order */
+static void
+shared_output_flush_captures(struct shared_output *so)
+{
+	struct ss_capture *capture;
+	bool updated = false;
+
+	while (!wl_list_empty(&so->capture_list)) {
+		capture = container_of(so->capture_list.next,
+				       struct ss_capture, link);
+		if (capture->pending > 0)
+			break;
+
+		/* Read the damage of a failed frame back with the next one. */
+		if (capture->failed) {
+			weston_log("screen-share: failed to read back frame, "
+				   "retrying with the next one\n");
+			pixman_region32_union(&so->missed_damage,
+					      &so->missed_damage,
+					      &capture->damage);
+			ss_capture_destroy(capture);
+			continue;
+		}
+
+		if (ss_capture_apply(so, capture) < 0) {
+			ss_capture_destroy(capture);
+			shared_output_destroy(so);
+			return;
+		}
+
+		ss_capture_destroy(capture);
+		updated = true;
+	}
+
+	if (updated)
+		shared_output_update(so);
+}
+
+static void
+ss_capture_done(void *data, bool success)
+{
+	struct ss_capture *capture = data;
+
+	if (!success)
+		capture->failed = true;
+
+	if (--capture->pending > 0)
+		return;
+
+	if (capture->so)
+		shared_output_flush_captures(capture->so);
+	else
+		ss_capture_destroy(capture);
+}
+
+static void
+shared_output_repainted(struct wl_listener *listener, void *data)
+{
+	struct shared_output *so =
+		container_of(listener, struct shared_output, frame_listener);
+	pixman_region32_t *current_damage = data;
+	struct ss_capture *capture;
+	int32_t width, height;
+	int i, nrects, do_yflip, y_orig;
+	pixman_box32_t *r;
+	uint32_t *pixels;
+	size_t size = 0;
+	bool full;
+
+	capture = zalloc(sizeof *capture);
+	if (!capture)
+		goto err_shared_output;
+
+	width = so->output->current_mode->width;
+	height = so->output->current_mode->height;
+	capture->so = so;
+	capture->cache_width = width;
+	capture->cache_height = height;
+	pixman_region32_init(&capture->buffer_damage);
+
+	/* Until the cache image exists or after a mode change, all of it
+	 * needs to be read back. */
+	full = !so->cache_image ||
+	       pixman_image_get_width(so->cache_image) != width ||
+	       pixman_image_get_height(so->cache_image) != height;
+	if (!wl_list_empty(&so->capture_list)) {
+		struct ss_capture *last =
+			container_of(so->capture_list.prev,
+				     struct ss_capture, link);
+
+		full = last->cache_width != width ||
+		       last->cache_height != height;
+	}
+
+	if (full) {
+		pixman_region32_init_rect(&capture->damage, 0, 0, width, height);
+	} else {
+		/* Damage in output coordinates */
+		pixman_region32_init(&capture->damage);
+		pixman_region32_intersect(&capture->damage, &so->output->region,
+					  current_damage);
+		pixman_region32_translate(&capture->damage,
+					  -so->output->x, -so->output->y);
+		pixman_region32_union(&capture->damage, &capture->damage,
+				      &so->missed_damage);
+	}
+	pixman_region32_clear(&so->missed_damage);
+
+	/* Transform to buffer coordinates */
+	weston_transformed_region(so->output->width, so->output->height,
+				  so->output->transform,
+				  so->output->current_scale,
+				  &capture->damage, &capture->buffer_damage);
+
+	r = pixman_region32_rectangles(&capture->buffer_damage, &nrects);
+	for (i = 0; i < nrects; ++i)
+		size += (size_t)(r[i].x2 - r[i].x1) * (r[i].y2 - r[i].y1) * 4;
+
+	capture->pixels = malloc(size > 0 ? size : 1);
+	wl_list_insert(so->capture_list.prev, &capture->link);
+	if (!capture->pixels) {
+		ss_capture_destroy(capture);
+		goto err_shared_output;
+	}
+
+	do_yflip = !!(so->output->compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
+
+	/* Held until all read backs have been queued */
+	capture->pending = 1;
+
+	pixels = capture->pixels;
+	for (i = 0; i < nrects; ++i) {
+		width = r[i].x2 - r[i].x1;
+		height = r[i].y2 - r[i].y1;
+
+		if (do_yflip)
+			y_orig = so->output->current_mode->height - r[i].y2;
+		else
+			y_orig = r[i].y1;
+
+		capture->pending++;
+		if (weston_output_read_pixels_async(so->output,
+						    PIXMAN_a8r8g8b8, pixels,
+						    r[i].x1, y_orig,
+						    width, height,
+						    ss_capture_done,
+						    capture) < 0) {
+			capture->pending--;
+			capture->failed = true;
+		}
+		pixels += width * height;
+	}
+
+	ss_capture_done(capture, true);
 
 	return;
 
-err_pixman_init:
-	pixman_region32_fini(&damage);
 err_shared_output:
 	shared_output_destroy(so);
 }
@@ -1008,6 +1122,8 @@ shared_output_create(struct weston_output *output, int parent_fd)
 	/* Ok, everything's created.  We should be good to go */
 	wl_list_init(&so->shm.buffers);
 	wl_list_init(&so->shm.free_buffers);
+	wl_list_init(&so->capture_list);
+	pixman_region32_init(&so->missed_damage);
 
 	so->output = output;
 	so->output_destroyed.notify = output_destroyed;
@@ -1035,9 +1151,23 @@ static void
 shared_output_destroy(struct shared_output *so)
 {
 	struct ss_shm_buffer *buffer, *bnext;
+	struct ss_capture *capture, *cnext;
 
 	weston_output_disable_planes_decr(so->output);
 
+	/* Read backs in flight free their captures when done, the others
+	 * only wait for an earlier capture. */
+	wl_list_for_each_safe(capture, cnext, &so->capture_list, link) {
+		if (capture->pending == 0) {
+			ss_capture_destroy(capture);
+			continue;
+		}
+
+		capture->so = NULL;
+		wl_list_remove(&capture->link);
+		wl_list_init(&capture->link);
+	}
+
 	wl_list_for_each_safe(buffer, bnext, &so->shm.buffers, link)
 		ss_shm_buffer_destroy(buffer);
 	wl_list_for_each_safe(buffer, bnext, &so->shm.free_buffers, free_link)
@@ -1049,8 +1179,9 @@ shared_output_destroy(struct shared_output *so)
 	wl_list_remove(&so->output_destroyed.link);
 	wl_list_remove(&so->frame_listener.link);
 
-	pixman_image_unref(so->cache_image);
-	free(so->tmp_data);
+	if (so->cache_image)
+		pixman_image_unref(so->cache_image);
+	pixman_region32_fini(&so->missed_damage);
 
 	free(so);
 }
@@ -35,7 +35,7 @@
 extern "C" {
 #endif
 
-#define WESTON_DRM_BACKEND_CONFIG_VERSION 4
+#define WESTON_DRM_BACKEND_CONFIG_VERSION 5
 
 struct libinput_device;
 
@@ -217,12 +217,19 @@ struct weston_drm_backend_config {
 	/** Specific DRM device to open
 	 *
 	 * A DRM device name, like "card0", to open. If NULL, use heuristics
-	 * based on seat names and boot_vga to find the right device.
+	 * based on seat names and boot_vga to find the right device. An
+	 * absolute path is opened as the device node itself, without
+	 * looking the device up in udev.
 	 */
 	char *specific_device;
 
 	/** Use shadow buffer if using Pixman-renderer. */
 	bool use_pixman_shadow;
+
+	/** Submit atomic commits and read page flip events on a thread of
+	 * their own, so that commits blocking in the kernel do not hold
+	 * up the compositor. Needs atomic modesetting. */
+	bool use_kms_thread;
 };
 
 #ifdef  __cplusplus
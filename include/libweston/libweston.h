@@ -201,6 +201,9 @@ struct weston_testsuite_quirks {
 	bool gl_force_full_redraw_of_shadow_fb;
 	/** Required enum weston_capability bit mask, otherwise skip run. */
 	uint32_t required_capabilities;
+	/** Headless backend puts the cursor on a plane of its own, which
+	 * the renderer does not draw. */
+	bool headless_cursor_plane;
 };
 
 /** Weston test suite data that is given to compositor
@@ -292,12 +295,17 @@ struct weston_output {
 	struct wl_list animation_list;
 	int32_t x, y, width, height;
 
-	/** List of paint nodes in z-order, from top to bottom, maybe pruned
+	/** List of paint nodes in z-order, from top to bottom, pruned to
+	 *  the views whose output_mask includes this output
 	 *
 	 *  struct weston_paint_node::z_order_link
 	 */
 	struct wl_list paint_node_z_order_list;
 
+	/** weston_compositor::view_list_generation at the time
+	 *  paint_node_z_order_list was last rebuilt */
+	uint32_t z_order_list_generation;
+
 	/** Output area in global coordinates, simple rect */
 	pixman_region32_t region;
 
@@ -320,9 +328,22 @@ struct weston_output {
 	 *  next repaint should be run */
 	struct timespec next_repaint;
 
+	/** Recent repaint durations, for the adaptive repaint window */
+	struct weston_repaint_window *repaint_window;
+
+	/** Phase timings, while the repaint-profiler scope is subscribed */
+	struct weston_repaint_profiler *repaint_profiler;
+
+	/** Monotonic counters for the stats scope, allocated on first use */
+	struct weston_output_counters *counters;
+
 	/** For cancelling the idle_repaint callback on output destruction. */
 	struct wl_event_source *idle_repaint_source;
 
+	/** Repaints the output to release throttled frame callbacks of
+	 *  occluded surfaces, see weston_compositor::occluded_frame_msec. */
+	struct wl_event_source *occluded_frame_timer;
+
 	struct weston_output_zoom zoom;
 	int dirty;
 	struct wl_signal frame_signal;
@@ -934,11 +955,30 @@ struct weston_plane {
 
 struct weston_drm_format_array;
 
+/** Completion callback of weston_output_read_pixels_async()
+ *
+ * \param data The user data given with the request.
+ * \param success Whether the pixels were read.
+ */
+typedef void (*weston_read_pixels_done_func_t)(void *data, bool success);
+
 struct weston_renderer {
 	int (*read_pixels)(struct weston_output *output,
 			       pixman_format_code_t format, void *pixels,
 			       uint32_t x, uint32_t y,
 			       uint32_t width, uint32_t height);
+	/** See weston_output_read_pixels_async(), may be NULL */
+	int (*read_pixels_async)(struct weston_output *output,
+				 pixman_format_code_t format, void *pixels,
+				 uint32_t x, uint32_t y,
+				 uint32_t width, uint32_t height,
+				 weston_read_pixels_done_func_t done,
+				 void *data);
+	/** See weston_output_capture_async(), may be NULL */
+	int (*capture_output_async)(struct weston_output *output,
+				    pixman_format_code_t format, void *pixels,
+				    weston_read_pixels_done_func_t done,
+				    void *data);
 	void (*repaint_output)(struct weston_output *output,
 			       pixman_region32_t *output_damage);
 	void (*flush_damage)(struct weston_surface *surface);
@@ -1099,6 +1139,8 @@ struct weston_compositor {
 	struct wl_list seat_list;
 	struct wl_list layer_list;	/* struct weston_layer::link */
 	struct wl_list view_list;	/* struct weston_view::link */
+	uint32_t view_list_generation;	/* bumped on scene graph changes */
+	struct weston_pick_grid *pick_grid; /* index over view_list */
 	struct wl_list plane_list;
 	struct wl_list key_binding_list;
 	struct wl_list modifier_binding_list;
@@ -1122,6 +1164,17 @@ struct weston_compositor {
 	struct weston_color_manager *color_manager;
 	struct weston_renderer *renderer;
 	pixman_format_code_t read_format;
+	/* Threads the pixman renderer composites an output with, including
+	 * the main thread. Read when the renderer is created. */
+	int32_t pixman_threads;
+	/* Make the GL renderer issue the draw calls of every view as it
+	 * goes, instead of batching the whole repaint into few draws. */
+	bool gl_immediate_draws;
+	/* Directory for the GL renderer's program binary cache, NULL to
+	 * disable it. Freed by weston_compositor_destroy(). */
+	char *gl_shader_cache_dir;
+	/* Build the GL programs of all texture variants at startup. */
+	bool gl_shader_prewarm;
 
 	struct weston_backend *backend;
 	struct weston_launcher *launcher;
@@ -1141,6 +1194,13 @@ struct weston_compositor {
 
 	clockid_t presentation_clock;
 	int32_t repaint_msec;
+	/* Adaptive repaint window: the percentile of measured repaint
+	 * times to schedule for, 0 to always use repaint_msec. */
+	int32_t repaint_window_percentile;
+	int32_t repaint_window_margin_usec;
+	/* Minimum interval between frame callbacks of fully occluded
+	 * surfaces, 0 disables occlusion culling. */
+	int32_t occluded_frame_msec;
 	struct timespec last_repaint_start;
 
 	unsigned int activate_serial;
@@ -1174,6 +1234,11 @@ struct weston_compositor {
 	struct weston_log_context *weston_log_ctx;
 	struct weston_log_scope *debug_scene;
 	struct weston_log_scope *timeline;
+	struct weston_log_scope *timeline_binary;
+	struct weston_log_scope *repaint_window_scope;
+	struct weston_log_scope *repaint_profiler_scope;
+	int repaint_profiler_subscriptions;
+	struct weston_stats *stats;
 
 	struct content_protection *content_protection;
 };
@@ -1360,6 +1425,13 @@ struct weston_view {
 	uint32_t psf_flags;
 
 	bool is_mapped;
+
+	/* Input picking grid membership, managed by pick-grid.c */
+	struct {
+		uint32_t serial;	/* grid serial when indexed */
+		uint32_t order;		/* position in view_list */
+		int32_t x1, y1, x2, y2;	/* cell range, x2 and y2 exclusive */
+	} pick;
 };
 
 struct weston_surface_state {
@@ -1479,6 +1551,8 @@ struct weston_surface {
 
 	struct wl_list frame_callback_list;
 	struct wl_list feedback_list;
+	/* presentation clock time frame callbacks were last sent at */
+	struct timespec frame_callback_time;
 
 	struct weston_buffer_reference buffer_ref;
 	struct weston_buffer_viewport buffer_viewport;
@@ -1486,6 +1560,12 @@ struct weston_surface {
 	int32_t height_from_buffer;
 	bool keep_buffer; /* for backends to prevent early release */
 
+	/* When the last buffer was committed, and the moving average of
+	 * the time between buffer commits in nsec, or 0 before the second
+	 * one; see weston_surface_get_update_rate(). */
+	struct timespec buffer_commit_time;
+	int64_t buffer_commit_interval;
+
 	/* wp_viewport resource for this surface */
 	struct wl_resource *viewport_resource;
 
@@ -1662,6 +1742,17 @@ weston_layer_mask_is_infinite(struct weston_layer *layer);
 
 void
 weston_output_schedule_repaint(struct weston_output *output);
+int
+weston_output_read_pixels_async(struct weston_output *output,
+				pixman_format_code_t format, void *pixels,
+				uint32_t x, uint32_t y,
+				uint32_t width, uint32_t height,
+				weston_read_pixels_done_func_t done,
+				void *data);
+int
+weston_output_capture_async(struct weston_output *output,
+			    pixman_format_code_t format, void *pixels,
+			    weston_read_pixels_done_func_t done, void *data);
 void
 weston_compositor_schedule_repaint(struct weston_compositor *compositor);
 void
@@ -121,6 +121,25 @@ weston_log_subscribe(struct weston_log_context *log_ctx,
 struct weston_log_subscriber *
 weston_log_subscriber_create_log(FILE *dump_to);
 
+/** What an asynchronous log subscriber does with a message that does not
+ * fit into its buffer
+ *
+ * @ingroup log
+ */
+enum weston_log_async_policy {
+	/** drop the message, the number of dropped messages gets logged */
+	WESTON_LOG_ASYNC_DROP,
+	/** wait for the writer thread to make room */
+	WESTON_LOG_ASYNC_BLOCK,
+};
+
+struct weston_log_subscriber *
+weston_log_subscriber_create_log_async(FILE *dump_to, size_t size,
+				       enum weston_log_async_policy policy);
+
+void
+weston_log_async_flush_on_crash(void);
+
 struct weston_log_subscriber *
 weston_log_subscriber_create_flight_rec(size_t size);
 
@@ -0,0 +1,144 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cursor-cache.h"
+
+/** Find the cursor BO holding an image
+ *
+ * The image is laid out the way it is in the BO, zero-padded to the
+ * cursor size, so equal contents mean an equal image of the same size.
+ *
+ * \param cache The cursor images of an output
+ * \param pixels The image
+ * \param size Size of the image in bytes, the same for every image
+ * \param hash fnv1a_64() of the image
+ * \return The index of the BO, or -1 if none holds the image
+ */
+int
+drm_cursor_cache_find(struct drm_cursor_cache *cache,
+		      const uint32_t *pixels, size_t size, uint64_t hash)
+{
+	struct drm_cursor_cache_entry *entry;
+	int i;
+
+	for (i = 0; i < cache->n_bos; i++) {
+		entry = &cache->entries[i];
+
+		if (!entry->pixels || entry->hash != hash ||
+		    memcmp(entry->pixels, pixels, size) != 0)
+			continue;
+
+		entry->last_used = ++cache->clock;
+		return i;
+	}
+
+	return -1;
+}
+
+/** Choose the cursor BO to copy a new image into
+ *
+ * That is a BO holding nothing, else a new BO while there are fewer than
+ * DRM_CURSOR_CACHE_SIZE and may_add is set, else the least recently used
+ * BO. BOs in use are skipped.
+ *
+ * \param cache The cursor images of an output
+ * \param busy Bit mask of the BOs in use, which must not change
+ * \param may_add Whether a BO can be added
+ * \return The index of the BO, which is cache->n_bos for a BO to add, or
+ * -1 if all are busy
+ */
+int
+drm_cursor_cache_victim(const struct drm_cursor_cache *cache, uint32_t busy,
+			bool may_add)
+{
+	const struct drm_cursor_cache_entry *entries = cache->entries;
+	int victim = -1;
+	int i;
+
+	for (i = 0; i < cache->n_bos; i++) {
+		if (busy & (1u << i))
+			continue;
+		if (!entries[i].pixels)
+			return i;
+		if (victim < 0 ||
+		    entries[i].last_used < entries[victim].last_used)
+			victim = i;
+	}
+
+	if (may_add && cache->n_bos < DRM_CURSOR_CACHE_SIZE)
+		return cache->n_bos;
+
+	return victim;
+}
+
+/** Remember the image copied into a cursor BO
+ *
+ * If the image can't be kept, the BO is taken to hold nothing reusable.
+ */
+void
+drm_cursor_cache_store(struct drm_cursor_cache *cache, int i,
+		       const uint32_t *pixels, size_t size, uint64_t hash)
+{
+	struct drm_cursor_cache_entry *entry = &cache->entries[i];
+
+	assert(i >= 0 && i < cache->n_bos);
+
+	if (!entry->pixels)
+		entry->pixels = malloc(size);
+	if (!entry->pixels)
+		return;
+
+	memcpy(entry->pixels, pixels, size);
+	entry->hash = hash;
+	entry->last_used = ++cache->clock;
+}
+
+/** Forget what a cursor BO holds, after copying into it failed */
+void
+drm_cursor_cache_forget(struct drm_cursor_cache *cache, int i)
+{
+	struct drm_cursor_cache_entry *entry = &cache->entries[i];
+
+	free(entry->pixels);
+	entry->pixels = NULL;
+}
+
+/** Forget all images, once the cursor BOs are gone */
+void
+drm_cursor_cache_fini(struct drm_cursor_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < DRM_CURSOR_CACHE_SIZE; i++)
+		free(cache->entries[i].pixels);
+
+	memset(cache, 0, sizeof *cache);
+}
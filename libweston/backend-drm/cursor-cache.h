@@ -0,0 +1,74 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef DRM_CURSOR_CACHE_H
+#define DRM_CURSOR_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Most cursor BOs per output; each keeps the last image copied into it,
+ * so cursors cycling through a few images are not copied again. */
+#define DRM_CURSOR_CACHE_SIZE 8
+
+/* The contents of a cursor BO */
+struct drm_cursor_cache_entry {
+	uint64_t hash;
+	uint32_t *pixels;	/* NULL if the BO holds nothing reusable */
+	uint64_t last_used;
+};
+
+/*
+ * The images held by the cursor BOs of an output. The BOs are allocated
+ * as needed: entries 0 to n_bos - 1 have one, and the backend adds the
+ * next when drm_cursor_cache_victim() asks for it. Nothing here touches
+ * the BOs, the backend copies images into them.
+ */
+struct drm_cursor_cache {
+	struct drm_cursor_cache_entry entries[DRM_CURSOR_CACHE_SIZE];
+	int n_bos;
+	uint64_t clock;
+};
+
+int
+drm_cursor_cache_find(struct drm_cursor_cache *cache,
+		      const uint32_t *pixels, size_t size, uint64_t hash);
+
+int
+drm_cursor_cache_victim(const struct drm_cursor_cache *cache, uint32_t busy,
+			bool may_add);
+
+void
+drm_cursor_cache_store(struct drm_cursor_cache *cache, int i,
+		       const uint32_t *pixels, size_t size, uint64_t hash);
+
+void
+drm_cursor_cache_forget(struct drm_cursor_cache *cache, int i);
+
+void
+drm_cursor_cache_fini(struct drm_cursor_cache *cache);
+
+#endif /* DRM_CURSOR_CACHE_H */
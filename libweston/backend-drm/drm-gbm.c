@@ -29,6 +29,7 @@
 
 #include "config.h"
 
+#include <assert.h>
 #include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -133,48 +134,61 @@ init_egl(struct drm_backend *b)
 
 static void drm_output_fini_cursor_egl(struct drm_output *output)
 {
-	unsigned int i;
+	int i;
 
-	for (i = 0; i < ARRAY_LENGTH(output->gbm_cursor_fb); i++) {
+	for (i = 0; i < output->cursor_cache.n_bos; i++) {
 		drm_fb_unref(output->gbm_cursor_fb[i]);
 		output->gbm_cursor_fb[i] = NULL;
 	}
+	drm_cursor_cache_fini(&output->cursor_cache);
+	output->current_cursor = 0;
+}
+
+/* Add a cursor BO after the ones the output has, see struct
+ * drm_cursor_cache. */
+int
+drm_output_add_cursor_bo(struct drm_output *output)
+{
+	struct drm_backend *b = output->backend;
+	int i = output->cursor_cache.n_bos;
+	struct gbm_bo *bo;
+
+	assert(i < DRM_CURSOR_CACHE_SIZE);
+
+	bo = gbm_bo_create(b->gbm, b->cursor_width, b->cursor_height,
+			   GBM_FORMAT_ARGB8888,
+			   GBM_BO_USE_CURSOR | GBM_BO_USE_WRITE);
+	if (!bo)
+		return -1;
+
+	output->gbm_cursor_fb[i] =
+		drm_fb_get_from_bo(bo, b, false, BUFFER_CURSOR);
+	if (!output->gbm_cursor_fb[i]) {
+		gbm_bo_destroy(bo);
+		return -1;
+	}
+	output->gbm_cursor_handle[i] = gbm_bo_get_handle(bo).s32;
+	output->cursor_cache.n_bos++;
+
+	return 0;
 }
 
 static int
 drm_output_init_cursor_egl(struct drm_output *output, struct drm_backend *b)
 {
-	unsigned int i;
-
 	/* No point creating cursors if we don't have a plane for them. */
 	if (!output->cursor_plane)
 		return 0;
 
-	for (i = 0; i < ARRAY_LENGTH(output->gbm_cursor_fb); i++) {
-		struct gbm_bo *bo;
-
-		bo = gbm_bo_create(b->gbm, b->cursor_width, b->cursor_height,
-				   GBM_FORMAT_ARGB8888,
-				   GBM_BO_USE_CURSOR | GBM_BO_USE_WRITE);
-		if (!bo)
-			goto err;
-
-		output->gbm_cursor_fb[i] =
-			drm_fb_get_from_bo(bo, b, false, BUFFER_CURSOR);
-		if (!output->gbm_cursor_fb[i]) {
-			gbm_bo_destroy(bo);
-			goto err;
-		}
-		output->gbm_cursor_handle[i] = gbm_bo_get_handle(bo).s32;
+	/* The others are added as cursor images need them. */
+	if (drm_output_add_cursor_bo(output) < 0) {
+		weston_log("cursor buffers unavailable, using gl cursors\n");
+		b->cursors_are_broken = true;
+		drm_output_fini_cursor_egl(output);
+		return -1;
 	}
 
 	return 0;
-
-err:
-	weston_log("cursor buffers unavailable, using gl cursors\n");
-	b->cursors_are_broken = true;
-	drm_output_fini_cursor_egl(output);
-	return -1;
 }
 
 static void
@@ -59,6 +59,7 @@
 #include "libinput-seat.h"
 #include "backend.h"
 #include "libweston-internal.h"
+#include "cursor-cache.h"
 
 #ifndef GBM_BO_USE_CURSOR
 #define GBM_BO_USE_CURSOR GBM_BO_USE_CURSOR_64X64
@@ -281,6 +282,9 @@ struct drm_backend {
 
 	uint32_t pageflip_timeout;
 
+	/* Commits atomic states and reads page flip events, if enabled */
+	struct drm_kms_thread *kms_thread;
+
 	bool shutting_down;
 
 	bool aspect_ratio_supported;
@@ -346,6 +350,8 @@ struct drm_edid {
 struct drm_pending_state {
 	struct drm_backend *backend;
 	struct wl_list output_list;
+	/* TEST_ONLY commits done with this state */
+	unsigned int n_tests;
 };
 
 /*
@@ -507,8 +513,9 @@ struct drm_output {
 	bool disable_pending;
 	bool dpms_off_pending;
 
-	uint32_t gbm_cursor_handle[2];
-	struct drm_fb *gbm_cursor_fb[2];
+	uint32_t gbm_cursor_handle[DRM_CURSOR_CACHE_SIZE];
+	struct drm_fb *gbm_cursor_fb[DRM_CURSOR_CACHE_SIZE];
+	struct drm_cursor_cache cursor_cache;
 	struct drm_plane *cursor_plane;
 	struct weston_view *cursor_view;
 	struct wl_listener cursor_view_destroy_listener;
@@ -530,13 +537,15 @@ struct drm_output {
 	struct drm_fb *dumb[2];
 	pixman_image_t *image[2];
 	int current_image;
-	pixman_region32_t previous_damage;
 
 	struct vaapi_recorder *recorder;
 	struct wl_listener recorder_frame_listener;
 
 	struct wl_event_source *pageflip_timer;
 
+	/* Plane assignments which passed an atomic test, by scene */
+	struct drm_plane_cache *plane_cache;
+
 	bool virtual;
 
 	submit_frame_cb virtual_submit_frame;
@@ -676,6 +685,26 @@ drm_output_update_complete(struct drm_output *output, uint32_t flags,
 			   unsigned int sec, unsigned int usec);
 int
 on_drm_input(int fd, uint32_t mask, void *data);
+void
+atomic_flip_handler(int fd, unsigned int frame, unsigned int sec,
+		    unsigned int usec, unsigned int crtc_id, void *data);
+
+struct drm_kms_job *
+drm_kms_job_create(struct drm_pending_state *pending_state);
+void
+drm_kms_job_detach_fences(struct drm_kms_job *job,
+			  struct drm_pending_state *pending_state);
+void
+drm_kms_job_destroy(struct drm_kms_job *job);
+void
+drm_kms_thread_queue(struct drm_kms_thread *thread, struct drm_kms_job *job,
+		     drmModeAtomicReq *req, uint32_t flags);
+void
+drm_kms_thread_flush(struct drm_kms_thread *thread);
+int
+drm_kms_thread_start(struct drm_backend *b);
+void
+drm_kms_thread_stop(struct drm_backend *b);
 
 struct drm_fb *
 drm_fb_ref(struct drm_fb *fb);
@@ -766,6 +795,12 @@ drm_plane_reset_state(struct drm_plane *plane);
 void
 drm_assign_planes(struct weston_output *output_base, void *repaint_data);
 
+void
+drm_output_plane_cache_clear(struct drm_output *output);
+
+void
+drm_output_plane_cache_destroy(struct drm_output *output);
+
 bool
 drm_plane_is_available(struct drm_plane *plane, struct drm_output *output);
 
@@ -798,6 +833,9 @@ drm_output_init_egl(struct drm_output *output, struct drm_backend *b);
 void
 drm_output_fini_egl(struct drm_output *output);
 
+int
+drm_output_add_cursor_bo(struct drm_output *output);
+
 struct drm_fb *
 drm_output_render_gl(struct drm_output_state *state, pixman_region32_t *damage);
 
@@ -40,6 +40,7 @@
 #include <linux/vt.h>
 #include <assert.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 
 #include <xf86drm.h>
@@ -331,13 +332,9 @@ drm_output_render_pixman(struct drm_output_state *state,
 
 	pixman_renderer_output_set_buffer(&output->base,
 					  output->image[output->current_image]);
-	pixman_renderer_output_set_hw_extra_damage(&output->base,
-						   &output->previous_damage);
 
 	ec->renderer->repaint_output(&output->base, damage);
 
-	pixman_region32_copy(&output->previous_damage, damage);
-
 	return drm_fb_ref(output->dumb[output->current_image]);
 }
 
@@ -644,9 +641,16 @@ drm_repaint_flush(struct weston_compositor *compositor, void *repaint_data)
 	int ret;
 
 	ret = drm_pending_state_apply(pending_state);
-	if (ret != 0)
+	if (ret != 0) {
+		struct drm_output *output;
+
 		weston_log("repaint-flush failed: %s\n", strerror(errno));
 
+		/* A cached plane assignment may be what the kernel refused. */
+		wl_list_for_each(output, &compositor->output_list, base.link)
+			drm_output_plane_cache_clear(output);
+	}
+
 	drm_debug(b, "[repaint] flushed pending_state %p\n", pending_state);
 	b->repaint_data = NULL;
 
@@ -1168,9 +1172,6 @@ drm_output_init_pixman(struct drm_output *output, struct drm_backend *b)
 	weston_log("DRM: output %s %s shadow framebuffer.\n", output->base.name,
 		   b->use_pixman_shadow ? "uses" : "does not use");
 
-	pixman_region32_init_rect(&output->previous_damage,
-				  output->base.x, output->base.y, output->base.width, output->base.height);
-
 	return 0;
 
 err:
@@ -1202,7 +1203,6 @@ drm_output_fini_pixman(struct drm_output *output)
 	}
 
 	pixman_renderer_output_destroy(&output->base);
-	pixman_region32_fini(&output->previous_damage);
 
 	for (i = 0; i < ARRAY_LENGTH(output->dumb); i++) {
 		pixman_image_unref(output->image[i]);
@@ -1774,6 +1774,7 @@ drm_output_deinit(struct weston_output *base)
 
 	drm_output_deinit_planes(output);
 	drm_output_detach_crtc(output);
+	drm_output_plane_cache_destroy(output);
 }
 
 static void
@@ -2487,7 +2488,9 @@ drm_destroy(struct weston_compositor *ec)
 	udev_input_destroy(&b->input);
 
 	wl_event_source_remove(b->udev_drm_source);
-	wl_event_source_remove(b->drm_source);
+	if (b->drm_source)
+		wl_event_source_remove(b->drm_source);
+	drm_kms_thread_stop(b);
 
 	b->shutting_down = true;
 
@@ -2543,6 +2546,10 @@ session_notify(struct wl_listener *listener, void *data)
 
 		weston_compositor_offscreen(compositor);
 
+		/* Disable the planes below after what was queued. */
+		if (b->kms_thread)
+			drm_kms_thread_flush(b->kms_thread);
+
 		/* If we have a repaint scheduled (either from a
 		 * pending pageflip or the idle handler), make sure we
 		 * cancel that so we don't try to pageflip when we're
@@ -2765,6 +2772,44 @@ open_specific_drm_device(struct drm_backend *b, const char *name)
 	return device;
 }
 
+/*
+ * Open a DRM device by the path of its device node, without looking it up
+ * in udev. This is for devices udev does not know about, like the fake KMS
+ * device of the test suite, so there is no sysfs device to get a backlight
+ * or hotplug events from.
+ */
+static bool
+open_drm_device_node(struct drm_backend *b, const char *path)
+{
+	drmModeRes *res;
+	struct stat st;
+	int fd;
+
+	fd = weston_launcher_open(b->compositor->launcher, path, O_RDWR);
+	if (fd < 0) {
+		weston_log("ERROR: could not open DRM device '%s'\n", path);
+		return false;
+	}
+
+	res = drmModeGetResources(fd);
+	if (!res || res->count_crtcs <= 0 || res->count_connectors <= 0 ||
+	    res->count_encoders <= 0 || fstat(fd, &st) < 0) {
+		weston_log("ERROR: DRM device '%s' is not a KMS device.\n",
+			   path);
+		drmModeFreeResources(res);
+		weston_launcher_close(b->compositor->launcher, fd);
+		return false;
+	}
+	drmModeFreeResources(res);
+
+	b->drm.fd = fd;
+	b->drm.id = -1;
+	b->drm.filename = strdup(path);
+	b->drm.devnum = st.st_rdev;
+
+	return true;
+}
+
 static void
 planes_binding(struct weston_keyboard *keyboard, const struct timespec *time,
 	       uint32_t key, void *data)
@@ -2964,13 +3009,19 @@ drm_backend_create(struct weston_compositor *compositor,
 	b->session_listener.notify = session_notify;
 	wl_signal_add(&compositor->session_signal, &b->session_listener);
 
-	if (config->specific_device)
-		drm_device = open_specific_drm_device(b, config->specific_device);
-	else
-		drm_device = find_primary_gpu(b, seat_id);
-	if (drm_device == NULL) {
-		weston_log("no drm device found\n");
-		goto err_udev;
+	if (config->specific_device && config->specific_device[0] == '/') {
+		drm_device = NULL;
+		if (!open_drm_device_node(b, config->specific_device))
+			goto err_udev;
+	} else {
+		if (config->specific_device)
+			drm_device = open_specific_drm_device(b, config->specific_device);
+		else
+			drm_device = find_primary_gpu(b, seat_id);
+		if (drm_device == NULL) {
+			weston_log("no drm device found\n");
+			goto err_udev;
+		}
 	}
 
 	if (init_kms_caps(b) < 0) {
@@ -3038,10 +3089,18 @@ drm_backend_create(struct weston_compositor *compositor,
 	if (!b->cursors_are_broken)
 		compositor->capabilities |= WESTON_CAP_CURSOR_PLANE;
 
+	if (config->use_kms_thread) {
+		if (!b->atomic_modeset)
+			weston_log("DRM: KMS thread needs atomic modesetting\n");
+		else if (drm_kms_thread_start(b) < 0)
+			weston_log("DRM: committing on the main thread\n");
+	}
+
 	loop = wl_display_get_event_loop(compositor->wl_display);
-	b->drm_source =
-		wl_event_loop_add_fd(loop, b->drm.fd,
-				     WL_EVENT_READABLE, on_drm_input, b);
+	if (!b->kms_thread)
+		b->drm_source =
+			wl_event_loop_add_fd(loop, b->drm.fd,
+					     WL_EVENT_READABLE, on_drm_input, b);
 
 	b->udev_monitor = udev_monitor_new_from_netlink(b->udev, "udev");
 	if (b->udev_monitor == NULL) {
@@ -3113,7 +3172,9 @@ err_udev_monitor:
 	wl_event_source_remove(b->udev_drm_source);
 	udev_monitor_unref(b->udev_monitor);
 err_drm_source:
-	wl_event_source_remove(b->drm_source);
+	if (b->drm_source)
+		wl_event_source_remove(b->drm_source);
+	drm_kms_thread_stop(b);
 err_udev_input:
 	udev_input_destroy(&b->input);
 err_sprite:
@@ -211,24 +211,59 @@ drm_fb_destroy_gbm(struct gbm_bo *bo, void *data)
 static void
 drm_fb_destroy_dmabuf(struct drm_fb *fb)
 {
+	struct drm_gem_close gem_close;
+	int i, j;
+
 	/* We deliberately do not close the GEM handles here; GBM manages
 	 * their lifetime through the BO. */
-	if (fb->bo)
+	if (fb->bo) {
 		gbm_bo_destroy(fb->bo);
+		drm_fb_destroy(fb);
+		return;
+	}
+
+	/* Imported without GBM: the planes of one dmabuf share a handle,
+	 * which is closed once. */
+	for (i = 0; i < fb->num_planes; i++) {
+		if (!fb->handles[i])
+			continue;
+		for (j = 0; j < i; j++) {
+			if (fb->handles[j] == fb->handles[i])
+				break;
+		}
+		if (j < i)
+			continue;
+
+		memset(&gem_close, 0, sizeof gem_close);
+		gem_close.handle = fb->handles[i];
+		drmIoctl(fb->fd, DRM_IOCTL_GEM_CLOSE, &gem_close);
+	}
 	drm_fb_destroy(fb);
 }
 
+/* Without a GBM device, as with the Pixman-renderer, import the dmabuf
+ * to KMS directly. */
+static int
+drm_fb_import_dmabuf_handles(struct drm_fb *fb,
+			     struct linux_dmabuf_buffer *dmabuf)
+{
+	int i;
+
+	for (i = 0; i < dmabuf->attributes.n_planes; i++) {
+		if (drmPrimeFDToHandle(fb->fd, dmabuf->attributes.fd[i],
+				       &fb->handles[i]) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
 static struct drm_fb *
 drm_fb_get_from_dmabuf(struct linux_dmabuf_buffer *dmabuf,
 		       struct drm_backend *backend, bool is_opaque)
 {
-#ifndef HAVE_GBM_FD_IMPORT
-	/* Importing a buffer to KMS requires explicit modifiers, so
-	 * we can't continue with the legacy GBM_BO_IMPORT_FD instead
-	 * of GBM_BO_IMPORT_FD_MODIFIER. */
-	return NULL;
-#else
 	struct drm_fb *fb;
+#ifdef HAVE_GBM_FD_IMPORT
 	int i;
 	struct gbm_import_fd_modifier_data import_mod = {
 		.width = dmabuf->attributes.width,
@@ -237,6 +272,7 @@ drm_fb_get_from_dmabuf(struct linux_dmabuf_buffer *dmabuf,
 		.num_fds = dmabuf->attributes.n_planes,
 		.modifier = dmabuf->attributes.modifier[0],
 	};
+#endif
 
         /* We should not import to KMS a buffer that has been allocated using no
          * modifiers. Usually drivers use linear layouts to allocate with no
@@ -266,21 +302,34 @@ drm_fb_get_from_dmabuf(struct linux_dmabuf_buffer *dmabuf,
 
 	fb->refcnt = 1;
 	fb->type = BUFFER_DMABUF;
+	fb->fd = backend->drm.fd;
+	fb->num_planes = dmabuf->attributes.n_planes;
 
-	ARRAY_COPY(import_mod.fds, dmabuf->attributes.fd);
-	ARRAY_COPY(import_mod.strides, dmabuf->attributes.stride);
-	ARRAY_COPY(import_mod.offsets, dmabuf->attributes.offset);
-
-	fb->bo = gbm_bo_import(backend->gbm, GBM_BO_IMPORT_FD_MODIFIER,
-			       &import_mod, GBM_BO_USE_SCANOUT);
-	if (!fb->bo)
+	if (!backend->gbm) {
+		if (drm_fb_import_dmabuf_handles(fb, dmabuf) < 0)
+			goto err_free;
+	} else {
+#ifdef HAVE_GBM_FD_IMPORT
+		ARRAY_COPY(import_mod.fds, dmabuf->attributes.fd);
+		ARRAY_COPY(import_mod.strides, dmabuf->attributes.stride);
+		ARRAY_COPY(import_mod.offsets, dmabuf->attributes.offset);
+
+		fb->bo = gbm_bo_import(backend->gbm, GBM_BO_IMPORT_FD_MODIFIER,
+				       &import_mod, GBM_BO_USE_SCANOUT);
+		if (!fb->bo)
+			goto err_free;
+#else
+		/* Importing a buffer to KMS requires explicit modifiers, so
+		 * we can't continue with the legacy GBM_BO_IMPORT_FD instead
+		 * of GBM_BO_IMPORT_FD_MODIFIER. */
 		goto err_free;
+#endif
+	}
 
 	fb->width = dmabuf->attributes.width;
 	fb->height = dmabuf->attributes.height;
 	fb->modifier = dmabuf->attributes.modifier[0];
 	fb->size = 0;
-	fb->fd = backend->drm.fd;
 
 	ARRAY_COPY(fb->strides, dmabuf->attributes.stride);
 	ARRAY_COPY(fb->offsets, dmabuf->attributes.offset);
@@ -303,8 +352,8 @@ drm_fb_get_from_dmabuf(struct linux_dmabuf_buffer *dmabuf,
 		goto err_free;
 	}
 
-	fb->num_planes = dmabuf->attributes.n_planes;
-	for (i = 0; i < dmabuf->attributes.n_planes; i++) {
+#ifdef HAVE_GBM_FD_IMPORT
+	for (i = 0; fb->bo && i < dmabuf->attributes.n_planes; i++) {
 		union gbm_bo_handle handle;
 
 	        handle = gbm_bo_get_handle_for_plane(fb->bo, i);
@@ -312,6 +361,7 @@ drm_fb_get_from_dmabuf(struct linux_dmabuf_buffer *dmabuf,
 			goto err_free;
 		fb->handles[i] = handle.u32;
 	}
+#endif
 
 	if (drm_fb_addfb(backend, fb) != 0)
 		goto err_free;
@@ -321,7 +371,6 @@ drm_fb_get_from_dmabuf(struct linux_dmabuf_buffer *dmabuf,
 err_free:
 	drm_fb_destroy_dmabuf(fb);
 	return NULL;
-#endif
 }
 
 struct drm_fb *
@@ -491,10 +540,6 @@ drm_fb_get_from_view(struct drm_output_state *state, struct weston_view *ev)
 	if (wl_shm_buffer_get(buffer->resource))
 		return NULL;
 
-	/* GBM is used for dmabuf import as well as from client wl_buffer. */
-	if (!b->gbm)
-		return NULL;
-
 	dmabuf = linux_dmabuf_buffer_get(buffer->resource);
 	if (dmabuf) {
 		fb = drm_fb_get_from_dmabuf(dmabuf, b, is_opaque);
@@ -503,6 +548,10 @@ drm_fb_get_from_view(struct drm_output_state *state, struct weston_view *ev)
 	} else {
 		struct gbm_bo *bo;
 
+		/* GBM is needed to import a client wl_buffer. */
+		if (!b->gbm)
+			return NULL;
+
 		bo = gbm_bo_import(b->gbm, GBM_BO_IMPORT_WL_BUFFER,
 				   buffer->resource, GBM_BO_USE_SCANOUT);
 		if (!bo)
@@ -0,0 +1,605 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <libweston/libweston.h>
+#include "shared/helpers.h"
+#include "drm-internal.h"
+#include "timeline.h"
+#include "presentation-time-server-protocol.h"
+
+/*
+ * An atomic commit can block: a modeset takes as long as the hardware
+ * needs to come up, and some drivers wait for the fences of the buffers
+ * even for a non-blocking commit. With the KMS thread, the commits which
+ * complete asynchronously are handed to a thread of their own, as well as
+ * reading the page flip events, so that the main thread keeps dispatching
+ * clients meanwhile.
+ *
+ * The main thread compiles the request from the pending state and takes
+ * the output states as submitted, as if it had committed them itself;
+ * the thread commits the requests in the order they were queued. Page
+ * flip events, and the outcome of every commit, are passed back to the
+ * main thread, which handles them like it handles the events it reads
+ * itself. Commits which complete synchronously are done on the
+ * main thread, after the queued ones.
+ */
+
+struct drm_kms_job {
+	struct wl_list link;	/* drm_kms_thread::jobs */
+	drmModeAtomicReq *req;
+	uint32_t flags;
+
+	/* CRTCs of the outputs in the commit */
+	uint32_t *crtc_ids;
+	int n_crtcs;
+
+	/* In-fences of the planes, the surfaces may close theirs before
+	 * the commit */
+	int *fence_fds;
+	int n_fences;
+};
+
+enum drm_kms_event_type {
+	DRM_KMS_EVENT_FLIP,
+	DRM_KMS_EVENT_COMMITTED,
+	DRM_KMS_EVENT_COMMIT_FAILED,
+};
+
+struct drm_kms_event {
+	enum drm_kms_event_type type;
+	uint32_t crtc_id;
+	unsigned int frame;
+	unsigned int sec;
+	unsigned int usec;
+	int error;
+};
+
+struct drm_kms_thread {
+	struct drm_backend *backend;
+	int drm_fd;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+
+	/* Signalled when the thread has nothing queued */
+	pthread_cond_t idle_cond;
+
+	/* Written by the main thread when there is something to do */
+	int wake_fd;
+
+	/* Written by the thread when there are events */
+	int event_fd;
+	struct wl_event_source *event_source;
+
+	/* Everything below is accessed under the mutex */
+	struct wl_list jobs;
+	struct wl_array events;	/* struct drm_kms_event */
+	bool busy;
+	bool stopping;
+};
+
+static void
+eventfd_signal(int fd)
+{
+	uint64_t one = 1;
+	ssize_t ret;
+
+	do {
+		ret = write(fd, &one, sizeof one);
+	} while (ret < 0 && errno == EINTR);
+}
+
+static void
+eventfd_clear(int fd)
+{
+	uint64_t count;
+	ssize_t ret;
+
+	do {
+		ret = read(fd, &count, sizeof count);
+	} while (ret < 0 && errno == EINTR);
+}
+
+/** Prepare the commit of a pending state for the KMS thread
+ *
+ * Must be called before the request is compiled: the in-fences of the
+ * planes are replaced by copies owned by the job, until
+ * drm_kms_job_detach_fences().
+ */
+struct drm_kms_job *
+drm_kms_job_create(struct drm_pending_state *pending_state)
+{
+	struct drm_output_state *output_state;
+	struct drm_plane_state *plane_state;
+	struct drm_kms_job *job;
+	int n_outputs = 0;
+	int n_fences = 0;
+
+	job = zalloc(sizeof *job);
+	if (!job)
+		return NULL;
+
+	wl_list_for_each(output_state, &pending_state->output_list, link) {
+		n_outputs++;
+		wl_list_for_each(plane_state, &output_state->plane_list, link) {
+			if (plane_state->in_fence_fd >= 0)
+				n_fences++;
+		}
+	}
+
+	job->crtc_ids = calloc(MAX(n_outputs, 1), sizeof *job->crtc_ids);
+	job->fence_fds = calloc(MAX(n_fences, 1), sizeof *job->fence_fds);
+	if (!job->crtc_ids || !job->fence_fds) {
+		drm_kms_job_destroy(job);
+		return NULL;
+	}
+
+	wl_list_for_each(output_state, &pending_state->output_list, link) {
+		struct drm_output *output = output_state->output;
+
+		if (!output->virtual)
+			job->crtc_ids[job->n_crtcs++] = output->crtc->crtc_id;
+
+		wl_list_for_each(plane_state, &output_state->plane_list, link) {
+			int fd;
+
+			if (plane_state->in_fence_fd < 0)
+				continue;
+
+			fd = fcntl(plane_state->in_fence_fd,
+				   F_DUPFD_CLOEXEC, 0);
+			if (fd < 0) {
+				weston_log("KMS thread: couldn't duplicate "
+					   "in-fence: %s\n", strerror(errno));
+				drm_kms_job_destroy(job);
+				return NULL;
+			}
+			job->fence_fds[job->n_fences++] = fd;
+			plane_state->in_fence_fd = fd;
+		}
+	}
+
+	return job;
+}
+
+/** Forget the job's in-fence copies in the plane states
+ *
+ * Must be called once the request has been compiled: the job closes the
+ * copies on the KMS thread, while the plane states live on.
+ */
+void
+drm_kms_job_detach_fences(struct drm_kms_job *job,
+			  struct drm_pending_state *pending_state)
+{
+	struct drm_output_state *output_state;
+	struct drm_plane_state *plane_state;
+	int i;
+
+	wl_list_for_each(output_state, &pending_state->output_list, link) {
+		wl_list_for_each(plane_state, &output_state->plane_list, link) {
+			for (i = 0; i < job->n_fences; i++) {
+				if (plane_state->in_fence_fd ==
+				    job->fence_fds[i]) {
+					plane_state->in_fence_fd = -1;
+					break;
+				}
+			}
+		}
+	}
+}
+
+void
+drm_kms_job_destroy(struct drm_kms_job *job)
+{
+	int i;
+
+	for (i = 0; i < job->n_fences; i++)
+		close(job->fence_fds[i]);
+	free(job->fence_fds);
+	free(job->crtc_ids);
+	drmModeAtomicFree(job->req);
+	free(job);
+}
+
+/** Queue the commit of a request, taking ownership of job and req */
+void
+drm_kms_thread_queue(struct drm_kms_thread *thread, struct drm_kms_job *job,
+		     drmModeAtomicReq *req, uint32_t flags)
+{
+	job->req = req;
+	job->flags = flags;
+
+	pthread_mutex_lock(&thread->mutex);
+	wl_list_insert(thread->jobs.prev, &job->link);
+	pthread_mutex_unlock(&thread->mutex);
+
+	eventfd_signal(thread->wake_fd);
+}
+
+/** Wait until the queued commits have been submitted to the kernel */
+void
+drm_kms_thread_flush(struct drm_kms_thread *thread)
+{
+	pthread_mutex_lock(&thread->mutex);
+	while (!wl_list_empty(&thread->jobs) || thread->busy)
+		pthread_cond_wait(&thread->idle_cond, &thread->mutex);
+	pthread_mutex_unlock(&thread->mutex);
+}
+
+static void
+drm_kms_thread_push_event(struct drm_kms_thread *thread,
+			  const struct drm_kms_event *event)
+{
+	struct drm_kms_event *copy;
+
+	pthread_mutex_lock(&thread->mutex);
+	copy = wl_array_add(&thread->events, sizeof *copy);
+	if (copy)
+		*copy = *event;
+	pthread_mutex_unlock(&thread->mutex);
+
+	eventfd_signal(thread->event_fd);
+}
+
+static void
+drm_kms_thread_flip_handler(int fd, unsigned int frame, unsigned int sec,
+			    unsigned int usec, unsigned int crtc_id, void *data)
+{
+	struct drm_backend *b = data;
+	struct drm_kms_event event = {
+		.type = DRM_KMS_EVENT_FLIP,
+		.crtc_id = crtc_id,
+		.frame = frame,
+		.sec = sec,
+		.usec = usec,
+	};
+
+	drm_kms_thread_push_event(b->kms_thread, &event);
+}
+
+static void
+drm_kms_thread_commit(struct drm_kms_thread *thread, struct drm_kms_job *job)
+{
+	struct drm_kms_event event = {
+		.type = DRM_KMS_EVENT_COMMITTED,
+	};
+	int i;
+
+	/* Same user data as the commits on the main thread, whose events
+	 * the thread reads as well */
+	if (drmModeAtomicCommit(thread->drm_fd, job->req, job->flags,
+				thread->backend) != 0) {
+		event.type = DRM_KMS_EVENT_COMMIT_FAILED;
+		event.error = errno;
+	}
+
+	for (i = 0; i < job->n_crtcs; i++) {
+		event.crtc_id = job->crtc_ids[i];
+		drm_kms_thread_push_event(thread, &event);
+	}
+}
+
+static void *
+drm_kms_thread_run(void *data)
+{
+	struct drm_kms_thread *thread = data;
+	drmEventContext evctx = {
+		.version = 3,
+		.page_flip_handler2 = drm_kms_thread_flip_handler,
+	};
+	struct pollfd fds[2] = {
+		{ .fd = thread->drm_fd, .events = POLLIN },
+		{ .fd = thread->wake_fd, .events = POLLIN },
+	};
+	struct drm_kms_job *job;
+
+	for (;;) {
+		pthread_mutex_lock(&thread->mutex);
+		while (!wl_list_empty(&thread->jobs)) {
+			job = wl_container_of(thread->jobs.next, job, link);
+			wl_list_remove(&job->link);
+			thread->busy = true;
+			pthread_mutex_unlock(&thread->mutex);
+
+			drm_kms_thread_commit(thread, job);
+			drm_kms_job_destroy(job);
+
+			pthread_mutex_lock(&thread->mutex);
+			thread->busy = false;
+		}
+		pthread_cond_broadcast(&thread->idle_cond);
+
+		if (thread->stopping) {
+			pthread_mutex_unlock(&thread->mutex);
+			break;
+		}
+		pthread_mutex_unlock(&thread->mutex);
+
+		if (poll(fds, ARRAY_LENGTH(fds), -1) < 0)
+			continue;
+
+		if (fds[1].revents & POLLIN)
+			eventfd_clear(thread->wake_fd);
+		if (fds[0].revents & POLLIN)
+			drmHandleEvent(thread->drm_fd, &evctx);
+	}
+
+	return NULL;
+}
+
+/* Undo drm_output_assign_state() for a state the kernel refused, as if
+ * it had never been assigned: the state before it is still on screen,
+ * and so are its framebuffers. */
+static void
+drm_output_unassign_state(struct drm_output *output)
+{
+	struct drm_output_state *failed = output->state_cur;
+	struct drm_output_state *last = output->state_last;
+	struct drm_plane_state *ps;
+
+	assert(last);
+
+	wl_list_for_each(ps, &failed->plane_list, link) {
+		struct drm_plane *plane = ps->plane;
+		struct drm_plane_state *on_screen;
+
+		if (plane->state_cur != ps)
+			continue;
+
+		/* A plane not in the previous state had an orphaned state,
+		 * which is gone; the next commit is a full one anyway. */
+		on_screen = drm_output_state_get_existing_plane(last, plane);
+		if (!on_screen) {
+			on_screen = drm_plane_state_alloc(NULL, plane);
+			on_screen->complete = true;
+		}
+		plane->state_cur = on_screen;
+	}
+
+	drm_output_state_free(failed);
+	output->state_cur = last;
+	output->state_last = NULL;
+	output->atomic_complete_pending = false;
+}
+
+/* The drm_kms_commit point of a commit the thread made, which marks when
+ * the kernel took it, up to the time the event takes to get here. */
+static void
+drm_kms_thread_committed(struct drm_backend *b,
+			 const struct drm_kms_event *event)
+{
+	struct drm_crtc *crtc;
+
+	crtc = drm_crtc_find(b, event->crtc_id);
+	if (!crtc || !crtc->output)
+		return;
+
+	TL_POINT(b->compositor, "drm_kms_commit",
+		 TLP_OUTPUT(&crtc->output->base), TLP_END);
+}
+
+/* A commit the thread made failed, after the state had been assigned
+ * optimistically. Take the assignment back, the way a commit failing on
+ * the main thread never makes it, and repaint from scratch. */
+static void
+drm_kms_thread_commit_failed(struct drm_backend *b,
+			     const struct drm_kms_event *event)
+{
+	struct drm_output *output = NULL;
+	struct drm_crtc *crtc;
+
+	crtc = drm_crtc_find(b, event->crtc_id);
+	if (crtc)
+		output = crtc->output;
+
+	weston_log("atomic: couldn't commit new state%s%s: %s\n",
+		   output ? " for output " : "",
+		   output ? output->base.name : "",
+		   strerror(event->error));
+
+	b->state_invalid = true;
+
+	if (!output || !output->atomic_complete_pending)
+		return;
+
+	/* A cached plane assignment may be what the kernel refused. */
+	drm_output_plane_cache_clear(output);
+
+	drm_output_unassign_state(output);
+
+	/* These only waited for the commit in flight to be done with. */
+	if (output->destroy_pending || output->disable_pending) {
+		struct timespec now;
+
+		weston_compositor_read_presentation_clock(b->compositor, &now);
+		drm_output_update_complete(output, 0, now.tv_sec,
+					   now.tv_nsec / 1000);
+		return;
+	}
+
+	/* Nothing was presented: no timestamp, and no feedback sent, only
+	 * a repaint as soon as possible. */
+	weston_output_damage(&output->base);
+	weston_output_finish_frame(&output->base, NULL,
+				   WP_PRESENTATION_FEEDBACK_INVALID);
+}
+
+static int
+on_kms_thread_event(int fd, uint32_t mask, void *data)
+{
+	struct drm_kms_thread *thread = data;
+	struct drm_backend *b = thread->backend;
+	struct drm_kms_event *event;
+	struct wl_array events;
+
+	eventfd_clear(thread->event_fd);
+
+	pthread_mutex_lock(&thread->mutex);
+	events = thread->events;
+	wl_array_init(&thread->events);
+	pthread_mutex_unlock(&thread->mutex);
+
+	wl_array_for_each(event, &events) {
+		switch (event->type) {
+		case DRM_KMS_EVENT_FLIP:
+			atomic_flip_handler(b->drm.fd, event->frame,
+					    event->sec, event->usec,
+					    event->crtc_id, b);
+			break;
+		case DRM_KMS_EVENT_COMMITTED:
+			drm_kms_thread_committed(b, event);
+			break;
+		case DRM_KMS_EVENT_COMMIT_FAILED:
+			drm_kms_thread_commit_failed(b, event);
+			break;
+		}
+	}
+
+	wl_array_release(&events);
+
+	return 1;
+}
+
+/** Start committing and reading page flip events on a thread of their own
+ *
+ * Replaces on_drm_input() on the main loop. Only for atomic modesetting.
+ */
+int
+drm_kms_thread_start(struct drm_backend *b)
+{
+	struct wl_event_loop *loop;
+	struct drm_kms_thread *thread;
+	sigset_t mask, old_mask;
+	int ret;
+
+	assert(b->atomic_modeset);
+	assert(!b->kms_thread);
+
+	thread = zalloc(sizeof *thread);
+	if (!thread)
+		return -1;
+
+	thread->backend = b;
+	thread->drm_fd = b->drm.fd;
+	wl_list_init(&thread->jobs);
+	wl_array_init(&thread->events);
+
+	thread->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	thread->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (thread->wake_fd < 0 || thread->event_fd < 0) {
+		weston_log("KMS thread: couldn't create eventfd: %s\n",
+			   strerror(errno));
+		goto err_fd;
+	}
+
+	loop = wl_display_get_event_loop(b->compositor->wl_display);
+	thread->event_source =
+		wl_event_loop_add_fd(loop, thread->event_fd, WL_EVENT_READABLE,
+				     on_kms_thread_event, thread);
+	if (!thread->event_source)
+		goto err_fd;
+
+	pthread_mutex_init(&thread->mutex, NULL);
+	pthread_cond_init(&thread->idle_cond, NULL);
+
+	/* Leave asynchronous signals to the main thread. */
+	sigfillset(&mask);
+	sigdelset(&mask, SIGBUS);
+	sigdelset(&mask, SIGSEGV);
+	sigdelset(&mask, SIGFPE);
+	sigdelset(&mask, SIGILL);
+	pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+	ret = pthread_create(&thread->thread, NULL, drm_kms_thread_run,
+			     thread);
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+	if (ret != 0) {
+		weston_log("KMS thread: couldn't start: %s\n", strerror(ret));
+		goto err_thread;
+	}
+
+	b->kms_thread = thread;
+	weston_log("DRM: committing on a KMS thread\n");
+
+	return 0;
+
+err_thread:
+	pthread_cond_destroy(&thread->idle_cond);
+	pthread_mutex_destroy(&thread->mutex);
+	wl_event_source_remove(thread->event_source);
+err_fd:
+	if (thread->wake_fd >= 0)
+		close(thread->wake_fd);
+	if (thread->event_fd >= 0)
+		close(thread->event_fd);
+	free(thread);
+	return -1;
+}
+
+/** Stop the KMS thread, after it submitted the queued commits
+ *
+ * Page flip events not handled yet are dropped.
+ */
+void
+drm_kms_thread_stop(struct drm_backend *b)
+{
+	struct drm_kms_thread *thread = b->kms_thread;
+
+	if (!thread)
+		return;
+
+	pthread_mutex_lock(&thread->mutex);
+	thread->stopping = true;
+	pthread_mutex_unlock(&thread->mutex);
+	eventfd_signal(thread->wake_fd);
+
+	pthread_join(thread->thread, NULL);
+
+	pthread_cond_destroy(&thread->idle_cond);
+	pthread_mutex_destroy(&thread->mutex);
+	wl_event_source_remove(thread->event_source);
+	close(thread->wake_fd);
+	close(thread->event_fd);
+	wl_array_release(&thread->events);
+	free(thread);
+
+	b->kms_thread = NULL;
+}
@@ -40,6 +40,7 @@
 #include "shared/weston-drm-fourcc.h"
 #include "drm-internal.h"
 #include "pixel-formats.h"
+#include "timeline.h"
 #include "presentation-time-server-protocol.h"
 
 struct drm_property_enum_info plane_type_enums[] = {
@@ -747,6 +748,9 @@ drm_output_apply_state_legacy(struct drm_output_state *state)
 		goto err;
 	}
 
+	TL_POINT(output->base.compositor, "drm_kms_commit",
+		 TLP_OUTPUT(&output->base), TLP_END);
+
 	assert(!output->page_flip_pending);
 
 	if (output->pageflip_timer)
@@ -1047,13 +1051,22 @@ drm_pending_state_apply_atomic(struct drm_pending_state *pending_state,
 	struct drm_backend *b = pending_state->backend;
 	struct drm_output_state *output_state, *tmp;
 	struct drm_plane *plane;
+	struct drm_kms_job *job = NULL;
 	drmModeAtomicReq *req = drmModeAtomicAlloc();
+	bool queued = false;
 	uint32_t flags;
 	int ret = 0;
 
 	if (!req)
 		return -1;
 
+	/* Without a job, commit here, after what was queued already. */
+	if (b->kms_thread && mode == DRM_STATE_APPLY_ASYNC) {
+		job = drm_kms_job_create(pending_state);
+		if (!job)
+			drm_kms_thread_flush(b->kms_thread);
+	}
+
 	switch (mode) {
 	case DRM_STATE_APPLY_SYNC:
 		flags = 0;
@@ -1157,13 +1170,27 @@ drm_pending_state_apply_atomic(struct drm_pending_state *pending_state,
 		ret |= drm_output_apply_state_atomic(output_state, req, &flags);
 	}
 
+	if (job)
+		drm_kms_job_detach_fences(job, pending_state);
+
 	if (ret != 0) {
 		weston_log("atomic: couldn't compile atomic state\n");
 		goto out;
 	}
 
-	ret = drmModeAtomicCommit(b->drm.fd, req, flags, b);
-	drm_debug(b, "[atomic] drmModeAtomicCommit\n");
+	if (job) {
+		/* The commit can only fail on the thread now, see
+		 * drm_kms_thread_commit_failed(). */
+		drm_kms_thread_queue(b->kms_thread, job, req, flags);
+		job = NULL;
+		req = NULL;
+		queued = true;
+		drm_debug(b, "[atomic] drmModeAtomicCommit queued to the "
+			     "KMS thread\n");
+	} else {
+		ret = drmModeAtomicCommit(b->drm.fd, req, flags, b);
+		drm_debug(b, "[atomic] drmModeAtomicCommit\n");
+	}
 
 	/* Test commits do not take ownership of the state; return
 	 * without freeing here. */
@@ -1178,6 +1205,14 @@ drm_pending_state_apply_atomic(struct drm_pending_state *pending_state,
 		goto out;
 	}
 
+	/* A queued commit gets its point once the thread has made it. */
+	wl_list_for_each(output_state, &pending_state->output_list, link) {
+		if (output_state->output->virtual || queued)
+			continue;
+		TL_POINT(b->compositor, "drm_kms_commit",
+			 TLP_OUTPUT(&output_state->output->base), TLP_END);
+	}
+
 	wl_list_for_each_safe(output_state, tmp, &pending_state->output_list,
 			      link)
 		drm_output_assign_state(output_state, mode);
@@ -1187,6 +1222,8 @@ drm_pending_state_apply_atomic(struct drm_pending_state *pending_state,
 	assert(wl_list_empty(&pending_state->output_list));
 
 out:
+	if (job)
+		drm_kms_job_destroy(job);
 	drmModeAtomicFree(req);
 	drm_pending_state_free(pending_state);
 	return ret;
@@ -1215,9 +1252,11 @@ drm_pending_state_test(struct drm_pending_state *pending_state)
 {
 	struct drm_backend *b = pending_state->backend;
 
-	if (b->atomic_modeset)
+	if (b->atomic_modeset) {
+		pending_state->n_tests++;
 		return drm_pending_state_apply_atomic(pending_state,
 						      DRM_STATE_TEST_ONLY);
+	}
 
 	/* We have no way to test state before application on the legacy
 	 * modesetting API, so just claim it succeeded. */
@@ -1297,6 +1336,10 @@ drm_pending_state_apply_sync(struct drm_pending_state *pending_state)
 	struct drm_output_state *output_state, *tmp;
 	struct drm_crtc *crtc;
 
+	/* Keep the commits in order. */
+	if (b->kms_thread)
+		drm_kms_thread_flush(b->kms_thread);
+
 	if (b->atomic_modeset)
 		return drm_pending_state_apply_atomic(pending_state,
 						      DRM_STATE_APPLY_SYNC);
@@ -1366,7 +1409,7 @@ page_flip_handler(int fd, unsigned int frame,
 	drm_output_update_complete(output, flags, sec, usec);
 }
 
-static void
+void
 atomic_flip_handler(int fd, unsigned int frame, unsigned int sec,
 		    unsigned int usec, unsigned int crtc_id, void *data)
 {
@@ -40,6 +40,9 @@
 
 #include "color.h"
 #include "linux-dmabuf.h"
+#include "stats.h"
+#include "timeline.h"
+#include "shared/hash-util.h"
 #include "presentation-time-server-protocol.h"
 
 enum drm_output_propose_state_mode {
@@ -63,6 +66,483 @@ drm_propose_state_mode_to_string(enum drm_output_propose_state_mode mode)
 	return drm_output_propose_state_mode_as_string[mode];
 }
 
+/*
+ * Finding a plane assignment takes a TEST_ONLY commit per view placed on
+ * an overlay in mixed mode, plus one for every state proposed. A stable
+ * scene, like a video playing over a static desktop, ends up with the
+ * same assignment every frame, so the assignments which passed the test
+ * are kept by scene: for every view, everything the assignment depends
+ * on. If a later frame has the same scene, the cached assignment is
+ * proposed again without testing it, see drm_output_propose_state().
+ * The states of other outputs in the same pending state are not part of
+ * the scene, so the cache is not used when more than one output repaints
+ * at once: a replayed assignment would not be tested together with them.
+ * Nor is it used for scenes with wl_drm buffers, whose format is not
+ * known before they are imported.
+ *
+ * An assignment which left views on the renderer, because their test
+ * failed or in renderer-only mode, may be owed to a transient failure.
+ * Such entries are only replayed DRM_PLANE_CACHE_NEGATIVE_REPLAYS times
+ * before the scene is searched again.
+ */
+#define DRM_PLANE_CACHE_SIZE 8
+#define DRM_PLANE_CACHE_NEGATIVE_REPLAYS 30
+
+/* What assigning a plane to a view depends on */
+struct drm_plane_cache_view {
+	struct weston_view *ev;
+	pixman_box32_t boundingbox;
+	pixman_box32_t opaque;
+	float matrix[16];
+	float alpha;
+	uint32_t output_mask;
+	uint32_t format;
+	uint64_t modifier;
+	int32_t buffer_width, buffer_height;
+	/* dmabuf layout, a new buffer of the same format and size may
+	 * still be laid out differently */
+	int n_planes;
+	uint32_t flags;
+	uint32_t stride[MAX_DMABUF_PLANES];
+	uint32_t offset[MAX_DMABUF_PLANES];
+	struct weston_buffer_viewport viewport;
+	enum weston_surface_protection_mode protection_mode;
+	enum weston_hdcp_protection desired_protection;
+	bool has_buffer;
+	bool is_shm;
+	bool y_inverted;
+	bool is_opaque;
+	bool has_fence;
+	bool xform_valid;
+	bool xform_identity;
+	/* The search prefers views updating more often, see
+	 * drm_plane_update_class(). */
+	int update_class;
+};
+
+struct drm_plane_cache_entry {
+	struct drm_plane_cache_view *views;
+	uint32_t *plane_ids;	/* for each view, 0 for the renderer */
+	int n_views;		/* 0 if the entry is unused */
+	uint64_t hash;
+	enum drm_output_propose_state_mode mode;
+	uint32_t last_used;
+	/* Replays left before the entry expires, -1 if it does not */
+	int replays_left;
+};
+
+struct drm_plane_cache {
+	struct drm_plane_cache_entry entries[DRM_PLANE_CACHE_SIZE];
+	uint32_t clock;
+
+	/* What the entries were tested with */
+	struct weston_mode *current_mode;
+	enum weston_hdcp_protection current_protection;
+
+	/* The scene of the current repaint */
+	struct drm_plane_cache_view *scene;
+	int n_scene;
+	int scene_alloc;
+	uint64_t scene_hash;
+
+	/* The entry drm_output_propose_state() is replaying, or NULL */
+	struct drm_plane_cache_entry *replay;
+
+	uint64_t hits;
+	uint64_t misses;
+};
+
+static void
+drm_plane_cache_entry_fini(struct drm_plane_cache_entry *entry)
+{
+	free(entry->views);
+	free(entry->plane_ids);
+	memset(entry, 0, sizeof *entry);
+}
+
+void
+drm_output_plane_cache_clear(struct drm_output *output)
+{
+	struct drm_plane_cache *cache = output->plane_cache;
+	int i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < DRM_PLANE_CACHE_SIZE; i++)
+		drm_plane_cache_entry_fini(&cache->entries[i]);
+}
+
+void
+drm_output_plane_cache_destroy(struct drm_output *output)
+{
+	if (!output->plane_cache)
+		return;
+
+	drm_output_plane_cache_clear(output);
+	free(output->plane_cache->scene);
+	free(output->plane_cache);
+	output->plane_cache = NULL;
+}
+
+static struct drm_plane_cache_entry *
+drm_output_plane_cache_replay(struct drm_output *output)
+{
+	return output->plane_cache ? output->plane_cache->replay : NULL;
+}
+
+/* The plane a replayed entry puts ev on, 0 for the renderer. */
+static uint32_t
+drm_plane_cache_entry_plane_id(struct drm_plane_cache_entry *entry,
+			       struct weston_view *ev)
+{
+	int i;
+
+	for (i = 0; i < entry->n_views; i++) {
+		if (entry->views[i].ev == ev)
+			return entry->plane_ids[i];
+	}
+
+	return 0;
+}
+
+/* Coarse classes of the update rate, so that the assignments the search
+ * found for a scene are not reused once, say, a video was paused, but
+ * the cache is not missed for every little change of the rate either. */
+static int
+drm_plane_update_class(uint32_t rate)
+{
+	if (rate < 1000)
+		return 0;
+	if (rate < 20000)
+		return 1;
+	return 2;
+}
+
+/* Record what assigning a plane to the view of pnode depends on. Fails
+ * for buffers other than shm and dmabuf ones, such as wl_drm ones, whose
+ * format and layout are only known once imported. */
+static bool
+drm_plane_cache_view_init(struct drm_plane_cache_view *cv,
+			  struct weston_paint_node *pnode,
+			  const struct timespec *now)
+{
+	struct weston_view *ev = pnode->view;
+	struct weston_surface *surface = ev->surface;
+	struct weston_buffer *buffer = surface->buffer_ref.buffer;
+	struct linux_dmabuf_buffer *dmabuf;
+	struct wl_shm_buffer *shmbuf;
+
+	/* Zeroes the padding too, views are compared with memcmp(). */
+	memset(cv, 0, sizeof *cv);
+
+	cv->ev = ev;
+	cv->boundingbox = *pixman_region32_extents(&ev->transform.boundingbox);
+	cv->opaque = *pixman_region32_extents(&ev->transform.opaque);
+	memcpy(cv->matrix, ev->transform.matrix.d, sizeof cv->matrix);
+	cv->alpha = ev->alpha;
+	cv->output_mask = ev->output_mask;
+	cv->viewport = surface->buffer_viewport;
+	cv->viewport.changed = 0;
+	cv->protection_mode = surface->protection_mode;
+	cv->desired_protection = surface->desired_protection;
+	cv->is_opaque = surface->is_opaque;
+	cv->has_fence = surface->acquire_fence_fd >= 0;
+	cv->xform_valid = pnode->surf_xform_valid;
+	cv->xform_identity = pnode->surf_xform.transform == NULL &&
+			     pnode->surf_xform.identity_pipeline;
+	cv->update_class =
+		drm_plane_update_class(weston_surface_get_update_rate(surface,
+								      now));
+
+	if (!weston_view_has_valid_buffer(ev))
+		return true;
+
+	cv->has_buffer = true;
+	cv->buffer_width = buffer->width;
+	cv->buffer_height = buffer->height;
+	cv->y_inverted = buffer->y_inverted;
+
+	shmbuf = wl_shm_buffer_get(buffer->resource);
+	if (shmbuf) {
+		cv->is_shm = true;
+		cv->format = wl_shm_buffer_get_format(shmbuf);
+		return true;
+	}
+
+	dmabuf = linux_dmabuf_buffer_get(buffer->resource);
+	if (dmabuf) {
+		const struct dmabuf_attributes *attr = &dmabuf->attributes;
+		int i;
+
+		cv->format = attr->format;
+		cv->modifier = attr->modifier[0];
+		cv->n_planes = attr->n_planes;
+		cv->flags = attr->flags;
+		for (i = 0; i < attr->n_planes; i++) {
+			cv->stride[i] = attr->stride[i];
+			cv->offset[i] = attr->offset[i];
+		}
+		return true;
+	}
+
+	return false;
+}
+
+/* Record the scene to be assigned planes in cache->scene. Fails if it
+ * can't be, see drm_plane_cache_view_init(). */
+static bool
+drm_plane_cache_build_scene(struct drm_plane_cache *cache,
+			    struct drm_output *output)
+{
+	struct weston_paint_node *pnode;
+	struct timespec now;
+	int n = 0;
+
+	wl_list_for_each(pnode, &output->base.paint_node_z_order_list,
+			 z_order_link)
+		n++;
+
+	if (n > cache->scene_alloc) {
+		struct drm_plane_cache_view *scene;
+
+		scene = realloc(cache->scene, n * sizeof *scene);
+		if (!scene)
+			return false;
+		cache->scene = scene;
+		cache->scene_alloc = n;
+	}
+
+	weston_compositor_read_presentation_clock(output->base.compositor,
+						  &now);
+
+	n = 0;
+	wl_list_for_each(pnode, &output->base.paint_node_z_order_list,
+			 z_order_link) {
+		if (!drm_plane_cache_view_init(&cache->scene[n++], pnode,
+					       &now))
+			return false;
+	}
+
+	cache->n_scene = n;
+	cache->scene_hash = fnv1a_64(FNV1A_64_INIT, cache->scene,
+				     n * sizeof *cache->scene);
+
+	return true;
+}
+
+static struct drm_plane_cache_entry *
+drm_plane_cache_lookup(struct drm_plane_cache *cache)
+{
+	struct drm_plane_cache_entry *entry;
+	int i;
+
+	for (i = 0; i < DRM_PLANE_CACHE_SIZE; i++) {
+		entry = &cache->entries[i];
+
+		if (entry->n_views == 0 || entry->n_views != cache->n_scene ||
+		    entry->hash != cache->scene_hash ||
+		    memcmp(entry->views, cache->scene,
+			   cache->n_scene * sizeof *cache->scene) != 0)
+			continue;
+
+		if (entry->replays_left == 0) {
+			drm_plane_cache_entry_fini(entry);
+			return NULL;
+		}
+		if (entry->replays_left > 0)
+			entry->replays_left--;
+
+		entry->last_used = ++cache->clock;
+		return entry;
+	}
+
+	return NULL;
+}
+
+/* Whether the view could have gone on a plane at all: shm buffers only
+ * go on the cursor plane. */
+static bool
+drm_plane_cache_view_wants_plane(struct drm_backend *b,
+				 const struct drm_plane_cache_view *cv)
+{
+	if (!cv->has_buffer)
+		return false;
+
+	return !cv->is_shm || (cv->buffer_width <= b->cursor_width &&
+			       cv->buffer_height <= b->cursor_height);
+}
+
+/* Remember the assignment of state, which passed the atomic test (or
+ * needs none in renderer-only mode), for the current scene. */
+static void
+drm_plane_cache_insert(struct drm_backend *b,
+		       struct drm_plane_cache *cache,
+		       struct drm_output_state *state,
+		       enum drm_output_propose_state_mode mode)
+{
+	struct drm_plane_cache_entry *entry = &cache->entries[0];
+	struct drm_plane_state *ps;
+	bool negative = mode == DRM_OUTPUT_PROPOSE_STATE_RENDERER_ONLY;
+	int i;
+
+	if (cache->n_scene == 0)
+		return;
+
+	/* An unused entry, or else the least recently used one */
+	for (i = 0; i < DRM_PLANE_CACHE_SIZE; i++) {
+		if (cache->entries[i].n_views == 0) {
+			entry = &cache->entries[i];
+			break;
+		}
+		if (cache->entries[i].last_used < entry->last_used)
+			entry = &cache->entries[i];
+	}
+	drm_plane_cache_entry_fini(entry);
+
+	entry->views = malloc(cache->n_scene * sizeof *entry->views);
+	entry->plane_ids = calloc(cache->n_scene, sizeof *entry->plane_ids);
+	if (!entry->views || !entry->plane_ids) {
+		drm_plane_cache_entry_fini(entry);
+		return;
+	}
+
+	memcpy(entry->views, cache->scene,
+	       cache->n_scene * sizeof *cache->scene);
+	for (i = 0; i < cache->n_scene; i++) {
+		wl_list_for_each(ps, &state->plane_list, link) {
+			if (ps->fb && ps->ev == entry->views[i].ev) {
+				entry->plane_ids[i] = ps->plane->plane_id;
+				break;
+			}
+		}
+		if (entry->plane_ids[i] == 0 &&
+		    drm_plane_cache_view_wants_plane(b, &entry->views[i]))
+			negative = true;
+	}
+
+	entry->n_views = cache->n_scene;
+	entry->hash = cache->scene_hash;
+	entry->mode = mode;
+	entry->last_used = ++cache->clock;
+	entry->replays_left = negative ? DRM_PLANE_CACHE_NEGATIVE_REPLAYS : -1;
+}
+
+/* Whether another output has a state in pending_state, or may add one in
+ * this repaint. */
+static bool
+drm_pending_state_is_shared(struct drm_pending_state *pending_state,
+			    struct drm_output *output)
+{
+	struct weston_compositor *compositor = output->base.compositor;
+	struct drm_output_state *output_state;
+	struct weston_output *base;
+	bool later = false;
+
+	wl_list_for_each(output_state, &pending_state->output_list, link) {
+		if (output_state->output != output)
+			return true;
+	}
+
+	/* Outputs repaint in the order of the compositor's list. */
+	wl_list_for_each(base, &compositor->output_list, link) {
+		if (base == &output->base) {
+			later = true;
+			continue;
+		}
+
+		if (later && base->enabled &&
+		    base->repaint_status == REPAINT_SCHEDULED &&
+		    base->repaint_needed)
+			return true;
+	}
+
+	return false;
+}
+
+/* Get the output's cache, ready to look up the scene of this repaint, or
+ * NULL if the cache can't be used for it. */
+static struct drm_plane_cache *
+drm_output_plane_cache_prepare(struct drm_output *output,
+			       struct drm_pending_state *pending_state)
+{
+	struct drm_backend *b = to_drm_backend(output->base.compositor);
+	struct drm_plane_cache *cache;
+
+	if (b->sprites_are_broken || output->virtual ||
+	    drm_pending_state_is_shared(pending_state, output))
+		return NULL;
+
+	if (!output->plane_cache) {
+		output->plane_cache = zalloc(sizeof *output->plane_cache);
+		if (!output->plane_cache)
+			return NULL;
+	}
+	cache = output->plane_cache;
+
+	/* Everything was tested against the previous KMS state. */
+	if (b->state_invalid ||
+	    cache->current_mode != output->base.current_mode ||
+	    cache->current_protection != output->base.current_protection) {
+		drm_output_plane_cache_clear(output);
+		cache->current_mode = output->base.current_mode;
+		cache->current_protection = output->base.current_protection;
+	}
+
+	if (b->state_invalid || !drm_plane_cache_build_scene(cache, output))
+		return NULL;
+
+	return cache;
+}
+
+/*
+ * In mixed mode, every view goes on the first plane which passes the
+ * atomic test, walking the views top to bottom. With more views which
+ * could go on overlays than there are overlays, that spends them on the
+ * views on top, which may be small ones while a fullscreen video below is
+ * composited by the renderer. So then the views are scored by the memory
+ * bandwidth composition would take for them, and states with only the
+ * best ones allowed on planes are proposed, replacing the views which
+ * still got no plane with the next best ones, for as long as a budget of
+ * atomic tests allows. See drm_output_search_state().
+ */
+#define DRM_PLANE_SEARCH_MAX_TESTS 16
+
+/* Update rate assumed for views committing rarely or not at all, in mHz,
+ * so that these are still ordered by their size */
+#define DRM_PLANE_SEARCH_MIN_RATE 1000
+
+struct drm_plane_candidate {
+	struct weston_view *ev;
+	uint64_t score;		/* bytes per second composition takes */
+	bool allowed;		/* on a plane if the kernel accepts it */
+	bool rejected;		/* got no plane when it was allowed */
+};
+
+struct drm_plane_search {
+	struct drm_plane_candidate *candidates;	/* by score, best first */
+	int n_candidates;
+};
+
+/* Whether the search lets ev go on a plane in the state being proposed */
+static bool
+drm_plane_search_allows(const struct drm_plane_search *search,
+			struct weston_view *ev)
+{
+	int i;
+
+	if (!search)
+		return true;
+
+	for (i = 0; i < search->n_candidates; i++) {
+		if (search->candidates[i].ev == ev)
+			return search->candidates[i].allowed;
+	}
+
+	/* Not competing for overlays, e.g. a cursor */
+	return true;
+}
+
 static void
 drm_output_add_zpos_plane(struct drm_plane *plane, struct wl_list *planes)
 {
@@ -247,6 +727,14 @@ drm_output_prepare_overlay_view(struct drm_plane *plane,
 		goto out;
 	}
 
+	/* A cached assignment has passed the test before. */
+	if (drm_output_plane_cache_replay(output)) {
+		drm_debug(b, "\t\t\t[overlay] provisionally placing "
+			     "view %p on overlay %lu from the plane cache\n",
+			  ev, (unsigned long) plane->plane_id);
+		goto out;
+	}
+
 	ret = drm_pending_state_test(output_state->pending_state);
 	if (ret == 0) {
 		drm_debug(b, "\t\t\t[overlay] provisionally placing "
@@ -267,19 +755,53 @@ out:
 }
 
 #ifdef BUILD_DRM_GBM
+/* The cursor BO to copy a new image into, adding one if it can, or -1.
+ * The BO on screen is busy, and so is the one proposed last, which may
+ * be in a state still to be committed, unless it holds nothing yet. */
+static int
+cursor_bo_victim(struct drm_output *output)
+{
+	struct drm_cursor_cache *cache = &output->cursor_cache;
+	struct drm_fb *on_screen = output->cursor_plane->state_cur->fb;
+	uint32_t busy = 0;
+	int i;
+
+	if (cache->entries[output->current_cursor].pixels)
+		busy |= 1u << output->current_cursor;
+
+	for (i = 0; i < cache->n_bos; i++) {
+		if (output->gbm_cursor_fb[i] == on_screen)
+			busy |= 1u << i;
+	}
+
+	i = drm_cursor_cache_victim(cache, busy, true);
+	if (i == cache->n_bos && drm_output_add_cursor_bo(output) < 0) {
+		drm_debug(output->backend, "\t\t\t\t[cursor] failed to add "
+					   "a cursor BO, reusing one\n");
+		i = drm_cursor_cache_victim(cache, busy, false);
+	}
+
+	return i;
+}
+
 /**
  * Update the image for the current cursor surface
  *
- * @param plane_state DRM cursor plane state
+ * Sets output->current_cursor to a cursor BO holding the image. The BOs
+ * are looked up by their contents first, see drm_cursor_cache_find(), and
+ * a BO found that way is used without copying anything.
+ *
+ * @param output DRM output the cursor is shown on
  * @param ev Source view for cursor
+ * @return false if there was no cursor BO to copy the image into
  */
-static void
-cursor_bo_update(struct drm_plane_state *plane_state, struct weston_view *ev)
+static bool
+cursor_bo_update(struct drm_output *output, struct weston_view *ev)
 {
-	struct drm_backend *b = plane_state->plane->backend;
-	struct gbm_bo *bo = plane_state->fb->bo;
+	struct drm_backend *b = output->backend;
 	struct weston_buffer *buffer = ev->surface->buffer_ref.buffer;
 	uint32_t buf[b->cursor_width * b->cursor_height];
+	uint64_t hash;
 	int32_t stride;
 	uint8_t *s;
 	int i;
@@ -300,8 +822,43 @@ cursor_bo_update(struct drm_plane_state *plane_state, struct weston_view *ev)
 		       buffer->width * 4);
 	wl_shm_buffer_end_access(buffer->shm_buffer);
 
-	if (gbm_bo_write(bo, buf, sizeof buf) < 0)
+	hash = fnv1a_64(FNV1A_64_INIT, buf, sizeof buf);
+
+	i = drm_cursor_cache_find(&output->cursor_cache, buf, sizeof buf, hash);
+	if (i >= 0) {
+		/* Proposing the same cursor again for the same repaint
+		 * is not a hit. */
+		if (i != output->current_cursor) {
+			drm_debug(b, "\t\t\t\t[cursor] reusing cursor BO %d\n",
+				  i);
+			weston_output_count(&output->base,
+					    WESTON_OUTPUT_CURSOR_CACHE_HITS, 1);
+			weston_output_count(&output->base,
+					    WESTON_OUTPUT_CURSOR_BYTES_SAVED,
+					    sizeof buf);
+			output->current_cursor = i;
+		}
+		return true;
+	}
+
+	i = cursor_bo_victim(output);
+	if (i < 0)
+		return false;
+	output->current_cursor = i;
+
+	drm_debug(b, "\t\t\t\t[cursor] copying new content to cursor BO %d\n",
+		  i);
+	weston_output_count(&output->base, WESTON_OUTPUT_CURSOR_CACHE_MISSES, 1);
+
+	if (gbm_bo_write(output->gbm_cursor_fb[i]->bo, buf, sizeof buf) < 0) {
 		weston_log("failed update cursor: %s\n", strerror(errno));
+		drm_cursor_cache_forget(&output->cursor_cache, i);
+		return true;
+	}
+
+	drm_cursor_cache_store(&output->cursor_cache, i, buf, sizeof buf,
+			       hash);
+	return true;
 }
 
 static struct drm_plane_state *
@@ -373,12 +930,13 @@ drm_output_prepare_cursor_view(struct drm_output_state *output_state,
 	 * pretty unique here, in that they lie partway between a Weston plane
 	 * (direct scanout) and a renderer. */
 	if (ev != output->cursor_view ||
-	    pixman_region32_not_empty(&ev->surface->damage)) {
-		output->current_cursor++;
-		output->current_cursor =
-			output->current_cursor %
-				ARRAY_LENGTH(output->gbm_cursor_fb);
+	    pixman_region32_not_empty(&ev->surface->damage))
 		needs_update = true;
+
+	if (needs_update && !cursor_bo_update(output, ev)) {
+		drm_debug(b, "\t\t\t\t[%s] not assigning view %p to %s plane "
+			     "(no cursor BO free)\n", p_name, ev, p_name);
+		goto err;
 	}
 
 	drm_output_set_cursor_view(output, ev);
@@ -387,11 +945,6 @@ drm_output_prepare_cursor_view(struct drm_output_state *output_state,
 	plane_state->fb =
 		drm_fb_ref(output->gbm_cursor_fb[output->current_cursor]);
 
-	if (needs_update) {
-		drm_debug(b, "\t\t\t\t[%s] copying new content to cursor BO\n", p_name);
-		cursor_bo_update(plane_state, ev);
-	}
-
 	/* The cursor API is somewhat special: in cursor_bo_update(), we upload
 	 * a buffer which is always cursor_width x cursor_height, even if the
 	 * surface we want to promote is actually smaller than this. Manually
@@ -658,6 +1211,9 @@ drm_output_prepare_plane_view(struct drm_output_state *state,
 {
 	struct drm_output *output = state->output;
 	struct drm_backend *b = to_drm_backend(output->base.compositor);
+	struct drm_plane_cache_entry *replay =
+		drm_output_plane_cache_replay(output);
+	uint32_t replay_plane_id = 0;
 
 	struct drm_plane_state *ps = NULL;
 	struct drm_plane *plane;
@@ -674,6 +1230,13 @@ drm_output_prepare_plane_view(struct drm_output_state *state,
 	if (!weston_view_has_valid_buffer(ev))
 		return ps;
 
+	/* Only try the plane a cached assignment used, if any. */
+	if (replay) {
+		replay_plane_id = drm_plane_cache_entry_plane_id(replay, ev);
+		if (replay_plane_id == 0)
+			return ps;
+	}
+
 	buffer = ev->surface->buffer_ref.buffer;
 	shmbuf = wl_shm_buffer_get(buffer->resource);
 	fb = drm_fb_get_from_view(state, ev);
@@ -683,6 +1246,9 @@ drm_output_prepare_plane_view(struct drm_output_state *state,
 		if (!drm_plane_is_available(plane, output))
 			continue;
 
+		if (replay && plane->plane_id != replay_plane_id)
+			continue;
+
 		if (drm_output_check_plane_has_view_assigned(plane, state)) {
 			drm_debug(b, "\t\t\t\t[plane] not adding plane %d to"
 				     " candidate list: view already assigned "
@@ -781,7 +1347,8 @@ drm_output_prepare_plane_view(struct drm_output_state *state,
 static struct drm_output_state *
 drm_output_propose_state(struct weston_output *output_base,
 			 struct drm_pending_state *pending_state,
-			 enum drm_output_propose_state_mode mode)
+			 enum drm_output_propose_state_mode mode,
+			 const struct drm_plane_search *search)
 {
 	struct drm_output *output = to_drm_output(output_base);
 	struct drm_backend *b = to_drm_backend(output->base.compositor);
@@ -874,15 +1441,6 @@ drm_output_propose_state(struct weston_output *output_base,
 		          ev, output->base.name,
 			  (unsigned long) output->base.id);
 
-		/* If this view doesn't touch our output at all, there's no
-		 * reason to do anything with it. */
-		/* TODO: turn this into assert once z_order_list is pruned. */
-		if (!(ev->output_mask & (1u << output->base.id))) {
-			drm_debug(b, "\t\t\t\t[view] ignoring view %p "
-			             "(not on our output)\n", ev);
-			continue;
-		}
-
 		/* Cannot show anything without a color transform. */
 		if (!pnode->surf_xform_valid) {
 			drm_debug(b, "\t\t\t\t[view] ignoring view %p "
@@ -954,6 +1512,12 @@ drm_output_propose_state(struct weston_output *output_base,
 			force_renderer = true;
 		}
 
+		if (!drm_plane_search_allows(search, ev)) {
+			drm_debug(b, "\t\t\t\t[view] not assigning view %p to plane "
+				     "(left to views saving more bandwidth)\n", ev);
+			force_renderer = true;
+		}
+
 		/* Now try to place it on a plane if we can. */
 		if (!force_renderer) {
 			drm_debug(b, "\t\t\t[plane] started with zpos %"PRIu64"\n",
@@ -1011,12 +1575,15 @@ drm_output_propose_state(struct weston_output *output_base,
 	/* check if we have invalid zpos values, like duplicate(s) */
 	drm_output_check_zpos_plane_states(state);
 
-	/* Check to see if this state will actually work. */
-	ret = drm_pending_state_test(state->pending_state);
-	if (ret != 0) {
-		drm_debug(b, "\t\t[view] failing state generation: "
-			     "atomic test not OK\n");
-		goto err;
+	/* Check to see if this state will actually work, unless it is a
+	 * cached assignment which did before. */
+	if (!drm_output_plane_cache_replay(output)) {
+		ret = drm_pending_state_test(state->pending_state);
+		if (ret != 0) {
+			drm_debug(b, "\t\t[view] failing state generation: "
+				     "atomic test not OK\n");
+			goto err;
+		}
 	}
 
 	/* Counterpart to duplicating scanout state at the top of this
@@ -1038,6 +1605,280 @@ err:
 	return NULL;
 }
 
+/* Bits per pixel composition reads from the buffer of ev */
+static int
+drm_view_bits_per_pixel(struct weston_view *ev)
+{
+	struct weston_buffer *buffer = ev->surface->buffer_ref.buffer;
+	const struct pixel_format_info *info = NULL;
+	struct linux_dmabuf_buffer *dmabuf;
+
+	dmabuf = linux_dmabuf_buffer_get(buffer->resource);
+	if (dmabuf)
+		info = pixel_format_get_info(dmabuf->attributes.format);
+
+	if (!info)
+		return 32;
+
+	if (info->bpp)
+		return info->bpp;
+
+	/* YUV: a luma sample for every pixel, and a pair of chroma samples
+	 * for every hsub x vsub pixels */
+	if (info->num_planes > 1 || info->hsub)
+		return 8 + 16 / (MAX(info->hsub, 1) * MAX(info->vsub, 1));
+
+	return 32;
+}
+
+/* The memory bandwidth composition takes for ev in bytes per second:
+ * reading its buffer and writing the framebuffer over the visible area,
+ * plus reading the framebuffer back if it is blended, every time the
+ * view updates. */
+static uint64_t
+drm_output_score_view(struct drm_output *output, struct weston_view *ev,
+		      const struct timespec *now)
+{
+	struct drm_backend *b = to_drm_backend(output->base.compositor);
+	pixman_region32_t visible;
+	pixman_box32_t *box;
+	uint64_t area, score;
+	uint32_t rate;
+	bool blended;
+	int bpp, bits;
+
+	pixman_region32_init(&visible);
+	pixman_region32_intersect(&visible, &ev->transform.boundingbox,
+				  &output->base.region);
+	box = pixman_region32_extents(&visible);
+	area = (uint64_t) (box->x2 - box->x1) * (box->y2 - box->y1);
+	blended = !weston_view_is_opaque(ev, &visible);
+	pixman_region32_fini(&visible);
+
+	bpp = drm_view_bits_per_pixel(ev);
+	bits = bpp + 32;
+	if (blended)
+		bits += 32;
+
+	rate = weston_surface_get_update_rate(ev->surface, now);
+	score = area * bits / 8 * MAX(rate, DRM_PLANE_SEARCH_MIN_RATE) / 1000;
+
+	drm_debug(b, "\t\t[search] view %p: %"PRIu64" pixels at %d bpp, "
+		     "%u.%03u Hz%s, %"PRIu64" B/s\n",
+		  ev, area, bpp, rate / 1000, rate % 1000,
+		  blended ? ", blended" : "", score);
+
+	return score;
+}
+
+/* Whether ev could go on an overlay plane at all */
+static bool
+drm_plane_search_is_candidate(struct drm_output *output,
+			      struct weston_paint_node *pnode)
+{
+	struct weston_view *ev = pnode->view;
+
+	if (!pnode->surf_xform_valid ||
+	    pnode->surf_xform.transform != NULL ||
+	    !pnode->surf_xform.identity_pipeline)
+		return false;
+
+	if (ev->output_mask != (1u << output->base.id))
+		return false;
+
+	if (!weston_view_has_valid_buffer(ev))
+		return false;
+
+	/* wl_shm buffers only go on the cursor plane */
+	if (wl_shm_buffer_get(ev->surface->buffer_ref.buffer->resource))
+		return false;
+
+	return true;
+}
+
+static int
+drm_plane_candidate_compare(const void *a, const void *b)
+{
+	const struct drm_plane_candidate *ca = a;
+	const struct drm_plane_candidate *cb = b;
+
+	if (ca->score == cb->score)
+		return 0;
+
+	return ca->score < cb->score ? 1 : -1;
+}
+
+/* Find which of the allowed candidates state put on planes, and return
+ * the bandwidth these save. */
+static uint64_t
+drm_plane_search_score_state(struct drm_plane_search *search,
+			     struct drm_output_state *state)
+{
+	struct drm_plane_candidate *c;
+	struct drm_plane_state *ps;
+	uint64_t score = 0;
+	int i;
+
+	for (i = 0; i < search->n_candidates; i++) {
+		c = &search->candidates[i];
+		if (!c->allowed)
+			continue;
+
+		c->rejected = true;
+		wl_list_for_each(ps, &state->plane_list, link) {
+			if (ps->fb && ps->ev == c->ev) {
+				c->rejected = false;
+				score += c->score;
+				break;
+			}
+		}
+	}
+
+	return score;
+}
+
+/* Propose a mixed-mode state which has the overlay planes on the views
+ * saving the most bandwidth, or return NULL to leave the assignment to
+ * the greedy walk. */
+static struct drm_output_state *
+drm_output_search_state(struct weston_output *output_base,
+			struct drm_pending_state *pending_state)
+{
+	struct drm_output *output = to_drm_output(output_base);
+	struct drm_backend *b = to_drm_backend(output_base->compositor);
+	enum drm_output_propose_state_mode mode = DRM_OUTPUT_PROPOSE_STATE_MIXED;
+	unsigned int first_test = pending_state->n_tests;
+	struct drm_output_state *state, *best = NULL;
+	struct drm_plane_search search = { 0 };
+	struct drm_plane_candidate *c;
+	struct weston_paint_node *pnode;
+	struct drm_plane *plane;
+	struct timespec now;
+	uint64_t score, best_score = 0;
+	bool retry;
+	int n_planes = 0;
+	int next, i;
+
+	wl_list_for_each(plane, &b->plane_list, link) {
+		if (plane->type == WDRM_PLANE_TYPE_OVERLAY &&
+		    drm_plane_is_available(plane, output))
+			n_planes++;
+	}
+
+	wl_list_for_each(pnode, &output->base.paint_node_z_order_list,
+			 z_order_link) {
+		if (drm_plane_search_is_candidate(output, pnode))
+			search.n_candidates++;
+	}
+
+	/* Enough overlays for everyone: nothing to choose. */
+	if (n_planes == 0 || search.n_candidates <= n_planes)
+		return NULL;
+
+	search.candidates = calloc(search.n_candidates,
+				   sizeof *search.candidates);
+	if (!search.candidates)
+		return NULL;
+
+	drm_debug(b, "\t\t[search] %d views for %d overlay planes on "
+		     "output %s (%lu)\n", search.n_candidates, n_planes,
+		  output->base.name, (unsigned long) output->base.id);
+
+	weston_compositor_read_presentation_clock(output_base->compositor,
+						  &now);
+	i = 0;
+	wl_list_for_each(pnode, &output->base.paint_node_z_order_list,
+			 z_order_link) {
+		if (!drm_plane_search_is_candidate(output, pnode))
+			continue;
+
+		c = &search.candidates[i++];
+		c->ev = pnode->view;
+		c->score = drm_output_score_view(output, pnode->view, &now);
+	}
+	qsort(search.candidates, search.n_candidates,
+	      sizeof *search.candidates, drm_plane_candidate_compare);
+
+	for (next = 0; next < n_planes; next++)
+		search.candidates[next].allowed = true;
+
+	/* Every proposal counts against the budget; one started within it
+	 * is finished. */
+	for (;;) {
+		if (pending_state->n_tests - first_test >=
+		    DRM_PLANE_SEARCH_MAX_TESTS) {
+			drm_debug(b, "\t\t[search] atomic test budget "
+				     "spent\n");
+			break;
+		}
+
+		state = drm_output_propose_state(output_base, pending_state,
+						 mode, &search);
+		if (!state)
+			break;
+
+		score = drm_plane_search_score_state(&search, state);
+		drm_debug(b, "\t\t[search] proposed state saves %"PRIu64" B/s\n",
+			  score);
+
+		if (!best || score > best_score) {
+			drm_output_state_free(best);
+			best = state;
+			best_score = score;
+			/* Keep it out of the tests of the next proposals,
+			 * which are for the same output. */
+			wl_list_remove(&best->link);
+			wl_list_init(&best->link);
+		} else {
+			drm_output_state_free(state);
+		}
+
+		/* Give the next best views a go at the planes the rejected
+		 * ones did not get. */
+		retry = false;
+		for (i = 0; i < search.n_candidates; i++) {
+			c = &search.candidates[i];
+			if (!c->allowed || !c->rejected)
+				continue;
+
+			c->allowed = false;
+			if (next < search.n_candidates) {
+				search.candidates[next++].allowed = true;
+				retry = true;
+			}
+		}
+		if (!retry)
+			break;
+	}
+
+	if (best) {
+		wl_list_insert(&pending_state->output_list, &best->link);
+		drm_debug(b, "\t\t[search] found state saving %"PRIu64" B/s "
+			     "in %u atomic tests\n", best_score,
+			  pending_state->n_tests - first_test);
+	} else {
+		drm_debug(b, "\t\t[search] no state found, "
+			     "falling back to the greedy assignment\n");
+	}
+
+	free(search.candidates);
+	return best;
+}
+
+static enum weston_output_counter
+plane_type_counter(enum wdrm_plane_type type)
+{
+	switch (type) {
+	case WDRM_PLANE_TYPE_PRIMARY:
+		return WESTON_OUTPUT_VIEWS_SCANOUT;
+	case WDRM_PLANE_TYPE_CURSOR:
+		return WESTON_OUTPUT_VIEWS_CURSOR;
+	case WDRM_PLANE_TYPE_OVERLAY:
+	default:
+		return WESTON_OUTPUT_VIEWS_OVERLAY;
+	}
+}
+
 void
 drm_assign_planes(struct weston_output *output_base, void *repaint_data)
 {
@@ -1049,50 +1890,86 @@ drm_assign_planes(struct weston_output *output_base, void *repaint_data)
 	struct weston_paint_node *pnode;
 	struct weston_plane *primary = &output_base->compositor->primary_plane;
 	enum drm_output_propose_state_mode mode = DRM_OUTPUT_PROPOSE_STATE_PLANES_ONLY;
+	struct drm_plane_cache *cache;
+	struct drm_plane_cache_entry *entry = NULL;
 
 	drm_debug(b, "\t[repaint] preparing state for output %s (%lu)\n",
 		  output_base->name, (unsigned long) output_base->id);
 
-	if (!b->sprites_are_broken && !output->virtual) {
+	cache = drm_output_plane_cache_prepare(output, pending_state);
+	if (cache)
+		entry = drm_plane_cache_lookup(cache);
+
+	if (entry) {
+		mode = entry->mode;
+		drm_debug(b, "\t[repaint] trying cached %s\n",
+			  drm_propose_state_mode_to_string(mode));
+		cache->replay = entry;
+		state = drm_output_propose_state(output_base, pending_state,
+						 mode, NULL);
+		cache->replay = NULL;
+
+		if (state) {
+			cache->hits++;
+		} else {
+			drm_debug(b, "\t[repaint] could not build cached "
+				     "state, searching again\n");
+			drm_plane_cache_entry_fini(entry);
+			entry = NULL;
+			mode = DRM_OUTPUT_PROPOSE_STATE_PLANES_ONLY;
+		}
+	}
+
+	if (!state && !b->sprites_are_broken && !output->virtual) {
 		drm_debug(b, "\t[repaint] trying planes-only build state\n");
-		state = drm_output_propose_state(output_base, pending_state, mode);
+		state = drm_output_propose_state(output_base, pending_state,
+						 mode, NULL);
 		if (!state) {
 			drm_debug(b, "\t[repaint] could not build planes-only "
 				     "state, trying mixed\n");
 			mode = DRM_OUTPUT_PROPOSE_STATE_MIXED;
+			state = drm_output_search_state(output_base,
+							pending_state);
+		}
+		if (!state) {
 			state = drm_output_propose_state(output_base,
 							 pending_state,
-							 mode);
+							 mode, NULL);
 		}
 		if (!state) {
 			drm_debug(b, "\t[repaint] could not build mixed-mode "
 				     "state, trying renderer-only\n");
 		}
-	} else {
+	} else if (!state) {
 		drm_debug(b, "\t[state] no overlay plane support\n");
 	}
 
 	if (!state) {
 		mode = DRM_OUTPUT_PROPOSE_STATE_RENDERER_ONLY;
 		state = drm_output_propose_state(output_base, pending_state,
-						 mode);
+						 mode, NULL);
 	}
 
 	assert(state);
 	drm_debug(b, "\t[repaint] Using %s composition\n",
 		  drm_propose_state_mode_to_string(mode));
 
+	if (cache) {
+		if (!entry) {
+			cache->misses++;
+			drm_plane_cache_insert(b, cache, state, mode);
+		}
+		drm_debug(b, "\t[repaint] plane cache %s: %"PRIu64" hits, "
+			     "%"PRIu64" misses (%.1f%% hit rate)\n",
+			  entry ? "hit" : "miss", cache->hits, cache->misses,
+			  100.0 * cache->hits / (cache->hits + cache->misses));
+	}
+
 	wl_list_for_each(pnode, &output->base.paint_node_z_order_list,
 			 z_order_link) {
 		struct weston_view *ev = pnode->view;
 		struct drm_plane *target_plane = NULL;
 
-		/* If this view doesn't touch our output at all, there's no
-		 * reason to do anything with it. */
-		/* TODO: turn this into assert once z_order_list is pruned. */
-		if (!(ev->output_mask & (1u << output->base.id)))
-			continue;
-
 		/* Test whether this buffer can ever go into a plane:
 		 * non-shm, or small enough to be a cursor.
 		 *
@@ -1128,10 +2005,18 @@ drm_assign_planes(struct weston_output *output_base, void *repaint_data)
 				  ev, plane_type_enums[target_plane->type].name,
 				  (unsigned long) target_plane->plane_id);
 			weston_view_move_to_plane(ev, &target_plane->base);
+			TL_POINT(output_base->compositor, "drm_assign_plane",
+				 TLP_SURFACE(ev->surface),
+				 TLP_OUTPUT(output_base), TLP_END);
+			weston_output_count(output_base,
+					    plane_type_counter(target_plane->type),
+					    1);
 		} else {
 			drm_debug(b, "\t[repaint] view %p using renderer "
 				     "composition\n", ev);
 			weston_view_move_to_plane(ev, primary);
+			weston_output_count(output_base,
+					    WESTON_OUTPUT_VIEWS_RENDERER, 1);
 		}
 
 		if (!target_plane ||
@@ -36,6 +36,7 @@
 #include <libweston/libweston.h>
 #include <libweston/backend-headless.h>
 #include "shared/helpers.h"
+#include "libweston-internal.h"
 #include "linux-explicit-synchronization.h"
 #include "pixman-renderer.h"
 #include "renderer-gl/gl-renderer.h"
@@ -72,6 +73,10 @@ struct headless_output {
 	struct wl_event_source *finish_frame_timer;
 	uint32_t *image_buf;
 	pixman_image_t *image;
+
+	/* Only with the headless_cursor_plane test quirk */
+	struct weston_plane cursor_plane;
+	bool has_cursor_plane;
 };
 
 static const uint32_t headless_formats[] = {
@@ -138,6 +143,26 @@ headless_output_repaint(struct weston_output *output_base,
 	return 0;
 }
 
+static void
+headless_output_assign_planes(struct weston_output *output_base,
+			      void *repaint_data)
+{
+	struct headless_output *output = to_headless_output(output_base);
+	struct weston_compositor *ec = output_base->compositor;
+	struct weston_paint_node *pnode;
+
+	wl_list_for_each(pnode, &output_base->paint_node_z_order_list,
+			 z_order_link) {
+		struct weston_view *view = pnode->view;
+
+		if (view->layer_link.layer == &ec->cursor_layer)
+			weston_view_move_to_plane(view, &output->cursor_plane);
+		else
+			weston_view_move_to_plane(view, &ec->primary_plane);
+		view->psf_flags = 0;
+	}
+}
+
 static void
 headless_output_disable_gl(struct headless_output *output)
 {
@@ -166,6 +191,12 @@ headless_output_disable(struct weston_output *base)
 
 	wl_event_source_remove(output->finish_frame_timer);
 
+	if (output->has_cursor_plane) {
+		weston_plane_release(&output->cursor_plane);
+		output->has_cursor_plane = false;
+		output->base.assign_planes = NULL;
+	}
+
 	switch (b->renderer_type) {
 	case HEADLESS_GL:
 		headless_output_disable_gl(output);
@@ -215,7 +246,7 @@ static int
 headless_output_enable_pixman(struct headless_output *output)
 {
 	const struct pixman_renderer_output_options options = {
-		.use_shadow = true,
+		.use_shadow = false,
 	};
 
 	output->image_buf = malloc(output->base.current_mode->width *
@@ -276,6 +307,14 @@ headless_output_enable(struct weston_output *base)
 		return -1;
 	}
 
+	if (b->compositor->test_data.test_quirks.headless_cursor_plane) {
+		weston_plane_init(&output->cursor_plane, b->compositor, 0, 0);
+		weston_compositor_stack_plane(b->compositor,
+					      &output->cursor_plane, NULL);
+		output->has_cursor_plane = true;
+		output->base.assign_planes = headless_output_assign_planes;
+	}
+
 	return 0;
 }
 
@@ -400,7 +400,7 @@ rdp_switch_mode(struct weston_output *output, struct weston_mode *target_mode)
 	rdpSettings *settings;
 	pixman_image_t *new_shadow_buffer;
 	struct weston_mode *local_mode;
-	const struct pixman_renderer_output_options options = { .use_shadow = true, };
+	const struct pixman_renderer_output_options options = { .use_shadow = false, };
 
 	local_mode = ensure_matching_mode(output, target_mode);
 	if (!local_mode) {
@@ -494,7 +494,7 @@ rdp_output_enable(struct weston_output *base)
 	struct rdp_backend *b = to_rdp_backend(base->compositor);
 	struct wl_event_loop *loop;
 	const struct pixman_renderer_output_options options = {
-		.use_shadow = true,
+		.use_shadow = false,
 	};
 
 	output->shadow_surface = pixman_image_create_bits(PIXMAN_x8r8g8b8,
@@ -654,7 +654,7 @@ wayland_output_repaint_pixman(struct weston_output *output_base,
 
 	wayland_output_update_shm_border(sb);
 	pixman_renderer_output_set_buffer(output_base, sb->pm_image);
-	b->compositor->renderer->repaint_output(output_base, &sb->damage);
+	b->compositor->renderer->repaint_output(output_base, damage);
 
 	wayland_shm_buffer_attach(sb);
 
@@ -803,7 +803,7 @@ static int
 wayland_output_init_pixman_renderer(struct wayland_output *output)
 {
 	const struct pixman_renderer_output_options options = {
-		.use_shadow = true,
+		.use_shadow = false,
 	};
 	return pixman_renderer_output_create(&output->base, &options);
 }
@@ -837,7 +837,7 @@ x11_output_switch_mode(struct weston_output *base, struct weston_mode *mode)
 
 	if (b->use_pixman) {
 		const struct pixman_renderer_output_options options = {
-			.use_shadow = true,
+			.use_shadow = false,
 		};
 		pixman_renderer_output_destroy(&output->base);
 		x11_output_deinit_shm(b, output);
@@ -1017,7 +1017,7 @@ x11_output_enable(struct weston_output *base)
 
 	if (b->use_pixman) {
 		const struct pixman_renderer_output_options options = {
-			.use_shadow = true,
+			.use_shadow = false,
 		};
 		if (x11_output_init_shm(b, output,
 					output->base.current_mode->width,
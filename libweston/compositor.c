@@ -75,6 +75,10 @@
 #include "backend.h"
 #include "libweston-internal.h"
 #include "color.h"
+#include "pick-grid.h"
+#include "repaint-profiler.h"
+#include "stats.h"
+#include "repaint-window.h"
 
 #include "weston-log-internal.h"
 
@@ -85,6 +89,7 @@
  */
 
 #define DEFAULT_REPAINT_WINDOW 7 /* milliseconds */
+#define DEFAULT_REPAINT_WINDOW_MARGIN 1000 /* microseconds */
 
 static void
 weston_output_update_matrix(struct weston_output *output);
@@ -93,13 +98,22 @@ static void
 weston_output_transform_scale_init(struct weston_output *output,
 				   uint32_t transform, uint32_t scale);
 
-static void
-weston_compositor_build_view_list(struct weston_compositor *compositor,
-				  struct weston_output *output);
-
 static char *
 weston_output_create_heads_string(struct weston_output *output);
 
+/** Mark the scene graph as changed
+ *
+ * Must be called whenever the layer list, the views on a layer or a
+ * sub-surface tree changes, so that weston_compositor_build_view_list()
+ * does not reuse the previously built view list and z-order lists.
+ */
+static void
+weston_compositor_view_list_dirty(struct weston_compositor *compositor)
+{
+	compositor->view_list_generation++;
+	weston_pick_grid_invalidate(compositor->pick_grid);
+}
+
 static struct weston_paint_node *
 weston_paint_node_create(struct weston_surface *surface,
 			 struct weston_view *view,
@@ -1401,6 +1415,10 @@ weston_view_assign_output(struct weston_view *ev)
 	}
 	pixman_region32_fini(&region);
 
+	/* The output z-order lists only contain the views on that output. */
+	if (ev->output_mask != mask)
+		weston_compositor_view_list_dirty(ec);
+
 	weston_view_set_output(ev, new_output);
 	ev->output_mask = mask;
 
@@ -1647,6 +1665,9 @@ weston_view_update_transform(struct weston_view *view)
 
 	weston_view_assign_output(view);
 
+	weston_pick_grid_update_view(view->surface->compositor->pick_grid,
+				     view);
+
 	wl_signal_emit(&view->surface->compositor->transform_signal,
 		       view->surface);
 }
@@ -2028,6 +2049,52 @@ weston_view_find_paint_node(struct weston_view *view,
 	return NULL;
 }
 
+/** Check if a view is hidden behind opaque views on all its outputs
+ *
+ * Only meaningful while occlusion culling is enabled, see
+ * weston_compositor::occluded_frame_msec. A view not on any output is
+ * not considered occluded.
+ */
+WL_EXPORT bool
+weston_view_is_occluded(struct weston_view *view)
+{
+	struct weston_paint_node *pnode;
+	bool occluded = false;
+
+	wl_list_for_each(pnode, &view->paint_node_list, view_link) {
+		/* Paint nodes outside their output are not repainted. */
+		if (!(view->output_mask & (1u << pnode->output->id)))
+			continue;
+
+		if (!pnode->occluded)
+			return false;
+
+		occluded = true;
+	}
+
+	return occluded;
+}
+
+/** Check if all views of a surface are occluded
+ *
+ * \sa weston_view_is_occluded
+ */
+WL_EXPORT bool
+weston_surface_is_occluded(struct weston_surface *surface)
+{
+	struct weston_view *view;
+
+	if (wl_list_empty(&surface->views))
+		return false;
+
+	wl_list_for_each(view, &surface->views, surface_link) {
+		if (!weston_view_is_occluded(view))
+			return false;
+	}
+
+	return true;
+}
+
 /* Check if a surface has a view assigned to it
  *
  * The indicator is set manually when mapping
@@ -2158,39 +2225,62 @@ weston_compositor_get_time(struct timespec *time)
 /** weston_compositor_pick_view
  * \ingroup compositor
  */
-WL_EXPORT struct weston_view *
-weston_compositor_pick_view(struct weston_compositor *compositor,
-			    wl_fixed_t x, wl_fixed_t y,
-			    wl_fixed_t *vx, wl_fixed_t *vy)
+static bool
+view_accepts_input_at(struct weston_view *view,
+		      wl_fixed_t x, wl_fixed_t y,
+		      wl_fixed_t *vx, wl_fixed_t *vy)
 {
-	struct weston_view *view;
 	wl_fixed_t view_x, view_y;
 	int view_ix, view_iy;
 	int ix = wl_fixed_to_int(x);
 	int iy = wl_fixed_to_int(y);
 
-	/* Can't use paint node list: occlusion by input regions, not opaque. */
-	wl_list_for_each(view, &compositor->view_list, link) {
-		if (!pixman_region32_contains_point(
-				&view->transform.boundingbox, ix, iy, NULL))
-			continue;
+	if (!pixman_region32_contains_point(&view->transform.boundingbox,
+					    ix, iy, NULL))
+		return false;
 
-		weston_view_from_global_fixed(view, x, y, &view_x, &view_y);
-		view_ix = wl_fixed_to_int(view_x);
-		view_iy = wl_fixed_to_int(view_y);
+	weston_view_from_global_fixed(view, x, y, &view_x, &view_y);
+	view_ix = wl_fixed_to_int(view_x);
+	view_iy = wl_fixed_to_int(view_y);
 
-		if (!pixman_region32_contains_point(&view->surface->input,
-						    view_ix, view_iy, NULL))
-			continue;
+	if (!pixman_region32_contains_point(&view->surface->input,
+					    view_ix, view_iy, NULL))
+		return false;
 
-		if (view->geometry.scissor_enabled &&
-		    !pixman_region32_contains_point(&view->geometry.scissor,
-						    view_ix, view_iy, NULL))
-			continue;
+	if (view->geometry.scissor_enabled &&
+	    !pixman_region32_contains_point(&view->geometry.scissor,
+					    view_ix, view_iy, NULL))
+		return false;
+
+	*vx = view_x;
+	*vy = view_y;
+	return true;
+}
 
-		*vx = view_x;
-		*vy = view_y;
-		return view;
+WL_EXPORT struct weston_view *
+weston_compositor_pick_view(struct weston_compositor *compositor,
+			    wl_fixed_t x, wl_fixed_t y,
+			    wl_fixed_t *vx, wl_fixed_t *vy)
+{
+	struct weston_view *view;
+	struct weston_view **candidates;
+	size_t n_candidates, i;
+
+	/* Can't use paint node list: occlusion by input regions, not opaque.
+	 * The pick grid narrows the view list down to the views whose
+	 * bounding box may contain the point, in the same order. */
+	if (weston_pick_grid_lookup(compositor->pick_grid, compositor,
+				    wl_fixed_to_int(x), wl_fixed_to_int(y),
+				    &candidates, &n_candidates)) {
+		for (i = 0; i < n_candidates; i++) {
+			if (view_accepts_input_at(candidates[i], x, y, vx, vy))
+				return candidates[i];
+		}
+	} else {
+		wl_list_for_each(view, &compositor->view_list, link) {
+			if (view_accepts_input_at(view, x, y, vx, vy))
+				return view;
+		}
 	}
 
 	*vx = wl_fixed_from_int(-1000000);
@@ -2225,6 +2315,7 @@ weston_view_unmap(struct weston_view *view)
 	weston_layer_entry_remove(&view->layer_link);
 	wl_list_remove(&view->link);
 	wl_list_init(&view->link);
+	weston_compositor_view_list_dirty(view->surface->compositor);
 	view->output_mask = 0;
 	weston_surface_assign_output(view->surface);
 
@@ -2255,6 +2346,7 @@ weston_surface_unmap(struct weston_surface *surface)
 	wl_list_for_each(view, &surface->views, surface_link)
 		weston_view_unmap(view);
 	surface->output = NULL;
+	weston_compositor_view_list_dirty(surface->compositor);
 }
 
 static void
@@ -2285,6 +2377,8 @@ weston_view_destroy(struct weston_view *view)
 	wl_list_for_each_safe(pnode, pntmp, &view->paint_node_list, view_link)
 		weston_paint_node_destroy(pnode);
 
+	if (!wl_list_empty(&view->link))
+		weston_compositor_view_list_dirty(view->surface->compositor);
 	wl_list_remove(&view->link);
 	weston_layer_entry_remove(&view->layer_link);
 
@@ -2565,11 +2659,35 @@ surface_flush_damage(struct weston_surface *surface)
 }
 
 static void
-view_accumulate_damage(struct weston_view *view,
+paint_node_update_occluded(struct weston_paint_node *pnode,
+			   pixman_region32_t *opaque)
+{
+	struct weston_view *view = pnode->view;
+	pixman_region32_t visible;
+
+	if (view->surface->compositor->occluded_frame_msec <= 0) {
+		pnode->occluded = false;
+		return;
+	}
+
+	pixman_region32_init(&visible);
+	pixman_region32_intersect(&visible, &view->transform.boundingbox,
+				  &pnode->output->region);
+	pixman_region32_subtract(&visible, &visible, opaque);
+	pixman_region32_subtract(&visible, &visible, &view->plane->clip);
+	pnode->occluded = !pixman_region32_not_empty(&visible);
+	pixman_region32_fini(&visible);
+}
+
+static void
+view_accumulate_damage(struct weston_paint_node *pnode,
 		       pixman_region32_t *opaque)
 {
+	struct weston_view *view = pnode->view;
 	pixman_region32_t damage;
 
+	paint_node_update_occluded(pnode, opaque);
+
 	pixman_region32_init(&damage);
 	if (view->transform.enabled) {
 		pixman_box32_t *extents;
@@ -2612,7 +2730,7 @@ output_accumulate_damage(struct weston_output *output)
 			if (pnode->view->plane != plane)
 				continue;
 
-			view_accumulate_damage(pnode->view, &opaque);
+			view_accumulate_damage(pnode, &opaque);
 		}
 
 		pixman_region32_union(&clip, &clip, &opaque);
@@ -2628,10 +2746,6 @@ output_accumulate_damage(struct weston_output *output)
 
 	wl_list_for_each(pnode, &output->paint_node_z_order_list,
 			 z_order_link) {
-		/* Ignore views not visible on the current output */
-		/* TODO: turn this into assert once z_order_list is pruned. */
-		if (!(pnode->view->output_mask & (1u << output->id)))
-			continue;
 		if (pnode->surface->touched)
 			continue;
 		pnode->surface->touched = true;
@@ -2644,9 +2758,12 @@ output_accumulate_damage(struct weston_output *output)
 		 * around for migrating the surface into a non-primary plane
 		 * later, keep_buffer is true. Otherwise, drop the core
 		 * reference now, and allow early buffer release. This enables
-		 * clients to use single-buffering.
+		 * clients to use single-buffering. Occluded surfaces may have
+		 * skipped the upload, keep their buffer for when they become
+		 * visible again.
 		 */
-		if (!pnode->surface->keep_buffer) {
+		if (!pnode->surface->keep_buffer &&
+		    !weston_surface_is_occluded(pnode->surface)) {
 			weston_buffer_reference(&pnode->surface->buffer_ref, NULL);
 			weston_buffer_release_reference(
 				&pnode->surface->buffer_release_ref, NULL);
@@ -2697,6 +2814,10 @@ view_ensure_paint_node(struct weston_view *view, struct weston_output *output)
 	if (!output)
 		return NULL;
 
+	/* Prune the z-order list to the views visible on the output. */
+	if (!(view->output_mask & (1u << output->id)))
+		return NULL;
+
 	pnode = weston_view_find_paint_node(view, output);
 	if (pnode)
 		return pnode;
@@ -2808,13 +2929,40 @@ view_list_add(struct weston_compositor *compositor,
 	}
 }
 
-static void
+/** Rebuild the view list and an output's paint node z-order list
+ *
+ * \param compositor The compositor instance.
+ * \param output The output whose z-order list to rebuild, or NULL.
+ *
+ * If nothing in the scene graph has changed since the z-order list of
+ * \c output was last built, as tracked by
+ * weston_compositor::view_list_generation, both compositor->view_list and
+ * output->paint_node_z_order_list are reused as is and only the view
+ * transforms are brought up to date.
+ *
+ * The z-order list of an output contains only the views whose output_mask
+ * includes that output.
+ */
+WL_EXPORT void
 weston_compositor_build_view_list(struct weston_compositor *compositor,
 				  struct weston_output *output)
 {
 	struct weston_view *view, *tmp;
 	struct weston_layer *layer;
 
+	if (output &&
+	    output->z_order_list_generation == compositor->view_list_generation) {
+		wl_list_for_each(view, &compositor->view_list, link)
+			weston_view_update_transform(view);
+
+		/* Views moving to or from an output dirty the scene graph. */
+		if (output->z_order_list_generation ==
+		    compositor->view_list_generation)
+			return;
+	}
+
+	weston_pick_grid_invalidate(compositor->pick_grid);
+
 	if (output) {
 		wl_list_remove(&output->paint_node_z_order_list);
 		wl_list_init(&output->paint_node_z_order_list);
@@ -2837,6 +2985,12 @@ weston_compositor_build_view_list(struct weston_compositor *compositor,
 	wl_list_for_each(layer, &compositor->layer_list, link)
 		wl_list_for_each(view, &layer->view_list.link, layer_link.link)
 			surface_free_unused_subsurface_views(view->surface);
+
+	/* Freeing unused sub-surface views above may have bumped the
+	 * generation; the result is up to date regardless. */
+	if (output)
+		output->z_order_list_generation =
+			compositor->view_list_generation;
 }
 
 static void
@@ -2864,6 +3018,136 @@ weston_output_take_feedback_list(struct weston_output *output,
 	wl_list_init(&surface->feedback_list);
 }
 
+static int
+output_occluded_frame_handler(void *data)
+{
+	struct weston_output *output = data;
+
+	weston_output_schedule_repaint(output);
+
+	return 0;
+}
+
+/* Hold back the frame callbacks of a fully occluded surface until
+ * occluded_frame_msec has passed since they were last sent.
+ *
+ * Returns the milliseconds left until they are due, or 0 to send them now.
+ */
+static int64_t
+surface_throttle_frame_callbacks(struct weston_surface *surface,
+				 const struct timespec *now)
+{
+	struct weston_compositor *ec = surface->compositor;
+	int64_t elapsed;
+
+	if (ec->occluded_frame_msec <= 0 ||
+	    wl_list_empty(&surface->frame_callback_list))
+		return 0;
+
+	if (!weston_surface_is_occluded(surface))
+		return 0;
+
+	elapsed = timespec_sub_to_msec(now, &surface->frame_callback_time);
+	if (elapsed >= ec->occluded_frame_msec)
+		return 0;
+
+	return ec->occluded_frame_msec - elapsed;
+}
+
+static void
+output_arm_occluded_frame_timer(struct weston_output *output, int64_t msec)
+{
+	struct weston_compositor *ec = output->compositor;
+	struct wl_event_loop *loop;
+
+	if (!output->occluded_frame_timer) {
+		loop = wl_display_get_event_loop(ec->wl_display);
+		output->occluded_frame_timer =
+			wl_event_loop_add_timer(loop,
+						output_occluded_frame_handler,
+						output);
+		if (!output->occluded_frame_timer)
+			return;
+	}
+
+	wl_event_source_timer_update(output->occluded_frame_timer, msec);
+}
+
+/* The repaint profiler of an output, or NULL while nobody is subscribed to
+ * the repaint-profiler log scope. */
+static struct weston_repaint_profiler *
+output_get_repaint_profiler(struct weston_output *output)
+{
+	struct weston_compositor *ec = output->compositor;
+
+	if (!weston_log_scope_is_enabled(ec->repaint_profiler_scope))
+		return NULL;
+
+	if (!output->repaint_profiler)
+		output->repaint_profiler = weston_repaint_profiler_create();
+
+	return output->repaint_profiler;
+}
+
+static void
+repaint_profiler_new_subscription(struct weston_log_subscription *sub,
+				  void *data)
+{
+	struct weston_compositor *ec = data;
+	struct weston_output *output;
+
+	if (ec->repaint_profiler_subscriptions++ > 0)
+		return;
+
+	/* The first subscriber gets only the repaints since. */
+	wl_list_for_each(output, &ec->output_list, link) {
+		weston_repaint_profiler_destroy(output->repaint_profiler);
+		output->repaint_profiler = NULL;
+	}
+}
+
+static void
+repaint_profiler_destroy_subscription(struct weston_log_subscription *sub,
+				      void *data)
+{
+	struct weston_compositor *ec = data;
+
+	ec->repaint_profiler_subscriptions--;
+}
+
+/* Record the time since mark as a phase, and move mark to now. */
+static void
+repaint_profiler_mark(struct weston_compositor *ec,
+		      struct weston_repaint_profiler *prof,
+		      enum weston_repaint_phase phase,
+		      struct timespec *mark)
+{
+	struct timespec now;
+
+	if (!prof)
+		return;
+
+	weston_compositor_read_presentation_clock(ec, &now);
+	weston_repaint_profiler_record(prof, phase,
+				       timespec_sub_to_nsec(&now, mark));
+	*mark = now;
+}
+
+static uint64_t
+region_area(pixman_region32_t *region)
+{
+	pixman_box32_t *rects;
+	uint64_t area = 0;
+	int i, nrects;
+
+	rects = pixman_region32_rectangles(region, &nrects);
+	for (i = 0; i < nrects; i++)
+		area += (uint64_t)(rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+
+	return area;
+}
+
 static int
 weston_output_repaint(struct weston_output *output, void *repaint_data)
 {
@@ -2876,22 +3160,27 @@ weston_output_repaint(struct weston_output *output, void *repaint_data)
 	int r;
 	uint32_t frame_time_msec;
 	enum weston_hdcp_protection highest_requested = WESTON_HDCP_DISABLE;
+	struct timespec now;
+	int64_t throttle_msec = 0;
+	struct weston_repaint_profiler *prof;
+	struct timespec mark;
 
 	if (output->destroying)
 		return 0;
 
 	TL_POINT(ec, "core_repaint_begin", TLP_OUTPUT(output), TLP_END);
 
+	prof = output_get_repaint_profiler(output);
+	if (prof)
+		weston_compositor_read_presentation_clock(ec, &mark);
+
 	/* Rebuild the surface list and update surface transforms up front. */
 	weston_compositor_build_view_list(ec, output);
+	repaint_profiler_mark(ec, prof, WESTON_REPAINT_PHASE_VIEW_LIST, &mark);
 
 	/* Find the highest protection desired for an output */
 	wl_list_for_each(pnode, &output->paint_node_z_order_list,
 			 z_order_link) {
-		/* TODO: turn this into assert once z_order_list is pruned. */
-		if ((pnode->surface->output_mask & (1u << output->id)) == 0)
-			continue;
-
 		/*
 		 * The desired_protection of the output should be the
 		 * maximum of the desired_protection of the surfaces,
@@ -2913,23 +3202,45 @@ weston_output_repaint(struct weston_output *output, void *repaint_data)
 			pnode->view->psf_flags = 0;
 		}
 	}
+	repaint_profiler_mark(ec, prof, WESTON_REPAINT_PHASE_ASSIGN_PLANES,
+			      &mark);
 
+	/* Also works out which paint nodes are occluded. */
+	output_accumulate_damage(output);
+	repaint_profiler_mark(ec, prof, WESTON_REPAINT_PHASE_ACCUMULATE_DAMAGE,
+			      &mark);
+
+	weston_compositor_read_presentation_clock(ec, &now);
 	wl_list_init(&frame_callback_list);
 	wl_list_for_each(pnode, &output->paint_node_z_order_list,
 			 z_order_link) {
+		struct weston_surface *surface = pnode->surface;
+		int64_t msec;
+
 		/* Note: This operation is safe to do multiple times on the
 		 * same surface.
 		 */
-		if (pnode->surface->output == output) {
-			wl_list_insert_list(&frame_callback_list,
-					    &pnode->surface->frame_callback_list);
-			wl_list_init(&pnode->surface->frame_callback_list);
+		if (surface->output != output)
+			continue;
+
+		weston_output_take_feedback_list(output, surface);
 
-			weston_output_take_feedback_list(output, pnode->surface);
+		msec = surface_throttle_frame_callbacks(surface, &now);
+		if (msec > 0) {
+			if (throttle_msec == 0 || msec < throttle_msec)
+				throttle_msec = msec;
+			continue;
 		}
+
+		if (!wl_list_empty(&surface->frame_callback_list))
+			surface->frame_callback_time = now;
+		wl_list_insert_list(&frame_callback_list,
+				    &surface->frame_callback_list);
+		wl_list_init(&surface->frame_callback_list);
 	}
 
-	output_accumulate_damage(output);
+	if (throttle_msec > 0)
+		output_arm_occluded_frame_timer(output, throttle_msec);
 
 	pixman_region32_init(&output_damage);
 	pixman_region32_intersect(&output_damage,
@@ -2941,7 +3252,13 @@ weston_output_repaint(struct weston_output *output, void *repaint_data)
 		weston_output_update_matrix(output);
 
 	r = output->repaint(output, &output_damage, repaint_data);
+	repaint_profiler_mark(ec, prof, WESTON_REPAINT_PHASE_RENDER, &mark);
 
+	if (r == 0) {
+		weston_output_count(output, WESTON_OUTPUT_REPAINTS, 1);
+		weston_output_count(output, WESTON_OUTPUT_DAMAGED_PIXELS,
+				    region_area(&output_damage));
+	}
 	pixman_region32_fini(&output_damage);
 
 	output->repaint_needed = false;
@@ -2953,6 +3270,9 @@ weston_output_repaint(struct weston_output *output, void *repaint_data)
 	frame_time_msec = timespec_to_msec(&output->frame_time);
 
 	wl_list_for_each_safe(cb, cnext, &frame_callback_list, link) {
+		weston_output_count(output, WESTON_OUTPUT_FRAME_CALLBACKS, 1);
+		weston_client_count(ec, wl_resource_get_client(cb->resource),
+				    WESTON_CLIENT_FRAME_CALLBACKS, 1);
 		wl_callback_send_done(cb->resource, frame_time_msec);
 		wl_resource_destroy(cb->resource);
 	}
@@ -2961,6 +3281,7 @@ weston_output_repaint(struct weston_output *output, void *repaint_data)
 		animation->frame_counter++;
 		animation->frame(animation, output, &output->frame_time);
 	}
+	repaint_profiler_mark(ec, prof, WESTON_REPAINT_PHASE_POST, &mark);
 
 	TL_POINT(ec, "core_repaint_posted", TLP_OUTPUT(output), TLP_END);
 
@@ -3059,21 +3380,127 @@ output_repaint_timer_arm(struct weston_compositor *compositor)
 	wl_event_source_timer_update(compositor->repaint_timer, msec_to_next);
 }
 
+/* Feed the time from the start of the repaint cycle until the backend has
+ * submitted the frames to the adaptive repaint window of each output. */
+static void
+output_repaint_record_time(struct weston_compositor *compositor,
+			   const struct timespec *start)
+{
+	struct weston_output *output;
+	struct timespec end;
+	int64_t nsec;
+
+	if (compositor->repaint_window_percentile <= 0)
+		return;
+
+	weston_compositor_read_presentation_clock(compositor, &end);
+	nsec = timespec_sub_to_nsec(&end, start);
+
+	wl_list_for_each(output, &compositor->output_list, link) {
+		if (!output->repainted)
+			continue;
+
+		if (!output->repaint_window)
+			output->repaint_window = weston_repaint_window_create();
+		if (output->repaint_window)
+			weston_repaint_window_add_sample(output->repaint_window,
+							 nsec);
+	}
+}
+
+/* Count the repainted outputs whose repaint cycle ended after the vblank
+ * it was aiming for, the first one after the cycle started. */
+static void
+output_repaint_count_missed(struct weston_compositor *compositor,
+			    const struct timespec *start)
+{
+	struct weston_output *output;
+	struct timespec end;
+	int64_t refresh_nsec, since_vblank;
+
+	weston_compositor_read_presentation_clock(compositor, &end);
+
+	wl_list_for_each(output, &compositor->output_list, link) {
+		if (!output->repainted || !output->current_mode ||
+		    output->current_mode->refresh == 0 ||
+		    timespec_is_zero(&output->frame_time))
+			continue;
+
+		refresh_nsec = millihz_to_nsec(output->current_mode->refresh);
+		since_vblank = timespec_sub_to_nsec(start, &output->frame_time);
+		if (since_vblank < 0)
+			since_vblank = 0;
+
+		/* The target vblank is frame_time + k * refresh_nsec. */
+		if (timespec_sub_to_nsec(&end, &output->frame_time) >
+		    (since_vblank / refresh_nsec + 1) * refresh_nsec)
+			weston_output_count(output,
+					    WESTON_OUTPUT_MISSED_DEADLINES, 1);
+	}
+}
+
+/* Record the phases of the repaint cycle shared by all outputs for the
+ * outputs that were repainted. */
+static void
+output_repaint_profile_cycle(struct weston_compositor *compositor,
+			     const struct timespec *start,
+			     const struct timespec *begin_end,
+			     const struct timespec *flush_start)
+{
+	struct weston_output *output;
+	struct timespec end;
+
+	weston_compositor_read_presentation_clock(compositor, &end);
+
+	wl_list_for_each(output, &compositor->output_list, link) {
+		struct weston_repaint_profiler *prof;
+
+		if (!output->repainted)
+			continue;
+
+		prof = output_get_repaint_profiler(output);
+		if (!prof)
+			continue;
+
+		weston_repaint_profiler_record(prof,
+			WESTON_REPAINT_PHASE_BEGIN,
+			timespec_sub_to_nsec(begin_end, start));
+		weston_repaint_profiler_record(prof,
+			WESTON_REPAINT_PHASE_FLUSH,
+			timespec_sub_to_nsec(&end, flush_start));
+		weston_repaint_profiler_record(prof,
+			WESTON_REPAINT_PHASE_TOTAL,
+			timespec_sub_to_nsec(&end, start));
+
+		weston_repaint_profiler_report(prof,
+					       compositor->repaint_profiler_scope,
+					       output->name, &end);
+	}
+}
+
 static int
 output_repaint_timer_handler(void *data)
 {
 	struct weston_compositor *compositor = data;
 	struct weston_output *output;
 	struct timespec now;
+	struct timespec begin_end = {}, flush_start = {};
+	bool profiling;
 	void *repaint_data = NULL;
 	int ret = 0;
 
 	weston_compositor_read_presentation_clock(compositor, &now);
 	compositor->last_repaint_start = now;
 
+	profiling = weston_log_scope_is_enabled(compositor->repaint_profiler_scope);
+
 	if (compositor->backend->repaint_begin)
 		repaint_data = compositor->backend->repaint_begin(compositor);
 
+	if (profiling)
+		weston_compositor_read_presentation_clock(compositor,
+							  &begin_end);
+
 	wl_list_for_each(output, &compositor->output_list, link) {
 		ret = weston_output_maybe_repaint(output, &now, repaint_data);
 		if (ret)
@@ -3081,9 +3508,19 @@ output_repaint_timer_handler(void *data)
 	}
 
 	if (ret == 0) {
+		if (profiling)
+			weston_compositor_read_presentation_clock(compositor,
+								  &flush_start);
 		if (compositor->backend->repaint_flush)
 			ret = compositor->backend->repaint_flush(compositor,
 							 repaint_data);
+		if (ret == 0) {
+			output_repaint_record_time(compositor, &now);
+			output_repaint_count_missed(compositor, &now);
+		}
+		if (profiling)
+			output_repaint_profile_cycle(compositor, &now,
+						     &begin_end, &flush_start);
 	} else {
 		if (compositor->backend->repaint_cancel)
 			compositor->backend->repaint_cancel(compositor,
@@ -3138,6 +3575,52 @@ convert_presentation_time_now(struct weston_compositor *compositor,
 	return target_stamp;
 }
 
+/* How long before the next vblank the repaint has to start
+ *
+ * With the adaptive repaint window, this is the configured percentile of the
+ * measured repaint times plus a safety margin, so that the repaint starts as
+ * late as it can still be expected to make the vblank. The static
+ * repaint_msec is used until enough measurements are available.
+ */
+static int64_t
+output_repaint_window_nsec(struct weston_output *output, int32_t refresh_nsec)
+{
+	struct weston_compositor *compositor = output->compositor;
+	int64_t fixed_nsec = (int64_t)compositor->repaint_msec * 1000000;
+	int64_t measured_nsec;
+	int64_t window_nsec;
+
+	if (compositor->repaint_window_percentile <= 0 ||
+	    !output->repaint_window)
+		return fixed_nsec;
+
+	measured_nsec =
+		weston_repaint_window_percentile(output->repaint_window,
+						 compositor->repaint_window_percentile);
+	if (measured_nsec < 0)
+		return fixed_nsec;
+
+	window_nsec = measured_nsec +
+		      (int64_t)compositor->repaint_window_margin_usec * 1000;
+	if (window_nsec > refresh_nsec)
+		window_nsec = refresh_nsec;
+
+	if (weston_log_scope_is_enabled(compositor->repaint_window_scope)) {
+		weston_log_scope_printf(compositor->repaint_window_scope,
+					"%s: p%d repaint time %lld us, "
+					"repaint window %lld us "
+					"(fixed %d ms, refresh %d us)\n",
+					output->name,
+					compositor->repaint_window_percentile,
+					(long long)(measured_nsec / 1000),
+					(long long)(window_nsec / 1000),
+					compositor->repaint_msec,
+					refresh_nsec / 1000);
+	}
+
+	return window_nsec;
+}
+
 /**
  * \ingroup output
  */
@@ -3188,8 +3671,8 @@ weston_output_finish_frame(struct weston_output *output,
 	output->frame_time = *stamp;
 
 	timespec_add_nsec(&output->next_repaint, stamp, refresh_nsec);
-	timespec_add_msec(&output->next_repaint, &output->next_repaint,
-			  -compositor->repaint_msec);
+	timespec_add_nsec(&output->next_repaint, &output->next_repaint,
+			  -output_repaint_window_nsec(output, refresh_nsec));
 	msec_rel = timespec_sub_to_msec(&output->next_repaint, &now);
 
 	if (msec_rel < -1000 || msec_rel > 1000) {
@@ -3241,11 +3724,15 @@ weston_layer_entry_insert(struct weston_layer_entry *list,
 {
 	wl_list_insert(&list->link, &entry->link);
 	entry->layer = list->layer;
+	weston_compositor_view_list_dirty(entry->layer->compositor);
 }
 
 WL_EXPORT void
 weston_layer_entry_remove(struct weston_layer_entry *entry)
 {
+	if (entry->layer)
+		weston_compositor_view_list_dirty(entry->layer->compositor);
+
 	wl_list_remove(&entry->link);
 	wl_list_init(&entry->link);
 	entry->layer = NULL;
@@ -3276,6 +3763,7 @@ WL_EXPORT void
 weston_layer_fini(struct weston_layer *layer)
 {
 	wl_list_remove(&layer->link);
+	weston_compositor_view_list_dirty(layer->compositor);
 
 	if (!wl_list_empty(&layer->view_list.link))
 		weston_log("BUG: finalizing a layer with views still on it.\n");
@@ -3298,6 +3786,7 @@ weston_layer_set_position(struct weston_layer *layer,
 	struct weston_layer *below;
 
 	wl_list_remove(&layer->link);
+	weston_compositor_view_list_dirty(layer->compositor);
 
 	/* layer_list is ordered from top to bottom, the last layer being the
 	 * background with the smallest position value */
@@ -3322,6 +3811,7 @@ weston_layer_unset_position(struct weston_layer *layer)
 {
 	wl_list_remove(&layer->link);
 	wl_list_init(&layer->link);
+	weston_compositor_view_list_dirty(layer->compositor);
 }
 
 WL_EXPORT void
@@ -3569,8 +4059,10 @@ weston_surface_commit_subsurface_order(struct weston_surface *surface)
 		wl_list_remove(&sub->parent_link);
 		wl_list_insert(&surface->subsurface_list, &sub->parent_link);
 
-		if (sub->reordered)
+		if (sub->reordered) {
 			weston_surface_damage_subsurfaces(sub);
+			weston_compositor_view_list_dirty(surface->compositor);
+		}
 	}
 }
 
@@ -3797,6 +4289,65 @@ weston_surface_set_protection_mode(struct weston_surface *surface,
 	}
 }
 
+/* Weight of the newest interval in the moving average, 1/8 */
+#define BUFFER_COMMIT_INTERVAL_SHIFT 3
+
+/* Shortest interval the update rate is computed from, in ns, so that a
+ * client committing twice in one dispatch does not overflow the rate */
+#define BUFFER_COMMIT_INTERVAL_MIN 1000
+
+static void
+weston_surface_update_commit_history(struct weston_surface *surface)
+{
+	struct timespec now;
+	int64_t interval;
+
+	weston_compositor_read_presentation_clock(surface->compositor, &now);
+
+	if (!timespec_is_zero(&surface->buffer_commit_time)) {
+		interval = timespec_sub_to_nsec(&now,
+						&surface->buffer_commit_time);
+		if (surface->buffer_commit_interval == 0)
+			surface->buffer_commit_interval = interval;
+		else
+			surface->buffer_commit_interval +=
+				(interval - surface->buffer_commit_interval) >>
+				BUFFER_COMMIT_INTERVAL_SHIFT;
+	}
+
+	surface->buffer_commit_time = now;
+}
+
+/** Estimate how often the content of a surface changes
+ *
+ * \param surface The surface.
+ * \param now The current time on the presentation clock.
+ * \return The rate of buffer commits in mHz, 0 if unknown.
+ *
+ * The rate is averaged over the recent buffer commits. A surface which
+ * has not committed a buffer for longer than its average interval is
+ * taken to have slowed down to the time since, so the rate of a stopped
+ * video decays towards 0.
+ *
+ * \internal
+ */
+WL_EXPORT uint32_t
+weston_surface_get_update_rate(struct weston_surface *surface,
+			       const struct timespec *now)
+{
+	int64_t interval = surface->buffer_commit_interval;
+	int64_t since;
+
+	if (interval <= 0)
+		return 0;
+
+	since = timespec_sub_to_nsec(now, &surface->buffer_commit_time);
+	interval = MAX(interval, since);
+	interval = MAX(interval, BUFFER_COMMIT_INTERVAL_MIN);
+
+	return 1000000000000LL / interval;
+}
+
 static void
 weston_surface_commit_state(struct weston_surface *surface,
 			    struct weston_surface_state *state)
@@ -3819,6 +4370,8 @@ weston_surface_commit_state(struct weston_surface *surface,
 		weston_buffer_release_move(&surface->buffer_release_ref,
 					   &state->buffer_release_ref);
 		weston_surface_attach(surface, state->buffer);
+		if (state->buffer)
+			weston_surface_update_commit_history(surface);
 	}
 	weston_surface_state_set_buffer(state, NULL);
 	assert(state->acquire_fence_fd == -1);
@@ -3980,6 +4533,11 @@ surface_commit(struct wl_client *client, struct wl_resource *resource)
 		return;
 	}
 
+	TL_POINT(surface->compositor, "core_commit", TLP_SURFACE(surface),
+		 TLP_END);
+	weston_client_count(surface->compositor, wl_resource_get_client(resource),
+			    WESTON_CLIENT_COMMITS, 1);
+
 	if (sub) {
 		weston_subsurface_commit(sub);
 		return;
@@ -4329,6 +4887,7 @@ subsurface_committed(struct weston_surface *surface, int32_t dx, int32_t dy)
 
 	if (!weston_surface_is_mapped(surface)) {
 		surface->is_mapped = true;
+		weston_compositor_view_list_dirty(surface->compositor);
 
 		/* Cannot call weston_view_update_transform(),
 		 * because that would call it also for the parent surface,
@@ -4667,6 +5226,7 @@ subsurface_set_desync(struct wl_client *client, struct wl_resource *resource)
 static void
 weston_subsurface_unlink_parent(struct weston_subsurface *sub)
 {
+	weston_compositor_view_list_dirty(sub->parent->compositor);
 	wl_list_remove(&sub->parent_link);
 	wl_list_remove(&sub->parent_link_pending);
 	wl_list_remove(&sub->parent_destroy_listener.link);
@@ -4733,6 +5293,7 @@ weston_subsurface_link_parent(struct weston_subsurface *sub,
 	wl_list_insert(&parent->subsurface_list, &sub->parent_link);
 	wl_list_insert(&parent->subsurface_list_pending,
 		       &sub->parent_link_pending);
+	weston_compositor_view_list_dirty(parent->compositor);
 }
 
 static void
@@ -4841,6 +5402,7 @@ weston_subsurface_create_for_parent(struct weston_surface *parent)
 	wl_list_insert(&parent->subsurface_list, &sub->parent_link);
 	wl_list_insert(&parent->subsurface_list_pending,
 		       &sub->parent_link_pending);
+	weston_compositor_view_list_dirty(parent->compositor);
 
 	return sub;
 }
@@ -6224,6 +6786,9 @@ weston_compositor_add_output(struct weston_compositor *compositor,
 	wl_list_insert(compositor->output_list.prev, &output->link);
 	output->enabled = true;
 
+	/* Force the first repaint to build the z-order list. */
+	weston_compositor_view_list_dirty(compositor);
+
 	wl_list_for_each(head, &output->head_list, output_link)
 		weston_head_add_global(head);
 
@@ -6328,6 +6893,19 @@ weston_compositor_remove_output(struct weston_output *output)
 	}
 	assert(wl_list_empty(&output->paint_node_z_order_list));
 
+	if (output->occluded_frame_timer) {
+		wl_event_source_remove(output->occluded_frame_timer);
+		output->occluded_frame_timer = NULL;
+	}
+
+	weston_repaint_window_destroy(output->repaint_window);
+	output->repaint_window = NULL;
+
+	weston_repaint_profiler_destroy(output->repaint_profiler);
+	output->repaint_profiler = NULL;
+
+	weston_output_counters_destroy(output);
+
 	/*
 	 * Use view_list in case the output did not go through repaint
 	 * after a view came on it, lacking a paint node. Just to be sure.
@@ -7663,6 +8241,7 @@ weston_compositor_create(struct wl_display *display,
 
 	ec->output_id_pool = 0;
 	ec->repaint_msec = DEFAULT_REPAINT_WINDOW;
+	ec->repaint_window_margin_usec = DEFAULT_REPAINT_WINDOW_MARGIN;
 
 	ec->activate_serial = 1;
 
@@ -7670,6 +8249,10 @@ weston_compositor_create(struct wl_display *display,
 
 	ec->content_protection = NULL;
 
+	ec->pick_grid = weston_pick_grid_create();
+	if (!ec->pick_grid)
+		goto fail;
+
 	if (!wl_global_create(ec->wl_display, &wl_compositor_interface, 4,
 			      ec, compositor_bind))
 		goto fail;
@@ -7741,9 +8324,31 @@ weston_compositor_create(struct wl_display *display,
 						weston_timeline_create_subscription,
 						weston_timeline_destroy_subscription,
 						ec);
+
+	ec->timeline_binary =
+		weston_compositor_add_log_scope(ec, "timeline-binary",
+						"Timeline event points, binary\n",
+						weston_timeline_create_subscription_binary,
+						weston_timeline_destroy_subscription,
+						ec);
+
+	ec->repaint_window_scope =
+		weston_compositor_add_log_scope(ec, "repaint-window",
+						"Adaptive repaint window\n",
+						NULL, NULL, ec);
+
+	ec->repaint_profiler_scope =
+		weston_compositor_add_log_scope(ec, "repaint-profiler",
+						"Repaint phase durations per output\n",
+						repaint_profiler_new_subscription,
+						repaint_profiler_destroy_subscription,
+						ec);
+
+	ec->stats = weston_stats_create(ec);
 	return ec;
 
 fail:
+	weston_pick_grid_destroy(ec->pick_grid);
 	free(ec);
 	return NULL;
 }
@@ -8122,6 +8727,23 @@ weston_compositor_destroy(struct weston_compositor *compositor)
 	weston_log_scope_destroy(compositor->timeline);
 	compositor->timeline = NULL;
 
+	weston_log_scope_destroy(compositor->timeline_binary);
+	compositor->timeline_binary = NULL;
+
+	weston_log_scope_destroy(compositor->repaint_window_scope);
+	compositor->repaint_window_scope = NULL;
+
+	weston_log_scope_destroy(compositor->repaint_profiler_scope);
+	compositor->repaint_profiler_scope = NULL;
+
+	weston_stats_destroy(compositor->stats);
+	compositor->stats = NULL;
+
+	weston_pick_grid_destroy(compositor->pick_grid);
+	compositor->pick_grid = NULL;
+
+	free(compositor->gl_shader_cache_dir);
+
 	free(compositor);
 }
 
@@ -8304,6 +8926,88 @@ weston_buffer_send_server_error(struct weston_buffer *buffer,
 			       "wl_buffer@%u: %s", id, msg);
 }
 
+/** Read back output framebuffer contents without stalling
+ *
+ * \param output The output to read from.
+ * \param format The pixel format, see weston_renderer::read_pixels.
+ * \param pixels Where to write the pixels, must stay valid until \c done
+ * is called.
+ * \param x X coordinate of the rectangle, in framebuffer pixels.
+ * \param y Y coordinate of the rectangle, in framebuffer pixels.
+ * \param width Width of the rectangle.
+ * \param height Height of the rectangle.
+ * \param done Called once the pixels are available, or the read failed.
+ * \param data User data for \c done.
+ * \return 0 if \c done will be called, -1 on failure.
+ *
+ * Like weston_renderer::read_pixels(), to be used from the output's frame
+ * signal, but the renderer only queues the read back and the pixels are
+ * delivered after the rendering has finished, so that screen capture does
+ * not wait for the GPU in the middle of a repaint. Requests on an output
+ * complete in order.
+ *
+ * With renderers that cannot read back asynchronously, the pixels are
+ * read right away and \c done is called before this function returns.
+ */
+WL_EXPORT int
+weston_output_read_pixels_async(struct weston_output *output,
+				pixman_format_code_t format, void *pixels,
+				uint32_t x, uint32_t y,
+				uint32_t width, uint32_t height,
+				weston_read_pixels_done_func_t done,
+				void *data)
+{
+	struct weston_renderer *renderer = output->compositor->renderer;
+
+	if (renderer->read_pixels_async &&
+	    renderer->read_pixels_async(output, format, pixels, x, y,
+					width, height, done, data) == 0)
+		return 0;
+
+	if (renderer->read_pixels(output, format, pixels,
+				  x, y, width, height) < 0)
+		return -1;
+
+	done(data, true);
+
+	return 0;
+}
+
+/** Compose the output's scene off-screen and read it back asynchronously
+ *
+ * \param output The output whose scene to capture.
+ * \param format The pixel format to read the pixels in.
+ * \param pixels Where to store the whole output, in the layout of
+ * weston_renderer::read_pixels().
+ * \param done Called with \c data once the pixels are stored or the
+ * capture failed.
+ * \param data User data for \c done.
+ * \return 0 if \c done will be called, -1 if the renderer cannot capture.
+ *
+ * To be used from the output's frame signal. All the views of the current
+ * paint node list are composited into a separate target, including the
+ * ones the backend assigned to hardware planes, so a screenshot does not
+ * need weston_output_disable_planes_incr() and a repaint without planes.
+ * The displayed frame is left alone. Protected content is censored as if
+ * the output was being recorded.
+ *
+ * Callers fall back to disabling planes and reading the output back when
+ * this fails.
+ */
+WL_EXPORT int
+weston_output_capture_async(struct weston_output *output,
+			    pixman_format_code_t format, void *pixels,
+			    weston_read_pixels_done_func_t done, void *data)
+{
+	struct weston_renderer *renderer = output->compositor->renderer;
+
+	if (!renderer->capture_output_async)
+		return -1;
+
+	return renderer->capture_output_async(output, format, pixels,
+					      done, data);
+}
+
 WL_EXPORT void
 weston_output_disable_planes_incr(struct weston_output *output)
 {
@@ -45,6 +45,7 @@
 #include <libweston/libweston.h>
 #include "backend.h"
 #include "libweston-internal.h"
+#include "timeline.h"
 #include "relative-pointer-unstable-v1-server-protocol.h"
 #include "pointer-constraints-unstable-v1-server-protocol.h"
 #include "input-timestamps-unstable-v1-server-protocol.h"
@@ -1779,6 +1780,42 @@ weston_pointer_handle_output_destroy(struct wl_listener *listener, void *data)
 	weston_pointer_move_to(pointer, fx, fy);
 }
 
+/* Timeline point for an input event, after it has been delivered. The
+ * point carries the event timestamp and the surface that had the focus,
+ * so that the commit answering the event and the frame showing it can be
+ * found, and the serial of the wl_pointer.button or wl_keyboard.key event
+ * sent for it, if any. */
+static void
+timeline_input_point(struct weston_compositor *compositor, const char *name,
+		     const struct timespec *time, struct weston_surface *focus,
+		     const uint32_t *serial)
+{
+	if (focus && serial)
+		TL_POINT(compositor, name, TLP_INPUT(time),
+			 TLP_SERIAL(serial), TLP_SURFACE(focus), TLP_END);
+	else if (focus)
+		TL_POINT(compositor, name, TLP_INPUT(time),
+			 TLP_SURFACE(focus), TLP_END);
+	else
+		TL_POINT(compositor, name, TLP_INPUT(time), TLP_END);
+}
+
+/* The serial a grab sent its event with, NULL if it sent none */
+static const uint32_t *
+sent_serial(struct weston_compositor *compositor, uint32_t before,
+	    uint32_t *serial)
+{
+	*serial = wl_display_get_serial(compositor->wl_display);
+
+	return *serial != before ? serial : NULL;
+}
+
+static struct weston_surface *
+pointer_focus_surface(struct weston_pointer *pointer)
+{
+	return pointer->focus ? pointer->focus->surface : NULL;
+}
+
 WL_EXPORT void
 notify_motion(struct weston_seat *seat,
 	      const struct timespec *time,
@@ -1789,6 +1826,9 @@ notify_motion(struct weston_seat *seat,
 
 	weston_compositor_wake(ec);
 	pointer->grab->interface->motion(pointer->grab, time, event);
+
+	timeline_input_point(ec, "core_input_motion", time,
+			     pointer_focus_surface(pointer), NULL);
 }
 
 static void
@@ -1844,6 +1884,9 @@ notify_motion_absolute(struct weston_seat *seat, const struct timespec *time,
 	};
 
 	pointer->grab->interface->motion(pointer->grab, time, &event);
+
+	timeline_input_point(ec, "core_input_motion", time,
+			     pointer_focus_surface(pointer), NULL);
 }
 
 static unsigned int
@@ -1881,6 +1924,8 @@ notify_button(struct weston_seat *seat, const struct timespec *time,
 {
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
+	const uint32_t *sent;
+	uint32_t before, serial;
 
 	if (state == WL_POINTER_BUTTON_STATE_PRESSED) {
 		weston_compositor_idle_inhibit(compositor);
@@ -1899,11 +1944,16 @@ notify_button(struct weston_seat *seat, const struct timespec *time,
 	weston_compositor_run_button_binding(compositor, pointer, time, button,
 					     state);
 
+	before = wl_display_get_serial(compositor->wl_display);
 	pointer->grab->interface->button(pointer->grab, time, button, state);
+	sent = sent_serial(compositor, before, &serial);
 
 	if (pointer->button_count == 1)
 		pointer->grab_serial =
 			wl_display_get_serial(compositor->wl_display);
+
+	timeline_input_point(compositor, "core_input_button", time,
+			     pointer_focus_surface(pointer), sent);
 }
 
 WL_EXPORT void
@@ -1920,6 +1970,9 @@ notify_axis(struct weston_seat *seat, const struct timespec *time,
 		return;
 
 	pointer->grab->interface->axis(pointer->grab, time, event);
+
+	timeline_input_point(compositor, "core_input_axis", time,
+			     pointer_focus_surface(pointer), NULL);
 }
 
 WL_EXPORT void
@@ -2192,6 +2245,8 @@ notify_key(struct weston_seat *seat, const struct timespec *time, uint32_t key,
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_keyboard *keyboard = weston_seat_get_keyboard(seat);
 	struct weston_keyboard_grab *grab = keyboard->grab;
+	const uint32_t *sent;
+	uint32_t before, serial;
 	uint32_t *k, *end;
 
 	if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
@@ -2222,7 +2277,9 @@ notify_key(struct weston_seat *seat, const struct timespec *time, uint32_t key,
 		grab = keyboard->grab;
 	}
 
+	before = wl_display_get_serial(compositor->wl_display);
 	grab->interface->key(grab, time, key, state);
+	sent = sent_serial(compositor, before, &serial);
 
 	if (keyboard->pending_keymap &&
 	    keyboard->keys.size == 0)
@@ -2240,6 +2297,9 @@ notify_key(struct weston_seat *seat, const struct timespec *time, uint32_t key,
 		keyboard->grab_time = *time;
 		keyboard->grab_key = key;
 	}
+
+	timeline_input_point(compositor, "core_input_key", time,
+			     keyboard->focus, sent);
 }
 
 WL_EXPORT void
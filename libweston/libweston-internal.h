@@ -76,6 +76,9 @@ void
 weston_compositor_add_head(struct weston_compositor *compositor,
 			   struct weston_head *head);
 void
+weston_compositor_build_view_list(struct weston_compositor *compositor,
+				  struct weston_output *output);
+void
 weston_compositor_add_pending_output(struct weston_output *output,
 				     struct weston_compositor *compositor);
 bool
@@ -268,6 +271,10 @@ weston_surface_to_buffer_region(struct weston_surface *surface,
 void
 weston_surface_schedule_repaint(struct weston_surface *surface);
 
+uint32_t
+weston_surface_get_update_rate(struct weston_surface *surface,
+			       const struct timespec *now);
+
 /* weston_spring */
 
 void
@@ -419,12 +426,22 @@ struct weston_paint_node {
 
 	struct weston_surface_color_transform surf_xform;
 	bool surf_xform_valid;
+
+	/* Fully hidden behind opaque views on the output as of the last
+	 * repaint; only tracked while occluded_frame_msec is set. */
+	bool occluded;
 };
 
 struct weston_paint_node *
 weston_view_find_paint_node(struct weston_view *view,
 			    struct weston_output *output);
 
+bool
+weston_view_is_occluded(struct weston_view *view);
+
+bool
+weston_surface_is_occluded(struct weston_surface *surface);
+
 /* others */
 int
 wl_data_device_manager_init(struct wl_display *display);
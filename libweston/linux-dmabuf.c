@@ -34,6 +34,7 @@
 #include "linux-dmabuf.h"
 #include "linux-dmabuf-unstable-v1-server-protocol.h"
 #include "libweston-internal.h"
+#include "stats.h"
 #include "shared/weston-drm-fourcc.h"
 
 static void
@@ -284,6 +285,9 @@ avoid_gpu_import:
 				       &linux_dmabuf_buffer_implementation,
 				       buffer, destroy_linux_dmabuf_wl_buffer);
 
+	weston_client_count(buffer->compositor, client,
+			    WESTON_CLIENT_DMABUF_IMPORTS, 1);
+
 	/* send 'created' event when the request is not for an immediate
 	 * import, ie buffer_id is zero */
 	if (buffer_id == 0)
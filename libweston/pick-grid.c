@@ -0,0 +1,340 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Uniform grid over the view bounding boxes for input picking.
+ *
+ * The grid covers the bounding rectangle of all enabled outputs. Every cell
+ * holds the views whose transform.boundingbox extents touch it, sorted by
+ * their position in weston_compositor::view_list, so that the first view
+ * in a cell accepting the input is the same view a linear walk of the view
+ * list would find.
+ *
+ * The grid is rebuilt lazily on the next lookup whenever the view list
+ * changes, and kept up to date incrementally when a view's bounding box is
+ * recomputed by weston_view_update_transform().
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libweston/libweston.h>
+#include <libweston/zalloc.h>
+#include "pick-grid.h"
+#include "shared/helpers.h"
+
+/* 128x128 pixel cells */
+#define CELL_SHIFT 7
+#define CELL_SIZE (1 << CELL_SHIFT)
+
+struct weston_pick_grid {
+	bool valid;
+	uint32_t serial;
+
+	/* Global coordinates of the top-left corner of cell (0, 0) */
+	int32_t x, y;
+	int32_t cols, rows;
+
+	/* cols * rows arrays of struct weston_view * */
+	struct wl_array *cells;
+	size_t cells_alloc;
+};
+
+struct weston_pick_grid *
+weston_pick_grid_create(void)
+{
+	return zalloc(sizeof(struct weston_pick_grid));
+}
+
+void
+weston_pick_grid_destroy(struct weston_pick_grid *grid)
+{
+	size_t i;
+
+	if (!grid)
+		return;
+
+	for (i = 0; i < grid->cells_alloc; i++)
+		wl_array_release(&grid->cells[i]);
+	free(grid->cells);
+	free(grid);
+}
+
+/** Mark the grid stale
+ *
+ * Must be called whenever views are added to or removed from
+ * weston_compositor::view_list, or their order changes.
+ */
+void
+weston_pick_grid_invalidate(struct weston_pick_grid *grid)
+{
+	grid->valid = false;
+}
+
+static int32_t
+cell_index(int64_t coord, int32_t origin, int32_t count)
+{
+	int64_t d = coord - origin;
+	int64_t i;
+
+	/* floor division */
+	if (d >= 0)
+		i = d / CELL_SIZE;
+	else
+		i = -((-d + CELL_SIZE - 1) / CELL_SIZE);
+
+	if (i < 0)
+		return 0;
+	if (i > count)
+		return count;
+	return i;
+}
+
+static void
+view_cell_range(struct weston_pick_grid *grid, struct weston_view *view)
+{
+	pixman_box32_t *box;
+
+	view->pick.x1 = view->pick.x2 = 0;
+	view->pick.y1 = view->pick.y2 = 0;
+
+	if (!pixman_region32_not_empty(&view->transform.boundingbox))
+		return;
+
+	box = pixman_region32_extents(&view->transform.boundingbox);
+	view->pick.x1 = cell_index(box->x1, grid->x, grid->cols);
+	view->pick.x2 = cell_index((int64_t)box->x2 - 1, grid->x,
+				   grid->cols - 1) + 1;
+	view->pick.y1 = cell_index(box->y1, grid->y, grid->rows);
+	view->pick.y2 = cell_index((int64_t)box->y2 - 1, grid->y,
+				   grid->rows - 1) + 1;
+
+	/* Entirely outside of the grid */
+	if (box->x2 <= grid->x || box->y2 <= grid->y ||
+	    view->pick.x1 >= grid->cols || view->pick.y1 >= grid->rows) {
+		view->pick.x1 = view->pick.x2 = 0;
+		view->pick.y1 = view->pick.y2 = 0;
+	}
+}
+
+static bool
+cell_insert(struct wl_array *cell, struct weston_view *view)
+{
+	struct weston_view **views;
+	size_t i;
+
+	if (!wl_array_add(cell, sizeof view))
+		return false;
+
+	/* Keep view list order; appending is the common case. */
+	views = cell->data;
+	i = cell->size / sizeof view - 1;
+	for (; i > 0 && views[i - 1]->pick.order > view->pick.order; i--)
+		views[i] = views[i - 1];
+	views[i] = view;
+
+	return true;
+}
+
+static void
+cell_remove(struct wl_array *cell, struct weston_view *view)
+{
+	struct weston_view **views = cell->data;
+	size_t n = cell->size / sizeof view;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (views[i] != view)
+			continue;
+
+		memmove(&views[i], &views[i + 1],
+			(n - i - 1) * sizeof view);
+		cell->size -= sizeof view;
+		return;
+	}
+}
+
+/* Disable the grid until the next rebuild, all lookups miss. */
+static void
+grid_disable(struct weston_pick_grid *grid)
+{
+	grid->cols = 0;
+	grid->rows = 0;
+}
+
+static void
+grid_insert_view(struct weston_pick_grid *grid, struct weston_view *view)
+{
+	int32_t cx, cy;
+
+	view_cell_range(grid, view);
+
+	for (cy = view->pick.y1; cy < view->pick.y2; cy++) {
+		for (cx = view->pick.x1; cx < view->pick.x2; cx++) {
+			struct wl_array *cell =
+				&grid->cells[cy * grid->cols + cx];
+
+			if (!cell_insert(cell, view)) {
+				grid_disable(grid);
+				return;
+			}
+		}
+	}
+}
+
+static void
+grid_remove_view(struct weston_pick_grid *grid, struct weston_view *view)
+{
+	int32_t cx, cy;
+
+	for (cy = view->pick.y1; cy < view->pick.y2; cy++)
+		for (cx = view->pick.x1; cx < view->pick.x2; cx++)
+			cell_remove(&grid->cells[cy * grid->cols + cx], view);
+}
+
+static void
+grid_rebuild(struct weston_pick_grid *grid,
+	     struct weston_compositor *compositor)
+{
+	struct weston_output *output;
+	struct weston_view *view;
+	pixman_box32_t ext = { 0, 0, 0, 0 };
+	bool have_output = false;
+	size_t n_cells;
+	uint32_t order = 0;
+	size_t i;
+
+	wl_list_for_each(output, &compositor->output_list, link) {
+		if (!have_output) {
+			ext.x1 = output->x;
+			ext.y1 = output->y;
+			ext.x2 = output->x + output->width;
+			ext.y2 = output->y + output->height;
+			have_output = true;
+			continue;
+		}
+
+		ext.x1 = MIN(ext.x1, output->x);
+		ext.y1 = MIN(ext.y1, output->y);
+		ext.x2 = MAX(ext.x2, output->x + output->width);
+		ext.y2 = MAX(ext.y2, output->y + output->height);
+	}
+
+	grid->valid = true;
+	grid->serial++;
+	grid->x = ext.x1;
+	grid->y = ext.y1;
+	grid->cols = (ext.x2 - ext.x1 + CELL_SIZE - 1) / CELL_SIZE;
+	grid->rows = (ext.y2 - ext.y1 + CELL_SIZE - 1) / CELL_SIZE;
+	n_cells = (size_t)grid->cols * grid->rows;
+
+	if (n_cells > grid->cells_alloc) {
+		struct wl_array *cells;
+
+		cells = realloc(grid->cells, n_cells * sizeof *cells);
+		if (!cells) {
+			grid_disable(grid);
+			return;
+		}
+
+		for (i = grid->cells_alloc; i < n_cells; i++)
+			wl_array_init(&cells[i]);
+
+		grid->cells = cells;
+		grid->cells_alloc = n_cells;
+	}
+
+	for (i = 0; i < n_cells; i++)
+		grid->cells[i].size = 0;
+
+	wl_list_for_each(view, &compositor->view_list, link) {
+		view->pick.serial = grid->serial;
+		view->pick.order = order++;
+		grid_insert_view(grid, view);
+		if (grid->cols == 0)
+			return;
+	}
+}
+
+/** Move a view to the cells of its new bounding box
+ *
+ * Called after weston_view_update_transform() has recomputed the bounding
+ * box. Views not indexed by the current grid are ignored.
+ */
+void
+weston_pick_grid_update_view(struct weston_pick_grid *grid,
+			     struct weston_view *view)
+{
+	if (!grid->valid || grid->cols == 0 ||
+	    view->pick.serial != grid->serial)
+		return;
+
+	grid_remove_view(grid, view);
+	grid_insert_view(grid, view);
+}
+
+/** Find the candidate views for input at a point
+ *
+ * \param grid The picking grid.
+ * \param compositor The compositor whose view list the grid mirrors.
+ * \param x Global X coordinate.
+ * \param y Global Y coordinate.
+ * \param[out] views The views whose bounding box may contain the point,
+ * in view list order.
+ * \param[out] n_views Number of elements in \c views.
+ * \return False if the point is not covered by the grid, in which case
+ * the caller must walk the whole view list instead.
+ */
+bool
+weston_pick_grid_lookup(struct weston_pick_grid *grid,
+			struct weston_compositor *compositor,
+			int32_t x, int32_t y,
+			struct weston_view ***views, size_t *n_views)
+{
+	struct wl_array *cell;
+	int64_t cx, cy;
+
+	if (!grid->valid)
+		grid_rebuild(grid, compositor);
+
+	cx = (int64_t)x - grid->x;
+	cy = (int64_t)y - grid->y;
+	if (cx < 0 || cy < 0)
+		return false;
+
+	cx /= CELL_SIZE;
+	cy /= CELL_SIZE;
+	if (cx >= grid->cols || cy >= grid->rows)
+		return false;
+
+	cell = &grid->cells[cy * grid->cols + cx];
+	*views = cell->data;
+	*n_views = cell->size / sizeof **views;
+
+	return true;
+}
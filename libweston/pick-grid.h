@@ -0,0 +1,56 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_PICK_GRID_H
+#define WESTON_PICK_GRID_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct weston_compositor;
+struct weston_pick_grid;
+struct weston_view;
+
+struct weston_pick_grid *
+weston_pick_grid_create(void);
+
+void
+weston_pick_grid_destroy(struct weston_pick_grid *grid);
+
+void
+weston_pick_grid_invalidate(struct weston_pick_grid *grid);
+
+void
+weston_pick_grid_update_view(struct weston_pick_grid *grid,
+			     struct weston_view *view);
+
+bool
+weston_pick_grid_lookup(struct weston_pick_grid *grid,
+			struct weston_compositor *compositor,
+			int32_t x, int32_t y,
+			struct weston_view ***views, size_t *n_views);
+
+#endif /* WESTON_PICK_GRID_H */
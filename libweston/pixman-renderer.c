@@ -28,6 +28,8 @@
 #include "config.h"
 
 #include <errno.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -38,17 +40,34 @@
 
 #include <linux/input.h>
 
+/* Frames of damage history, enough for triple buffering */
+#define BUFFER_DAMAGE_COUNT 3
+
+/* A hw buffer the renderer has drawn into, for its buffer age */
+struct pixman_hw_buffer {
+	pixman_image_t *image;	/* referenced, so the pointer stays unique */
+	uint64_t frame;		/* frame_count when last drawn into */
+};
+
 struct pixman_output_state {
 	void *shadow_buffer;
 	pixman_image_t *shadow_image;
 	pixman_image_t *hw_buffer;
 	pixman_region32_t *hw_extra_damage;
+
+	struct pixman_hw_buffer hw_buffers[BUFFER_DAMAGE_COUNT + 1];
+	uint64_t frame_count;
+	pixman_region32_t buffer_damage[BUFFER_DAMAGE_COUNT];
+	int buffer_damage_index;
 };
 
 struct pixman_surface_state {
 	struct weston_surface *surface;
 
 	pixman_image_t *image;
+	/* Valid when image is a solid fill from surface_set_color */
+	bool is_solid;
+	pixman_color_t solid_color;
 	struct weston_buffer_reference buffer_ref;
 	struct weston_buffer_release_reference buffer_release_ref;
 
@@ -57,6 +76,38 @@ struct pixman_surface_state {
 	struct wl_listener renderer_destroy_listener;
 };
 
+/* A horizontal band of an output composited by one thread */
+struct pixman_band {
+	/* Private image on the pixels of the render target */
+	pixman_image_t *target;
+	/* The rows of the band, in output coordinates */
+	pixman_region32_t region;
+	/* Largest composite_clipped() overdraw seen */
+	int overdraw;
+};
+
+struct pixman_band_job {
+	struct weston_output *output;
+	pixman_region32_t *damage;
+	struct pixman_band *bands;
+	int n_bands;
+	int next;
+	int done;
+};
+
+/* Worker threads compositing the bands of an output along with the
+ * main thread. */
+struct pixman_thread_pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	struct pixman_band_job *job;
+	bool quit;
+
+	pthread_t *threads;
+	int n_threads;
+};
+
 struct pixman_renderer {
 	struct weston_renderer base;
 
@@ -64,9 +115,21 @@ struct pixman_renderer {
 	pixman_image_t *debug_color;
 	struct weston_binding *debug_binding;
 
+	struct pixman_thread_pool *pool;
+
 	struct wl_signal destroy_signal;
 };
 
+/* A band is at least this many rows high */
+#define MIN_BAND_ROWS 8
+
+/* Bands per thread, to even out unequally damaged bands */
+#define BANDS_PER_THREAD 2
+
+static const pixman_color_t debug_red = {
+	0x3fff, 0x0000, 0x0000, 0x3fff
+};
+
 static inline struct pixman_output_state *
 get_output_state(struct weston_output *output)
 {
@@ -230,6 +293,20 @@ composite_whole(pixman_op_t op,
 }
 
 static void
+warn_overdraw(int n_box)
+{
+	static bool warned = false;
+
+	if (n_box <= 1)
+		return;
+
+	if (!warned)
+		weston_log("Pixman-renderer warning: %dx overdraw\n", n_box);
+	warned = true;
+}
+
+/* Returns the number of times the destination was painted over. */
+static int
 composite_clipped(pixman_image_t *src,
 		  pixman_image_t *mask,
 		  pixman_image_t *dest,
@@ -298,14 +375,26 @@ composite_clipped(pixman_image_t *src,
 		pixman_image_unref(boximg);
 	}
 
-	if (n_box > 1) {
-		static bool warned = false;
+	return n_box;
+}
 
-		if (!warned)
-			weston_log("Pixman-renderer warning: %dx overdraw\n",
-				   n_box);
-		warned = true;
-	}
+/* An image of the surface contents that only the calling thread uses
+ *
+ * Compositing changes the transform and filter of the source image, so
+ * bands rendered in parallel each need their own image on the same pixels.
+ */
+static pixman_image_t *
+surface_image_for_band(struct pixman_surface_state *ps)
+{
+	if (ps->is_solid)
+		return pixman_image_create_solid_fill(&ps->solid_color);
+
+	return pixman_image_create_bits_no_clear(
+			pixman_image_get_format(ps->image),
+			pixman_image_get_width(ps->image),
+			pixman_image_get_height(ps->image),
+			pixman_image_get_data(ps->image),
+			pixman_image_get_stride(ps->image));
 }
 
 /** Paint an intersected region
@@ -316,12 +405,15 @@ composite_clipped(pixman_image_t *src,
  * \param source_clip The region of the source image to use, in source image
  *                    coordinates. If NULL, use the whole source image.
  * \param pixman_op Compositing operator, either SRC or OVER.
+ * \param band The band to restrict painting to, or NULL to paint
+ *             on the main thread without restriction.
  */
 static void
 repaint_region(struct weston_view *ev, struct weston_output *output,
 	       pixman_region32_t *repaint_output,
 	       pixman_region32_t *source_clip,
-	       pixman_op_t pixman_op)
+	       pixman_op_t pixman_op,
+	       struct pixman_band *band)
 {
 	struct pixman_renderer *pr =
 		(struct pixman_renderer *) output->compositor->renderer;
@@ -329,15 +421,36 @@ repaint_region(struct weston_view *ev, struct weston_output *output,
 	struct pixman_output_state *po = get_output_state(output);
 	struct weston_buffer_viewport *vp = &ev->surface->buffer_viewport;
 	pixman_image_t *target_image;
+	pixman_image_t *src_image;
+	pixman_image_t *debug_image;
+	pixman_region32_t band_clip;
 	pixman_transform_t transform;
 	pixman_filter_t filter;
 	pixman_image_t *mask_image;
 	pixman_color_t mask = { 0, };
+	int n_box;
 
-	if (po->shadow_image)
-		target_image = po->shadow_image;
-	else
-		target_image = po->hw_buffer;
+	if (band) {
+		pixman_region32_init(&band_clip);
+		pixman_region32_intersect(&band_clip, repaint_output,
+					  &band->region);
+		src_image = NULL;
+		if (pixman_region32_not_empty(&band_clip))
+			src_image = surface_image_for_band(ps);
+		if (!src_image) {
+			pixman_region32_fini(&band_clip);
+			return;
+		}
+
+		target_image = band->target;
+		repaint_output = &band_clip;
+	} else {
+		if (po->shadow_image)
+			target_image = po->shadow_image;
+		else
+			target_image = po->hw_buffer;
+		src_image = ps->image;
+	}
 
  	/* Clip rendering to the damaged output region */
 	pixman_image_set_clip_region32(target_image, repaint_output);
@@ -359,12 +472,17 @@ repaint_region(struct weston_view *ev, struct weston_output *output,
 		mask_image = NULL;
 	}
 
-	if (source_clip)
-		composite_clipped(ps->image, mask_image, target_image,
-				  &transform, filter, source_clip);
-	else
-		composite_whole(pixman_op, ps->image, mask_image,
+	if (source_clip) {
+		n_box = composite_clipped(src_image, mask_image, target_image,
+					  &transform, filter, source_clip);
+		if (band)
+			band->overdraw = MAX(band->overdraw, n_box);
+		else
+			warn_overdraw(n_box);
+	} else {
+		composite_whole(pixman_op, src_image, mask_image,
 				target_image, &transform, filter);
+	}
 
 	if (mask_image)
 		pixman_image_unref(mask_image);
@@ -372,9 +490,14 @@ repaint_region(struct weston_view *ev, struct weston_output *output,
 	if (ps->buffer_ref.buffer)
 		wl_shm_buffer_end_access(ps->buffer_ref.buffer->shm_buffer);
 
-	if (pr->repaint_debug)
+	if (pr->repaint_debug) {
+		if (band)
+			debug_image = pixman_image_create_solid_fill(&debug_red);
+		else
+			debug_image = pr->debug_color;
+
 		pixman_image_composite32(PIXMAN_OP_OVER,
-					 pr->debug_color, /* src */
+					 debug_image, /* src */
 					 NULL /* mask */,
 					 target_image, /* dest */
 					 0, 0, /* src_x, src_y */
@@ -383,12 +506,22 @@ repaint_region(struct weston_view *ev, struct weston_output *output,
 					 pixman_image_get_width (target_image), /* width */
 					 pixman_image_get_height (target_image) /* height */);
 
+		if (band)
+			pixman_image_unref(debug_image);
+	}
+
 	pixman_image_set_clip_region32(target_image, NULL);
+
+	if (band) {
+		pixman_image_unref(src_image);
+		pixman_region32_fini(&band_clip);
+	}
 }
 
 static void
 draw_view_translated(struct weston_view *view, struct weston_output *output,
-		     pixman_region32_t *repaint_global)
+		     pixman_region32_t *repaint_global,
+		     struct pixman_band *band)
 {
 	struct weston_surface *surface = view->surface;
 	/* non-opaque region in surface coordinates: */
@@ -417,7 +550,7 @@ draw_view_translated(struct weston_view *view, struct weston_output *output,
 							 &repaint_output);
 
 			repaint_region(view, output, &repaint_output, NULL,
-				       PIXMAN_OP_SRC);
+				       PIXMAN_OP_SRC, band);
 		}
 	}
 
@@ -428,7 +561,7 @@ draw_view_translated(struct weston_view *view, struct weston_output *output,
 		weston_output_region_from_global(output, &repaint_output);
 
 		repaint_region(view, output, &repaint_output, NULL,
-			       PIXMAN_OP_OVER);
+			       PIXMAN_OP_OVER, band);
 	}
 
 	pixman_region32_fini(&surface_blend);
@@ -438,7 +571,8 @@ draw_view_translated(struct weston_view *view, struct weston_output *output,
 static void
 draw_view_source_clipped(struct weston_view *view,
 			 struct weston_output *output,
-			 pixman_region32_t *repaint_global)
+			 pixman_region32_t *repaint_global,
+			 struct pixman_band *band)
 {
 	struct weston_surface *surface = view->surface;
 	pixman_region32_t surf_region;
@@ -464,7 +598,7 @@ draw_view_source_clipped(struct weston_view *view,
 	weston_output_region_from_global(output, &repaint_output);
 
 	repaint_region(view, output, &repaint_output, &buffer_region,
-		       PIXMAN_OP_OVER);
+		       PIXMAN_OP_OVER, band);
 
 	pixman_region32_fini(&repaint_output);
 	pixman_region32_fini(&buffer_region);
@@ -473,7 +607,8 @@ draw_view_source_clipped(struct weston_view *view,
 
 static void
 draw_paint_node(struct weston_paint_node *pnode,
-		pixman_region32_t *damage /* in global coordinates */)
+		pixman_region32_t *damage /* in global coordinates */,
+		struct pixman_band *band)
 {
 	struct pixman_surface_state *ps = get_surface_state(pnode->surface);
 	/* repaint bounding region in global coordinates: */
@@ -504,7 +639,8 @@ draw_paint_node(struct weston_paint_node *pnode,
 		 * Also the boundingbox is accurate rather than an
 		 * approximation.
 		 */
-		draw_view_translated(pnode->view, pnode->output, &repaint);
+		draw_view_translated(pnode->view, pnode->output, &repaint,
+				     band);
 	} else {
 		/* The complex case: the view transformation does not allow
 		 * converting opaque etc. regions into global coordinate space.
@@ -513,14 +649,18 @@ draw_paint_node(struct weston_paint_node *pnode,
 		 * to be used whole. Source clipping does not work with
 		 * PIXMAN_OP_SRC.
 		 */
-		draw_view_source_clipped(pnode->view, pnode->output, &repaint);
+		draw_view_source_clipped(pnode->view, pnode->output, &repaint,
+					 band);
 	}
 
 out:
 	pixman_region32_fini(&repaint);
 }
+
 static void
-repaint_surfaces(struct weston_output *output, pixman_region32_t *damage)
+repaint_surfaces_band(struct weston_output *output,
+		      pixman_region32_t *damage,
+		      struct pixman_band *band)
 {
 	struct weston_compositor *compositor = output->compositor;
 	struct weston_paint_node *pnode;
@@ -528,8 +668,270 @@ repaint_surfaces(struct weston_output *output, pixman_region32_t *damage)
 	wl_list_for_each_reverse(pnode, &output->paint_node_z_order_list,
 				 z_order_link) {
 		if (pnode->view->plane == &compositor->primary_plane)
-			draw_paint_node(pnode, damage);
+			draw_paint_node(pnode, damage, band);
+	}
+}
+
+/* Composite the bands of the current job until none are left.
+ * Called with the pool mutex locked. */
+static void
+thread_pool_run_bands(struct pixman_thread_pool *pool)
+{
+	struct pixman_band_job *job = pool->job;
+
+	while (job->next < job->n_bands) {
+		struct pixman_band *band = &job->bands[job->next++];
+
+		pthread_mutex_unlock(&pool->mutex);
+		repaint_surfaces_band(job->output, job->damage, band);
+		pthread_mutex_lock(&pool->mutex);
+
+		if (++job->done == job->n_bands)
+			pthread_cond_signal(&pool->done_cond);
+	}
+}
+
+static void *
+thread_pool_worker(void *data)
+{
+	struct pixman_thread_pool *pool = data;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		while (!pool->quit &&
+		       !(pool->job && pool->job->next < pool->job->n_bands))
+			pthread_cond_wait(&pool->work_cond, &pool->mutex);
+
+		if (pool->quit)
+			break;
+
+		thread_pool_run_bands(pool);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+static void
+thread_pool_destroy(struct pixman_thread_pool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->n_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool);
+}
+
+static struct pixman_thread_pool *
+thread_pool_create(int n_threads)
+{
+	struct pixman_thread_pool *pool;
+	sigset_t mask, old_mask;
+	int i;
+
+	pool = zalloc(sizeof *pool);
+	if (!pool)
+		return NULL;
+
+	pool->threads = calloc(n_threads, sizeof pool->threads[0]);
+	if (!pool->threads) {
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	/* Leave asynchronous signals to the main thread. SIGBUS must stay
+	 * deliverable for wl_shm_buffer_begin_access() to work. */
+	sigfillset(&mask);
+	sigdelset(&mask, SIGBUS);
+	sigdelset(&mask, SIGSEGV);
+	sigdelset(&mask, SIGFPE);
+	sigdelset(&mask, SIGILL);
+	pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+
+	for (i = 0; i < n_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL,
+				   thread_pool_worker, pool) != 0)
+			break;
+		pool->n_threads++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+	if (pool->n_threads == 0) {
+		thread_pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+/* Split the output into horizontal bands and composite them in parallel.
+ * Every band composites the full z-order list clipped to its rows, which
+ * gives exactly the same pixels as compositing the output in one go. */
+static void
+repaint_surfaces_threaded(struct weston_output *output,
+			  pixman_region32_t *damage,
+			  pixman_image_t *target_image)
+{
+	struct pixman_renderer *pr = get_renderer(output->compositor);
+	struct pixman_thread_pool *pool = pr->pool;
+	struct weston_paint_node *pnode;
+	struct pixman_band_job job = { 0 };
+	struct pixman_band *bands;
+	pixman_region32_t damage_output;
+	int width = pixman_image_get_width(target_image);
+	int height = pixman_image_get_height(target_image);
+	int band_rows;
+	int n_bands;
+	int overdraw = 0;
+	int i;
+
+	n_bands = (pool->n_threads + 1) * BANDS_PER_THREAD;
+	band_rows = MAX(MIN_BAND_ROWS, (height + n_bands - 1) / n_bands);
+	n_bands = (height + band_rows - 1) / band_rows;
+
+	bands = calloc(n_bands, sizeof *bands);
+	if (!bands) {
+		repaint_surfaces_band(output, damage, NULL);
+		return;
+	}
+
+	/* Surface state is created on demand, do it before threading. */
+	wl_list_for_each(pnode, &output->paint_node_z_order_list, z_order_link)
+		get_surface_state(pnode->surface);
+
+	pixman_region32_init(&damage_output);
+	pixman_region32_copy(&damage_output, damage);
+	weston_output_region_from_global(output, &damage_output);
+
+	for (i = 0; i < n_bands; i++) {
+		struct pixman_band *band = &bands[job.n_bands];
+		int y1 = i * band_rows;
+		int y2 = MIN(height, y1 + band_rows);
+		pixman_box32_t box = { 0, y1, width, y2 };
+
+		if (pixman_region32_contains_rectangle(&damage_output, &box) ==
+		    PIXMAN_REGION_OUT)
+			continue;
+
+		band->target = pixman_image_create_bits_no_clear(
+				pixman_image_get_format(target_image),
+				width, height,
+				pixman_image_get_data(target_image),
+				pixman_image_get_stride(target_image));
+		if (!band->target)
+			break;
+
+		pixman_region32_init_rect(&band->region, 0, y1, width, y2 - y1);
+		job.n_bands++;
+	}
+	pixman_region32_fini(&damage_output);
+
+	if (i < n_bands) {
+		/* Out of memory, paint whatever the bands would have. */
+		repaint_surfaces_band(output, damage, NULL);
+	} else if (job.n_bands > 0) {
+		job.output = output;
+		job.damage = damage;
+		job.bands = bands;
+
+		pthread_mutex_lock(&pool->mutex);
+		pool->job = &job;
+		pthread_cond_broadcast(&pool->work_cond);
+		thread_pool_run_bands(pool);
+		while (job.done < job.n_bands)
+			pthread_cond_wait(&pool->done_cond, &pool->mutex);
+		pool->job = NULL;
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	for (i = 0; i < job.n_bands; i++) {
+		overdraw = MAX(overdraw, bands[i].overdraw);
+		pixman_image_unref(bands[i].target);
+		pixman_region32_fini(&bands[i].region);
 	}
+	free(bands);
+
+	warn_overdraw(overdraw);
+}
+
+static void
+repaint_surfaces(struct weston_output *output, pixman_region32_t *damage)
+{
+	struct pixman_renderer *pr = get_renderer(output->compositor);
+	struct pixman_output_state *po = get_output_state(output);
+	pixman_image_t *target_image;
+
+	if (po->shadow_image)
+		target_image = po->shadow_image;
+	else
+		target_image = po->hw_buffer;
+
+	if (pr->pool &&
+	    pixman_image_get_height(target_image) >= 2 * MIN_BAND_ROWS)
+		repaint_surfaces_threaded(output, damage, target_image);
+	else
+		repaint_surfaces_band(output, damage, NULL);
+}
+
+/* Composite the views of all planes into the caller's pixels as one
+ * band covering the whole output. Pixman is done right away, so the
+ * capture completes before this returns. */
+static int
+pixman_renderer_capture_output_async(struct weston_output *output,
+				     pixman_format_code_t format,
+				     void *pixels,
+				     weston_read_pixels_done_func_t done,
+				     void *data)
+{
+	struct pixman_output_state *po = get_output_state(output);
+	struct weston_paint_node *pnode;
+	struct pixman_band band = { 0 };
+	pixman_color_t black = { 0, 0, 0, 0xffff };
+	pixman_rectangle16_t rect;
+	int width, height;
+
+	if (!po->hw_buffer)
+		return -1;
+
+	width = pixman_image_get_width(po->hw_buffer);
+	height = pixman_image_get_height(po->hw_buffer);
+
+	band.target = pixman_image_create_bits(format, width, height, pixels,
+					       (PIXMAN_FORMAT_BPP(format) / 8) *
+					       width);
+	if (!band.target)
+		return -1;
+
+	rect = (pixman_rectangle16_t) { 0, 0, width, height };
+	pixman_image_fill_rectangles(PIXMAN_OP_SRC, band.target, &black,
+				     1, &rect);
+
+	pixman_region32_init_rect(&band.region, 0, 0, width, height);
+	wl_list_for_each_reverse(pnode, &output->paint_node_z_order_list,
+				 z_order_link)
+		draw_paint_node(pnode, &output->region, &band);
+	pixman_region32_fini(&band.region);
+
+	pixman_image_unref(band.target);
+
+	done(data, true);
+
+	return 0;
 }
 
 static void
@@ -559,6 +961,86 @@ copy_to_hw_buffer(struct weston_output *output, pixman_region32_t *region)
 	pixman_image_set_clip_region32 (po->hw_buffer, NULL);
 }
 
+static struct pixman_hw_buffer *
+output_find_hw_buffer(struct pixman_output_state *po, pixman_image_t *image)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_LENGTH(po->hw_buffers); i++) {
+		if (po->hw_buffers[i].image == image)
+			return &po->hw_buffers[i];
+	}
+
+	return NULL;
+}
+
+/* How many frames ago the current hw buffer was drawn into, 0 if never */
+static uint64_t
+output_get_buffer_age(struct pixman_output_state *po)
+{
+	struct pixman_hw_buffer *hb;
+
+	hb = output_find_hw_buffer(po, po->hw_buffer);
+	if (!hb)
+		return 0;
+
+	return po->frame_count - hb->frame;
+}
+
+/* The damage the current hw buffer has missed since it was last drawn
+ * into, in global coordinates. */
+static void
+output_get_damage(struct weston_output *output,
+		  pixman_region32_t *buffer_damage)
+{
+	struct pixman_output_state *po = get_output_state(output);
+	uint64_t buffer_age = output_get_buffer_age(po);
+	unsigned int i;
+
+	if (buffer_age == 0 || buffer_age - 1 > BUFFER_DAMAGE_COUNT) {
+		pixman_region32_copy(buffer_damage, &output->region);
+		return;
+	}
+
+	for (i = 0; i < buffer_age - 1; i++)
+		pixman_region32_union(buffer_damage, buffer_damage,
+				      &po->buffer_damage[(po->buffer_damage_index + i) % BUFFER_DAMAGE_COUNT]);
+}
+
+/* Record the frame's damage and that the current hw buffer is now up to
+ * date. Buffers not seen for the longest time make room for new ones. */
+static void
+output_rotate_damage(struct weston_output *output,
+		     pixman_region32_t *output_damage)
+{
+	struct pixman_output_state *po = get_output_state(output);
+	struct pixman_hw_buffer *hb;
+	unsigned int i;
+
+	po->buffer_damage_index += BUFFER_DAMAGE_COUNT - 1;
+	po->buffer_damage_index %= BUFFER_DAMAGE_COUNT;
+	pixman_region32_copy(&po->buffer_damage[po->buffer_damage_index],
+			     output_damage);
+
+	hb = output_find_hw_buffer(po, po->hw_buffer);
+	if (!hb) {
+		hb = &po->hw_buffers[0];
+		for (i = 1; i < ARRAY_LENGTH(po->hw_buffers); i++) {
+			if (!hb->image)
+				break;
+			if (!po->hw_buffers[i].image ||
+			    po->hw_buffers[i].frame < hb->frame)
+				hb = &po->hw_buffers[i];
+		}
+
+		if (hb->image)
+			pixman_image_unref(hb->image);
+		hb->image = pixman_image_ref(po->hw_buffer);
+	}
+
+	hb->frame = po->frame_count++;
+}
+
 static void
 pixman_renderer_repaint_output(struct weston_output *output,
 			       pixman_region32_t *output_damage)
@@ -574,13 +1056,15 @@ pixman_renderer_repaint_output(struct weston_output *output,
  		return;
 	}
 
+	/* Bring the hw buffer up to date: this frame's damage and
+	 * everything that changed since the buffer was last used. */
 	pixman_region32_init(&hw_damage);
+	output_get_damage(output, &hw_damage);
+	pixman_region32_union(&hw_damage, &hw_damage, output_damage);
 	if (po->hw_extra_damage) {
 		pixman_region32_union(&hw_damage,
-				      po->hw_extra_damage, output_damage);
+				      &hw_damage, po->hw_extra_damage);
 		po->hw_extra_damage = NULL;
-	} else {
-		pixman_region32_copy(&hw_damage, output_damage);
 	}
 
 	if (po->shadow_image) {
@@ -591,6 +1075,8 @@ pixman_renderer_repaint_output(struct weston_output *output,
 	}
 	pixman_region32_fini(&hw_damage);
 
+	output_rotate_damage(output, output_damage);
+
 	wl_signal_emit(&output->frame_signal, output_damage);
 
 	/* Actual flip should be done by caller */
@@ -638,6 +1124,7 @@ pixman_renderer_attach(struct weston_surface *es, struct weston_buffer *buffer)
 		pixman_image_unref(ps->image);
 		ps->image = NULL;
 	}
+	ps->is_solid = false;
 
 	if (!buffer)
 		return;
@@ -778,6 +1265,8 @@ pixman_renderer_surface_set_color(struct weston_surface *es,
 	}
 
 	ps->image = pixman_image_create_solid_fill(&color);
+	ps->is_solid = true;
+	ps->solid_color = color;
 }
 
 static void
@@ -787,6 +1276,8 @@ pixman_renderer_destroy(struct weston_compositor *ec)
 
 	wl_signal_emit(&pr->destroy_signal, pr);
 	weston_binding_destroy(pr->debug_binding);
+	if (pr->pool)
+		thread_pool_destroy(pr->pool);
 	free(pr);
 
 	ec->renderer = NULL;
@@ -849,11 +1340,7 @@ debug_binding(struct weston_keyboard *keyboard, const struct timespec *time,
 	pr->repaint_debug ^= 1;
 
 	if (pr->repaint_debug) {
-		pixman_color_t red = {
-			0x3fff, 0x0000, 0x0000, 0x3fff
-		};
-
-		pr->debug_color = pixman_image_create_solid_fill(&red);
+		pr->debug_color = pixman_image_create_solid_fill(&debug_red);
 	} else {
 		pixman_image_unref(pr->debug_color);
 		weston_compositor_damage_all(ec);
@@ -872,6 +1359,8 @@ pixman_renderer_init(struct weston_compositor *ec)
 	renderer->repaint_debug = 0;
 	renderer->debug_color = NULL;
 	renderer->base.read_pixels = pixman_renderer_read_pixels;
+	renderer->base.capture_output_async =
+		pixman_renderer_capture_output_async;
 	renderer->base.repaint_output = pixman_renderer_repaint_output;
 	renderer->base.flush_damage = pixman_renderer_flush_damage;
 	renderer->base.attach = pixman_renderer_attach;
@@ -893,9 +1382,30 @@ pixman_renderer_init(struct weston_compositor *ec)
 
 	wl_signal_init(&renderer->destroy_signal);
 
+	if (ec->pixman_threads > 1) {
+		/* The main thread composites too. */
+		renderer->pool = thread_pool_create(ec->pixman_threads - 1);
+		if (renderer->pool)
+			weston_log("Pixman renderer compositing with %d threads\n",
+				   renderer->pool->n_threads + 1);
+		else
+			weston_log("Pixman renderer failed to start worker "
+				   "threads, compositing on the main thread\n");
+	}
+
 	return 0;
 }
 
+/** Set the image the next repaint of the output draws into
+ *
+ * \param output The output.
+ * \param buffer The hw buffer image, or NULL.
+ *
+ * The renderer remembers the last few buffers it drew into and the damage
+ * of the frames since, so a backend cycling through a swap chain of images
+ * only gets the regions repainted each image has missed. Unknown images
+ * are repainted whole.
+ */
 WL_EXPORT void
 pixman_renderer_output_set_buffer(struct weston_output *output,
 				  pixman_image_t *buffer)
@@ -927,11 +1437,15 @@ pixman_renderer_output_create(struct weston_output *output,
 {
 	struct pixman_output_state *po;
 	int w, h;
+	int i;
 
 	po = zalloc(sizeof *po);
 	if (po == NULL)
 		return -1;
 
+	for (i = 0; i < BUFFER_DAMAGE_COUNT; i++)
+		pixman_region32_init(&po->buffer_damage[i]);
+
 	if (options->use_shadow) {
 		/* set shadow image transformation */
 		w = output->current_mode->width;
@@ -939,10 +1453,8 @@ pixman_renderer_output_create(struct weston_output *output,
 
 		po->shadow_buffer = malloc(w * h * 4);
 
-		if (!po->shadow_buffer) {
-			free(po);
-			return -1;
-		}
+		if (!po->shadow_buffer)
+			goto err;
 
 		po->shadow_image =
 			pixman_image_create_bits(PIXMAN_x8r8g8b8, w, h,
@@ -950,20 +1462,35 @@ pixman_renderer_output_create(struct weston_output *output,
 
 		if (!po->shadow_image) {
 			free(po->shadow_buffer);
-			free(po);
-			return -1;
+			goto err;
 		}
 	}
 
 	output->renderer_state = po;
 
 	return 0;
+
+err:
+	for (i = 0; i < BUFFER_DAMAGE_COUNT; i++)
+		pixman_region32_fini(&po->buffer_damage[i]);
+	free(po);
+
+	return -1;
 }
 
 WL_EXPORT void
 pixman_renderer_output_destroy(struct weston_output *output)
 {
 	struct pixman_output_state *po = get_output_state(output);
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_LENGTH(po->hw_buffers); i++) {
+		if (po->hw_buffers[i].image)
+			pixman_image_unref(po->hw_buffers[i].image);
+	}
+
+	for (i = 0; i < BUFFER_DAMAGE_COUNT; i++)
+		pixman_region32_fini(&po->buffer_damage[i]);
 
 	if (po->shadow_image)
 		pixman_image_unref(po->shadow_image);
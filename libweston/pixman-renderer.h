@@ -33,7 +33,10 @@ int
 pixman_renderer_init(struct weston_compositor *ec);
 
 struct pixman_renderer_output_options {
-	/** Composite into a shadow buffer, copying to the hardware buffer */
+	/** Composite into a shadow buffer, copying to the hardware buffer.
+	 * Only worth it when reading the hardware buffer is slow, otherwise
+	 * the renderer draws into the hardware buffers directly, tracking
+	 * their buffer age. */
 	bool use_shadow;
 };
 
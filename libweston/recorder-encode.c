@@ -0,0 +1,333 @@
+/*
+ * Copyright © 2008-2011 Kristian Høgsberg
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libweston/zalloc.h>
+#include "shared/helpers.h"
+#include "shared/wcap-format.h"
+#include "shared/wcap-rle.h"
+#include "recorder-encode.h"
+
+/** Set up encoding frames of the given size, to be written to fd
+ *
+ * \param yflip Whether the rows of the rectangles of damage come in
+ * reverse order, as with WESTON_CAP_CAPTURE_YFLIP.
+ * \return 0 on success, -1 if out of memory.
+ */
+int
+weston_recorder_encoder_init(struct weston_recorder_encoder *encoder,
+			     int fd, int width, int height, bool yflip)
+{
+	memset(encoder, 0, sizeof *encoder);
+	encoder->fd = fd;
+	encoder->width = width;
+	encoder->height = height;
+	encoder->yflip = yflip;
+	encoder->keyframe_interval = RECORDER_KEYFRAME_INTERVAL;
+	encoder->kernels = wcap_kernels_get();
+	wl_array_init(&encoder->out);
+	wl_array_init(&encoder->index);
+	/* The first frame is a key frame. */
+	encoder->since_keyframe = encoder->keyframe_interval;
+
+	encoder->frame = zalloc((size_t)width * height * 4);
+	if (!encoder->frame)
+		return -1;
+
+	return 0;
+}
+
+/* Does not close the file. */
+void
+weston_recorder_encoder_fini(struct weston_recorder_encoder *encoder)
+{
+	wl_array_release(&encoder->out);
+	wl_array_release(&encoder->index);
+	free(encoder->frame);
+}
+
+/** Write the header of the stream, before anything else
+ *
+ * \param format One of the WCAP_FORMAT_* values.
+ * \return 0 on success, -1 with errno set on failure; a short write sets
+ * errno to EIO.
+ */
+int
+weston_recorder_write_header(struct weston_recorder_encoder *encoder,
+			     uint32_t format)
+{
+	struct wcap_header header = {
+		.magic = WCAP_HEADER_MAGIC_V2,
+		.format = format,
+		.width = encoder->width,
+		.height = encoder->height,
+	};
+	ssize_t len;
+
+	do {
+		len = write(encoder->fd, &header, sizeof header);
+	} while (len < 0 && errno == EINTR);
+
+	if (len < 0)
+		return -1;
+	if (len != sizeof header) {
+		errno = EIO;
+		return -1;
+	}
+
+	encoder->total += len;
+
+	return 0;
+}
+
+/* Delta and run length encode one rectangle, read back bottom-up unless
+ * the capture is y-flipped. Every output word covers at least one pixel,
+ * so p needs room for as many words as the rectangle has pixels. */
+static uint32_t *
+weston_recorder_encode_rect(struct weston_recorder_encoder *encoder,
+			    const pixman_box32_t *r, const uint32_t *pixels,
+			    uint32_t *p)
+{
+	int width = r->x2 - r->x1;
+	int height = r->y2 - r->y1;
+	struct wcap_run run;
+	int j, y_orig;
+	uint32_t *d;
+	const uint32_t *s;
+
+	wcap_run_init(&run);
+	for (j = 0; j < height; j++) {
+		if (encoder->yflip)
+			s = pixels + width * j;
+		else
+			s = pixels + width * (height - j - 1);
+		y_orig = r->y2 - j - 1;
+		d = encoder->frame + encoder->width * y_orig + r->x1;
+
+		p = encoder->kernels->encode(p, s, d, width, &run);
+	}
+
+	return wcap_run_flush(p, &run);
+}
+
+/* Store one rectangle in the reference frame without encoding it. */
+static void
+weston_recorder_apply_rect(struct weston_recorder_encoder *encoder,
+			   const pixman_box32_t *r, const uint32_t *pixels)
+{
+	int width = r->x2 - r->x1;
+	int height = r->y2 - r->y1;
+	const uint32_t *s;
+	int j;
+
+	for (j = 0; j < height; j++) {
+		if (encoder->yflip)
+			s = pixels + width * j;
+		else
+			s = pixels + width * (height - j - 1);
+		memcpy(encoder->frame + encoder->width * (r->y2 - j - 1) +
+		       r->x1, s, width * sizeof *s);
+	}
+}
+
+/* Encode the whole reference frame against black, bottom row first. */
+static uint32_t *
+weston_recorder_encode_keyframe(struct weston_recorder_encoder *encoder,
+				uint32_t *p)
+{
+	struct wcap_run run;
+	int j;
+
+	wcap_run_init(&run);
+	for (j = encoder->height - 1; j >= 0; j--)
+		p = encoder->kernels->encode(p, encoder->frame +
+					     encoder->width * j, NULL,
+					     encoder->width, &run);
+
+	return wcap_run_flush(p, &run);
+}
+
+/* Write out everything encoded so far. */
+void
+weston_recorder_write_out(struct weston_recorder_encoder *encoder)
+{
+	const char *data = encoder->out.data;
+	size_t left = encoder->out.size;
+	ssize_t len;
+
+	while (left > 0 && encoder->write_errno == 0) {
+		len = write(encoder->fd, data, left);
+		if (len < 0) {
+			if (errno != EINTR)
+				encoder->write_errno = errno;
+			continue;
+		}
+
+		encoder->total += len;
+		data += len;
+		left -= len;
+	}
+
+	encoder->out.size = 0;
+}
+
+/* Reserve room in the output buffer, writing out what is buffered
+ * already if memory is short. Returns the offset of the reserved room
+ * from the start of the output buffer, or -1. */
+static ssize_t
+weston_recorder_reserve(struct weston_recorder_encoder *encoder, size_t size)
+{
+	size_t offset = encoder->out.size;
+
+	if (wl_array_add(&encoder->out, size))
+		return offset;
+
+	if (offset == 0)
+		return -1;
+
+	weston_recorder_write_out(encoder);
+	if (wl_array_add(&encoder->out, size))
+		return 0;
+
+	return -1;
+}
+
+/* Append one frame to the output buffer, as a key frame covering the
+ * whole output every keyframe_interval frames. The pixels are those of
+ * the rectangles of damage, one rectangle after another. */
+void
+weston_recorder_encode_capture(struct weston_recorder_encoder *encoder,
+			       uint32_t msecs, pixman_region32_t *damage,
+			       const uint32_t *pixels)
+{
+	pixman_box32_t *r;
+	pixman_box32_t full = { 0, 0, encoder->width, encoder->height };
+	struct wcap_frame_header_v2 header;
+	struct wcap_index_entry *entry;
+	bool keyframe;
+	size_t size;
+	ssize_t offset;
+	uint32_t *start, *p;
+	int i, n;
+
+	r = pixman_region32_rectangles(damage, &n);
+	keyframe = encoder->since_keyframe >= encoder->keyframe_interval;
+
+	size = sizeof header;
+	if (keyframe) {
+		size += sizeof full + (size_t)encoder->width *
+			encoder->height * 4;
+	} else {
+		size += n * sizeof *r;
+		for (i = 0; i < n; i++)
+			size += (size_t)(r[i].x2 - r[i].x1) *
+				(r[i].y2 - r[i].y1) * 4;
+	}
+
+	entry = wl_array_add(&encoder->index, sizeof *entry);
+	offset = weston_recorder_reserve(encoder, size);
+	if (!entry || offset < 0) {
+		/* Not encoding the frame keeps the stream consistent, its
+		 * pixels only show up with the next frame damaging them. */
+		if (entry)
+			encoder->index.size -= sizeof *entry;
+		return;
+	}
+	start = (uint32_t *) ((char *) encoder->out.data + offset);
+
+	header.msecs = msecs;
+	header.nrects = keyframe ? 1 : n;
+	header.flags = keyframe ? WCAP_FRAME_KEY : 0;
+	memcpy(start, &header, sizeof header);
+	p = start + sizeof header / sizeof *p;
+
+	if (keyframe) {
+		for (i = 0; i < n; i++) {
+			weston_recorder_apply_rect(encoder, &r[i], pixels);
+			pixels += (r[i].x2 - r[i].x1) * (r[i].y2 - r[i].y1);
+		}
+
+		memcpy(p, &full, sizeof full);
+		p = weston_recorder_encode_keyframe(encoder, p + 4);
+		encoder->since_keyframe = 0;
+	} else {
+		memcpy(p, r, n * sizeof *r);
+		p += n * 4;
+		for (i = 0; i < n; i++) {
+			p = weston_recorder_encode_rect(encoder, &r[i],
+							pixels, p);
+			pixels += (r[i].x2 - r[i].x1) * (r[i].y2 - r[i].y1);
+		}
+	}
+
+	entry->offset = encoder->total + offset;
+	entry->msecs = msecs;
+	entry->flags = header.flags;
+
+	encoder->out.size = offset + (p - start) * sizeof *p;
+	encoder->since_keyframe++;
+	encoder->count++;
+}
+
+/* Append the frame index and the footer pointing to it, once the last
+ * frame has been encoded. */
+void
+weston_recorder_encode_index(struct weston_recorder_encoder *encoder)
+{
+	struct wcap_index_footer footer;
+	size_t padding, size;
+	ssize_t offset;
+	char *start;
+
+	if (encoder->index.size == 0)
+		return;
+
+	/* The index is aligned for its 64 bit offsets. */
+	padding = (encoder->total + encoder->out.size) % sizeof(uint64_t);
+	if (padding)
+		padding = sizeof(uint64_t) - padding;
+
+	size = padding + encoder->index.size + sizeof footer;
+	offset = weston_recorder_reserve(encoder, size);
+	if (offset < 0)
+		return;
+	start = (char *) encoder->out.data + offset;
+
+	footer.magic = WCAP_INDEX_MAGIC;
+	footer.nframes = encoder->index.size / sizeof(struct wcap_index_entry);
+	footer.offset = encoder->total + offset + padding;
+
+	memset(start, 0, padding);
+	memcpy(start + padding, encoder->index.data, encoder->index.size);
+	memcpy(start + padding + encoder->index.size, &footer, sizeof footer);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright © 2008-2011 Kristian Høgsberg
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_RECORDER_ENCODE_H
+#define WESTON_RECORDER_ENCODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pixman.h>
+#include <wayland-util.h>
+
+struct wcap_kernels;
+
+/* Frames between key frames, which bounds the work of seeking */
+#define RECORDER_KEYFRAME_INTERVAL 120
+
+/*
+ * Encodes the frames of a recording into a wcap version 2 stream, see
+ * wcap/README. Encoded data piles up in out until it is written out to
+ * fd; the frame index is kept until the end of the stream.
+ */
+struct weston_recorder_encoder {
+	int fd;
+	int width, height;
+	bool yflip;
+	int keyframe_interval;
+
+	const struct wcap_kernels *kernels;
+	uint32_t *frame; /* what the decoder has after the last frame */
+	struct wl_array out;
+	struct wl_array index; /* struct wcap_index_entry */
+	int since_keyframe;
+	uint64_t total; /* bytes written out */
+	int count; /* frames encoded */
+	int write_errno;
+};
+
+int
+weston_recorder_encoder_init(struct weston_recorder_encoder *encoder,
+			     int fd, int width, int height, bool yflip);
+
+void
+weston_recorder_encoder_fini(struct weston_recorder_encoder *encoder);
+
+int
+weston_recorder_write_header(struct weston_recorder_encoder *encoder,
+			     uint32_t format);
+
+void
+weston_recorder_encode_capture(struct weston_recorder_encoder *encoder,
+			       uint32_t msecs, pixman_region32_t *damage,
+			       const uint32_t *pixels);
+
+void
+weston_recorder_encode_index(struct weston_recorder_encoder *encoder);
+
+void
+weston_recorder_write_out(struct weston_recorder_encoder *encoder);
+
+#endif /* WESTON_RECORDER_ENCODE_H */
@@ -34,9 +34,17 @@
 #include <wayland-util.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <GLES3/gl3.h>
 #include "shared/weston-egl-ext.h"  /* for PFN* stuff */
 #include "shared/helpers.h"
 
+#ifndef GL_EXT_buffer_storage
+#define GL_EXT_buffer_storage 1
+#define GL_MAP_PERSISTENT_BIT_EXT         0x0040
+#define GL_MAP_COHERENT_BIT_EXT           0x0080
+typedef void (GL_APIENTRYP PFNGLBUFFERSTORAGEEXTPROC) (GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+#endif
+
 enum gl_shader_texture_variant {
 	SHADER_VARIANT_NONE = 0,
 /* Keep the following in sync with fragment.glsl. */
@@ -87,6 +95,30 @@ struct gl_shader_config {
 	GLuint input_tex[GL_SHADER_INPUT_TEX_MAX];
 };
 
+#define GL_UPLOAD_RING_FENCES 32
+
+/** Staging memory for wl_shm texture uploads
+ *
+ * A pixel unpack buffer object used as a ring: uploads take their space
+ * at head, and the space is reclaimed from tail once the fence inserted
+ * after the upload has signalled.
+ */
+struct gl_upload_ring {
+	GLuint pbo;
+	size_t size;
+	uint8_t *map; /* persistent mapping, or NULL */
+
+	size_t head;
+	size_t tail;
+
+	struct {
+		GLsync sync;
+		size_t end; /* head after the fenced upload */
+	} fences[GL_UPLOAD_RING_FENCES];
+	unsigned int fence_first;
+	unsigned int fence_count;
+};
+
 struct gl_renderer {
 	struct weston_renderer base;
 	struct weston_compositor *compositor;
@@ -108,6 +140,13 @@ struct gl_renderer {
 	struct wl_array vertices;
 	struct wl_array vtxcnt;
 
+	/* Batched drawing of a whole output repaint, see batch_flush() */
+	bool batching;
+	struct wl_array batch_indices;	/* GLushort */
+	struct wl_array batch_draws;	/* struct gl_batch_draw */
+	uint32_t batch_segment;		/* vertex the indices count from */
+	GLuint batch_buffers[2];	/* vertex and index buffer objects */
+
 	struct weston_drm_format_array supported_formats;
 
 	PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture_2d;
@@ -142,6 +181,11 @@ struct gl_renderer {
 
 	bool has_gl_texture_rg;
 
+	/* GLES 3.0 pixel buffer objects for wl_shm uploads */
+	bool has_pbo_upload;
+	PFNGLBUFFERSTORAGEEXTPROC buffer_storage;
+	struct gl_upload_ring upload_ring;
+
 	struct gl_shader *current_shader;
 	struct gl_shader *fallback_shader;
 
@@ -167,6 +211,12 @@ struct gl_renderer {
 	 */
 	struct wl_list shader_list;
 	struct weston_log_scope *shader_scope;
+
+	/* On-disk program binary cache, NULL dir when disabled */
+	char *shader_cache_dir;
+	uint64_t shader_cache_salt;
+	unsigned int shader_cache_hits;
+	unsigned int shader_cache_misses;
 };
 
 static inline struct gl_renderer *
@@ -221,4 +271,13 @@ gl_renderer_use_program(struct gl_renderer *gr,
 struct weston_log_scope *
 gl_shader_scope_create(struct gl_renderer *gr);
 
+void
+gl_shader_cache_init(struct gl_renderer *gr, const char *dir);
+
+void
+gl_shader_cache_fini(struct gl_renderer *gr);
+
+void
+gl_renderer_prewarm_programs(struct gl_renderer *gr);
+
 #endif /* GL_RENDERER_INTERNAL_H */
@@ -42,6 +42,7 @@
 #include <unistd.h>
 
 #include "linux-sync-file.h"
+#include "stats.h"
 #include "timeline.h"
 
 #include "color.h"
@@ -102,7 +103,13 @@ struct gl_output_state {
 	/* struct timeline_render_point::link */
 	struct wl_list timeline_render_point_list;
 
+	/* struct gl_readback::link, oldest first */
+	struct wl_list readback_list;
+
 	struct gl_fbo_texture shadow;
+
+	/* Off-screen target of gl_renderer_capture_output_async() */
+	struct gl_fbo_texture capture;
 };
 
 enum buffer_type {
@@ -213,6 +220,42 @@ enum timeline_render_point_type {
 	TIMELINE_RENDER_POINT_TYPE_END
 };
 
+/* Indices are GLushort, so a draw can address this many vertices */
+#define BATCH_SEGMENT_VERTICES 65536
+
+/** A run of indexed triangles drawn with one shader configuration
+ *
+ * Consecutive regions sharing the shader configuration and blending state,
+ * of the same or of different views, end up in the same draw.
+ */
+struct gl_batch_draw {
+	struct gl_shader_config sconf;
+	struct weston_view *view; /* for reporting shader errors */
+	bool blend;
+	uint32_t segment; /* first vertex, the indices are relative to it */
+	uint32_t first; /* offset into gl_renderer::batch_indices */
+	uint32_t count;
+};
+
+/* Poll interval for read backs without a native fence fd */
+#define READBACK_POLL_MSEC 1
+
+/** A pending weston_renderer::read_pixels_async request */
+struct gl_readback {
+	struct wl_list link; /* gl_output_state::readback_list */
+	struct weston_output *output;
+	GLuint pbo;
+	uint32_t width, height;
+	void *pixels;
+	weston_read_pixels_done_func_t done;
+	void *data;
+
+	/* Signalled when glReadPixels() has finished, either of: */
+	int fence_fd;
+	GLsync sync;
+	struct wl_event_source *event_source;
+};
+
 struct timeline_render_point {
 	struct wl_list link; /* gl_output_state::timeline_render_point_list */
 
@@ -825,6 +868,201 @@ repaint_region(struct gl_renderer *gr,
 	gr->vtxcnt.size = 0;
 }
 
+static bool
+gl_shader_config_equal(const struct gl_shader_config *a,
+		       const struct gl_shader_config *b)
+{
+	int i;
+
+	if (memcmp(&a->req, &b->req, sizeof a->req) != 0 ||
+	    memcmp(a->projection.d, b->projection.d,
+		   sizeof a->projection.d) != 0 ||
+	    a->view_alpha != b->view_alpha ||
+	    a->input_tex_filter != b->input_tex_filter)
+		return false;
+
+	for (i = 0; i < 4; i++) {
+		if (a->unicolor[i] != b->unicolor[i])
+			return false;
+	}
+
+	for (i = 0; i < GL_SHADER_INPUT_TEX_MAX; i++) {
+		if (a->input_tex[i] != b->input_tex[i])
+			return false;
+	}
+
+	return true;
+}
+
+/* The draw new triangles with this configuration get appended to: the
+ * last one if it matches, else a new one. */
+static struct gl_batch_draw *
+batch_get_draw(struct gl_renderer *gr,
+	       struct weston_view *ev,
+	       const struct gl_shader_config *sconf,
+	       bool blend)
+{
+	struct gl_batch_draw *draw;
+
+	if (gr->batch_draws.size > 0) {
+		draw = (struct gl_batch_draw *)
+			((char *)gr->batch_draws.data +
+			 gr->batch_draws.size - sizeof *draw);
+		if (draw->segment == gr->batch_segment &&
+		    draw->blend == blend &&
+		    gl_shader_config_equal(&draw->sconf, sconf))
+			return draw;
+	}
+
+	draw = wl_array_add(&gr->batch_draws, sizeof *draw);
+	*draw = (struct gl_batch_draw) {
+		.sconf = *sconf,
+		.view = ev,
+		.blend = blend,
+		.segment = gr->batch_segment,
+		.first = gr->batch_indices.size / sizeof(GLushort),
+		.count = 0,
+	};
+
+	return draw;
+}
+
+/* Like repaint_region(), but only queues the triangles for batch_flush(),
+ * appending the vertices to the frame's vertex buffer and turning the
+ * triangle fans into indexed triangles. */
+static void
+batch_region(struct gl_renderer *gr,
+	     struct weston_view *ev,
+	     pixman_region32_t *region,
+	     pixman_region32_t *surf_region,
+	     const struct gl_shader_config *sconf,
+	     bool blend)
+{
+	const size_t stride = 4 * sizeof(GLfloat);
+	struct gl_batch_draw *draw = NULL;
+	unsigned int *vtxcnt;
+	uint32_t first, base;
+	GLushort *index;
+	int i, k, n, nfans;
+
+	first = gr->vertices.size / stride;
+	nfans = texture_region(ev, region, surf_region);
+	vtxcnt = gr->vtxcnt.data;
+
+	for (i = 0; i < nfans; i++) {
+		n = vtxcnt[i];
+
+		if (first + n - gr->batch_segment > BATCH_SEGMENT_VERTICES) {
+			gr->batch_segment = first;
+			draw = NULL;
+		}
+		if (!draw)
+			draw = batch_get_draw(gr, ev, sconf, blend);
+
+		base = first - draw->segment;
+		index = wl_array_add(&gr->batch_indices,
+				     (n - 2) * 3 * sizeof *index);
+		for (k = 1; k < n - 1; k++) {
+			*index++ = base;
+			*index++ = base + k;
+			*index++ = base + k + 1;
+		}
+		draw->count += (n - 2) * 3;
+		first += n;
+	}
+
+	/* Drop the worst case space texture_region() reserved but did
+	 * not fill. */
+	gr->vertices.size = first * stride;
+	gr->vtxcnt.size = 0;
+}
+
+/* Draw everything batch_region() queued: one vertex and one index buffer
+ * upload and a single glDrawElements() per run of same shader config. */
+static void
+batch_flush(struct gl_renderer *gr)
+{
+	const size_t stride = 4 * sizeof(GLfloat);
+	struct gl_batch_draw *draw;
+	uint32_t segment = UINT32_MAX;
+
+	if (gr->batch_draws.size == 0)
+		goto out;
+
+	glBindBuffer(GL_ARRAY_BUFFER, gr->batch_buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, gr->vertices.size,
+		     gr->vertices.data, GL_STREAM_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gr->batch_buffers[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, gr->batch_indices.size,
+		     gr->batch_indices.data, GL_STREAM_DRAW);
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	wl_array_for_each(draw, &gr->batch_draws) {
+		if (draw->segment != segment) {
+			uintptr_t offset = (uintptr_t)draw->segment * stride;
+
+			/* position: */
+			glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride,
+					      (void *)offset);
+			/* texcoord: */
+			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride,
+					      (void *)(offset +
+						       2 * sizeof(GLfloat)));
+			segment = draw->segment;
+		}
+
+		if (draw->blend)
+			glEnable(GL_BLEND);
+		else
+			glDisable(GL_BLEND);
+
+		if (!gl_renderer_use_program(gr, &draw->sconf)) {
+			gl_renderer_send_shader_error(draw->view);
+			/* continue drawing with the fallback shader */
+		}
+
+		glDrawElements(GL_TRIANGLES, draw->count, GL_UNSIGNED_SHORT,
+			       (void *)((uintptr_t)draw->first *
+					sizeof(GLushort)));
+	}
+
+	glDisableVertexAttribArray(1);
+	glDisableVertexAttribArray(0);
+
+	/* Everything else draws from client memory. */
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+out:
+	gr->vertices.size = 0;
+	gr->batch_indices.size = 0;
+	gr->batch_draws.size = 0;
+	gr->batch_segment = 0;
+}
+
+static void
+draw_region(struct gl_renderer *gr,
+	    struct weston_view *ev,
+	    pixman_region32_t *region,
+	    pixman_region32_t *surf_region,
+	    const struct gl_shader_config *sconf,
+	    bool blend)
+{
+	if (gr->batching) {
+		batch_region(gr, ev, region, surf_region, sconf, blend);
+		return;
+	}
+
+	if (blend)
+		glEnable(GL_BLEND);
+	else
+		glDisable(GL_BLEND);
+
+	repaint_region(gr, ev, region, surf_region, sconf);
+}
+
 static int
 use_output(struct weston_output *output)
 {
@@ -926,7 +1164,8 @@ ensure_surface_buffer_is_ready(struct gl_renderer *gr,
 static void
 maybe_censor_override(struct gl_shader_config *sconf,
 		      struct weston_output *output,
-		      struct weston_view *ev)
+		      struct weston_view *ev,
+		      bool capture)
 {
 	const struct gl_shader_config alt = {
 		.req = {
@@ -949,6 +1188,14 @@ maybe_censor_override(struct gl_shader_config *sconf,
 		return;
 	}
 
+	/* The client is not told about off-screen captures, so they are
+	 * censored in either protection mode. */
+	if (capture &&
+	    ev->surface->desired_protection > WESTON_HDCP_DISABLE) {
+		*sconf = alt;
+		return;
+	}
+
 	/* When not in enforced mode, the client is notified of the protection */
 	/* change, so content censoring is not required */
 	if (ev->surface->protection_mode !=
@@ -1002,7 +1249,8 @@ gl_shader_config_init_for_paint_node(struct gl_shader_config *sconf,
 
 static void
 draw_paint_node(struct weston_paint_node *pnode,
-		pixman_region32_t *damage /* in global coordinates */)
+		pixman_region32_t *damage /* in global coordinates */,
+		bool capture)
 {
 	struct gl_renderer *gr = get_renderer(pnode->surface->compositor);
 	struct gl_surface_state *gs = get_surface_state(pnode->surface);
@@ -1064,7 +1312,7 @@ draw_paint_node(struct weston_paint_node *pnode,
 	else
 		pixman_region32_copy(&surface_opaque, &pnode->surface->opaque);
 
-	maybe_censor_override(&sconf, pnode->output, pnode->view);
+	maybe_censor_override(&sconf, pnode->output, pnode->view, capture);
 
 	if (pixman_region32_not_empty(&surface_opaque)) {
 		struct gl_shader_config alt = sconf;
@@ -1078,18 +1326,14 @@ draw_paint_node(struct weston_paint_node *pnode,
 			alt.req.variant = SHADER_VARIANT_RGBX;
 		}
 
-		if (pnode->view->alpha < 1.0)
-			glEnable(GL_BLEND);
-		else
-			glDisable(GL_BLEND);
-
-		repaint_region(gr, pnode->view, &repaint, &surface_opaque, &alt);
+		draw_region(gr, pnode->view, &repaint, &surface_opaque, &alt,
+			    pnode->view->alpha < 1.0);
 		gs->used_in_output_repaint = true;
 	}
 
 	if (pixman_region32_not_empty(&surface_blend)) {
-		glEnable(GL_BLEND);
-		repaint_region(gr, pnode->view, &repaint, &surface_blend, &sconf);
+		draw_region(gr, pnode->view, &repaint, &surface_blend, &sconf,
+			    true);
 		gs->used_in_output_repaint = true;
 	}
 
@@ -1100,17 +1344,28 @@ out:
 	pixman_region32_fini(&repaint);
 }
 
+/* Draw the views of the primary plane, or for a capture the views of
+ * all planes. */
 static void
-repaint_views(struct weston_output *output, pixman_region32_t *damage)
+repaint_views(struct weston_output *output, pixman_region32_t *damage,
+	      bool capture)
 {
 	struct weston_compositor *compositor = output->compositor;
+	struct gl_renderer *gr = get_renderer(compositor);
 	struct weston_paint_node *pnode;
 
+	/* The fan debug overlay needs the fans drawn one by one. */
+	gr->batching = !compositor->gl_immediate_draws && !gr->fan_debug;
+
 	wl_list_for_each_reverse(pnode, &output->paint_node_z_order_list,
 				 z_order_link) {
-		if (pnode->view->plane == &compositor->primary_plane)
-			draw_paint_node(pnode, damage);
+		if (capture ||
+		    pnode->view->plane == &compositor->primary_plane)
+			draw_paint_node(pnode, damage, capture);
 	}
+
+	if (gr->batching)
+		batch_flush(gr);
 }
 
 static int
@@ -1558,6 +1813,21 @@ blit_shadow_to_output(struct weston_output *output,
 	pixman_region32_fini(&translated_damage);
 }
 
+/* Calculate the global GL matrix */
+static void
+output_update_matrix(struct weston_output *output)
+{
+	struct gl_output_state *go = get_output_state(output);
+
+	go->output_matrix = output->matrix;
+	weston_matrix_translate(&go->output_matrix,
+				-(output->current_mode->width / 2.0),
+				-(output->current_mode->height / 2.0), 0);
+	weston_matrix_scale(&go->output_matrix,
+			    2.0 / output->current_mode->width,
+			    -2.0 / output->current_mode->height, 1);
+}
+
 /* NOTE: We now allow falling back to ARGB gl visuals when XRGB is
  * unavailable, so we're assuming the background has no transparency
  * and that everything with a blend, like drop shadows, will have something
@@ -1606,14 +1876,7 @@ gl_renderer_repaint_output(struct weston_output *output,
 
 	go->begin_render_sync = create_render_sync(gr);
 
-	/* Calculate the global GL matrix */
-	go->output_matrix = output->matrix;
-	weston_matrix_translate(&go->output_matrix,
-				-(output->current_mode->width / 2.0),
-				-(output->current_mode->height / 2.0), 0);
-	weston_matrix_scale(&go->output_matrix,
-			    2.0 / output->current_mode->width,
-			    -2.0 / output->current_mode->height, 1);
+	output_update_matrix(output);
 
 	/* If using shadow, redirect all drawing to it first. */
 	if (shadow_exists(go)) {
@@ -1641,7 +1904,7 @@ gl_renderer_repaint_output(struct weston_output *output,
 		pixman_region32_subtract(&undamaged, &output->region,
 					 output_damage);
 		gr->fan_debug = false;
-		repaint_views(output, &undamaged);
+		repaint_views(output, &undamaged, false);
 		gr->fan_debug = true;
 		pixman_region32_fini(&undamaged);
 	}
@@ -1679,9 +1942,9 @@ gl_renderer_repaint_output(struct weston_output *output,
 	if (shadow_exists(go)) {
 		/* Repaint into shadow. */
 		if (compositor->test_data.test_quirks.gl_force_full_redraw_of_shadow_fb)
-			repaint_views(output, &output->region);
+			repaint_views(output, &output->region, false);
 		else
-			repaint_views(output, output_damage);
+			repaint_views(output, output_damage, false);
 
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 		glViewport(go->borders[GL_RENDERER_BORDER_LEFT].width,
@@ -1690,7 +1953,7 @@ gl_renderer_repaint_output(struct weston_output *output,
 			   output->current_mode->height);
 		blit_shadow_to_output(output, &total_damage);
 	} else {
-		repaint_views(output, &total_damage);
+		repaint_views(output, &total_damage, false);
 	}
 
 	pixman_region32_fini(&total_damage);
@@ -1773,6 +2036,275 @@ gl_renderer_read_pixels(struct weston_output *output,
 	return 0;
 }
 
+static void
+gl_readback_destroy(struct gl_readback *rb)
+{
+	wl_list_remove(&rb->link);
+	if (rb->event_source)
+		wl_event_source_remove(rb->event_source);
+	if (rb->fence_fd >= 0)
+		close(rb->fence_fd);
+	if (rb->sync)
+		glDeleteSync(rb->sync);
+	glDeleteBuffers(1, &rb->pbo);
+	free(rb);
+}
+
+/* Copy the pixels out of the pixel buffer object and notify the caller.
+ * The GL context must be current. */
+static void
+gl_readback_complete(struct gl_readback *rb, bool success)
+{
+	weston_read_pixels_done_func_t done = rb->done;
+	void *data = rb->data;
+	size_t size = (size_t)rb->width * rb->height * 4;
+	void *map = NULL;
+
+	if (success) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+		map = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size,
+				       GL_MAP_READ_BIT);
+		if (map) {
+			memcpy(rb->pixels, map, size);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	gl_readback_destroy(rb);
+	done(data, map != NULL);
+}
+
+/* GL finishes the read backs in submission order: when one is done, so
+ * are all the ones before it. */
+static void
+gl_readback_complete_until(struct weston_output *output,
+			   struct gl_readback *last)
+{
+	struct gl_output_state *go = get_output_state(output);
+	struct gl_readback *rb;
+	bool more = true;
+
+	if (use_output(output) < 0)
+		return;
+
+	while (more && !wl_list_empty(&go->readback_list)) {
+		rb = container_of(go->readback_list.next,
+				  struct gl_readback, link);
+		more = rb != last;
+		gl_readback_complete(rb, true);
+	}
+}
+
+static int
+gl_readback_fence_handler(int fd, uint32_t mask, void *data)
+{
+	struct gl_readback *rb = data;
+
+	gl_readback_complete_until(rb->output, rb);
+
+	return 0;
+}
+
+static int
+gl_readback_poll_handler(void *data)
+{
+	struct gl_readback *rb = data;
+	GLenum ret;
+
+	if (use_output(rb->output) < 0)
+		return 0;
+
+	ret = glClientWaitSync(rb->sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (ret == GL_TIMEOUT_EXPIRED) {
+		wl_event_source_timer_update(rb->event_source,
+					     READBACK_POLL_MSEC);
+		return 0;
+	}
+
+	gl_readback_complete_until(rb->output, rb);
+
+	return 0;
+}
+
+/* Queue a read back of the bound framebuffer into a pixel buffer object.
+ * The pixels are copied out and done is called once GL has finished. */
+static int
+gl_readback_queue(struct weston_output *output, GLenum gl_format,
+		  uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+		  void *pixels, weston_read_pixels_done_func_t done,
+		  void *data)
+{
+	struct gl_renderer *gr = get_renderer(output->compositor);
+	struct gl_output_state *go = get_output_state(output);
+	struct wl_event_loop *loop;
+	struct gl_readback *rb;
+	EGLSyncKHR egl_sync;
+
+	rb = zalloc(sizeof *rb);
+	if (!rb)
+		return -1;
+
+	rb->output = output;
+	rb->width = width;
+	rb->height = height;
+	rb->pixels = pixels;
+	rb->done = done;
+	rb->data = data;
+	rb->fence_fd = -1;
+	wl_list_insert(go->readback_list.prev, &rb->link);
+
+	glGenBuffers(1, &rb->pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+	glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4,
+		     NULL, GL_STREAM_READ);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(x, y, width, height, gl_format, GL_UNSIGNED_BYTE, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	loop = wl_display_get_event_loop(gr->compositor->wl_display);
+
+	egl_sync = create_render_sync(gr);
+	if (egl_sync != EGL_NO_SYNC_KHR) {
+		/* The fence fd only exists after a flush. */
+		glFlush();
+		rb->fence_fd = gr->dup_native_fence_fd(gr->egl_display,
+							egl_sync);
+		gr->destroy_sync(gr->egl_display, egl_sync);
+	}
+
+	if (rb->fence_fd >= 0) {
+		rb->event_source =
+			wl_event_loop_add_fd(loop, rb->fence_fd,
+					     WL_EVENT_READABLE,
+					     gl_readback_fence_handler, rb);
+	} else {
+		rb->fence_fd = -1;
+		rb->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		rb->event_source =
+			wl_event_loop_add_timer(loop,
+						gl_readback_poll_handler, rb);
+		if (rb->event_source)
+			wl_event_source_timer_update(rb->event_source,
+						     READBACK_POLL_MSEC);
+	}
+
+	if (!rb->event_source) {
+		gl_readback_destroy(rb);
+		return -1;
+	}
+
+	return 0;
+}
+
+static GLenum
+gl_readback_format(pixman_format_code_t format)
+{
+	switch (format) {
+	case PIXMAN_a8r8g8b8:
+		return GL_BGRA_EXT;
+	case PIXMAN_a8b8g8r8:
+		return GL_RGBA;
+	default:
+		return GL_NONE;
+	}
+}
+
+static int
+gl_renderer_read_pixels_async(struct weston_output *output,
+			      pixman_format_code_t format, void *pixels,
+			      uint32_t x, uint32_t y,
+			      uint32_t width, uint32_t height,
+			      weston_read_pixels_done_func_t done,
+			      void *data)
+{
+	struct gl_renderer *gr = get_renderer(output->compositor);
+	struct gl_output_state *go = get_output_state(output);
+	GLenum gl_format = gl_readback_format(format);
+
+	/* Pixel buffer objects need GLES 3.0. */
+	if (gr->gl_version < gr_gl_version(3, 0) || gl_format == GL_NONE)
+		return -1;
+
+	if (use_output(output) < 0)
+		return -1;
+
+	return gl_readback_queue(output, gl_format,
+				 x + go->borders[GL_RENDERER_BORDER_LEFT].width,
+				 y + go->borders[GL_RENDERER_BORDER_BOTTOM].height,
+				 width, height, pixels, done, data);
+}
+
+static void
+gl_surface_upload_damage(struct weston_surface *surface);
+
+/* Draw the paint nodes of all planes into an off-screen framebuffer of
+ * the output's size and read it back, leaving the output's framebuffer
+ * and plane assignment alone. */
+static int
+gl_renderer_capture_output_async(struct weston_output *output,
+				 pixman_format_code_t format, void *pixels,
+				 weston_read_pixels_done_func_t done,
+				 void *data)
+{
+	struct gl_renderer *gr = get_renderer(output->compositor);
+	struct gl_output_state *go = get_output_state(output);
+	struct weston_paint_node *pnode;
+	GLenum gl_format = gl_readback_format(format);
+	int32_t width = output->current_mode->width;
+	int32_t height = output->current_mode->height;
+	int ret;
+
+	if (gr->gl_version < gr_gl_version(3, 0) || gl_format == GL_NONE)
+		return -1;
+
+	/* The shadow holds blending space content, which the capture
+	 * target cannot represent. */
+	if (shadow_exists(go))
+		return -1;
+
+	if (use_output(output) < 0)
+		return -1;
+
+	if (go->capture.fbo &&
+	    (go->capture.width != width || go->capture.height != height))
+		gl_fbo_texture_fini(&go->capture);
+
+	if (!go->capture.fbo &&
+	    !gl_fbo_texture_init(&go->capture, width, height,
+				 GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE))
+		return -1;
+
+	/* The textures of views on other planes, or occluded ones, were
+	 * not kept up to date by gl_renderer_flush_damage(). */
+	wl_list_for_each(pnode, &output->paint_node_z_order_list,
+			 z_order_link) {
+		struct gl_surface_state *gs = get_surface_state(pnode->surface);
+
+		if (gs->buffer_type == BUFFER_TYPE_SHM && gs->buffer_ref.buffer)
+			gl_surface_upload_damage(pnode->surface);
+	}
+
+	output_update_matrix(output);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, go->capture.fbo);
+	glViewport(0, 0, width, height);
+	glClearColor(0.0, 0.0, 0.0, 1.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	repaint_views(output, &output->region, true);
+
+	ret = gl_readback_queue(output, gl_format, 0, 0, width, height,
+				pixels, done, data);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(go->borders[GL_RENDERER_BORDER_LEFT].width,
+		   go->borders[GL_RENDERER_BORDER_BOTTOM].height,
+		   width, height);
+
+	return ret;
+}
+
 static GLenum
 gl_format_from_internal(GLenum internal_format)
 {
@@ -1786,40 +2318,350 @@ gl_format_from_internal(GLenum internal_format)
 	}
 }
 
+/* Staging memory, uploads not fitting in it are done directly */
+#define UPLOAD_RING_SIZE (32 * 1024 * 1024)
+#define UPLOAD_RING_ALIGN 64
+#define UPLOAD_WAIT_NSEC 1000000000ull
+
+static bool
+upload_ring_init(struct gl_renderer *gr)
+{
+	struct gl_upload_ring *ring = &gr->upload_ring;
+	const GLbitfield flags = GL_MAP_WRITE_BIT |
+				 GL_MAP_PERSISTENT_BIT_EXT |
+				 GL_MAP_COHERENT_BIT_EXT;
+
+	glGenBuffers(1, &ring->pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->pbo);
+
+	if (gr->buffer_storage) {
+		gr->buffer_storage(GL_PIXEL_UNPACK_BUFFER, UPLOAD_RING_SIZE,
+				   NULL, flags);
+		ring->map = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+					     UPLOAD_RING_SIZE, flags);
+	} else {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, UPLOAD_RING_SIZE,
+			     NULL, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (glGetError() != GL_NO_ERROR || (gr->buffer_storage && !ring->map)) {
+		weston_log("Failed to create the texture upload buffer, "
+			   "uploading wl_shm buffers directly.\n");
+		glDeleteBuffers(1, &ring->pbo);
+		ring->pbo = 0;
+		ring->map = NULL;
+		gr->has_pbo_upload = false;
+		return false;
+	}
+
+	ring->size = UPLOAD_RING_SIZE;
+
+	return true;
+}
+
+/* Reclaim the space of uploads the GL is done with. With wait, block
+ * until at least the oldest one has finished. */
 static void
-gl_renderer_flush_damage(struct weston_surface *surface)
+upload_ring_retire(struct gl_upload_ring *ring, bool wait)
+{
+	while (ring->fence_count > 0) {
+		unsigned int i = ring->fence_first;
+		GLenum ret;
+
+		ret = glClientWaitSync(ring->fences[i].sync,
+				       wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+				       wait ? UPLOAD_WAIT_NSEC : 0);
+		if (ret == GL_TIMEOUT_EXPIRED)
+			break;
+
+		glDeleteSync(ring->fences[i].sync);
+		ring->tail = ring->fences[i].end;
+		ring->fence_first = (i + 1) % GL_UPLOAD_RING_FENCES;
+		ring->fence_count--;
+		wait = false;
+	}
+
+	if (ring->fence_count == 0)
+		ring->head = ring->tail = 0;
+}
+
+static bool
+upload_ring_fit(struct gl_upload_ring *ring, size_t len, size_t *offset)
+{
+	bool full = ring->head == ring->tail && ring->fence_count > 0;
+
+	if (full)
+		return false;
+
+	if (ring->head >= ring->tail) {
+		if (len <= ring->size - ring->head) {
+			*offset = ring->head;
+			return true;
+		}
+
+		/* wrap around, leaving the end unused */
+		if (len <= ring->tail) {
+			*offset = 0;
+			return true;
+		}
+
+		return false;
+	}
+
+	if (len <= ring->tail - ring->head) {
+		*offset = ring->head;
+		return true;
+	}
+
+	return false;
+}
+
+/* Take len bytes of staging memory, waiting for earlier uploads to
+ * finish if needed. Returns false if that is not possible. */
+static bool
+upload_ring_alloc(struct gl_upload_ring *ring, size_t len, size_t *offset)
+{
+	unsigned int fence_count;
+
+	len = (len + UPLOAD_RING_ALIGN - 1) & ~(size_t)(UPLOAD_RING_ALIGN - 1);
+	if (len > ring->size)
+		return false;
+
+	upload_ring_retire(ring, false);
+	if (ring->fence_count == GL_UPLOAD_RING_FENCES) {
+		upload_ring_retire(ring, true);
+		/* No fence left for this upload */
+		if (ring->fence_count == GL_UPLOAD_RING_FENCES)
+			return false;
+	}
+
+	while (!upload_ring_fit(ring, len, offset)) {
+		fence_count = ring->fence_count;
+		upload_ring_retire(ring, true);
+		if (ring->fence_count == fence_count)
+			return false;
+	}
+
+	ring->head = *offset + len;
+
+	return true;
+}
+
+/* Fence everything using the staging memory up to the current head. */
+static void
+upload_ring_fence(struct gl_upload_ring *ring)
+{
+	unsigned int i;
+
+	assert(ring->fence_count < GL_UPLOAD_RING_FENCES);
+
+	i = (ring->fence_first + ring->fence_count) % GL_UPLOAD_RING_FENCES;
+	ring->fences[i].sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ring->fences[i].end = ring->head;
+	ring->fence_count++;
+}
+
+static void
+upload_ring_fini(struct gl_upload_ring *ring)
+{
+	while (ring->fence_count > 0) {
+		glDeleteSync(ring->fences[ring->fence_first].sync);
+		ring->fence_first = (ring->fence_first + 1) %
+				    GL_UPLOAD_RING_FENCES;
+		ring->fence_count--;
+	}
+
+	if (!ring->pbo)
+		return;
+
+	if (ring->map) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->pbo);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &ring->pbo);
+}
+
+static int
+gl_format_bytes_per_texel(GLenum format, GLenum type)
+{
+	if (type == GL_UNSIGNED_SHORT_5_6_5)
+		return 2;
+
+	switch (format) {
+	case GL_R8_EXT:
+	case GL_LUMINANCE:
+		return 1;
+	case GL_RG8_EXT:
+	case GL_LUMINANCE_ALPHA:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+/* A damaged rectangle of one plane, in texels of that plane */
+struct upload_rect {
+	int x, y, width, height;
+	int bpp;
+	size_t stride; /* in the staging memory, GL_UNPACK_ALIGNMENT 4 */
+};
+
+static void
+upload_rect_for_plane(struct upload_rect *ur, struct gl_surface_state *gs,
+		      int plane, const pixman_box32_t *r)
+{
+	ur->x = r->x1 / gs->hsub[plane];
+	ur->y = r->y1 / gs->vsub[plane];
+	ur->width = (r->x2 - r->x1) / gs->hsub[plane];
+	ur->height = (r->y2 - r->y1) / gs->vsub[plane];
+	ur->bpp = gl_format_bytes_per_texel(gs->gl_format[plane],
+					    gs->gl_pixel_type);
+	ur->stride = ((size_t)ur->width * ur->bpp + 3) & ~(size_t)3;
+}
+
+/* Bytes of all planes to upload for a rectangle in buffer coordinates */
+static uint64_t
+upload_rect_bytes(struct gl_surface_state *gs, const pixman_box32_t *r)
+{
+	struct upload_rect ur;
+	uint64_t bytes = 0;
+	int j;
+
+	for (j = 0; j < gs->num_textures; j++) {
+		upload_rect_for_plane(&ur, gs, j, r);
+		bytes += (uint64_t)ur.width * ur.height * ur.bpp;
+	}
+
+	return bytes;
+}
+
+/** Upload wl_shm damage through the staging ring
+ *
+ * All damaged rectangles of all planes are copied into one piece of
+ * staging memory, which the texture uploads then read from without
+ * stalling. Once this returns the wl_shm buffer is no longer needed.
+ *
+ * \param rects Damage in buffer coordinates.
+ * \param full Whether to (re)specify the whole textures, rects must then
+ * be the whole buffer.
+ * \return False if the staging memory could not be used, nothing was
+ * uploaded then.
+ */
+static bool
+upload_shm_staged(struct gl_renderer *gr, struct gl_surface_state *gs,
+		  struct wl_shm_buffer *shm_buffer,
+		  const pixman_box32_t *rects, int n, bool full)
+{
+	struct gl_upload_ring *ring = &gr->upload_ring;
+	const uint8_t *data = wl_shm_buffer_get_data(shm_buffer);
+	struct upload_rect ur;
+	size_t len = 0;
+	size_t offset, pos;
+	uint8_t *map;
+	int i, j, row;
+
+	if (!ring->pbo && !upload_ring_init(gr))
+		return false;
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < gs->num_textures; j++) {
+			upload_rect_for_plane(&ur, gs, j, &rects[i]);
+			len += ur.stride * ur.height;
+		}
+	}
+
+	if (len == 0 || !upload_ring_alloc(ring, len, &offset))
+		return false;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->pbo);
+
+	if (ring->map)
+		map = ring->map + offset;
+	else
+		map = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, len,
+				       GL_MAP_WRITE_BIT |
+				       GL_MAP_INVALIDATE_RANGE_BIT |
+				       GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!map) {
+		/* Nothing was uploaded: give the space back unfenced. */
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		ring->head = offset;
+		return false;
+	}
+
+	pos = 0;
+	wl_shm_buffer_begin_access(shm_buffer);
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < gs->num_textures; j++) {
+			size_t src_stride;
+			const uint8_t *src;
+
+			upload_rect_for_plane(&ur, gs, j, &rects[i]);
+			src_stride = (size_t)(gs->pitch / gs->hsub[j]) * ur.bpp;
+			src = data + gs->offset[j] + ur.y * src_stride +
+			      ur.x * ur.bpp;
+
+			for (row = 0; row < ur.height; row++) {
+				memcpy(map + pos, src, ur.width * ur.bpp);
+				src += src_stride;
+				pos += ur.stride;
+			}
+		}
+	}
+	wl_shm_buffer_end_access(shm_buffer);
+
+	if (!ring->map)
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+
+	pos = offset;
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < gs->num_textures; j++) {
+			GLenum format = gl_format_from_internal(gs->gl_format[j]);
+			const void *pixels = (const void *)(uintptr_t)pos;
+
+			upload_rect_for_plane(&ur, gs, j, &rects[i]);
+			glBindTexture(GL_TEXTURE_2D, gs->textures[j]);
+			if (full)
+				glTexImage2D(GL_TEXTURE_2D, 0, gs->gl_format[j],
+					     ur.width, ur.height, 0, format,
+					     gs->gl_pixel_type, pixels);
+			else
+				glTexSubImage2D(GL_TEXTURE_2D, 0, ur.x, ur.y,
+						ur.width, ur.height, format,
+						gs->gl_pixel_type, pixels);
+			pos += ur.stride * ur.height;
+		}
+	}
+
+	upload_ring_fence(ring);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	return true;
+}
+
+static void
+/* Upload the damage accumulated in texture_damage from the shm buffer,
+ * and let go of the buffer. */
+static void
+gl_surface_upload_damage(struct weston_surface *surface)
 {
 	const struct weston_testsuite_quirks *quirks =
 		&surface->compositor->test_data.test_quirks;
+	struct gl_renderer *gr = get_renderer(surface->compositor);
 	struct gl_surface_state *gs = get_surface_state(surface);
 	struct weston_buffer *buffer = gs->buffer_ref.buffer;
-	struct weston_view *view;
-	bool texture_used;
 	pixman_box32_t *rectangles;
+	uint64_t upload_bytes = 0;
 	uint8_t *data;
 	int i, j, n;
 
-	pixman_region32_union(&gs->texture_damage,
-			      &gs->texture_damage, &surface->damage);
-
-	if (!buffer)
-		return;
-
-	/* Avoid upload, if the texture won't be used this time.
-	 * We still accumulate the damage in texture_damage, and
-	 * hold the reference to the buffer, in case the surface
-	 * migrates back to the primary plane.
-	 */
-	texture_used = false;
-	wl_list_for_each(view, &surface->views, surface_link) {
-		if (view->plane == &surface->compositor->primary_plane) {
-			texture_used = true;
-			break;
-		}
-	}
-	if (!texture_used)
-		return;
-
 	if (!pixman_region32_not_empty(&gs->texture_damage) &&
 	    !gs->needs_full_upload)
 		goto done;
@@ -1829,6 +2671,14 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 	glActiveTexture(GL_TEXTURE0);
 
 	if (gs->needs_full_upload || quirks->gl_force_full_upload) {
+		pixman_box32_t whole = { 0, 0, gs->pitch, buffer->height };
+
+		upload_bytes = upload_rect_bytes(gs, &whole);
+		if (gr->has_pbo_upload &&
+		    upload_shm_staged(gr, gs, buffer->shm_buffer,
+				      &whole, 1, true))
+			goto done;
+
 		glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
 		glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
 		wl_shm_buffer_begin_access(buffer->shm_buffer);
@@ -1850,6 +2700,29 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 	}
 
 	rectangles = pixman_region32_rectangles(&gs->texture_damage, &n);
+	for (i = 0; i < n; i++) {
+		pixman_box32_t r;
+
+		r = weston_surface_to_buffer_rect(surface, rectangles[i]);
+		upload_bytes += upload_rect_bytes(gs, &r);
+	}
+
+	if (gr->has_pbo_upload) {
+		pixman_box32_t *rects = malloc(n * sizeof *rects);
+		bool staged = false;
+
+		if (rects) {
+			for (i = 0; i < n; i++)
+				rects[i] = weston_surface_to_buffer_rect(surface,
+									 rectangles[i]);
+			staged = upload_shm_staged(gr, gs, buffer->shm_buffer,
+						   rects, n, false);
+			free(rects);
+		}
+		if (staged)
+			goto done;
+	}
+
 	wl_shm_buffer_begin_access(buffer->shm_buffer);
 	for (i = 0; i < n; i++) {
 		pixman_box32_t r;
@@ -1877,6 +2750,11 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 	wl_shm_buffer_end_access(buffer->shm_buffer);
 
 done:
+	if (upload_bytes > 0 && surface->resource)
+		weston_client_count(surface->compositor,
+				    wl_resource_get_client(surface->resource),
+				    WESTON_CLIENT_SHM_BYTES, upload_bytes);
+
 	pixman_region32_fini(&gs->texture_damage);
 	pixman_region32_init(&gs->texture_damage);
 	gs->needs_full_upload = false;
@@ -1885,6 +2763,38 @@ done:
 	weston_buffer_release_reference(&gs->buffer_release_ref, NULL);
 }
 
+static void
+gl_renderer_flush_damage(struct weston_surface *surface)
+{
+	struct gl_surface_state *gs = get_surface_state(surface);
+	struct weston_view *view;
+	bool texture_used;
+
+	pixman_region32_union(&gs->texture_damage,
+			      &gs->texture_damage, &surface->damage);
+
+	if (!gs->buffer_ref.buffer)
+		return;
+
+	/* Avoid upload, if the texture won't be used this time.
+	 * We still accumulate the damage in texture_damage, and
+	 * hold the reference to the buffer, in case the surface
+	 * migrates back to the primary plane or stops being occluded.
+	 */
+	texture_used = false;
+	wl_list_for_each(view, &surface->views, surface_link) {
+		if (view->plane == &surface->compositor->primary_plane &&
+		    !weston_view_is_occluded(view)) {
+			texture_used = true;
+			break;
+		}
+	}
+	if (!texture_used)
+		return;
+
+	gl_surface_upload_damage(surface);
+}
+
 static void
 ensure_textures(struct gl_surface_state *gs, GLenum target, int num_textures)
 {
@@ -3315,6 +4225,7 @@ gl_renderer_output_create(struct weston_output *output,
 		pixman_region32_init(&go->buffer_damage[i]);
 
 	wl_list_init(&go->timeline_render_point_list);
+	wl_list_init(&go->readback_list);
 
 	go->begin_render_sync = EGL_NO_SYNC_KHR;
 	go->end_render_sync = EGL_NO_SYNC_KHR;
@@ -3441,6 +4352,9 @@ gl_renderer_output_destroy(struct weston_output *output)
 	eglMakeCurrent(gr->egl_display,
 		       gr->dummy_surface, gr->dummy_surface, gr->egl_context);
 
+	if (go->capture.fbo)
+		gl_fbo_texture_fini(&go->capture);
+
 	weston_platform_destroy_egl_surface(gr->egl_display, go->egl_surface);
 
 	if (!wl_list_empty(&go->timeline_render_point_list))
@@ -3450,6 +4364,14 @@ gl_renderer_output_destroy(struct weston_output *output)
 	wl_list_for_each_safe(trp, tmp, &go->timeline_render_point_list, link)
 		timeline_render_point_destroy(trp);
 
+	while (!wl_list_empty(&go->readback_list)) {
+		struct gl_readback *rb;
+
+		rb = container_of(go->readback_list.next,
+				  struct gl_readback, link);
+		gl_readback_complete(rb, false);
+	}
+
 	if (go->begin_render_sync != EGL_NO_SYNC_KHR)
 		gr->destroy_sync(gr->egl_display, go->begin_render_sync);
 	if (go->end_render_sync != EGL_NO_SYNC_KHR)
@@ -3491,6 +4413,11 @@ gl_renderer_destroy(struct weston_compositor *ec)
 	if (gr->fallback_shader)
 		gl_shader_destroy(gr, gr->fallback_shader);
 
+	if (gr->batch_buffers[0])
+		glDeleteBuffers(ARRAY_LENGTH(gr->batch_buffers),
+				gr->batch_buffers);
+	upload_ring_fini(&gr->upload_ring);
+
 	/* Work around crash in egl_dri2.c's dri2_make_current() - when does this apply? */
 	eglMakeCurrent(gr->egl_display,
 		       EGL_NO_SURFACE, EGL_NO_SURFACE,
@@ -3513,6 +4440,8 @@ gl_renderer_destroy(struct weston_compositor *ec)
 
 	wl_array_release(&gr->vertices);
 	wl_array_release(&gr->vtxcnt);
+	wl_array_release(&gr->batch_indices);
+	wl_array_release(&gr->batch_draws);
 
 	if (gr->fragment_binding)
 		weston_binding_destroy(gr->fragment_binding);
@@ -3520,6 +4449,7 @@ gl_renderer_destroy(struct weston_compositor *ec)
 		weston_binding_destroy(gr->fan_binding);
 
 	weston_log_scope_destroy(gr->shader_scope);
+	gl_shader_cache_fini(gr);
 	free(gr);
 }
 
@@ -3578,6 +4508,8 @@ gl_renderer_display_create(struct weston_compositor *ec,
 		goto fail;
 
 	gr->base.read_pixels = gl_renderer_read_pixels;
+	gr->base.read_pixels_async = gl_renderer_read_pixels_async;
+	gr->base.capture_output_async = gl_renderer_capture_output_async;
 	gr->base.repaint_output = gl_renderer_repaint_output;
 	gr->base.flush_damage = gl_renderer_flush_damage;
 	gr->base.attach = gl_renderer_attach;
@@ -3826,6 +4758,15 @@ gl_renderer_setup(struct weston_compositor *ec, EGLSurface egl_surface)
 	if (weston_check_egl_extension(extensions, "GL_OES_EGL_image_external"))
 		gr->has_egl_image_external = true;
 
+	if (gr->gl_version >= gr_gl_version(3, 0)) {
+		gr->has_pbo_upload = true;
+
+		if (weston_check_egl_extension(extensions,
+					       "GL_EXT_buffer_storage"))
+			gr->buffer_storage =
+				(void *) eglGetProcAddress("glBufferStorageEXT");
+	}
+
 	if (gr->gl_version >= gr_gl_version(3, 0) &&
 	    weston_check_egl_extension(extensions, "GL_EXT_color_buffer_half_float")) {
 		gr->gl_supports_color_transforms = true;
@@ -3833,12 +4774,20 @@ gl_renderer_setup(struct weston_compositor *ec, EGLSurface egl_surface)
 
 	glActiveTexture(GL_TEXTURE0);
 
+	if (ec->gl_shader_cache_dir && gr->gl_version >= gr_gl_version(3, 0))
+		gl_shader_cache_init(gr, ec->gl_shader_cache_dir);
+
 	gr->fallback_shader = gl_renderer_create_fallback_shader(gr);
 	if (!gr->fallback_shader) {
 		weston_log("Error: compiling fallback shader failed.\n");
 		return -1;
 	}
 
+	if (ec->gl_shader_prewarm)
+		gl_renderer_prewarm_programs(gr);
+
+	glGenBuffers(ARRAY_LENGTH(gr->batch_buffers), gr->batch_buffers);
+
 	gr->fragment_binding =
 		weston_compositor_add_debug_binding(ec, KEY_S,
 						    fragment_debug_binding,
@@ -3855,6 +4804,8 @@ gl_renderer_setup(struct weston_compositor *ec, EGLSurface egl_surface)
 		ec->read_format == PIXMAN_a8r8g8b8 ? "BGRA" : "RGBA");
 	weston_log_continue(STAMP_SPACE "EGL Wayland extension: %s\n",
 			    gr->has_bind_display ? "yes" : "no");
+	weston_log_continue(STAMP_SPACE "shader program cache: %s\n",
+			    gr->shader_cache_dir ? gr->shader_cache_dir : "no");
 
 	return 0;
 }
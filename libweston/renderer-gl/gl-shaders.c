@@ -29,9 +29,15 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <libweston/libweston.h>
 #include <libweston/weston-log.h>
@@ -41,6 +47,7 @@
 
 #include "gl-renderer.h"
 #include "gl-renderer-internal.h"
+#include "shared/hash-util.h"
 #include "shared/helpers.h"
 #include "shared/timespec-util.h"
 
@@ -50,6 +57,21 @@
 /* static const char fragment_shader[]; fragment.glsl */
 #include "fragment-shader.h"
 
+/* Program binary cache file layout: the header followed by the binary */
+#define SHADER_CACHE_MAGIC 0x42535357 /* "WSSB" */
+#define SHADER_CACHE_VERSION 1
+#define SHADER_CACHE_MAX_BINARY (16 * 1024 * 1024)
+
+struct shader_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t salt;
+	struct gl_shader_requirements key;
+	uint32_t binary_format;
+	uint32_t binary_size;
+	uint32_t pad;
+};
+
 struct gl_shader {
 	struct gl_shader_requirements key;
 	GLuint program;
@@ -171,6 +193,222 @@ create_shader_config_string(const struct gl_shader_requirements *req)
 	return str;
 }
 
+/* mkdir -p */
+static int
+ensure_directory(const char *path)
+{
+	char *tmp;
+	char *p;
+	int ret = 0;
+
+	tmp = strdup(path);
+	if (!tmp)
+		return -1;
+
+	for (p = strchr(tmp + 1, '/'); p; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		if (mkdir(tmp, 0700) < 0 && errno != EEXIST)
+			ret = -1;
+		*p = '/';
+	}
+
+	if (mkdir(tmp, 0700) < 0 && errno != EEXIST)
+		ret = -1;
+
+	free(tmp);
+	return ret;
+}
+
+/** Enable the on-disk program binary cache
+ *
+ * \param gr The renderer, with its GL context current.
+ * \param dir Directory to keep the program binaries in, created if needed.
+ *
+ * Cached programs are only used with the same GL driver and version and
+ * the same shader sources they were built from. Needs GLES 3.0.
+ */
+void
+gl_shader_cache_init(struct gl_renderer *gr, const char *dir)
+{
+	const char *strings[] = {
+		(const char *)glGetString(GL_VENDOR),
+		(const char *)glGetString(GL_RENDERER),
+		(const char *)glGetString(GL_VERSION),
+		vertex_shader,
+		fragment_shader,
+	};
+	uint64_t salt = FNV1A_64_INIT;
+	GLint formats = 0;
+	unsigned int i;
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if (formats <= 0) {
+		weston_log("GL driver supports no program binary formats, "
+			   "shader cache disabled.\n");
+		return;
+	}
+
+	if (ensure_directory(dir) < 0) {
+		weston_log("Cannot create shader cache directory %s: %s\n",
+			   dir, strerror(errno));
+		return;
+	}
+
+	for (i = 0; i < ARRAY_LENGTH(strings); i++) {
+		if (strings[i])
+			salt = fnv1a_64(salt, strings[i], strlen(strings[i]) + 1);
+	}
+
+	gr->shader_cache_dir = strdup(dir);
+	gr->shader_cache_salt = salt;
+}
+
+void
+gl_shader_cache_fini(struct gl_renderer *gr)
+{
+	free(gr->shader_cache_dir);
+	gr->shader_cache_dir = NULL;
+}
+
+static char *
+shader_cache_path(struct gl_renderer *gr,
+		  const struct gl_shader_requirements *key)
+{
+	uint64_t hash;
+	char *path;
+
+	hash = fnv1a_64(gr->shader_cache_salt, key, sizeof *key);
+	if (asprintf(&path, "%s/%016" PRIx64 ".bin",
+		     gr->shader_cache_dir, hash) < 0)
+		return NULL;
+
+	return path;
+}
+
+static bool
+gl_shader_cache_load(struct gl_renderer *gr, struct gl_shader *shader)
+{
+	struct shader_cache_header hdr;
+	GLint status = GL_FALSE;
+	void *binary = NULL;
+	char *path;
+	FILE *fp;
+
+	path = shader_cache_path(gr, &shader->key);
+	if (!path)
+		return false;
+
+	fp = fopen(path, "re");
+	free(path);
+	if (!fp)
+		return false;
+
+	if (fread(&hdr, sizeof hdr, 1, fp) != 1 ||
+	    hdr.magic != SHADER_CACHE_MAGIC ||
+	    hdr.version != SHADER_CACHE_VERSION ||
+	    hdr.salt != gr->shader_cache_salt ||
+	    memcmp(&hdr.key, &shader->key, sizeof hdr.key) != 0 ||
+	    hdr.binary_size == 0 ||
+	    hdr.binary_size > SHADER_CACHE_MAX_BINARY)
+		goto out;
+
+	binary = malloc(hdr.binary_size);
+	if (!binary || fread(binary, hdr.binary_size, 1, fp) != 1)
+		goto out;
+
+	shader->program = glCreateProgram();
+	glProgramBinary(shader->program, hdr.binary_format,
+			binary, hdr.binary_size);
+
+	/* Drivers reject binaries from other builds here. */
+	glGetProgramiv(shader->program, GL_LINK_STATUS, &status);
+	if (!status) {
+		glDeleteProgram(shader->program);
+		shader->program = 0;
+	}
+
+out:
+	free(binary);
+	fclose(fp);
+
+	return status == GL_TRUE;
+}
+
+static void
+gl_shader_cache_store(struct gl_renderer *gr, struct gl_shader *shader)
+{
+	struct shader_cache_header hdr;
+	GLint size = 0;
+	GLenum format;
+	void *binary;
+	char *path;
+	char *tmp = NULL;
+	FILE *fp = NULL;
+	int fd;
+
+	glGetProgramiv(shader->program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (size <= 0 || size > SHADER_CACHE_MAX_BINARY)
+		return;
+
+	binary = malloc(size);
+	if (!binary)
+		return;
+
+	glGetProgramBinary(shader->program, size, &size, &format, binary);
+
+	memset(&hdr, 0, sizeof hdr);
+	hdr.magic = SHADER_CACHE_MAGIC;
+	hdr.version = SHADER_CACHE_VERSION;
+	hdr.salt = gr->shader_cache_salt;
+	hdr.key = shader->key;
+	hdr.binary_format = format;
+	hdr.binary_size = size;
+
+	path = shader_cache_path(gr, &shader->key);
+	if (!path || asprintf(&tmp, "%s.XXXXXX", path) < 0) {
+		tmp = NULL;
+		goto out;
+	}
+
+	/* Write a temporary file and rename it into place, so that a
+	 * concurrent reader never sees a partial binary. */
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd < 0)
+		goto out;
+
+	fp = fdopen(fd, "w");
+	if (!fp) {
+		close(fd);
+		unlink(tmp);
+		goto out;
+	}
+
+	if (fwrite(&hdr, sizeof hdr, 1, fp) != 1 ||
+	    fwrite(binary, size, 1, fp) != 1 ||
+	    fclose(fp) != 0 ||
+	    rename(tmp, path) < 0) {
+		weston_log("Failed to write shader cache file %s\n", path);
+		unlink(tmp);
+	}
+
+out:
+	free(tmp);
+	free(path);
+	free(binary);
+}
+
+static void
+gl_shader_get_uniforms(struct gl_shader *shader)
+{
+	shader->proj_uniform = glGetUniformLocation(shader->program, "proj");
+	shader->tex_uniforms[0] = glGetUniformLocation(shader->program, "tex");
+	shader->tex_uniforms[1] = glGetUniformLocation(shader->program, "tex1");
+	shader->tex_uniforms[2] = glGetUniformLocation(shader->program, "tex2");
+	shader->alpha_uniform = glGetUniformLocation(shader->program, "alpha");
+	shader->color_uniform = glGetUniformLocation(shader->program,
+						     "unicolor");
+}
+
 static struct gl_shader *
 gl_shader_create(struct gl_renderer *gr,
 		 const struct gl_shader_requirements *requirements)
@@ -191,6 +429,25 @@ gl_shader_create(struct gl_renderer *gr,
 	wl_list_init(&shader->link);
 	shader->key = *requirements;
 
+	if (gr->shader_cache_dir) {
+		if (gl_shader_cache_load(gr, shader)) {
+			gr->shader_cache_hits++;
+			if (verbose) {
+				char *desc;
+
+				desc = create_shader_description_string(requirements);
+				weston_log_scope_printf(gr->shader_scope,
+							"Loaded cached shader program for: %s "
+							"(%u hits, %u misses)\n",
+							desc, gr->shader_cache_hits,
+							gr->shader_cache_misses);
+				free(desc);
+			}
+			goto done;
+		}
+		gr->shader_cache_misses++;
+	}
+
 	if (verbose) {
 		char *desc;
 
@@ -223,6 +480,9 @@ gl_shader_create(struct gl_renderer *gr,
 	glAttachShader(shader->program, shader->fragment_shader);
 	glBindAttribLocation(shader->program, 0, "position");
 	glBindAttribLocation(shader->program, 1, "texcoord");
+	if (gr->shader_cache_dir)
+		glProgramParameteri(shader->program,
+				    GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
 	glLinkProgram(shader->program);
 	glGetProgramiv(shader->program, GL_LINK_STATUS, &status);
@@ -235,13 +495,11 @@ gl_shader_create(struct gl_renderer *gr,
 	glDeleteShader(shader->vertex_shader);
 	glDeleteShader(shader->fragment_shader);
 
-	shader->proj_uniform = glGetUniformLocation(shader->program, "proj");
-	shader->tex_uniforms[0] = glGetUniformLocation(shader->program, "tex");
-	shader->tex_uniforms[1] = glGetUniformLocation(shader->program, "tex1");
-	shader->tex_uniforms[2] = glGetUniformLocation(shader->program, "tex2");
-	shader->alpha_uniform = glGetUniformLocation(shader->program, "alpha");
-	shader->color_uniform = glGetUniformLocation(shader->program,
-						     "unicolor");
+	if (gr->shader_cache_dir)
+		gl_shader_cache_store(gr, shader);
+
+done:
+	gl_shader_get_uniforms(shader);
 
 	free(conf);
 
@@ -330,6 +588,15 @@ gl_shader_scope_new_subscription(struct weston_log_subscription *subs,
 					       msecs / 1000.0, desc);
 	}
 	weston_log_subscription_printf(subs, "Total: %d programs.\n", count);
+
+	if (gr->shader_cache_dir)
+		weston_log_subscription_printf(subs,
+			"Program binary cache in %s: %u hits, %u misses.\n",
+			gr->shader_cache_dir, gr->shader_cache_hits,
+			gr->shader_cache_misses);
+	else
+		weston_log_subscription_printf(subs,
+			"Program binary cache disabled.\n");
 }
 
 struct weston_log_scope *
@@ -394,6 +661,36 @@ gl_renderer_get_program(struct gl_renderer *gr,
 	return NULL;
 }
 
+/** Build the programs of all texture variants up front
+ *
+ * With the program binary cache this is mostly loading binaries, and
+ * avoids compiling shaders in the middle of a repaint later.
+ */
+void
+gl_renderer_prewarm_programs(struct gl_renderer *gr)
+{
+	int v;
+
+	for (v = SHADER_VARIANT_RGBX; v <= SHADER_VARIANT_EXTERNAL; v++) {
+		const struct gl_shader_requirements reqs = {
+			.variant = v,
+		};
+
+		if (v == SHADER_VARIANT_EXTERNAL && !gr->has_egl_image_external)
+			continue;
+
+		if (!gl_renderer_get_program(gr, &reqs))
+			weston_log("Error: failed to generate shader program "
+				   "for %s.\n",
+				   gl_shader_texture_variant_to_string(v));
+	}
+
+	weston_log_scope_printf(gr->shader_scope,
+				"Prewarmed shader programs "
+				"(%u cache hits, %u misses)\n",
+				gr->shader_cache_hits, gr->shader_cache_misses);
+}
+
 void
 gl_renderer_garbage_collect_programs(struct gl_renderer *gr)
 {
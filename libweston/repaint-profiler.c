@@ -0,0 +1,244 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Per-phase repaint timing histograms.
+ *
+ * Every phase of a repaint has a log-linear histogram in the manner of
+ * HdrHistogram: values below SUB_BUCKETS nanoseconds get a bucket each, and
+ * every power of two above that is split into SUB_BUCKETS linear buckets,
+ * bounding the relative error of the reported percentiles to 1/SUB_BUCKETS.
+ * Recording a value is a couple of instructions and never allocates.
+ *
+ * The histograms are summarised and reset once per REPORT_INTERVAL.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libweston/libweston.h>
+#include <libweston/weston-log.h>
+#include <libweston/zalloc.h>
+#include "repaint-profiler.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+
+/* Values up to 2^MAX_BITS ns, a little over 17 minutes */
+#define MAX_BITS 40
+#define N_BUCKETS (SUB_BUCKETS + (MAX_BITS - SUB_BUCKET_BITS) * SUB_BUCKETS)
+
+#define REPORT_INTERVAL_MSEC 1000
+
+struct histogram {
+	uint32_t buckets[N_BUCKETS];
+	uint32_t count;
+	int64_t min;
+	int64_t max;
+};
+
+struct weston_repaint_profiler {
+	struct histogram phases[WESTON_REPAINT_PHASE_COUNT];
+	struct timespec last_report;
+};
+
+static const char * const phase_names[] = {
+	[WESTON_REPAINT_PHASE_BEGIN] = "repaint_begin",
+	[WESTON_REPAINT_PHASE_VIEW_LIST] = "build_view_list",
+	[WESTON_REPAINT_PHASE_ASSIGN_PLANES] = "assign_planes",
+	[WESTON_REPAINT_PHASE_ACCUMULATE_DAMAGE] = "accumulate_damage",
+	[WESTON_REPAINT_PHASE_RENDER] = "repaint_output",
+	[WESTON_REPAINT_PHASE_POST] = "post_repaint",
+	[WESTON_REPAINT_PHASE_FLUSH] = "repaint_flush",
+	[WESTON_REPAINT_PHASE_TOTAL] = "total",
+};
+
+static unsigned int
+bucket_index(int64_t value)
+{
+	unsigned int msb;
+	unsigned int i;
+
+	if (value < SUB_BUCKETS)
+		return value < 0 ? 0 : value;
+
+	msb = 63 - __builtin_clzll(value);
+	if (msb >= MAX_BITS)
+		return N_BUCKETS - 1;
+
+	i = (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+	i += (value >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+
+	return i;
+}
+
+/* The largest value falling into a bucket */
+static int64_t
+bucket_upper_bound(unsigned int i)
+{
+	unsigned int shift;
+	int64_t sub;
+
+	if (i < SUB_BUCKETS)
+		return i;
+
+	shift = i / SUB_BUCKETS - 1;
+	sub = SUB_BUCKETS + i % SUB_BUCKETS;
+
+	return ((sub + 1) << shift) - 1;
+}
+
+static void
+histogram_record(struct histogram *h, int64_t value)
+{
+	if (h->count == 0 || value < h->min)
+		h->min = value;
+	if (h->count == 0 || value > h->max)
+		h->max = value;
+
+	h->buckets[bucket_index(value)]++;
+	h->count++;
+}
+
+static int64_t
+histogram_percentile(const struct histogram *h, unsigned int percentile)
+{
+	uint64_t rank;
+	uint64_t seen = 0;
+	unsigned int i;
+
+	/* nearest-rank */
+	rank = ((uint64_t)h->count * percentile + 99) / 100;
+	if (rank == 0)
+		rank = 1;
+
+	for (i = 0; i < N_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank)
+			return MIN(MAX(bucket_upper_bound(i), h->min), h->max);
+	}
+
+	return h->max;
+}
+
+struct weston_repaint_profiler *
+weston_repaint_profiler_create(void)
+{
+	return zalloc(sizeof(struct weston_repaint_profiler));
+}
+
+void
+weston_repaint_profiler_destroy(struct weston_repaint_profiler *prof)
+{
+	free(prof);
+}
+
+/** Record the duration of a repaint phase in nanoseconds */
+void
+weston_repaint_profiler_record(struct weston_repaint_profiler *prof,
+			       enum weston_repaint_phase phase,
+			       int64_t nsec)
+{
+	assert(phase < WESTON_REPAINT_PHASE_COUNT);
+
+	histogram_record(&prof->phases[phase], nsec);
+}
+
+/** Get a percentile of the durations of a phase since the last summary
+ *
+ * \param prof The profiler.
+ * \param phase The repaint phase.
+ * \param percentile The percentile, 1 to 100.
+ * \return The duration in nanoseconds, within 1/8 above the exact
+ * nearest-rank percentile, or -1 without samples.
+ */
+int64_t
+weston_repaint_profiler_percentile(struct weston_repaint_profiler *prof,
+				   enum weston_repaint_phase phase,
+				   unsigned int percentile)
+{
+	assert(phase < WESTON_REPAINT_PHASE_COUNT);
+
+	if (prof->phases[phase].count == 0)
+		return -1;
+
+	return histogram_percentile(&prof->phases[phase], percentile);
+}
+
+/** Print a summary of the phase durations if one is due
+ *
+ * \param prof The profiler of an output.
+ * \param scope The log scope to print to.
+ * \param name Name of the output.
+ * \param now Current time.
+ *
+ * Once the reporting interval has passed since the previous summary, prints
+ * the minimum, median, 99th percentile and maximum of each phase in
+ * microseconds and starts over with empty histograms.
+ */
+void
+weston_repaint_profiler_report(struct weston_repaint_profiler *prof,
+			       struct weston_log_scope *scope,
+			       const char *name,
+			       const struct timespec *now)
+{
+	unsigned int i;
+
+	if (prof->last_report.tv_sec == 0 && prof->last_report.tv_nsec == 0)
+		prof->last_report = *now;
+
+	if (timespec_sub_to_msec(now, &prof->last_report) <
+	    REPORT_INTERVAL_MSEC)
+		return;
+
+	weston_log_scope_printf(scope, "%s: repaint phases over %lld ms, "
+				"min/p50/p99/max in us\n", name,
+				(long long)timespec_sub_to_msec(now,
+							&prof->last_report));
+
+	for (i = 0; i < WESTON_REPAINT_PHASE_COUNT; i++) {
+		struct histogram *h = &prof->phases[i];
+
+		if (h->count == 0)
+			continue;
+
+		weston_log_scope_printf(scope,
+					"  %-18s %6u  %9.1f %9.1f %9.1f %9.1f\n",
+					phase_names[i], h->count,
+					h->min / 1000.0,
+					histogram_percentile(h, 50) / 1000.0,
+					histogram_percentile(h, 99) / 1000.0,
+					h->max / 1000.0);
+	}
+
+	memset(prof->phases, 0, sizeof prof->phases);
+	prof->last_report = *now;
+}
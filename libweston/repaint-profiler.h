@@ -0,0 +1,71 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef WESTON_REPAINT_PROFILER_H
+#define WESTON_REPAINT_PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+struct weston_log_scope;
+struct weston_repaint_profiler;
+
+enum weston_repaint_phase {
+	WESTON_REPAINT_PHASE_BEGIN = 0,		/* backend repaint_begin */
+	WESTON_REPAINT_PHASE_VIEW_LIST,		/* build_view_list */
+	WESTON_REPAINT_PHASE_ASSIGN_PLANES,
+	WESTON_REPAINT_PHASE_ACCUMULATE_DAMAGE,
+	WESTON_REPAINT_PHASE_RENDER,		/* weston_output::repaint */
+	WESTON_REPAINT_PHASE_POST,		/* repick, frame callbacks */
+	WESTON_REPAINT_PHASE_FLUSH,		/* backend repaint_flush */
+	WESTON_REPAINT_PHASE_TOTAL,
+	WESTON_REPAINT_PHASE_COUNT
+};
+
+struct weston_repaint_profiler *
+weston_repaint_profiler_create(void);
+
+void
+weston_repaint_profiler_destroy(struct weston_repaint_profiler *prof);
+
+void
+weston_repaint_profiler_record(struct weston_repaint_profiler *prof,
+			       enum weston_repaint_phase phase,
+			       int64_t nsec);
+
+int64_t
+weston_repaint_profiler_percentile(struct weston_repaint_profiler *prof,
+				   enum weston_repaint_phase phase,
+				   unsigned int percentile);
+
+void
+weston_repaint_profiler_report(struct weston_repaint_profiler *prof,
+			       struct weston_log_scope *scope,
+			       const char *name,
+			       const struct timespec *now);
+
+#endif /* WESTON_REPAINT_PROFILER_H */
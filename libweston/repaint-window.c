@@ -0,0 +1,121 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Moving percentile of the time an output needs from the start of a repaint
+ * cycle until the backend has submitted the frame.
+ *
+ * The last WINDOW_SAMPLES measurements are kept in a ring. The percentile is
+ * read from a sorted scratch copy; the ring is small enough for that to be
+ * cheaper than maintaining an ordered structure on every sample.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libweston/zalloc.h>
+#include "repaint-window.h"
+
+/* About two seconds at 60 Hz */
+#define WINDOW_SAMPLES 128
+
+/* Below this many samples the percentile is meaningless. */
+#define WINDOW_MIN_SAMPLES 16
+
+struct weston_repaint_window {
+	int64_t samples[WINDOW_SAMPLES];
+	unsigned int count;
+	unsigned int next;
+
+	int64_t scratch[WINDOW_SAMPLES];
+};
+
+struct weston_repaint_window *
+weston_repaint_window_create(void)
+{
+	return zalloc(sizeof(struct weston_repaint_window));
+}
+
+void
+weston_repaint_window_destroy(struct weston_repaint_window *rw)
+{
+	free(rw);
+}
+
+/** Record how long a repaint took, in nanoseconds */
+void
+weston_repaint_window_add_sample(struct weston_repaint_window *rw,
+				 int64_t nsec)
+{
+	if (nsec < 0)
+		nsec = 0;
+
+	rw->samples[rw->next] = nsec;
+	rw->next = (rw->next + 1) % WINDOW_SAMPLES;
+	if (rw->count < WINDOW_SAMPLES)
+		rw->count++;
+}
+
+static int
+compare_int64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/** Get the given percentile of the recorded repaint times
+ *
+ * \param rw The repaint time history.
+ * \param percentile Percentile in the range [1, 100].
+ * \return The repaint time in nanoseconds, or -1 if not enough samples have
+ * been recorded yet.
+ */
+int64_t
+weston_repaint_window_percentile(struct weston_repaint_window *rw,
+				 int percentile)
+{
+	unsigned int k;
+
+	assert(percentile > 0 && percentile <= 100);
+
+	if (rw->count < WINDOW_MIN_SAMPLES)
+		return -1;
+
+	/* nearest-rank */
+	k = (rw->count * percentile + 99) / 100;
+	if (k > 0)
+		k--;
+
+	memcpy(rw->scratch, rw->samples, rw->count * sizeof rw->samples[0]);
+	qsort(rw->scratch, rw->count, sizeof rw->scratch[0], compare_int64);
+
+	return rw->scratch[k];
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef WESTON_REPAINT_WINDOW_H
+#define WESTON_REPAINT_WINDOW_H
+
+#include <stdint.h>
+
+struct weston_repaint_window;
+
+struct weston_repaint_window *
+weston_repaint_window_create(void);
+
+void
+weston_repaint_window_destroy(struct weston_repaint_window *rw);
+
+void
+weston_repaint_window_add_sample(struct weston_repaint_window *rw,
+				 int64_t nsec);
+
+int64_t
+weston_repaint_window_percentile(struct weston_repaint_window *rw,
+				 int percentile);
+
+#endif /* WESTON_REPAINT_WINDOW_H */
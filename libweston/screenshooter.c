@@ -33,7 +33,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
-#include <sys/uio.h>
+#include <pthread.h>
+#include <signal.h>
 
 #include <libweston/libweston.h>
 #include "shared/helpers.h"
@@ -41,12 +42,16 @@
 #include "backend.h"
 #include "libweston-internal.h"
 
-#include "wcap/wcap-decode.h"
+#include "shared/wcap-format.h"
+#include "shared/wcap-rle.h"
+#include "recorder-encode.h"
 
 struct screenshooter_frame_listener {
 	struct wl_listener listener;
 	struct weston_buffer *buffer;
+	struct wl_listener buffer_destroy_listener;
 	struct weston_output *output;
+	uint8_t *pixels;
 	weston_screenshooter_done_func_t done;
 	void *data;
 };
@@ -115,36 +120,45 @@ copy_rgba(uint8_t *dst, uint8_t *src, int height, int stride)
 }
 
 static void
-screenshooter_frame_notify(struct wl_listener *listener, void *data)
+screenshooter_frame_listener_destroy(struct screenshooter_frame_listener *l)
+{
+	if (l->buffer)
+		wl_list_remove(&l->buffer_destroy_listener.link);
+	free(l->pixels);
+	free(l);
+}
+
+static void
+screenshooter_buffer_destroy(struct wl_listener *listener, void *data)
 {
 	struct screenshooter_frame_listener *l =
-		container_of(listener,
-			     struct screenshooter_frame_listener, listener);
+		container_of(listener, struct screenshooter_frame_listener,
+			     buffer_destroy_listener);
+
+	wl_list_remove(&l->buffer_destroy_listener.link);
+	l->buffer = NULL;
+}
+
+/* Copy the pixels read back from the whole output into the client's
+ * buffer and complete the screenshot. */
+static void
+screenshooter_finish(struct screenshooter_frame_listener *l)
+{
 	struct weston_output *output = l->output;
 	struct weston_compositor *compositor = output->compositor;
 	int32_t stride;
-	uint8_t *pixels, *d, *s;
+	uint8_t *d, *s;
 
-	weston_output_disable_planes_decr(output);
-	wl_list_remove(&listener->link);
-	stride = l->buffer->width * (PIXMAN_FORMAT_BPP(compositor->read_format) / 8);
-	pixels = malloc(stride * l->buffer->height);
-
-	if (pixels == NULL) {
-		l->done(l->data, WESTON_SCREENSHOOTER_NO_MEMORY);
-		free(l);
+	if (!l->buffer) {
+		l->done(l->data, WESTON_SCREENSHOOTER_BAD_BUFFER);
+		screenshooter_frame_listener_destroy(l);
 		return;
 	}
 
-	compositor->renderer->read_pixels(output,
-			     compositor->read_format, pixels,
-			     0, 0, output->current_mode->width,
-			     output->current_mode->height);
-
 	stride = wl_shm_buffer_get_stride(l->buffer->shm_buffer);
 
 	d = wl_shm_buffer_get_data(l->buffer->shm_buffer);
-	s = pixels + stride * (l->buffer->height - 1);
+	s = l->pixels + stride * (l->buffer->height - 1);
 
 	wl_shm_buffer_begin_access(l->buffer->shm_buffer);
 
@@ -154,14 +168,14 @@ screenshooter_frame_notify(struct wl_listener *listener, void *data)
 		if (compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP)
 			copy_bgra_yflip(d, s, output->current_mode->height, stride);
 		else
-			copy_bgra(d, pixels, output->current_mode->height, stride);
+			copy_bgra(d, l->pixels, output->current_mode->height, stride);
 		break;
 	case PIXMAN_x8b8g8r8:
 	case PIXMAN_a8b8g8r8:
 		if (compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP)
 			copy_rgba_yflip(d, s, output->current_mode->height, stride);
 		else
-			copy_rgba(d, pixels, output->current_mode->height, stride);
+			copy_rgba(d, l->pixels, output->current_mode->height, stride);
 		break;
 	default:
 		break;
@@ -170,8 +184,66 @@ screenshooter_frame_notify(struct wl_listener *listener, void *data)
 	wl_shm_buffer_end_access(l->buffer->shm_buffer);
 
 	l->done(l->data, WESTON_SCREENSHOOTER_SUCCESS);
-	free(pixels);
-	free(l);
+	screenshooter_frame_listener_destroy(l);
+}
+
+static void
+screenshooter_frame_notify(struct wl_listener *listener, void *data)
+{
+	struct screenshooter_frame_listener *l =
+		container_of(listener,
+			     struct screenshooter_frame_listener, listener);
+	struct weston_output *output = l->output;
+	struct weston_compositor *compositor = output->compositor;
+
+	weston_output_disable_planes_decr(output);
+	wl_list_remove(&listener->link);
+
+	compositor->renderer->read_pixels(output,
+			     compositor->read_format, l->pixels,
+			     0, 0, output->current_mode->width,
+			     output->current_mode->height);
+
+	screenshooter_finish(l);
+}
+
+static void
+screenshooter_capture_done(void *data, bool success)
+{
+	struct screenshooter_frame_listener *l = data;
+
+	if (!success) {
+		l->done(l->data, WESTON_SCREENSHOOTER_NO_MEMORY);
+		screenshooter_frame_listener_destroy(l);
+		return;
+	}
+
+	screenshooter_finish(l);
+}
+
+/* Capture the scene off-screen, keeping the planes of the displayed frame.
+ * Renderers that cannot do that get the output repainted without planes
+ * and read back. */
+static void
+screenshooter_capture_notify(struct wl_listener *listener, void *data)
+{
+	struct screenshooter_frame_listener *l =
+		container_of(listener,
+			     struct screenshooter_frame_listener, listener);
+	struct weston_output *output = l->output;
+
+	wl_list_remove(&listener->link);
+
+	if (weston_output_capture_async(output,
+					output->compositor->read_format,
+					l->pixels, screenshooter_capture_done,
+					l) == 0)
+		return;
+
+	l->listener.notify = screenshooter_frame_notify;
+	wl_signal_add(&output->frame_signal, &l->listener);
+	weston_output_disable_planes_incr(output);
+	weston_output_schedule_repaint(output);
 }
 
 WL_EXPORT int
@@ -179,7 +251,9 @@ weston_screenshooter_shoot(struct weston_output *output,
 			   struct weston_buffer *buffer,
 			   weston_screenshooter_done_func_t done, void *data)
 {
+	struct weston_compositor *compositor = output->compositor;
 	struct screenshooter_frame_listener *l;
+	int32_t stride;
 
 	if (!wl_shm_buffer_get(buffer->resource)) {
 		done(data, WESTON_SCREENSHOOTER_BAD_BUFFER);
@@ -196,67 +270,208 @@ weston_screenshooter_shoot(struct weston_output *output,
 		return -1;
 	}
 
-	l = malloc(sizeof *l);
+	l = zalloc(sizeof *l);
 	if (l == NULL) {
 		done(data, WESTON_SCREENSHOOTER_NO_MEMORY);
 		return -1;
 	}
 
+	stride = buffer->width * (PIXMAN_FORMAT_BPP(compositor->read_format) / 8);
+	l->pixels = malloc(stride * buffer->height);
+	if (l->pixels == NULL) {
+		free(l);
+		done(data, WESTON_SCREENSHOOTER_NO_MEMORY);
+		return -1;
+	}
+
 	l->buffer = buffer;
+	l->buffer_destroy_listener.notify = screenshooter_buffer_destroy;
+	wl_signal_add(&buffer->destroy_signal, &l->buffer_destroy_listener);
 	l->output = output;
 	l->done = done;
 	l->data = data;
-	l->listener.notify = screenshooter_frame_notify;
+
+	/* The capture happens on the next frame, when the paint node list
+	 * and the surface contents are up to date. */
+	if (compositor->renderer->capture_output_async) {
+		l->listener.notify = screenshooter_capture_notify;
+	} else {
+		l->listener.notify = screenshooter_frame_notify;
+		weston_output_disable_planes_incr(output);
+	}
 	wl_signal_add(&output->frame_signal, &l->listener);
-	weston_output_disable_planes_incr(output);
 	weston_output_schedule_repaint(output);
 
 	return 0;
 }
 
+/* Frames being read back or encoded at most; later ones are dropped. */
+#define RECORDER_QUEUE_LENGTH 4
+/* Encoded data is written out in chunks of at least this many bytes, or
+ * whenever the encoder runs out of work. */
+#define RECORDER_WRITE_BATCH (1024 * 1024)
 struct weston_recorder {
 	struct weston_output *output;
-	uint32_t *frame, *rect;
-	uint32_t *tmpbuf;
-	uint32_t total;
-	int fd;
 	struct wl_listener frame_listener;
-	int count, destroying;
+	struct wl_list capture_list; /* weston_recorder_capture::link */
+	int destroying;
+
+	/* Damage of dropped frames, in framebuffer coordinates, to be
+	 * read back with the next frame. */
+	pixman_region32_t missed_damage;
+	int dropped;
+
+	/* Shared with the encoder thread */
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t queue_cond;
+	struct wl_list queue; /* weston_recorder_capture::link */
+	int queue_length; /* including the frame being encoded */
+	bool stopping;
+
+	/* Only touched by the encoder thread while it runs */
+	struct weston_recorder_encoder encoder;
+};
+
+/* The damaged pixels of one frame, being read back and then encoded */
+struct weston_recorder_capture {
+	struct weston_recorder *recorder;
+	struct wl_list link; /* weston_recorder::capture_list, then ::queue */
+	uint32_t msecs;
+	pixman_region32_t damage; /* in framebuffer coordinates */
+	uint32_t *pixels; /* the rectangles of damage, one after another */
+	int pending; /* read backs not done yet */
+	bool failed;
 };
 
-static uint32_t *
-output_run(uint32_t *p, uint32_t delta, int run)
+static void
+weston_recorder_destroy(struct weston_recorder *recorder);
+
+static void
+weston_recorder_capture_destroy(struct weston_recorder_capture *capture)
 {
-	int i;
+	pixman_region32_fini(&capture->damage);
+	free(capture->pixels);
+	free(capture);
+}
 
-	while (run > 0) {
-		if (run <= 0xe0) {
-			*p++ = delta | ((run - 1) << 24);
-			break;
+static void *
+weston_recorder_thread(void *data)
+{
+	struct weston_recorder *recorder = data;
+	struct weston_recorder_capture *capture;
+
+	pthread_mutex_lock(&recorder->mutex);
+	for (;;) {
+		if (!wl_list_empty(&recorder->queue)) {
+			capture = container_of(recorder->queue.next,
+					       struct weston_recorder_capture,
+					       link);
+			wl_list_remove(&capture->link);
+			pthread_mutex_unlock(&recorder->mutex);
+
+			weston_recorder_encode_capture(&recorder->encoder,
+						       capture->msecs,
+						       &capture->damage,
+						       capture->pixels);
+			weston_recorder_capture_destroy(capture);
+			if (recorder->encoder.out.size >= RECORDER_WRITE_BATCH)
+				weston_recorder_write_out(&recorder->encoder);
+
+			pthread_mutex_lock(&recorder->mutex);
+			recorder->queue_length--;
+			continue;
 		}
 
-		i = 24 - __builtin_clz(run);
-		*p++ = delta | ((i + 0xe0) << 24);
-		run -= 1 << (7 + i);
+		if (recorder->encoder.out.size > 0) {
+			pthread_mutex_unlock(&recorder->mutex);
+			weston_recorder_write_out(&recorder->encoder);
+			pthread_mutex_lock(&recorder->mutex);
+			continue;
+		}
+
+		if (recorder->stopping)
+			break;
+
+		pthread_cond_wait(&recorder->queue_cond, &recorder->mutex);
 	}
+	pthread_mutex_unlock(&recorder->mutex);
+
+	weston_recorder_encode_index(&recorder->encoder);
+	weston_recorder_write_out(&recorder->encoder);
 
-	return p;
+	return NULL;
 }
 
-static uint32_t
-component_delta(uint32_t next, uint32_t prev)
+/* Hand the frames that have been read back to the encoder, in order.
+ * Destroys the recorder once it is stopping and nothing is left in
+ * flight. */
+static void
+weston_recorder_flush(struct weston_recorder *recorder)
 {
-	unsigned char dr, dg, db;
+	struct weston_recorder_capture *capture;
 
-	dr = (next >> 16) - (prev >> 16);
-	dg = (next >>  8) - (prev >>  8);
-	db = (next >>  0) - (prev >>  0);
+	while (!wl_list_empty(&recorder->capture_list)) {
+		capture = container_of(recorder->capture_list.next,
+				       struct weston_recorder_capture, link);
+		if (capture->pending > 0)
+			break;
+
+		wl_list_remove(&capture->link);
+
+		if (capture->failed) {
+			weston_log("recorder: failed to read back frame, "
+				   "dropping it\n");
+			pixman_region32_union(&recorder->missed_damage,
+					      &recorder->missed_damage,
+					      &capture->damage);
+			recorder->dropped++;
+			weston_recorder_capture_destroy(capture);
+
+			pthread_mutex_lock(&recorder->mutex);
+			recorder->queue_length--;
+			pthread_mutex_unlock(&recorder->mutex);
+			continue;
+		}
+
+		pthread_mutex_lock(&recorder->mutex);
+		wl_list_insert(recorder->queue.prev, &capture->link);
+		pthread_cond_signal(&recorder->queue_cond);
+		pthread_mutex_unlock(&recorder->mutex);
+	}
 
-	return (dr << 16) | (dg << 8) | (db << 0);
+	if (recorder->destroying && wl_list_empty(&recorder->capture_list))
+		weston_recorder_destroy(recorder);
 }
 
 static void
-weston_recorder_destroy(struct weston_recorder *recorder);
+weston_recorder_capture_done(void *data, bool success)
+{
+	struct weston_recorder_capture *capture = data;
+
+	if (!success)
+		capture->failed = true;
+
+	if (--capture->pending > 0)
+		return;
+
+	weston_recorder_flush(capture->recorder);
+}
+
+/* Whether the encoder has fallen too far behind to take another frame.
+ * The queue length counts frames from the moment their read back is
+ * issued until they have been encoded. */
+static bool
+weston_recorder_queue_full(struct weston_recorder *recorder)
+{
+	int length;
+
+	pthread_mutex_lock(&recorder->mutex);
+	length = recorder->queue_length;
+	pthread_mutex_unlock(&recorder->mutex);
+
+	return length >= RECORDER_QUEUE_LENGTH;
+}
 
 static void
 weston_recorder_frame_notify(struct wl_listener *listener, void *data)
@@ -265,25 +480,13 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 		container_of(listener, struct weston_recorder, frame_listener);
 	struct weston_output *output = recorder->output;
 	struct weston_compositor *compositor = output->compositor;
-	uint32_t msecs = timespec_to_msec(&output->frame_time);
+	struct weston_recorder_capture *capture = NULL;
 	pixman_box32_t *r;
 	pixman_region32_t damage, transformed_damage;
-	int i, j, k, n, width, height, run, stride;
-	uint32_t delta, prev, *d, *s, *p, next;
-	struct {
-		uint32_t msecs;
-		uint32_t nrects;
-	} header;
-	struct iovec v[2];
-	int do_yflip;
+	uint32_t *pixels;
+	size_t size = 0;
+	int i, n, width, height;
 	int y_orig;
-	uint32_t *outbuf;
-
-	do_yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
-	if (do_yflip)
-		outbuf = recorder->rect;
-	else
-		outbuf = recorder->tmpbuf;
 
 	pixman_region32_init(&damage);
 	pixman_region32_init(&transformed_damage);
@@ -294,78 +497,83 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 				 &damage, &transformed_damage);
 	pixman_region32_fini(&damage);
 
+	if (recorder->destroying) {
+		wl_list_remove(&recorder->frame_listener.link);
+		wl_list_init(&recorder->frame_listener.link);
+	}
+
+	if (pixman_region32_not_empty(&transformed_damage) &&
+	    weston_recorder_queue_full(recorder)) {
+		pixman_region32_union(&recorder->missed_damage,
+				      &recorder->missed_damage,
+				      &transformed_damage);
+		pixman_region32_fini(&transformed_damage);
+		recorder->dropped++;
+		weston_recorder_flush(recorder);
+		return;
+	}
+
+	pixman_region32_union(&transformed_damage, &transformed_damage,
+			      &recorder->missed_damage);
+
 	r = pixman_region32_rectangles(&transformed_damage, &n);
-	if (n == 0) {
+	for (i = 0; i < n; i++)
+		size += (size_t)(r[i].x2 - r[i].x1) * (r[i].y2 - r[i].y1) * 4;
+
+	if (n > 0)
+		capture = zalloc(sizeof *capture);
+	if (capture)
+		capture->pixels = malloc(size);
+	if (capture && !capture->pixels) {
+		free(capture);
+		capture = NULL;
+	}
+	if (n > 0 && !capture)
+		weston_log("%s: out of memory\n", __func__);
+
+	if (!capture) {
 		pixman_region32_fini(&transformed_damage);
+		weston_recorder_flush(recorder);
 		return;
 	}
 
-	header.msecs = msecs;
-	header.nrects = n;
-	v[0].iov_base = &header;
-	v[0].iov_len = sizeof header;
-	v[1].iov_base = r;
-	v[1].iov_len = n * sizeof *r;
-	recorder->total += writev(recorder->fd, v, 2);
-	stride = output->current_mode->width;
+	pixman_region32_clear(&recorder->missed_damage);
 
+	capture->recorder = recorder;
+	capture->msecs = timespec_to_msec(&output->frame_time);
+	capture->damage = transformed_damage;
+	/* Held until all read backs have been queued */
+	capture->pending = 1;
+	wl_list_insert(recorder->capture_list.prev, &capture->link);
+
+	pthread_mutex_lock(&recorder->mutex);
+	recorder->queue_length++;
+	pthread_mutex_unlock(&recorder->mutex);
+
+	pixels = capture->pixels;
 	for (i = 0; i < n; i++) {
 		width = r[i].x2 - r[i].x1;
 		height = r[i].y2 - r[i].y1;
 
-		if (do_yflip)
+		if (recorder->encoder.yflip)
 			y_orig = output->current_mode->height - r[i].y2;
 		else
 			y_orig = r[i].y1;
 
-		compositor->renderer->read_pixels(output,
-				compositor->read_format, recorder->rect,
-				r[i].x1, y_orig, width, height);
-
-		p = outbuf;
-		run = prev = 0; /* quiet gcc */
-		for (j = 0; j < height; j++) {
-			if (do_yflip)
-				s = recorder->rect + width * j;
-			else
-				s = recorder->rect + width * (height - j - 1);
-			y_orig = r[i].y2 - j - 1;
-			d = recorder->frame + stride * y_orig + r[i].x1;
-
-			for (k = 0; k < width; k++) {
-				next = *s++;
-				delta = component_delta(next, *d);
-				*d++ = next;
-				if (run == 0 || delta == prev) {
-					run++;
-				} else {
-					p = output_run(p, prev, run);
-					run = 1;
-				}
-				prev = delta;
-			}
+		capture->pending++;
+		if (weston_output_read_pixels_async(output,
+						    compositor->read_format,
+						    pixels, r[i].x1, y_orig,
+						    width, height,
+						    weston_recorder_capture_done,
+						    capture) < 0) {
+			capture->pending--;
+			capture->failed = true;
 		}
-
-		p = output_run(p, prev, run);
-
-		recorder->total += write(recorder->fd,
-					 outbuf, (p - outbuf) * 4);
-
-#if 0
-		fprintf(stderr,
-			"%dx%d at %d,%d rle from %d to %d bytes (%f) total %dM\n",
-			width, height, r[i].x1, r[i].y1,
-			width * height * 4, (int) (p - outbuf) * 4,
-			(float) (p - outbuf) / (width * height),
-			recorder->total / 1024 / 1024);
-#endif
+		pixels += width * height;
 	}
 
-	pixman_region32_fini(&transformed_damage);
-	recorder->count++;
-
-	if (recorder->destroying)
-		weston_recorder_destroy(recorder);
+	weston_recorder_capture_done(capture, true);
 }
 
 static void
@@ -374,9 +582,8 @@ weston_recorder_free(struct weston_recorder *recorder)
 	if (recorder == NULL)
 		return;
 
-	free(recorder->tmpbuf);
-	free(recorder->rect);
-	free(recorder->frame);
+	pixman_region32_fini(&recorder->missed_damage);
+	weston_recorder_encoder_fini(&recorder->encoder);
 	free(recorder);
 }
 
@@ -385,11 +592,10 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 {
 	struct weston_compositor *compositor = output->compositor;
 	struct weston_recorder *recorder;
-	int stride, size;
-	struct { uint32_t magic, format, width, height; } header;
-	int do_yflip;
-
-	do_yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
+	sigset_t mask, old_mask;
+	uint32_t format;
+	bool yflip;
+	int fd, ret;
 
 	recorder = zalloc(sizeof *recorder);
 	if (recorder == NULL) {
@@ -397,52 +603,65 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 		return NULL;
 	}
 
-	stride = output->current_mode->width;
-	size = stride * 4 * output->current_mode->height;
-	recorder->frame = zalloc(size);
-	recorder->rect = malloc(size);
 	recorder->output = output;
-
-	if ((recorder->frame == NULL) || (recorder->rect == NULL)) {
-		weston_log("%s: out of memory\n", __func__);
-		goto err_recorder;
-	}
-
-	if (!do_yflip) {
-		recorder->tmpbuf = malloc(size);
-		if (recorder->tmpbuf == NULL) {
-			weston_log("%s: out of memory\n", __func__);
-			goto err_recorder;
-		}
-	}
-
-	header.magic = WCAP_HEADER_MAGIC;
+	wl_list_init(&recorder->capture_list);
+	wl_list_init(&recorder->queue);
+	pixman_region32_init(&recorder->missed_damage);
 
 	switch (compositor->read_format) {
 	case PIXMAN_x8r8g8b8:
 	case PIXMAN_a8r8g8b8:
-		header.format = WCAP_FORMAT_XRGB8888;
+		format = WCAP_FORMAT_XRGB8888;
 		break;
 	case PIXMAN_a8b8g8r8:
-		header.format = WCAP_FORMAT_XBGR8888;
+		format = WCAP_FORMAT_XBGR8888;
 		break;
 	default:
 		weston_log("unknown recorder format\n");
 		goto err_recorder;
 	}
 
-	recorder->fd = open(filename,
-			    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-
-	if (recorder->fd < 0) {
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
 		weston_log("problem opening output file %s: %s\n", filename,
 			   strerror(errno));
 		goto err_recorder;
 	}
 
-	header.width = output->current_mode->width;
-	header.height = output->current_mode->height;
-	recorder->total += write(recorder->fd, &header, sizeof header);
+	yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
+	if (weston_recorder_encoder_init(&recorder->encoder, fd,
+					 output->current_mode->width,
+					 output->current_mode->height,
+					 yflip) < 0) {
+		weston_log("%s: out of memory\n", __func__);
+		goto err_file;
+	}
+
+	if (weston_recorder_write_header(&recorder->encoder, format) < 0) {
+		weston_log("problem writing output file %s: %s\n", filename,
+			   strerror(errno));
+		goto err_file;
+	}
+
+	pthread_mutex_init(&recorder->mutex, NULL);
+	pthread_cond_init(&recorder->queue_cond, NULL);
+
+	/* Leave asynchronous signals to the main thread. */
+	sigfillset(&mask);
+	sigdelset(&mask, SIGBUS);
+	sigdelset(&mask, SIGSEGV);
+	sigdelset(&mask, SIGFPE);
+	sigdelset(&mask, SIGILL);
+	pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+	ret = pthread_create(&recorder->thread, NULL,
+			     weston_recorder_thread, recorder);
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+	if (ret != 0) {
+		weston_log("recorder: failed to start encoder thread: %s\n",
+			   strerror(ret));
+		goto err_thread;
+	}
 
 	recorder->frame_listener.notify = weston_recorder_frame_notify;
 	wl_signal_add(&output->frame_signal, &recorder->frame_listener);
@@ -451,17 +670,41 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 
 	return recorder;
 
+err_thread:
+	pthread_cond_destroy(&recorder->queue_cond);
+	pthread_mutex_destroy(&recorder->mutex);
+err_file:
+	close(fd);
 err_recorder:
 	weston_recorder_free(recorder);
 	return NULL;
 }
 
+/* Waits for the encoder to finish the frames queued already. */
 static void
 weston_recorder_destroy(struct weston_recorder *recorder)
 {
 	wl_list_remove(&recorder->frame_listener.link);
-	close(recorder->fd);
 	weston_output_disable_planes_decr(recorder->output);
+
+	pthread_mutex_lock(&recorder->mutex);
+	recorder->stopping = true;
+	pthread_cond_signal(&recorder->queue_cond);
+	pthread_mutex_unlock(&recorder->mutex);
+
+	pthread_join(recorder->thread, NULL);
+	pthread_cond_destroy(&recorder->queue_cond);
+	pthread_mutex_destroy(&recorder->mutex);
+	close(recorder->encoder.fd);
+
+	if (recorder->encoder.write_errno != 0)
+		weston_log("recorder: writing the capture failed: %s\n",
+			   strerror(recorder->encoder.write_errno));
+	weston_log("recorder stopped, total file size %dM, %d frames, "
+		   "%d dropped\n",
+		   (int)(recorder->encoder.total / (1024 * 1024)),
+		   recorder->encoder.count, recorder->dropped);
+
 	weston_recorder_free(recorder);
 }
 
@@ -478,16 +721,17 @@ weston_recorder_start(struct weston_output *output, const char *filename)
 		return NULL;
 	}
 
-	weston_log("starting recorder for output %s, file %s\n",
-		   output->name, filename);
+	weston_log("starting recorder for output %s, file %s, "
+		   "using %s encoding\n", output->name, filename,
+		   wcap_kernels_get()->name);
 	return weston_recorder_create(output, filename);
 }
 
 WL_EXPORT void
 weston_recorder_stop(struct weston_recorder *recorder)
 {
-	weston_log("stopping recorder, total file size %dM, %d frames\n",
-		   recorder->total / (1024 * 1024), recorder->count);
+	weston_log("stopping recorder on output %s\n",
+		   recorder->output->name);
 
 	recorder->destroying = 1;
 	weston_output_schedule_repaint(recorder->output);
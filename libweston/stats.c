@@ -0,0 +1,351 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Monotonic counters of what the compositor does, per output and per
+ * client, for monitoring throughput in production. Counting is an
+ * addition, plus a short list walk to find a client's counters. While
+ * the 'stats' log scope has subscribers, a snapshot of all counters is
+ * printed every SNAPSHOT_INTERVAL_MSEC, one line per output and client:
+ *
+ *   <sec>.<nsec> output <name> repaints=<n> missed_deadlines=<n> ...
+ *   <sec>.<nsec> client <id> pid=<pid> commits=<n> shm_bytes=<n> ...
+ *
+ * The time is CLOCK_MONOTONIC. The counters of a client are printed one
+ * last time with 'disconnected' at the end of the line when it goes away.
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include <libweston/libweston.h>
+#include <libweston/weston-log.h>
+#include <libweston/zalloc.h>
+#include "stats.h"
+#include "shared/helpers.h"
+
+#define SNAPSHOT_INTERVAL_MSEC 1000
+
+struct weston_output_counters {
+	uint64_t counters[WESTON_OUTPUT_COUNTER_COUNT];
+};
+
+struct weston_client_counters {
+	struct weston_stats *stats;
+	struct wl_listener destroy_listener;
+	struct wl_list link;		/* weston_stats::client_list */
+	unsigned int id;
+	pid_t pid;
+	uint64_t counters[WESTON_CLIENT_COUNTER_COUNT];
+};
+
+struct weston_stats {
+	struct weston_compositor *compositor;
+	struct weston_log_scope *scope;
+	struct wl_event_source *timer;
+	struct wl_list client_list;	/* weston_client_counters::link */
+	unsigned int next_client_id;
+};
+
+static const char * const output_counter_names[] = {
+	[WESTON_OUTPUT_REPAINTS] = "repaints",
+	[WESTON_OUTPUT_MISSED_DEADLINES] = "missed_deadlines",
+	[WESTON_OUTPUT_DAMAGED_PIXELS] = "damaged_pixels",
+	[WESTON_OUTPUT_FRAME_CALLBACKS] = "frame_callbacks",
+	[WESTON_OUTPUT_VIEWS_RENDERER] = "views_renderer",
+	[WESTON_OUTPUT_VIEWS_SCANOUT] = "views_scanout",
+	[WESTON_OUTPUT_VIEWS_OVERLAY] = "views_overlay",
+	[WESTON_OUTPUT_VIEWS_CURSOR] = "views_cursor",
+	[WESTON_OUTPUT_CURSOR_CACHE_HITS] = "cursor_cache_hits",
+	[WESTON_OUTPUT_CURSOR_CACHE_MISSES] = "cursor_cache_misses",
+	[WESTON_OUTPUT_CURSOR_BYTES_SAVED] = "cursor_bytes_saved",
+};
+
+static const char * const client_counter_names[] = {
+	[WESTON_CLIENT_COMMITS] = "commits",
+	[WESTON_CLIENT_SHM_BYTES] = "shm_bytes",
+	[WESTON_CLIENT_DMABUF_IMPORTS] = "dmabuf_imports",
+	[WESTON_CLIENT_FRAME_CALLBACKS] = "frame_callbacks",
+};
+
+/* Prints one line to one subscription, or all of them if sub is NULL. */
+static void
+stats_print_line(struct weston_stats *stats,
+		 struct weston_log_subscription *sub,
+		 const struct timespec *now, const char *what,
+		 const char * const *names, const uint64_t *counters,
+		 unsigned int count, const char *extra)
+{
+	char line[512] = "";
+	FILE *fp;
+	size_t len;
+	unsigned int i;
+
+	/* Room for a newline and the terminator after a truncated line */
+	fp = fmemopen(line, sizeof line - 2, "w");
+	if (!fp)
+		return;
+
+	fprintf(fp, "%" PRId64 ".%09ld %s", (int64_t)now->tv_sec,
+		now->tv_nsec, what);
+	for (i = 0; i < count; i++)
+		fprintf(fp, " %s=%" PRIu64, names[i], counters[i]);
+	fprintf(fp, "%s\n", extra);
+	fclose(fp);
+
+	len = strlen(line);
+	if (len > 0 && line[len - 1] != '\n')
+		strcpy(line + len, "\n");
+
+	if (sub)
+		weston_log_subscription_printf(sub, "%s", line);
+	else
+		weston_log_scope_printf(stats->scope, "%s", line);
+}
+
+static void
+stats_print_output(struct weston_stats *stats,
+		   struct weston_log_subscription *sub,
+		   const struct timespec *now, struct weston_output *output)
+{
+	static const uint64_t zero[WESTON_OUTPUT_COUNTER_COUNT];
+	char what[128];
+
+	snprintf(what, sizeof what, "output %s", output->name);
+	stats_print_line(stats, sub, now, what, output_counter_names,
+			 output->counters ? output->counters->counters : zero,
+			 WESTON_OUTPUT_COUNTER_COUNT, "");
+}
+
+static void
+stats_print_client(struct weston_stats *stats,
+		   struct weston_log_subscription *sub,
+		   const struct timespec *now,
+		   struct weston_client_counters *cc, bool disconnected)
+{
+	char what[64];
+
+	snprintf(what, sizeof what, "client %u pid=%d", cc->id, (int)cc->pid);
+	stats_print_line(stats, sub, now, what, client_counter_names,
+			 cc->counters, WESTON_CLIENT_COUNTER_COUNT,
+			 disconnected ? " disconnected" : "");
+}
+
+static void
+stats_print_snapshot(struct weston_stats *stats,
+		     struct weston_log_subscription *sub)
+{
+	struct weston_client_counters *cc;
+	struct weston_output *output;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	wl_list_for_each(output, &stats->compositor->output_list, link)
+		stats_print_output(stats, sub, &now, output);
+
+	wl_list_for_each(cc, &stats->client_list, link)
+		stats_print_client(stats, sub, &now, cc, false);
+}
+
+static int
+stats_timer_handler(void *data)
+{
+	struct weston_stats *stats = data;
+
+	/* The timer stops once nobody is listening. */
+	if (!weston_log_scope_is_enabled(stats->scope))
+		return 0;
+
+	stats_print_snapshot(stats, NULL);
+	wl_event_source_timer_update(stats->timer, SNAPSHOT_INTERVAL_MSEC);
+
+	return 0;
+}
+
+static void
+stats_new_subscription(struct weston_log_subscription *sub, void *data)
+{
+	struct weston_stats *stats = data;
+
+	stats_print_snapshot(stats, sub);
+	wl_event_source_timer_update(stats->timer, SNAPSHOT_INTERVAL_MSEC);
+}
+
+static void
+client_counters_destroy(struct weston_client_counters *cc)
+{
+	wl_list_remove(&cc->destroy_listener.link);
+	wl_list_remove(&cc->link);
+	free(cc);
+}
+
+static void
+client_counters_handle_destroy(struct wl_listener *listener, void *data)
+{
+	struct weston_client_counters *cc =
+		container_of(listener, struct weston_client_counters,
+			     destroy_listener);
+	struct timespec now;
+
+	if (weston_log_scope_is_enabled(cc->stats->scope)) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		stats_print_client(cc->stats, NULL, &now, cc, true);
+	}
+
+	client_counters_destroy(cc);
+}
+
+static struct weston_client_counters *
+client_counters_get(struct weston_stats *stats, struct wl_client *client)
+{
+	struct weston_client_counters *cc;
+	struct wl_listener *listener;
+	uid_t uid;
+	gid_t gid;
+
+	listener = wl_client_get_destroy_listener(client,
+						  client_counters_handle_destroy);
+	if (listener)
+		return container_of(listener, struct weston_client_counters,
+				    destroy_listener);
+
+	cc = zalloc(sizeof *cc);
+	if (!cc)
+		return NULL;
+
+	cc->stats = stats;
+	cc->id = ++stats->next_client_id;
+	wl_client_get_credentials(client, &cc->pid, &uid, &gid);
+	cc->destroy_listener.notify = client_counters_handle_destroy;
+	wl_client_add_destroy_listener(client, &cc->destroy_listener);
+	wl_list_insert(stats->client_list.prev, &cc->link);
+
+	return cc;
+}
+
+struct weston_stats *
+weston_stats_create(struct weston_compositor *compositor)
+{
+	struct weston_stats *stats;
+	struct wl_event_loop *loop;
+
+	stats = zalloc(sizeof *stats);
+	if (!stats)
+		return NULL;
+
+	stats->compositor = compositor;
+	wl_list_init(&stats->client_list);
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	stats->timer = wl_event_loop_add_timer(loop, stats_timer_handler,
+					       stats);
+	if (!stats->timer) {
+		free(stats);
+		return NULL;
+	}
+
+	stats->scope =
+		weston_compositor_add_log_scope(compositor, "stats",
+						"Snapshots of the output and "
+						"client counters\n",
+						stats_new_subscription, NULL,
+						stats);
+
+	return stats;
+}
+
+void
+weston_stats_destroy(struct weston_stats *stats)
+{
+	struct weston_client_counters *cc, *tmp;
+
+	if (!stats)
+		return;
+
+	weston_log_scope_destroy(stats->scope);
+	wl_event_source_remove(stats->timer);
+
+	wl_list_for_each_safe(cc, tmp, &stats->client_list, link)
+		client_counters_destroy(cc);
+
+	free(stats);
+}
+
+/** Add to a counter of an output
+ *
+ * \param output The output.
+ * \param counter Which counter.
+ * \param n How much to add.
+ */
+WL_EXPORT void
+weston_output_count(struct weston_output *output,
+		    enum weston_output_counter counter, uint64_t n)
+{
+	if (!output->counters) {
+		output->counters = zalloc(sizeof *output->counters);
+		if (!output->counters)
+			return;
+	}
+
+	output->counters->counters[counter] += n;
+}
+
+void
+weston_output_counters_destroy(struct weston_output *output)
+{
+	free(output->counters);
+	output->counters = NULL;
+}
+
+/** Add to a counter of a client
+ *
+ * \param compositor The compositor.
+ * \param client The client, or NULL for the compositor's own surfaces,
+ * which are not counted.
+ * \param counter Which counter.
+ * \param n How much to add.
+ */
+WL_EXPORT void
+weston_client_count(struct weston_compositor *compositor,
+		    struct wl_client *client,
+		    enum weston_client_counter counter, uint64_t n)
+{
+	struct weston_client_counters *cc;
+
+	if (!client || !compositor->stats)
+		return;
+
+	cc = client_counters_get(compositor->stats, client);
+	if (cc)
+		cc->counters[counter] += n;
+}
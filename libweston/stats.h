@@ -0,0 +1,77 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_STATS_H
+#define WESTON_STATS_H
+
+#include <stdint.h>
+
+struct weston_compositor;
+struct weston_output;
+struct weston_stats;
+struct wl_client;
+
+enum weston_output_counter {
+	WESTON_OUTPUT_REPAINTS = 0,
+	WESTON_OUTPUT_MISSED_DEADLINES,	/* repaints done after their vblank */
+	WESTON_OUTPUT_DAMAGED_PIXELS,	/* repainted by the renderer */
+	WESTON_OUTPUT_FRAME_CALLBACKS,
+	WESTON_OUTPUT_VIEWS_RENDERER,	/* plane assignment outcomes */
+	WESTON_OUTPUT_VIEWS_SCANOUT,
+	WESTON_OUTPUT_VIEWS_OVERLAY,
+	WESTON_OUTPUT_VIEWS_CURSOR,
+	WESTON_OUTPUT_CURSOR_CACHE_HITS,	/* cursor images not copied */
+	WESTON_OUTPUT_CURSOR_CACHE_MISSES,
+	WESTON_OUTPUT_CURSOR_BYTES_SAVED,
+	WESTON_OUTPUT_COUNTER_COUNT
+};
+
+enum weston_client_counter {
+	WESTON_CLIENT_COMMITS = 0,
+	WESTON_CLIENT_SHM_BYTES,	/* uploaded by the renderer */
+	WESTON_CLIENT_DMABUF_IMPORTS,
+	WESTON_CLIENT_FRAME_CALLBACKS,
+	WESTON_CLIENT_COUNTER_COUNT
+};
+
+struct weston_stats *
+weston_stats_create(struct weston_compositor *compositor);
+
+void
+weston_stats_destroy(struct weston_stats *stats);
+
+void
+weston_output_count(struct weston_output *output,
+		    enum weston_output_counter counter, uint64_t n);
+
+void
+weston_output_counters_destroy(struct weston_output *output);
+
+void
+weston_client_count(struct weston_compositor *compositor,
+		    struct wl_client *client,
+		    enum weston_client_counter counter, uint64_t n);
+
+#endif /* WESTON_STATS_H */
@@ -36,6 +36,32 @@
 #include <libweston/weston-log.h>
 #include "timeline.h"
 #include "weston-log-internal.h"
+#include "shared/timeline-binary.h"
+
+/* Encoded records collect in a buffer that is written out when the
+ * compositor goes idle, or when it is full. */
+#define TIMELINE_BINARY_BUFFER_SIZE (64 * 1024)
+/* Arguments of a point beyond these are dropped */
+#define TIMELINE_BINARY_MAX_ARGS 8
+/* Longest string in a record, including the NUL */
+#define TIMELINE_BINARY_MAX_STRING 512
+
+/** State of a 'timeline-binary' subscription
+ *
+ * Everything a timeline point needs is allocated up front, so that
+ * recording a point is a clock read and a few stores.
+ *
+ * @ingroup internal-log
+ */
+struct weston_timeline_binary {
+	struct weston_log_subscription *subscription;
+	struct wl_event_loop *loop;
+	struct wl_event_source *flush_source;
+	const char *names[TIMELINE_BINARY_MAX_NAMES];
+	unsigned int n_names;
+	size_t used;
+	uint64_t buffer[TIMELINE_BINARY_BUFFER_SIZE / sizeof(uint64_t)];
+};
 
 /**
  * Timeline itself is not a subscriber but a scope (a producer of data), and it
@@ -128,6 +154,18 @@ weston_timeline_destroy_subscription(struct weston_log_subscription *sub,
 			      &tl_sub->objects, subscription_link)
 		weston_timeline_destroy_subscription_object(sub_obj);
 
+	if (tl_sub->binary) {
+		struct weston_timeline_binary *tlb = tl_sub->binary;
+
+		if (tlb->used > 0)
+			weston_log_subscription_write(sub,
+						      (const char *)tlb->buffer,
+						      tlb->used);
+		if (tlb->flush_source)
+			wl_event_source_remove(tlb->flush_source);
+		free(tlb);
+	}
+
 	free(tl_sub);
 }
 
@@ -344,6 +382,27 @@ emit_gpu_timestamp(struct timeline_emit_context *ctx, void *obj)
 	return 1;
 }
 
+static int
+emit_serial(struct timeline_emit_context *ctx, void *obj)
+{
+	uint32_t *serial = obj;
+
+	fprintf(ctx->cur, "\"serial\":%u", *serial);
+
+	return 1;
+}
+
+static int
+emit_input_timestamp(struct timeline_emit_context *ctx, void *obj)
+{
+	struct timespec *ts = obj;
+
+	fprintf(ctx->cur, "\"input_monotonic\":[%" PRId64 ", %ld]",
+		(int64_t)ts->tv_sec, ts->tv_nsec);
+
+	return 1;
+}
+
 static struct weston_timeline_subscription_object *
 weston_timeline_get_subscription_object(struct weston_log_subscription *sub,
 		void *object)
@@ -357,6 +416,24 @@ weston_timeline_get_subscription_object(struct weston_log_subscription *sub,
 	return weston_timeline_subscription_search(tl_sub, object);
 }
 
+static void
+weston_timeline_refresh_scope_objects(struct weston_log_scope *scope,
+				      void *object)
+{
+	struct weston_log_subscription *sub = NULL;
+
+	if (!scope)
+		return;
+
+	while ((sub = weston_log_subscription_iterate(scope, sub))) {
+		struct weston_timeline_subscription_object *sub_obj;
+
+		sub_obj = weston_timeline_get_subscription_object(sub, object);
+		if (sub_obj)
+			sub_obj->force_refresh = true;
+	}
+}
+
 /** Sets (on) the timeline subscription object refresh status.
  *
  * This function 'notifies' timeline to print the object ID. The timeline code
@@ -373,15 +450,8 @@ WL_EXPORT void
 weston_timeline_refresh_subscription_objects(struct weston_compositor *wc,
 					     void *object)
 {
-	struct weston_log_subscription *sub = NULL;
-
-	while ((sub = weston_log_subscription_iterate(wc->timeline, sub))) {
-		struct weston_timeline_subscription_object *sub_obj;
-
-		sub_obj = weston_timeline_get_subscription_object(sub, object);
-		if (sub_obj)
-			sub_obj->force_refresh = true;
-	}
+	weston_timeline_refresh_scope_objects(wc->timeline, object);
+	weston_timeline_refresh_scope_objects(wc->timeline_binary, object);
 }
 
 typedef int (*type_func)(struct timeline_emit_context *ctx, void *obj);
@@ -391,6 +461,8 @@ static const type_func type_dispatch[] = {
 	[TLT_SURFACE] = emit_weston_surface,
 	[TLT_VBLANK] = emit_vblank_timestamp,
 	[TLT_GPU] = emit_gpu_timestamp,
+	[TLT_SERIAL] = emit_serial,
+	[TLT_INPUT] = emit_input_timestamp,
 };
 
 /** Disseminates the message to all subscriptions of the scope \c
@@ -462,3 +534,280 @@ weston_timeline_point(struct weston_log_scope *timeline_scope,
 
 	}
 }
+
+/** Create a binary timeline subscription and hang it off the subscription
+ *
+ * Called when a subscription to the 'timeline-binary' scope is created.
+ * Writes the stream header.
+ *
+ * @param sub the subscription
+ * @param user_data the weston_compositor
+ *
+ * @ingroup internal-log
+ */
+void
+weston_timeline_create_subscription_binary(struct weston_log_subscription *sub,
+					   void *user_data)
+{
+	struct weston_compositor *compositor = user_data;
+	struct weston_timeline_subscription *tl_sub;
+	struct weston_timeline_binary *tlb;
+	const struct timeline_binary_header header = {
+		.magic = TIMELINE_BINARY_MAGIC,
+		.version = TIMELINE_BINARY_VERSION,
+	};
+
+	tl_sub = zalloc(sizeof(*tl_sub));
+	tlb = zalloc(sizeof(*tlb));
+	if (!tl_sub || !tlb) {
+		free(tl_sub);
+		free(tlb);
+		return;
+	}
+
+	wl_list_init(&tl_sub->objects);
+
+	tlb->subscription = sub;
+	tlb->loop = wl_display_get_event_loop(compositor->wl_display);
+	tl_sub->binary = tlb;
+
+	weston_log_subscription_set_data(sub, tl_sub);
+	weston_log_subscription_write(sub, (const char *)&header,
+				      sizeof(header));
+}
+
+static void
+timeline_binary_flush(struct weston_timeline_binary *tlb)
+{
+	if (tlb->used > 0)
+		weston_log_subscription_write(tlb->subscription,
+					      (const char *)tlb->buffer,
+					      tlb->used);
+	tlb->used = 0;
+}
+
+static void
+timeline_binary_flush_idle(void *data)
+{
+	struct weston_timeline_binary *tlb = data;
+
+	tlb->flush_source = NULL;
+	timeline_binary_flush(tlb);
+}
+
+/* Append a record with room for payload bytes after the header */
+static struct timeline_binary_record *
+timeline_binary_append(struct weston_timeline_binary *tlb,
+		       enum timeline_binary_record_type type, uint32_t id,
+		       uint32_t payload)
+{
+	uint32_t size = timeline_binary_record_size(payload);
+	struct timeline_binary_record *rec;
+
+	if (tlb->used + size > sizeof(tlb->buffer))
+		timeline_binary_flush(tlb);
+
+	if (!tlb->flush_source)
+		tlb->flush_source =
+			wl_event_loop_add_idle(tlb->loop,
+					       timeline_binary_flush_idle, tlb);
+
+	rec = (struct timeline_binary_record *)
+		((char *)tlb->buffer + tlb->used);
+	rec->type = type;
+	rec->size = size;
+	rec->id = id;
+	tlb->used += size;
+
+	return rec;
+}
+
+static void
+timeline_binary_append_string(struct weston_timeline_binary *tlb,
+			      enum timeline_binary_record_type type,
+			      uint32_t id, uint32_t main_id, const char *str)
+{
+	struct timeline_binary_record *rec;
+	uint32_t prefix = type == TIMELINE_BINARY_SURFACE ? 8 : 0;
+	size_t len = strnlen(str, TIMELINE_BINARY_MAX_STRING - 1);
+	char *p;
+
+	rec = timeline_binary_append(tlb, type, id, prefix + len + 1);
+	p = (char *)(rec + 1);
+	memset(p, 0, rec->size - sizeof(*rec));
+	if (prefix)
+		memcpy(p, &main_id, sizeof(main_id));
+	memcpy(p + prefix, str, len);
+}
+
+static uint32_t
+timeline_binary_name(struct weston_timeline_binary *tlb, const char *name)
+{
+	unsigned int i;
+
+	/* The names are string literals. */
+	for (i = 0; i < tlb->n_names; i++)
+		if (tlb->names[i] == name)
+			return i + 1;
+
+	/* Start over, the ids get defined again. */
+	if (tlb->n_names == TIMELINE_BINARY_MAX_NAMES)
+		tlb->n_names = 0;
+
+	tlb->names[tlb->n_names++] = name;
+	timeline_binary_append_string(tlb, TIMELINE_BINARY_NAME,
+				      tlb->n_names, 0, name);
+
+	return tlb->n_names;
+}
+
+static uint32_t
+timeline_binary_output(struct weston_timeline_subscription *tl_sub,
+		       struct weston_output *output)
+{
+	struct weston_timeline_subscription_object *sub_obj;
+
+	sub_obj = weston_timeline_subscription_output_ensure(tl_sub, output);
+	if (weston_timeline_check_object_refresh(sub_obj))
+		timeline_binary_append_string(tl_sub->binary,
+					      TIMELINE_BINARY_OUTPUT,
+					      sub_obj->id, 0,
+					      output->name ? output->name : "");
+
+	return sub_obj->id;
+}
+
+static uint32_t
+timeline_binary_surface(struct weston_timeline_subscription *tl_sub,
+			struct weston_surface *surface)
+{
+	struct weston_timeline_subscription_object *sub_obj;
+	struct weston_surface *mains;
+	uint32_t main_id = 0;
+	char d[TIMELINE_BINARY_MAX_STRING];
+
+	sub_obj = weston_timeline_subscription_surface_ensure(tl_sub, surface);
+	if (!weston_timeline_check_object_refresh(sub_obj))
+		return sub_obj->id;
+
+	mains = weston_surface_get_main_surface(surface);
+	if (mains != surface)
+		main_id = timeline_binary_surface(tl_sub, mains);
+
+	if (!surface->get_label ||
+	    surface->get_label(surface, d, sizeof(d)) < 0)
+		d[0] = '\0';
+
+	timeline_binary_append_string(tl_sub->binary, TIMELINE_BINARY_SURFACE,
+				      sub_obj->id, main_id, d);
+
+	return sub_obj->id;
+}
+
+static void
+timeline_binary_arg_timestamp(struct timeline_binary_arg *arg,
+			      enum timeline_binary_arg_type type,
+			      const struct timespec *ts)
+{
+	arg->type = type;
+	arg->value = ts->tv_nsec;
+	arg->tv_sec = ts->tv_sec;
+}
+
+/** Records a timeline point in all subscriptions of the binary scope
+ * \c timeline_scope
+ *
+ * The binary counterpart of weston_timeline_point(), taking the same
+ * arguments. Objects are described the first time they are seen, and
+ * the point itself is a fixed size record appended to a preallocated
+ * buffer. Nothing is formatted or allocated.
+ *
+ * @param timeline_scope the binary timeline scope
+ * @param name the name of the timeline point, a string literal
+ *
+ * @ingroup log
+ */
+WL_EXPORT void
+weston_timeline_point_binary(struct weston_log_scope *timeline_scope,
+			     const char *name, ...)
+{
+	struct timespec ts;
+	struct weston_log_subscription *sub = NULL;
+
+	if (!weston_log_scope_is_enabled(timeline_scope))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	while ((sub = weston_log_subscription_iterate(timeline_scope, sub))) {
+		struct weston_timeline_subscription *tl_sub;
+		struct timeline_binary_arg args[TIMELINE_BINARY_MAX_ARGS];
+		struct timeline_binary_record *rec;
+		struct timeline_binary_point *point;
+		enum timeline_type otype;
+		unsigned int n_args = 0;
+		uint32_t name_id;
+		va_list argp;
+		void *obj;
+
+		tl_sub = weston_log_subscription_get_data(sub);
+		if (!tl_sub || !tl_sub->binary)
+			continue;
+
+		/* Object descriptions go before the point. */
+		va_start(argp, name);
+		while ((otype = va_arg(argp, enum timeline_type)) != TLT_END) {
+			struct timeline_binary_arg *arg = &args[n_args];
+
+			obj = va_arg(argp, void *);
+			if (n_args == TIMELINE_BINARY_MAX_ARGS)
+				continue;
+
+			switch (otype) {
+			case TLT_OUTPUT:
+				arg->type = TIMELINE_BINARY_ARG_OUTPUT;
+				arg->value = timeline_binary_output(tl_sub, obj);
+				arg->tv_sec = 0;
+				break;
+			case TLT_SURFACE:
+				arg->type = TIMELINE_BINARY_ARG_SURFACE;
+				arg->value = timeline_binary_surface(tl_sub, obj);
+				arg->tv_sec = 0;
+				break;
+			case TLT_VBLANK:
+				timeline_binary_arg_timestamp(arg,
+						TIMELINE_BINARY_ARG_VBLANK, obj);
+				break;
+			case TLT_GPU:
+				timeline_binary_arg_timestamp(arg,
+						TIMELINE_BINARY_ARG_GPU, obj);
+				break;
+			case TLT_SERIAL:
+				arg->type = TIMELINE_BINARY_ARG_SERIAL;
+				arg->value = *(const uint32_t *)obj;
+				arg->tv_sec = 0;
+				break;
+			case TLT_INPUT:
+				timeline_binary_arg_timestamp(arg,
+						TIMELINE_BINARY_ARG_INPUT, obj);
+				break;
+			default:
+				continue;
+			}
+			n_args++;
+		}
+		va_end(argp);
+
+		name_id = timeline_binary_name(tl_sub->binary, name);
+
+		rec = timeline_binary_append(tl_sub->binary,
+					     TIMELINE_BINARY_POINT, name_id,
+					     sizeof(*point) +
+					     n_args * sizeof(args[0]));
+		point = (struct timeline_binary_point *)(rec + 1);
+		point->tv_sec = ts.tv_sec;
+		point->tv_nsec = ts.tv_nsec;
+		point->n_args = n_args;
+		memcpy(point->args, args, n_args * sizeof(args[0]));
+	}
+}
@@ -31,7 +31,13 @@
 
 #include "weston-log-internal.h"
 
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 /** File type of stream
  */
@@ -96,3 +102,328 @@ weston_log_subscriber_create_log(FILE *dump_to)
 
 	return &file->base;
 }
+
+/** Asynchronous file type of stream
+ *
+ * The compositor thread copies messages into a single-producer,
+ * single-consumer ring buffer and a writer thread writes them out, so
+ * that a slow file never stalls the compositor.
+ *
+ * head and tail count the bytes ever written into and out of the ring,
+ * the ring offset being the count modulo the size. head is only stored
+ * by the producer and tail only by the writer thread. The mutex and the
+ * condition variables are only touched when one side has to sleep.
+ */
+struct weston_debug_log_async_file {
+	struct weston_log_subscriber base;
+	FILE *file;
+	enum weston_log_async_policy policy;
+
+	char *buf;
+	size_t size;			/**< a power of two */
+	size_t head;
+	size_t tail;
+	unsigned int dropped;		/**< messages lost to a full ring */
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t data_cond;	/**< signalled for writer_sleeping */
+	pthread_cond_t space_cond;	/**< signalled for producer_sleeping */
+	bool writer_sleeping;
+	bool producer_sleeping;
+	bool stopping;
+};
+
+/** allows flushing the ring from a crash handler */
+static struct weston_debug_log_async_file *weston_primary_async_log = NULL;
+
+static struct weston_debug_log_async_file *
+to_weston_debug_log_async_file(struct weston_log_subscriber *sub)
+{
+	return container_of(sub, struct weston_debug_log_async_file, base);
+}
+
+/* Wakes up the other side if it is sleeping. The sequentially consistent
+ * accesses guarantee that either it sees our update before sleeping, or
+ * we see it sleeping; it holds the mutex from the check until it waits. */
+static void
+async_log_wake(struct weston_debug_log_async_file *stream, bool *sleeping,
+	       pthread_cond_t *cond)
+{
+	if (!__atomic_load_n(sleeping, __ATOMIC_SEQ_CST))
+		return;
+
+	pthread_mutex_lock(&stream->mutex);
+	pthread_cond_signal(cond);
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+static void
+async_log_wait(struct weston_debug_log_async_file *stream, bool *sleeping,
+	       pthread_cond_t *cond, size_t *pos, size_t old)
+{
+	pthread_mutex_lock(&stream->mutex);
+	__atomic_store_n(sleeping, true, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(pos, __ATOMIC_SEQ_CST) == old &&
+	       !stream->stopping)
+		pthread_cond_wait(cond, &stream->mutex);
+	__atomic_store_n(sleeping, false, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+/* Copies len bytes into the ring at head, which has room for them. */
+static void
+async_log_copy_in(struct weston_debug_log_async_file *stream, size_t head,
+		  const char *data, size_t len)
+{
+	size_t offset = head & (stream->size - 1);
+	size_t n = MIN(len, stream->size - offset);
+
+	memcpy(stream->buf + offset, data, n);
+	memcpy(stream->buf, data + n, len - n);
+	__atomic_store_n(&stream->head, head + len, __ATOMIC_SEQ_CST);
+}
+
+static void
+weston_log_async_file_write(struct weston_log_subscriber *sub,
+			    const char *data, size_t len)
+{
+	struct weston_debug_log_async_file *stream =
+		to_weston_debug_log_async_file(sub);
+	size_t head = stream->head;
+	size_t tail, space, n;
+
+	if (stream->policy == WESTON_LOG_ASYNC_DROP) {
+		tail = __atomic_load_n(&stream->tail, __ATOMIC_ACQUIRE);
+		if (stream->size - (head - tail) < len) {
+			__atomic_add_fetch(&stream->dropped, 1,
+					   __ATOMIC_RELAXED);
+			return;
+		}
+
+		async_log_copy_in(stream, head, data, len);
+		async_log_wake(stream, &stream->writer_sleeping,
+			       &stream->data_cond);
+		return;
+	}
+
+	/* Messages larger than the ring go in pieces. */
+	while (len > 0) {
+		tail = __atomic_load_n(&stream->tail, __ATOMIC_ACQUIRE);
+		space = stream->size - (head - tail);
+		if (space == 0) {
+			async_log_wake(stream, &stream->writer_sleeping,
+				       &stream->data_cond);
+			async_log_wait(stream, &stream->producer_sleeping,
+				       &stream->space_cond, &stream->tail,
+				       tail);
+			continue;
+		}
+
+		n = MIN(len, space);
+		async_log_copy_in(stream, head, data, n);
+		head += n;
+		data += n;
+		len -= n;
+	}
+
+	async_log_wake(stream, &stream->writer_sleeping, &stream->data_cond);
+}
+
+static void
+async_log_write_out(struct weston_debug_log_async_file *stream,
+		    size_t tail, size_t head)
+{
+	size_t offset = tail & (stream->size - 1);
+	size_t n = MIN(head - tail, stream->size - offset);
+
+	fwrite(stream->buf + offset, 1, n, stream->file);
+	fwrite(stream->buf, 1, head - tail - n, stream->file);
+}
+
+static void *
+weston_log_async_file_thread(void *data)
+{
+	struct weston_debug_log_async_file *stream = data;
+	unsigned int dropped;
+	size_t head, tail = 0;
+	bool stopping;
+
+	while (true) {
+		/* Once stopping is seen, everything written before is. */
+		stopping = __atomic_load_n(&stream->stopping, __ATOMIC_SEQ_CST);
+		head = __atomic_load_n(&stream->head, __ATOMIC_ACQUIRE);
+		dropped = __atomic_exchange_n(&stream->dropped, 0,
+					      __ATOMIC_RELAXED);
+
+		if (head != tail)
+			async_log_write_out(stream, tail, head);
+		if (dropped)
+			fprintf(stream->file, "[log: %u messages dropped, "
+				"the writer could not keep up]\n", dropped);
+		fflush(stream->file);
+
+		/* Only what has reached the file descriptor leaves the
+		 * range weston_log_async_flush_on_crash() writes. */
+		if (head != tail) {
+			tail = head;
+			__atomic_store_n(&stream->tail, tail,
+					 __ATOMIC_SEQ_CST);
+			async_log_wake(stream, &stream->producer_sleeping,
+				       &stream->space_cond);
+		}
+
+		if (stopping)
+			break;
+
+		async_log_wait(stream, &stream->writer_sleeping,
+			       &stream->data_cond, &stream->head, tail);
+	}
+
+	return NULL;
+}
+
+/* Writes out everything queued before returning. */
+static void
+weston_log_subscriber_destroy_log_async(struct weston_log_subscriber *subscriber)
+{
+	struct weston_debug_log_async_file *stream =
+		to_weston_debug_log_async_file(subscriber);
+
+	weston_log_subscriber_release(subscriber);
+
+	pthread_mutex_lock(&stream->mutex);
+	__atomic_store_n(&stream->stopping, true, __ATOMIC_SEQ_CST);
+	pthread_cond_signal(&stream->data_cond);
+	pthread_mutex_unlock(&stream->mutex);
+	pthread_join(stream->thread, NULL);
+
+	if (weston_primary_async_log == stream)
+		weston_primary_async_log = NULL;
+
+	pthread_cond_destroy(&stream->space_cond);
+	pthread_cond_destroy(&stream->data_cond);
+	pthread_mutex_destroy(&stream->mutex);
+	free(stream->buf);
+	free(stream);
+}
+
+/** Creates an asynchronous file type of subscriber
+ *
+ * Like weston_log_subscriber_create_log(), but the writing happens on a
+ * thread of its own. The messages are queued in a ring buffer, and the
+ * policy decides what happens to a message that does not fit.
+ * Destroying the subscriber writes out everything queued.
+ *
+ * Messages must come from a single thread, the compositor thread, and
+ * the FILE must not be used by others until the subscriber is destroyed.
+ *
+ * Should be destroyed using weston_log_subscriber_destroy()
+ *
+ * @param dump_to if specified, used for writing data to
+ * @param size the size of the ring buffer in bytes, rounded up to a power
+ * of two
+ * @param policy what to do when the ring buffer is full
+ * @returns a weston_log_subscriber object or NULL in case of failure
+ *
+ * @sa weston_log_subscriber_destroy weston_log_async_flush_on_crash
+ */
+WL_EXPORT struct weston_log_subscriber *
+weston_log_subscriber_create_log_async(FILE *dump_to, size_t size,
+				       enum weston_log_async_policy policy)
+{
+	struct weston_debug_log_async_file *stream;
+	sigset_t mask, old_mask;
+	int ret;
+
+	stream = zalloc(sizeof(*stream));
+	if (!stream)
+		return NULL;
+
+	stream->file = dump_to ? dump_to : stderr;
+	stream->policy = policy;
+
+	stream->size = 4096;
+	while (stream->size < size)
+		stream->size *= 2;
+	stream->buf = malloc(stream->size);
+	if (!stream->buf) {
+		free(stream);
+		return NULL;
+	}
+
+	pthread_mutex_init(&stream->mutex, NULL);
+	pthread_cond_init(&stream->data_cond, NULL);
+	pthread_cond_init(&stream->space_cond, NULL);
+
+	/* Leave asynchronous signals to the main thread. */
+	sigfillset(&mask);
+	sigdelset(&mask, SIGBUS);
+	sigdelset(&mask, SIGSEGV);
+	sigdelset(&mask, SIGFPE);
+	sigdelset(&mask, SIGILL);
+	pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+	ret = pthread_create(&stream->thread, NULL,
+			     weston_log_async_file_thread, stream);
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+	if (ret != 0) {
+		fprintf(stderr, "Failed to start the log writer thread: %s\n",
+			strerror(ret));
+		pthread_cond_destroy(&stream->space_cond);
+		pthread_cond_destroy(&stream->data_cond);
+		pthread_mutex_destroy(&stream->mutex);
+		free(stream->buf);
+		free(stream);
+		return NULL;
+	}
+
+	stream->base.write = weston_log_async_file_write;
+	stream->base.destroy = weston_log_subscriber_destroy_log_async;
+	stream->base.destroy_subscription = NULL;
+	stream->base.complete = NULL;
+
+	wl_list_init(&stream->base.subscription_list);
+
+	if (!weston_primary_async_log)
+		weston_primary_async_log = stream;
+
+	return &stream->base;
+}
+
+/** Writes out what the asynchronous log has not written yet
+ *
+ * Meant to be called from a handler of a fatal signal, so that the last
+ * messages before a crash are not lost. Only async-signal-safe functions
+ * are used: the queued data is written to the file descriptor directly,
+ * bypassing the FILE. Data the writer thread was writing at the same
+ * time may appear twice.
+ *
+ * Uses the first asynchronous subscriber created.
+ */
+WL_EXPORT void
+weston_log_async_flush_on_crash(void)
+{
+	struct weston_debug_log_async_file *stream = weston_primary_async_log;
+	size_t head, tail, offset, n;
+	ssize_t ret;
+	int fd;
+
+	if (!stream)
+		return;
+
+	fd = fileno(stream->file);
+	head = __atomic_load_n(&stream->head, __ATOMIC_SEQ_CST);
+	tail = __atomic_load_n(&stream->tail, __ATOMIC_SEQ_CST);
+
+	while (tail != head) {
+		offset = tail & (stream->size - 1);
+		n = MIN(head - tail, stream->size - offset);
+		ret = write(fd, stream->buf + offset, n);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		tail += ret;
+	}
+}
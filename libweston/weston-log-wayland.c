@@ -205,8 +205,9 @@ stream_destroy(struct wl_resource *stream_resource)
 	struct weston_log_debug_wayland *stream;
 	stream = wl_resource_get_user_data(stream_resource);
 
-	stream_close_unlink(stream);
+	/* Subscriptions may write out buffered data as they go. */
 	weston_log_subscriber_release(&stream->base);
+	stream_close_unlink(stream);
 	free(stream);
 }
 
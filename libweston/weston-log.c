@@ -179,7 +179,7 @@ weston_log_subscription_destroy_pending(struct weston_log_subscription *sub)
  *
  * @memberof weston_log_subscription
  */
-static void
+void
 weston_log_subscription_write(struct weston_log_subscription *sub,
 			      const char *data, size_t len)
 {
@@ -272,6 +272,9 @@ weston_log_subscription_create(struct weston_log_subscriber *owner,
  * Removes the subscription from the scopes subscription list and from
  * subscriber's subscription list. It destroys the subscription afterwads.
  *
+ * The scope is told first, while the stream is still open, so that it
+ * can write out what it has buffered for the subscription.
+ *
  * @memberof weston_log_subscription
  */
 void
@@ -279,12 +282,12 @@ weston_log_subscription_destroy(struct weston_log_subscription *sub)
 {
 	assert(sub);
 
-	if (sub->owner->destroy_subscription)
-		sub->owner->destroy_subscription(sub->owner);
-
 	if (sub->source->destroy_subscription)
 		sub->source->destroy_subscription(sub, sub->source->user_data);
 
+	if (sub->owner->destroy_subscription)
+		sub->owner->destroy_subscription(sub->owner);
+
 	if (sub->owner)
 		wl_list_remove(&sub->owner_link);
 
@@ -0,0 +1,135 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "shared/timeline-binary.h"
+
+/* The string at offset in a payload of len bytes, NULL if it is not
+ * NUL-terminated within the payload. */
+static const char *
+payload_string(const char *payload, size_t len, size_t offset)
+{
+	if (offset >= len)
+		return "";
+
+	if (!memchr(payload + offset, '\0', len - offset))
+		return NULL;
+
+	return payload + offset;
+}
+
+static int
+set_name(struct timeline_binary_names *names, uint32_t id, const char *name)
+{
+	char *copy;
+
+	/* The writer never uses more, a corrupt stream may. */
+	if (id == 0 || id > TIMELINE_BINARY_MAX_NAMES)
+		return -1;
+
+	copy = strdup(name);
+	if (!copy)
+		return -1;
+
+	free(names->names[id - 1]);
+	names->names[id - 1] = copy;
+
+	return 0;
+}
+
+/** Check a record of a 'timeline-binary' stream and pick it apart
+ *
+ * \param names The point names of the stream, updated by NAME records.
+ * \param rec The record header.
+ * \param payload The rec->size - sizeof(*rec) bytes following the record
+ * header, 8 byte aligned.
+ * \param parsed Filled in with the contents of the record.
+ * \return 0 on success, -1 on a corrupt record or allocation failure.
+ *
+ * Records of unknown types are returned with only type and id set.
+ */
+int
+timeline_binary_parse_record(struct timeline_binary_names *names,
+			     const struct timeline_binary_record *rec,
+			     const void *payload,
+			     struct timeline_binary_parsed *parsed)
+{
+	size_t len;
+
+	if (rec->size < sizeof(*rec))
+		return -1;
+	len = rec->size - sizeof(*rec);
+
+	memset(parsed, 0, sizeof(*parsed));
+	parsed->type = rec->type;
+	parsed->id = rec->id;
+
+	switch (rec->type) {
+	case TIMELINE_BINARY_NAME:
+		parsed->string = payload_string(payload, len, 0);
+		if (!parsed->string)
+			return -1;
+		return set_name(names, rec->id, parsed->string);
+	case TIMELINE_BINARY_OUTPUT:
+		parsed->string = payload_string(payload, len, 0);
+		return parsed->string ? 0 : -1;
+	case TIMELINE_BINARY_SURFACE:
+		if (len < 8)
+			return -1;
+		memcpy(&parsed->main_surface, payload,
+		       sizeof(parsed->main_surface));
+		parsed->string = payload_string(payload, len, 8);
+		return parsed->string ? 0 : -1;
+	case TIMELINE_BINARY_POINT:
+		if (len < sizeof(struct timeline_binary_point))
+			return -1;
+		parsed->point = payload;
+		if (rec->id >= 1 && rec->id <= TIMELINE_BINARY_MAX_NAMES)
+			parsed->name = names->names[rec->id - 1];
+		parsed->n_args = parsed->point->n_args;
+		len = (len - sizeof(*parsed->point)) /
+		      sizeof(parsed->point->args[0]);
+		if (parsed->n_args > len)
+			parsed->n_args = len;
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+void
+timeline_binary_names_fini(struct timeline_binary_names *names)
+{
+	unsigned int i;
+
+	for (i = 0; i < TIMELINE_BINARY_MAX_NAMES; i++) {
+		free(names->names[i]);
+		names->names[i] = NULL;
+	}
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_TIMELINE_BINARY_H
+#define WESTON_TIMELINE_BINARY_H
+
+#include <stdint.h>
+
+/*
+ * The 'timeline-binary' log scope carries the same timeline points as the
+ * 'timeline' scope, in a compact binary encoding that is cheap to produce.
+ * weston-timeline converts it into the JSON that wesgr reads.
+ *
+ * The stream starts with a struct timeline_binary_header, followed by
+ * records in host byte order. Every record starts with a struct
+ * timeline_binary_record and its size is a multiple of 8 bytes.
+ *
+ * Point names, outputs and surfaces are identified by numbers, defined
+ * by a record before the first point referring to them. A definition
+ * may be repeated with different contents, the last one applies.
+ */
+
+#define TIMELINE_BINARY_MAGIC 0x4c544c57 /* "WLTL" */
+#define TIMELINE_BINARY_VERSION 1
+
+/* Point name ids are 1 to this */
+#define TIMELINE_BINARY_MAX_NAMES 64
+
+struct timeline_binary_header {
+	uint32_t magic;
+	uint32_t version;
+};
+
+enum timeline_binary_record_type {
+	/* id: name id, followed by the NUL-terminated name */
+	TIMELINE_BINARY_NAME = 1,
+	/* id: output id, followed by the NUL-terminated output name */
+	TIMELINE_BINARY_OUTPUT,
+	/* id: surface id, followed by the main surface id (0 if the surface
+	 * is a main surface), 4 bytes of padding and the NUL-terminated
+	 * description, which is empty if the surface has none */
+	TIMELINE_BINARY_SURFACE,
+	/* id: name id, followed by struct timeline_binary_point */
+	TIMELINE_BINARY_POINT,
+};
+
+struct timeline_binary_record {
+	uint16_t type;		/* enum timeline_binary_record_type */
+	uint16_t size;		/* in bytes, including this header */
+	uint32_t id;
+};
+
+enum timeline_binary_arg_type {
+	TIMELINE_BINARY_ARG_OUTPUT = 1,
+	TIMELINE_BINARY_ARG_SURFACE,
+	TIMELINE_BINARY_ARG_VBLANK,
+	TIMELINE_BINARY_ARG_GPU,
+	TIMELINE_BINARY_ARG_SERIAL,
+	TIMELINE_BINARY_ARG_INPUT,	/* timestamp of the input event */
+};
+
+struct timeline_binary_arg {
+	uint32_t type;		/* enum timeline_binary_arg_type */
+	uint32_t value;		/* object id, serial, or tv_nsec of a timestamp */
+	int64_t tv_sec;		/* of a timestamp */
+};
+
+/* CLOCK_MONOTONIC time of the point, followed by n_args arguments */
+struct timeline_binary_point {
+	int64_t tv_sec;
+	uint32_t tv_nsec;
+	uint32_t n_args;
+	struct timeline_binary_arg args[];
+};
+
+/* Bytes a record of the given payload size takes, with padding */
+static inline uint32_t
+timeline_binary_record_size(uint32_t payload)
+{
+	return (sizeof(struct timeline_binary_record) + payload + 7) & ~7u;
+}
+
+/* Point names defined so far by a stream being read */
+struct timeline_binary_names {
+	char *names[TIMELINE_BINARY_MAX_NAMES];
+};
+
+/* A record read from a stream, checked against its size */
+struct timeline_binary_parsed {
+	uint16_t type;			/* enum timeline_binary_record_type */
+	uint32_t id;
+	/* NAME, OUTPUT and SURFACE: the NUL-terminated string */
+	const char *string;
+	/* SURFACE: the main surface id, 0 for a main surface */
+	uint32_t main_surface;
+	/* POINT: the point, its name (NULL if undefined) and the number
+	 * of its arguments which are within the record */
+	const struct timeline_binary_point *point;
+	const char *name;
+	uint32_t n_args;
+};
+
+int
+timeline_binary_parse_record(struct timeline_binary_names *names,
+			     const struct timeline_binary_record *rec,
+			     const void *payload,
+			     struct timeline_binary_parsed *parsed);
+
+void
+timeline_binary_names_fini(struct timeline_binary_names *names);
+
+#endif /* WESTON_TIMELINE_BINARY_H */
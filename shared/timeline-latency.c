@@ -0,0 +1,418 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shared/timeline-latency.h"
+
+#define LATENCY_TIMEOUT_NSEC 1000000000LL
+
+enum latency_stage {
+	LATENCY_WAIT_COMMIT,
+	LATENCY_WAIT_FLUSH,
+	LATENCY_WAIT_PRESENT,
+};
+
+struct latency_pending {
+	unsigned int event;		/* index into timeline_latency::events */
+	enum latency_stage stage;
+	uint32_t surface;
+	uint32_t output;
+	int64_t input_nsec;
+	int64_t commit_nsec;
+	int64_t plane_nsec;	/* 0 until drm_assign_plane */
+	int64_t kms_nsec;	/* 0 until drm_kms_commit */
+};
+
+struct latency_event {
+	struct timeline_latency_event base;
+	unsigned int alloc_commit;
+	unsigned int alloc_plane;
+	unsigned int alloc_kms;
+	unsigned int alloc_present;
+	bool sorted;
+};
+
+struct timeline_latency {
+	struct timeline_binary_names names;
+
+	struct latency_event *events;
+	unsigned int n_events;
+
+	struct latency_pending *pending;
+	unsigned int n_pending;
+	unsigned int alloc_pending;
+
+	unsigned int dropped;
+};
+
+/* The arguments of a point this analysis looks at, 0 when absent */
+struct latency_point {
+	int64_t nsec;
+	uint32_t surface;
+	uint32_t output;
+	int64_t input_nsec;
+	int64_t vblank_nsec;
+	bool has_input;
+	bool has_vblank;
+};
+
+static int64_t
+arg_nsec(const struct timeline_binary_arg *arg)
+{
+	return arg->tv_sec * 1000000000LL + arg->value;
+}
+
+static int
+find_event(struct timeline_latency *lat, const char *name)
+{
+	struct latency_event *events;
+	unsigned int i;
+
+	for (i = 0; i < lat->n_events; i++) {
+		if (strcmp(lat->events[i].base.name, name) == 0)
+			return i;
+	}
+
+	events = realloc(lat->events, (i + 1) * sizeof(*events));
+	if (!events)
+		return -1;
+	lat->events = events;
+
+	memset(&events[i], 0, sizeof(events[i]));
+	events[i].base.name = strdup(name);
+	if (!events[i].base.name)
+		return -1;
+	lat->n_events++;
+
+	return i;
+}
+
+static int
+samples_add(struct timeline_latency_samples *s, unsigned int *alloc,
+	    int64_t nsec)
+{
+	int64_t *samples;
+	unsigned int n;
+
+	if (s->count == *alloc) {
+		n = *alloc ? *alloc * 2 : 64;
+		samples = realloc(s->nsec, n * sizeof(*samples));
+		if (!samples)
+			return -1;
+		s->nsec = samples;
+		*alloc = n;
+	}
+
+	s->nsec[s->count++] = nsec;
+
+	return 0;
+}
+
+static int
+event_add_sample(struct latency_event *ev,
+		 const struct latency_pending *pending, int64_t vblank_nsec)
+{
+	int64_t input = pending->input_nsec;
+
+	ev->sorted = false;
+
+	if (samples_add(&ev->base.to_commit, &ev->alloc_commit,
+			pending->commit_nsec - input) < 0 ||
+	    samples_add(&ev->base.to_present, &ev->alloc_present,
+			vblank_nsec - input) < 0)
+		return -1;
+
+	if (pending->plane_nsec &&
+	    samples_add(&ev->base.to_plane, &ev->alloc_plane,
+			pending->plane_nsec - input) < 0)
+		return -1;
+
+	if (pending->kms_nsec &&
+	    samples_add(&ev->base.to_kms, &ev->alloc_kms,
+			pending->kms_nsec - input) < 0)
+		return -1;
+
+	return 0;
+}
+
+static void
+remove_pending(struct timeline_latency *lat, unsigned int i)
+{
+	lat->pending[i] = lat->pending[--lat->n_pending];
+}
+
+static int
+add_input(struct timeline_latency *lat, const char *name,
+	  const struct latency_point *pt)
+{
+	struct latency_pending *pending;
+	unsigned int i, n;
+	int event;
+
+	/* Nobody to respond to it. */
+	if (!pt->surface)
+		return 0;
+
+	/* Events the client never answered would pile up. */
+	for (i = 0; i < lat->n_pending; ) {
+		if (pt->nsec - lat->pending[i].input_nsec >
+		    LATENCY_TIMEOUT_NSEC) {
+			remove_pending(lat, i);
+			lat->dropped++;
+		} else {
+			i++;
+		}
+	}
+
+	event = find_event(lat, name);
+	if (event < 0)
+		return -1;
+
+	if (lat->n_pending == lat->alloc_pending) {
+		n = lat->alloc_pending ? lat->alloc_pending * 2 : 64;
+		pending = realloc(lat->pending, n * sizeof(*pending));
+		if (!pending)
+			return -1;
+		lat->pending = pending;
+		lat->alloc_pending = n;
+	}
+
+	pending = &lat->pending[lat->n_pending++];
+	pending->event = event;
+	pending->stage = LATENCY_WAIT_COMMIT;
+	pending->surface = pt->surface;
+	pending->output = 0;
+	pending->input_nsec = pt->input_nsec;
+	pending->commit_nsec = 0;
+	pending->plane_nsec = 0;
+	pending->kms_nsec = 0;
+
+	return 0;
+}
+
+static int
+add_point(struct timeline_latency *lat,
+	  const struct timeline_binary_parsed *rec)
+{
+	const struct timeline_binary_point *point = rec->point;
+	const char *name = rec->name;
+	struct latency_point pt = {};
+	struct latency_pending *pending;
+	uint32_t i;
+
+	if (!name)
+		return 0;
+
+	pt.nsec = point->tv_sec * 1000000000LL + point->tv_nsec;
+	for (i = 0; i < rec->n_args; i++) {
+		const struct timeline_binary_arg *arg = &point->args[i];
+
+		switch (arg->type) {
+		case TIMELINE_BINARY_ARG_OUTPUT:
+			pt.output = arg->value;
+			break;
+		case TIMELINE_BINARY_ARG_SURFACE:
+			pt.surface = arg->value;
+			break;
+		case TIMELINE_BINARY_ARG_VBLANK:
+			pt.vblank_nsec = arg_nsec(arg);
+			pt.has_vblank = true;
+			break;
+		case TIMELINE_BINARY_ARG_INPUT:
+			pt.input_nsec = arg_nsec(arg);
+			pt.has_input = true;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (pt.has_input)
+		return add_input(lat, name, &pt);
+
+	if (strcmp(name, "core_commit") == 0) {
+		for (i = 0; i < lat->n_pending; i++) {
+			pending = &lat->pending[i];
+			if (pending->stage != LATENCY_WAIT_COMMIT ||
+			    pending->surface != pt.surface)
+				continue;
+			pending->stage = LATENCY_WAIT_FLUSH;
+			pending->commit_nsec = pt.nsec;
+		}
+	} else if (strcmp(name, "drm_assign_plane") == 0) {
+		/* Planes are assigned before the damage is flushed. */
+		for (i = 0; i < lat->n_pending; i++) {
+			pending = &lat->pending[i];
+			if (pending->stage != LATENCY_WAIT_FLUSH ||
+			    pending->surface != pt.surface)
+				continue;
+			pending->plane_nsec = pt.nsec;
+		}
+	} else if (strcmp(name, "core_flush_damage") == 0) {
+		for (i = 0; i < lat->n_pending; i++) {
+			pending = &lat->pending[i];
+			if (pending->stage != LATENCY_WAIT_FLUSH ||
+			    pending->surface != pt.surface)
+				continue;
+			pending->stage = LATENCY_WAIT_PRESENT;
+			pending->output = pt.output;
+		}
+	} else if (strcmp(name, "drm_kms_commit") == 0) {
+		for (i = 0; i < lat->n_pending; i++) {
+			pending = &lat->pending[i];
+			if (pending->stage != LATENCY_WAIT_PRESENT ||
+			    pending->output != pt.output || pending->kms_nsec)
+				continue;
+			pending->kms_nsec = pt.nsec;
+		}
+	} else if (strcmp(name, "core_repaint_finished") == 0 &&
+		   pt.has_vblank) {
+		for (i = 0; i < lat->n_pending; ) {
+			pending = &lat->pending[i];
+			if (pending->stage != LATENCY_WAIT_PRESENT ||
+			    pending->output != pt.output) {
+				i++;
+				continue;
+			}
+			if (event_add_sample(&lat->events[pending->event],
+					     pending, pt.vblank_nsec) < 0)
+				return -1;
+			remove_pending(lat, i);
+		}
+	}
+
+	return 0;
+}
+
+struct timeline_latency *
+timeline_latency_create(void)
+{
+	return calloc(1, sizeof(struct timeline_latency));
+}
+
+void
+timeline_latency_destroy(struct timeline_latency *lat)
+{
+	unsigned int i;
+
+	timeline_binary_names_fini(&lat->names);
+
+	for (i = 0; i < lat->n_events; i++) {
+		free((char *)lat->events[i].base.name);
+		free(lat->events[i].base.to_commit.nsec);
+		free(lat->events[i].base.to_plane.nsec);
+		free(lat->events[i].base.to_kms.nsec);
+		free(lat->events[i].base.to_present.nsec);
+	}
+	free(lat->events);
+
+	free(lat->pending);
+	free(lat);
+}
+
+/** Feed the next record of the stream
+ *
+ * \param payload The rec->size - sizeof(*rec) bytes following the record
+ * header, 8 byte aligned.
+ * \return 0 on success, -1 on a corrupt record or allocation failure.
+ */
+int
+timeline_latency_add_record(struct timeline_latency *lat,
+			    const struct timeline_binary_record *rec,
+			    const void *payload)
+{
+	struct timeline_binary_parsed parsed;
+
+	if (timeline_binary_parse_record(&lat->names, rec, payload,
+					 &parsed) < 0)
+		return -1;
+
+	if (parsed.type == TIMELINE_BINARY_POINT)
+		return add_point(lat, &parsed);
+
+	return 0;
+}
+
+static int
+compare_nsec(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void
+samples_sort(struct timeline_latency_samples *s)
+{
+	qsort(s->nsec, s->count, sizeof(s->nsec[0]), compare_nsec);
+}
+
+/** Get the i-th kind of input event seen, with sorted samples
+ *
+ * \return The event, or NULL if i is out of range.
+ */
+const struct timeline_latency_event *
+timeline_latency_get_event(struct timeline_latency *lat, unsigned int i)
+{
+	struct latency_event *ev;
+
+	if (i >= lat->n_events)
+		return NULL;
+
+	ev = &lat->events[i];
+	if (!ev->sorted) {
+		samples_sort(&ev->base.to_commit);
+		samples_sort(&ev->base.to_plane);
+		samples_sort(&ev->base.to_kms);
+		samples_sort(&ev->base.to_present);
+		ev->sorted = true;
+	}
+
+	return &ev->base;
+}
+
+/** Number of input events whose surface did not respond in time */
+unsigned int
+timeline_latency_get_dropped(struct timeline_latency *lat)
+{
+	return lat->dropped;
+}
+
+/** Nearest-rank percentile of sorted samples, count must not be 0 */
+int64_t
+timeline_latency_percentile(const int64_t *sorted, unsigned int count,
+			    unsigned int percent)
+{
+	unsigned int rank = (count * percent + 99) / 100;
+
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_TIMELINE_LATENCY_H
+#define WESTON_TIMELINE_LATENCY_H
+
+#include <stdint.h>
+
+#include "shared/timeline-binary.h"
+
+/*
+ * Input-to-present latency from a 'timeline-binary' stream.
+ *
+ * Every core_input_* point names the surface that had the focus. The
+ * event is followed to the next core_commit of that surface, the
+ * core_flush_damage that puts the new content on an output, and the
+ * core_repaint_finished of that output, whose vblank time is when the
+ * response became visible. Events whose surface does not respond within
+ * a second are dropped.
+ *
+ * On the DRM backend, the drm_assign_plane of the surface in the repaint
+ * that flushes the response, and the drm_kms_commit of its output after
+ * that, are reported as well.
+ */
+
+struct timeline_latency;
+
+/* Latencies from the input event to one stage, sorted, in nanoseconds */
+struct timeline_latency_samples {
+	unsigned int count;
+	int64_t *nsec;
+};
+
+/* Completed events of one kind. Every event has to_commit and
+ * to_present samples; only the responses the DRM backend put on a
+ * plane have to_plane samples, and only the DRM backend has to_kms. */
+struct timeline_latency_event {
+	const char *name;
+	struct timeline_latency_samples to_commit;
+	struct timeline_latency_samples to_plane;
+	struct timeline_latency_samples to_kms;
+	struct timeline_latency_samples to_present;
+};
+
+struct timeline_latency *
+timeline_latency_create(void);
+
+void
+timeline_latency_destroy(struct timeline_latency *lat);
+
+int
+timeline_latency_add_record(struct timeline_latency *lat,
+			    const struct timeline_binary_record *rec,
+			    const void *payload);
+
+const struct timeline_latency_event *
+timeline_latency_get_event(struct timeline_latency *lat, unsigned int i);
+
+unsigned int
+timeline_latency_get_dropped(struct timeline_latency *lat);
+
+int64_t
+timeline_latency_percentile(const int64_t *sorted, unsigned int count,
+			    unsigned int percent);
+
+#endif /* WESTON_TIMELINE_LATENCY_H */
@@ -0,0 +1,289 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include "shared/wcap-decode.h"
+#include "shared/wcap-rle.h"
+
+static void
+wcap_decoder_decode_rectangle(struct wcap_decoder *decoder,
+			      struct wcap_rectangle *rect)
+{
+	uint32_t v, *p = decoder->p, *d;
+	int width = rect->x2 - rect->x1, height = rect->y2 - rect->y1;
+	int x, i, j, k, l, count = width * height;
+
+	d = decoder->frame + (rect->y2 - 1) * decoder->width;
+	x = rect->x1;
+	i = 0;
+	while (i < count) {
+		v = *p++;
+		l = v >> 24;
+		if (l < 0xe0) {
+			j = l + 1;
+		} else {
+			j = 1 << (l - 0xe0 + 7);
+		}
+
+		i += j;
+		while (j > 0) {
+			k = rect->x2 - x;
+			if (k > j)
+				k = j;
+			decoder->kernels->apply(d + x, v, k);
+			x += k;
+			j -= k;
+			if (x == rect->x2) {
+				x = rect->x1;
+				d -= decoder->width;
+			}
+		}
+	}
+
+	if (i != count)
+		printf("rle encoding longer than expected (%d expected %d)\n",
+		       i, count);
+
+	decoder->p = p;
+}
+
+int
+wcap_decoder_get_frame(struct wcap_decoder *decoder)
+{
+	struct wcap_rectangle *rects;
+	struct wcap_frame_header *header_v1;
+	struct wcap_frame_header_v2 header;
+	size_t header_size;
+	uint32_t i;
+
+	if (decoder->version == 2)
+		header_size = sizeof header;
+	else
+		header_size = sizeof *header_v1;
+
+	if ((size_t) ((char *) decoder->end - (char *) decoder->p) < header_size)
+		return 0;
+
+	if (decoder->version == 2) {
+		memcpy(&header, decoder->p, sizeof header);
+	} else {
+		header_v1 = decoder->p;
+		header.msecs = header_v1->msecs;
+		header.nrects = header_v1->nrects;
+		header.flags = 0;
+	}
+
+	decoder->msecs = header.msecs;
+	decoder->count++;
+
+	if (header.flags & WCAP_FRAME_KEY)
+		memset(decoder->frame, 0,
+		       decoder->width * decoder->height * 4);
+
+	rects = (void *) ((char *) decoder->p + header_size);
+	decoder->p = (uint32_t *) (rects + header.nrects);
+	for (i = 0; i < header.nrects; i++)
+		wcap_decoder_decode_rectangle(decoder, &rects[i]);
+
+	return 1;
+}
+
+static void
+wcap_decoder_restart(struct wcap_decoder *decoder, void *p, uint32_t count)
+{
+	decoder->p = p;
+	decoder->count = count;
+	memset(decoder->frame, 0, decoder->width * decoder->height * 4);
+}
+
+/* Decode the given frame, counting from 0, and return 0 if there is no
+ * such frame. Indexed files are decoded from the closest key frame
+ * before it, others are replayed from the start when seeking backwards.
+ */
+int
+wcap_decoder_seek(struct wcap_decoder *decoder, uint32_t frame)
+{
+	uint32_t key, current = decoder->count - 1;
+
+	if (decoder->index) {
+		if (frame >= decoder->nframes)
+			return 0;
+
+		for (key = frame; key > 0; key--)
+			if (decoder->index[key].flags & WCAP_FRAME_KEY)
+				break;
+
+		/* Keep going from the current frame unless that means
+		 * going backwards or decoding more frames. */
+		if (decoder->count == 0 || current < key || current > frame)
+			wcap_decoder_restart(decoder,
+					     (char *) decoder->map +
+					     decoder->index[key].offset, key);
+	} else if (decoder->count == 0 || current > frame) {
+		wcap_decoder_restart(decoder, decoder->frames, 0);
+	}
+
+	while (decoder->count <= frame)
+		if (!wcap_decoder_get_frame(decoder))
+			return 0;
+
+	return 1;
+}
+
+/* Use the trailing frame index of a v2 file, if it is intact. A capture
+ * that was not stopped cleanly has none and is decoded sequentially. */
+static void
+wcap_decoder_load_index(struct wcap_decoder *decoder)
+{
+	struct wcap_index_footer footer;
+	const struct wcap_index_entry *index;
+	size_t frames_offset = (char *) decoder->frames - (char *) decoder->map;
+	uint64_t offset;
+	uint32_t i;
+
+	if (decoder->size < frames_offset + sizeof footer)
+		return;
+
+	/* Only aligned if the file is intact */
+	memcpy(&footer, (char *) decoder->map + decoder->size - sizeof footer,
+	       sizeof footer);
+	offset = footer.offset;
+	if (footer.magic != WCAP_INDEX_MAGIC || footer.nframes == 0 ||
+	    offset % sizeof(uint64_t) != 0 || offset < frames_offset ||
+	    offset > decoder->size - sizeof footer ||
+	    (decoder->size - sizeof footer - offset) / sizeof *index !=
+	    footer.nframes)
+		return;
+
+	index = (const void *) ((char *) decoder->map + offset);
+	for (i = 0; i < footer.nframes; i++) {
+		if (index[i].offset < frames_offset ||
+		    index[i].offset >= offset ||
+		    (i > 0 && index[i].offset <= index[i - 1].offset))
+			return;
+	}
+
+	decoder->index = index;
+	decoder->nframes = footer.nframes;
+	decoder->end = (char *) decoder->map + offset;
+}
+
+struct wcap_decoder *
+wcap_decoder_create(const char *filename)
+{
+	struct wcap_decoder *decoder;
+	struct wcap_header *header;
+	int frame_size;
+	struct stat buf;
+
+	decoder = calloc(1, sizeof *decoder);
+	if (decoder == NULL)
+		return NULL;
+
+	decoder->fd = open(filename, O_RDONLY);
+	if (decoder->fd == -1) {
+		free(decoder);
+		return NULL;
+	}
+
+	fstat(decoder->fd, &buf);
+	decoder->size = buf.st_size;
+	if (decoder->size < sizeof *header) {
+		fprintf(stderr, "not a wcap file\n");
+		close(decoder->fd);
+		free(decoder);
+		return NULL;
+	}
+
+	decoder->map = mmap(NULL, decoder->size,
+			    PROT_READ, MAP_PRIVATE, decoder->fd, 0);
+	if (decoder->map == MAP_FAILED) {
+		fprintf(stderr, "mmap failed\n");
+		close(decoder->fd);
+		free(decoder);
+		return NULL;
+	}
+
+	header = decoder->map;
+	switch (header->magic) {
+	case WCAP_HEADER_MAGIC:
+		decoder->version = 1;
+		break;
+	case WCAP_HEADER_MAGIC_V2:
+		decoder->version = 2;
+		break;
+	default:
+		fprintf(stderr, "not a wcap file\n");
+		munmap(decoder->map, decoder->size);
+		close(decoder->fd);
+		free(decoder);
+		return NULL;
+	}
+
+	decoder->kernels = wcap_kernels_get();
+	decoder->format = header->format;
+	decoder->count = 0;
+	decoder->width = header->width;
+	decoder->height = header->height;
+	decoder->frames = header + 1;
+	decoder->p = decoder->frames;
+	decoder->end = decoder->map + decoder->size;
+
+	if (decoder->version == 2)
+		wcap_decoder_load_index(decoder);
+
+	frame_size = header->width * header->height * 4;
+	decoder->frame = malloc(frame_size);
+	if (decoder->frame == NULL) {
+		munmap(decoder->map, decoder->size);
+		close(decoder->fd);
+		free(decoder);
+		return NULL;
+	}
+	memset(decoder->frame, 0, frame_size);
+
+	return decoder;
+}
+
+void
+wcap_decoder_destroy(struct wcap_decoder *decoder)
+{
+	munmap(decoder->map, decoder->size);
+	close(decoder->fd);
+	free(decoder->frame);
+	free(decoder);
+}
@@ -28,40 +28,30 @@
 
 #include <stdint.h>
 
-#define WCAP_HEADER_MAGIC	0x57434150
+#include "shared/wcap-format.h"
 
-#define WCAP_FORMAT_XRGB8888	0x34325258
-#define WCAP_FORMAT_XBGR8888	0x34324258
-#define WCAP_FORMAT_RGBX8888	0x34325852
-#define WCAP_FORMAT_BGRX8888	0x34325842
-
-struct wcap_header {
-	uint32_t magic;
-	uint32_t format;
-	uint32_t width, height;
-};
-
-struct wcap_frame_header {
-	uint32_t msecs;
-	uint32_t nrects;
-};
-
-struct wcap_rectangle {
-	int32_t x1, y1, x2, y2;
-};
+struct wcap_kernels;
 
 struct wcap_decoder {
 	int fd;
 	size_t size;
 	void *map, *p, *end;
+	void *frames; /* the first frame */
 	uint32_t *frame;
+	const struct wcap_kernels *kernels;
+	uint32_t version;
 	uint32_t format;
 	uint32_t msecs;
 	uint32_t count;
 	int width, height;
+
+	/* NULL if the file has no (valid) index */
+	const struct wcap_index_entry *index;
+	uint32_t nframes;
 };
 
 int wcap_decoder_get_frame(struct wcap_decoder *decoder);
+int wcap_decoder_seek(struct wcap_decoder *decoder, uint32_t frame);
 struct wcap_decoder *wcap_decoder_create(const char *filename);
 void wcap_decoder_destroy(struct wcap_decoder *decoder);
 
@@ -0,0 +1,384 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * The vector implementations compute the deltas of a block of pixels at
+ * once, which is a byte-wise subtraction with X masked off. While the
+ * whole block continues the current run, only the run length changes;
+ * otherwise the block's deltas go through the same run detection as the
+ * scalar code. Unchanged areas, the bulk of a desktop capture, are a
+ * single run of zero deltas.
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_WCAP_AVX2 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_WCAP_NEON 1
+#endif
+
+#include "shared/wcap-rle.h"
+
+#define DELTA_MASK 0x00ffffff
+
+static uint32_t *
+output_run(uint32_t *p, uint32_t delta, int run)
+{
+	int i;
+
+	while (run > 0) {
+		if (run <= 0xe0) {
+			*p++ = delta | ((run - 1) << 24);
+			break;
+		}
+
+		i = 24 - __builtin_clz(run);
+		*p++ = delta | ((i + 0xe0) << 24);
+		run -= 1 << (7 + i);
+	}
+
+	return p;
+}
+
+static inline uint32_t
+component_delta(uint32_t next, uint32_t prev)
+{
+	unsigned char dr, dg, db;
+
+	dr = (next >> 16) - (prev >> 16);
+	dg = (next >>  8) - (prev >>  8);
+	db = (next >>  0) - (prev >>  0);
+
+	return (dr << 16) | (dg << 8) | (db << 0);
+}
+
+static inline uint32_t *
+run_add(uint32_t *p, uint32_t delta, struct wcap_run *run)
+{
+	if (run->length == 0 || delta == run->delta) {
+		run->length++;
+	} else {
+		p = output_run(p, run->delta, run->length);
+		run->length = 1;
+	}
+	run->delta = delta;
+
+	return p;
+}
+
+uint32_t *
+wcap_run_flush(uint32_t *p, struct wcap_run *run)
+{
+	p = output_run(p, run->delta, run->length);
+	run->length = 0;
+
+	return p;
+}
+
+static uint32_t *
+encode_scalar(uint32_t *p, const uint32_t *next, uint32_t *ref, int n,
+	      struct wcap_run *run)
+{
+	int k;
+
+	for (k = 0; k < n; k++)
+		p = run_add(p, component_delta(next[k], ref ? ref[k] : 0), run);
+
+	if (ref)
+		memcpy(ref, next, n * sizeof *next);
+
+	return p;
+}
+
+static void
+apply_scalar(uint32_t *d, uint32_t delta, int n)
+{
+	unsigned char r, g, b, dr, dg, db;
+	int k;
+
+	dr = (delta >> 16);
+	dg = (delta >>  8);
+	db = (delta >>  0);
+	for (k = 0; k < n; k++) {
+		r = (d[k] >> 16) + dr;
+		g = (d[k] >>  8) + dg;
+		b = (d[k] >>  0) + db;
+		d[k] = 0xff000000 | (r << 16) | (g << 8) | b;
+	}
+}
+
+static const struct wcap_kernels kernels_scalar = {
+	.name = "scalar",
+	.encode = encode_scalar,
+	.apply = apply_scalar,
+};
+
+#if defined(__SSE2__)
+static uint32_t *
+encode_sse2(uint32_t *p, const uint32_t *next, uint32_t *ref, int n,
+	    struct wcap_run *run)
+{
+	const __m128i mask = _mm_set1_epi32(DELTA_MASK);
+	__m128i a, b, delta;
+	uint32_t deltas[4];
+	int i, k;
+
+	for (k = 0; k + 4 <= n; k += 4) {
+		a = _mm_loadu_si128((const __m128i *) (next + k));
+		if (ref) {
+			b = _mm_loadu_si128((const __m128i *) (ref + k));
+			_mm_storeu_si128((__m128i *) (ref + k), a);
+		} else {
+			b = _mm_setzero_si128();
+		}
+		delta = _mm_and_si128(_mm_sub_epi8(a, b), mask);
+
+		if (run->length > 0 &&
+		    _mm_movemask_epi8(_mm_cmpeq_epi32(delta,
+				_mm_set1_epi32(run->delta))) == 0xffff) {
+			run->length += 4;
+			continue;
+		}
+
+		_mm_storeu_si128((__m128i *) deltas, delta);
+		for (i = 0; i < 4; i++)
+			p = run_add(p, deltas[i], run);
+	}
+
+	return encode_scalar(p, next + k, ref ? ref + k : NULL, n - k, run);
+}
+
+static void
+apply_sse2(uint32_t *d, uint32_t delta, int n)
+{
+	const __m128i vdelta = _mm_set1_epi32(delta & DELTA_MASK);
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	__m128i x;
+	int k;
+
+	for (k = 0; k + 4 <= n; k += 4) {
+		x = _mm_loadu_si128((const __m128i *) (d + k));
+		x = _mm_or_si128(_mm_add_epi8(x, vdelta), alpha);
+		_mm_storeu_si128((__m128i *) (d + k), x);
+	}
+
+	apply_scalar(d + k, delta, n - k);
+}
+
+static const struct wcap_kernels kernels_sse2 = {
+	.name = "sse2",
+	.encode = encode_sse2,
+	.apply = apply_sse2,
+};
+#endif
+
+#if defined(HAVE_WCAP_AVX2)
+__attribute__((target("avx2"))) static uint32_t *
+encode_avx2(uint32_t *p, const uint32_t *next, uint32_t *ref, int n,
+	    struct wcap_run *run)
+{
+	const __m256i mask = _mm256_set1_epi32(DELTA_MASK);
+	__m256i a, b, delta;
+	uint32_t deltas[8];
+	int i, k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		a = _mm256_loadu_si256((const __m256i *) (next + k));
+		if (ref) {
+			b = _mm256_loadu_si256((const __m256i *) (ref + k));
+			_mm256_storeu_si256((__m256i *) (ref + k), a);
+		} else {
+			b = _mm256_setzero_si256();
+		}
+		delta = _mm256_and_si256(_mm256_sub_epi8(a, b), mask);
+
+		if (run->length > 0 &&
+		    (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi32(delta,
+				_mm256_set1_epi32(run->delta))) == 0xffffffff) {
+			run->length += 8;
+			continue;
+		}
+
+		_mm256_storeu_si256((__m256i *) deltas, delta);
+		for (i = 0; i < 8; i++)
+			p = run_add(p, deltas[i], run);
+	}
+
+	return encode_scalar(p, next + k, ref ? ref + k : NULL, n - k, run);
+}
+
+__attribute__((target("avx2"))) static void
+apply_avx2(uint32_t *d, uint32_t delta, int n)
+{
+	const __m256i vdelta = _mm256_set1_epi32(delta & DELTA_MASK);
+	const __m256i alpha = _mm256_set1_epi32(0xff000000);
+	__m256i x;
+	int k;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		x = _mm256_loadu_si256((const __m256i *) (d + k));
+		x = _mm256_or_si256(_mm256_add_epi8(x, vdelta), alpha);
+		_mm256_storeu_si256((__m256i *) (d + k), x);
+	}
+
+	apply_scalar(d + k, delta, n - k);
+}
+
+static const struct wcap_kernels kernels_avx2 = {
+	.name = "avx2",
+	.encode = encode_avx2,
+	.apply = apply_avx2,
+};
+
+static bool
+avx2_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#if defined(HAVE_WCAP_NEON)
+static uint32_t *
+encode_neon(uint32_t *p, const uint32_t *next, uint32_t *ref, int n,
+	    struct wcap_run *run)
+{
+	const uint32x4_t mask = vdupq_n_u32(DELTA_MASK);
+	uint32x4_t a, b, delta, eq;
+	uint32x2_t all;
+	uint32_t deltas[4];
+	int i, k;
+
+	for (k = 0; k + 4 <= n; k += 4) {
+		a = vld1q_u32(next + k);
+		if (ref) {
+			b = vld1q_u32(ref + k);
+			vst1q_u32(ref + k, a);
+		} else {
+			b = vdupq_n_u32(0);
+		}
+		delta = vandq_u32(vreinterpretq_u32_u8(
+				vsubq_u8(vreinterpretq_u8_u32(a),
+					 vreinterpretq_u8_u32(b))), mask);
+
+		if (run->length > 0) {
+			eq = vceqq_u32(delta, vdupq_n_u32(run->delta));
+			all = vand_u32(vget_low_u32(eq), vget_high_u32(eq));
+			if ((vget_lane_u32(all, 0) & vget_lane_u32(all, 1)) ==
+			    0xffffffff) {
+				run->length += 4;
+				continue;
+			}
+		}
+
+		vst1q_u32(deltas, delta);
+		for (i = 0; i < 4; i++)
+			p = run_add(p, deltas[i], run);
+	}
+
+	return encode_scalar(p, next + k, ref ? ref + k : NULL, n - k, run);
+}
+
+static void
+apply_neon(uint32_t *d, uint32_t delta, int n)
+{
+	const uint8x16_t vdelta =
+		vreinterpretq_u8_u32(vdupq_n_u32(delta & DELTA_MASK));
+	const uint32x4_t alpha = vdupq_n_u32(0xff000000);
+	uint8x16_t x;
+	int k;
+
+	for (k = 0; k + 4 <= n; k += 4) {
+		x = vreinterpretq_u8_u32(vld1q_u32(d + k));
+		vst1q_u32(d + k, vorrq_u32(vreinterpretq_u32_u8(
+				vaddq_u8(x, vdelta)), alpha));
+	}
+
+	apply_scalar(d + k, delta, n - k);
+}
+
+static const struct wcap_kernels kernels_neon = {
+	.name = "neon",
+	.encode = encode_neon,
+	.apply = apply_neon,
+};
+#endif
+
+static const struct {
+	const struct wcap_kernels *kernels;
+	bool (*supported)(void);
+} implementations[] = {
+#if defined(HAVE_WCAP_AVX2)
+	{ &kernels_avx2, avx2_supported },
+#endif
+#if defined(__SSE2__)
+	{ &kernels_sse2, NULL },
+#endif
+#if defined(HAVE_WCAP_NEON)
+	{ &kernels_neon, NULL },
+#endif
+	{ &kernels_scalar, NULL },
+};
+
+/** Get the i-th implementation the CPU supports, fastest first
+ *
+ * \return The implementation, or NULL if i is out of range. The scalar
+ * implementation is always the last one.
+ */
+const struct wcap_kernels *
+wcap_kernels_enumerate(int i)
+{
+	size_t k;
+
+	for (k = 0; k < sizeof implementations / sizeof implementations[0];
+	     k++) {
+		if (implementations[k].supported &&
+		    !implementations[k].supported())
+			continue;
+
+		if (i-- == 0)
+			return implementations[k].kernels;
+	}
+
+	return NULL;
+}
+
+/** Get the fastest implementation the CPU supports */
+const struct wcap_kernels *
+wcap_kernels_get(void)
+{
+	return wcap_kernels_enumerate(0);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright © 2012 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _WCAP_RLE_
+#define _WCAP_RLE_
+
+#include <stdint.h>
+
+/* Run length encoder state, carried across the rows of a rectangle */
+struct wcap_run {
+	uint32_t delta;
+	int length;
+};
+
+/* Delta and run length coding of wcap pixels. All implementations
+ * produce exactly the same output. */
+struct wcap_kernels {
+	const char *name;
+
+	/* Encode the component-wise differences of n pixels from ref and
+	 * store them in ref, or encode them against 0x00000000 pixels if
+	 * ref is NULL. p needs room for n words. Returns the new end of
+	 * the output. */
+	uint32_t *(*encode)(uint32_t *p, const uint32_t *next, uint32_t *ref,
+			    int n, struct wcap_run *run);
+
+	/* Add the components of delta to n pixels, setting X to 0xff. */
+	void (*apply)(uint32_t *d, uint32_t delta, int n);
+};
+
+static inline void
+wcap_run_init(struct wcap_run *run)
+{
+	run->delta = 0;
+	run->length = 0;
+}
+
+uint32_t *
+wcap_run_flush(uint32_t *p, struct wcap_run *run);
+
+const struct wcap_kernels *
+wcap_kernels_enumerate(int i);
+
+const struct wcap_kernels *
+wcap_kernels_get(void);
+
+#endif
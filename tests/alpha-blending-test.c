@@ -35,6 +35,8 @@
 struct setup_args {
 	struct fixture_metadata meta;
 	enum renderer_type renderer;
+	int pixman_threads;
+	bool gl_immediate_draws;
 };
 
 static const int ALPHA_STEPS = 256;
@@ -45,10 +47,20 @@ static const struct setup_args my_setup_args[] = {
 		.renderer = RENDERER_PIXMAN,
 		.meta.name = "pixman"
 	},
+	{
+		.renderer = RENDERER_PIXMAN,
+		.pixman_threads = 2,
+		.meta.name = "pixman threaded"
+	},
 	{
 		.renderer = RENDERER_GL,
 		.meta.name = "GL"
 	},
+	{
+		.renderer = RENDERER_GL,
+		.gl_immediate_draws = true,
+		.meta.name = "GL immediate"
+	},
 };
 
 static enum test_result_code
@@ -62,6 +74,17 @@ fixture_setup(struct weston_test_harness *harness, const struct setup_args *arg)
 	setup.height = 16;
 	setup.shell = SHELL_TEST_DESKTOP;
 
+	if (arg->pixman_threads > 0) {
+		weston_ini_setup(&setup,
+				 cfgln("[core]"),
+				 cfgln("pixman-threads=%d", arg->pixman_threads));
+	}
+	if (arg->gl_immediate_draws) {
+		weston_ini_setup(&setup,
+				 cfgln("[core]"),
+				 cfgln("gl-immediate-draws=true"));
+	}
+
 	return weston_test_harness_execute_as_client(harness, &setup);
 }
 DECLARE_FIXTURE_SETUP_WITH_ARG(fixture_setup, my_setup_args, meta);
@@ -0,0 +1,176 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "weston-test-runner.h"
+
+#include "cursor-cache.h"
+#include "shared/hash-util.h"
+
+#define CURSOR_PIXELS (64 * 64)
+#define N_IMAGES 10
+
+static uint32_t images[N_IMAGES][CURSOR_PIXELS];
+
+/* What the DRM-backend does with the cursor images of an output, each
+ * shown for a frame. */
+struct cursor {
+	struct drm_cursor_cache cache;
+	int on_screen;
+	int current;
+	int hits;
+	int copies;
+};
+
+static void
+cursor_init(struct cursor *cursor)
+{
+	int i, j;
+
+	for (i = 0; i < N_IMAGES; i++) {
+		for (j = 0; j < CURSOR_PIXELS; j++)
+			images[i][j] = 0xff000000 | (i << 16) | j;
+	}
+
+	memset(cursor, 0, sizeof *cursor);
+	cursor->on_screen = -1;
+
+	/* The backend creates one BO up front. */
+	cursor->cache.n_bos = 1;
+}
+
+/* See cursor_bo_update() */
+static void
+cursor_show(struct cursor *cursor, const uint32_t *image)
+{
+	struct drm_cursor_cache *cache = &cursor->cache;
+	size_t size = CURSOR_PIXELS * sizeof *image;
+	uint64_t hash = fnv1a_64(FNV1A_64_INIT, image, size);
+	uint32_t busy = 0;
+	int i;
+
+	i = drm_cursor_cache_find(cache, image, size, hash);
+	if (i >= 0) {
+		if (i != cursor->current)
+			cursor->hits++;
+	} else {
+		if (cache->entries[cursor->current].pixels)
+			busy |= 1u << cursor->current;
+		if (cursor->on_screen >= 0)
+			busy |= 1u << cursor->on_screen;
+
+		i = drm_cursor_cache_victim(cache, busy, true);
+		assert(i >= 0);
+		assert(!(busy & (1u << i)));
+		if (i == cache->n_bos)
+			cache->n_bos++;
+
+		drm_cursor_cache_store(cache, i, image, size, hash);
+		cursor->copies++;
+	}
+
+	cursor->current = i;
+	cursor->on_screen = i;
+	assert(memcmp(cache->entries[i].pixels, image, size) == 0);
+}
+
+TEST(cursor_cache_still_image)
+{
+	struct cursor cursor;
+	int i;
+
+	cursor_init(&cursor);
+
+	for (i = 0; i < 20; i++)
+		cursor_show(&cursor, images[0]);
+
+	/* Copied once, into the BO there was. */
+	assert(cursor.copies == 1);
+	assert(cursor.hits == 0);
+	assert(cursor.cache.n_bos == 1);
+
+	drm_cursor_cache_fini(&cursor.cache);
+}
+
+TEST(cursor_cache_two_images)
+{
+	struct cursor cursor;
+	int i;
+
+	cursor_init(&cursor);
+
+	for (i = 0; i < 20; i++)
+		cursor_show(&cursor, images[i % 2]);
+
+	/* No image is copied a second time. */
+	assert(cursor.copies == 2);
+	assert(cursor.hits == 18);
+	assert(cursor.cache.n_bos == 2);
+
+	drm_cursor_cache_fini(&cursor.cache);
+}
+
+TEST(cursor_cache_more_images_than_bos)
+{
+	struct cursor cursor;
+	int i;
+
+	cursor_init(&cursor);
+
+	/* Least recently used first: cycling through more images than
+	 * there are BOs copies every one every time. */
+	for (i = 0; i < 3 * N_IMAGES; i++)
+		cursor_show(&cursor, images[i % N_IMAGES]);
+
+	assert(cursor.copies == 3 * N_IMAGES);
+	assert(cursor.hits == 0);
+	assert(cursor.cache.n_bos == DRM_CURSOR_CACHE_SIZE);
+
+	/* The images shown last are still there. */
+	cursor_show(&cursor, images[N_IMAGES - 2]);
+	assert(cursor.copies == 3 * N_IMAGES);
+	assert(cursor.hits == 1);
+
+	drm_cursor_cache_fini(&cursor.cache);
+}
+
+TEST(cursor_cache_all_busy)
+{
+	struct drm_cursor_cache cache;
+
+	memset(&cache, 0, sizeof cache);
+	cache.n_bos = 2;
+
+	assert(drm_cursor_cache_victim(&cache, 0x3, true) == 2);
+	assert(drm_cursor_cache_victim(&cache, 0x3, false) == -1);
+	assert(drm_cursor_cache_victim(&cache, 0x2, false) == 0);
+
+	drm_cursor_cache_fini(&cache);
+}
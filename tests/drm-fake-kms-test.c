@@ -0,0 +1,129 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+
+#include "weston-test-client-helper.h"
+#include "weston-test-fixture-compositor.h"
+#include "fake-kms.h"
+
+/* Shared with the compositor running in the same process */
+static struct fake_kms *kms;
+
+struct setup_args {
+	struct fixture_metadata meta;
+	bool kms_thread;
+};
+
+static const struct setup_args my_setup_args[] = {
+	{
+		.kms_thread = false,
+		.meta.name = "main thread"
+	},
+	{
+		.kms_thread = true,
+		.meta.name = "KMS thread"
+	},
+};
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness, const struct setup_args *arg)
+{
+	struct compositor_setup setup;
+	struct fake_kms_config config;
+	enum test_result_code ret;
+
+	fake_kms_config_defaults(&config);
+	kms = fake_kms_create(&config);
+
+	compositor_setup_defaults(&setup);
+	setup.shell = SHELL_TEST_DESKTOP;
+	setup.backend = WESTON_BACKEND_DRM;
+	setup.renderer = RENDERER_PIXMAN;
+	setup.drm_device = FAKE_KMS_DEVICE_PATH;
+
+	if (arg->kms_thread) {
+		weston_ini_setup(&setup,
+				 cfgln("[core]"),
+				 cfgln("kms-thread=true"));
+	}
+
+	ret = weston_test_harness_execute_as_client(harness, &setup);
+
+	fake_kms_destroy(kms);
+	kms = NULL;
+
+	return ret;
+}
+DECLARE_FIXTURE_SETUP_WITH_ARG(fixture_setup, my_setup_args, meta);
+
+TEST(drm_fake_kms_flips)
+{
+	struct fake_kms_counters before, after;
+	struct client *client;
+	struct buffer *buffer;
+	struct wl_surface *surface;
+	pixman_color_t red;
+	int i, frame;
+
+	color_rgb888(&red, 255, 0, 0);
+
+	client = create_client_and_test_surface(0, 0, 200, 200);
+	assert(client);
+
+	surface = client->surface->wl_surface;
+	buffer = create_shm_buffer_a8r8g8b8(client, 200, 200);
+
+	fill_image_with_color(buffer->image, &red);
+
+	fake_kms_get_counters(kms, &before);
+
+	for (i = 0; i < 5; i++) {
+		wl_surface_attach(surface, buffer->proxy, 0, 0);
+		wl_surface_damage(surface, 0, 0, 200, 200);
+		frame_callback_set(surface, &frame);
+		wl_surface_commit(surface);
+		frame_callback_wait(client, &frame);
+	}
+
+	fake_kms_get_counters(kms, &after);
+
+	/* Every frame was committed and completed by a page flip. */
+	assert(after.commits - before.commits >= 5);
+	assert(after.flips - before.flips >= 5);
+	assert(after.commits_failed == 0);
+
+	/* The renderer's buffer was tested on the primary plane. */
+	assert(after.tests > 0);
+	assert(after.tests_failed == 0);
+
+	testlog("%" PRIu64 " commits, %" PRIu64 " flips, %" PRIu64 " tests\n",
+		after.commits, after.flips, after.tests);
+
+	buffer_destroy(buffer);
+	client_destroy(client);
+}
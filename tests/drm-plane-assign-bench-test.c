@@ -0,0 +1,857 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <xf86drmMode.h>
+
+#include <libweston/libweston.h>
+#include <libweston/backend-drm.h>
+#include "libweston-internal.h"
+#include "backend.h"
+#include "linux-dmabuf.h"
+#include "shared/helpers.h"
+#include "shared/os-compatibility.h"
+#include "shared/timespec-util.h"
+#include "shared/weston-drm-fourcc.h"
+#include "shared/xalloc.h"
+#include "weston-test-runner.h"
+#include "test-config.h"
+#include "fake-kms.h"
+#include "linux-dmabuf-unstable-v1-client-protocol.h"
+
+#define BENCH_VIEWS 500
+#define BENCH_ITERATIONS 200
+/* Positions the moving view cycles through, more than the plane
+ * assignment cache holds */
+#define BENCH_POSITIONS 100
+#define BENCH_BUFFERS 4
+
+/* DRM_PLANE_SEARCH_MAX_TESTS of the DRM-backend */
+#define SEARCH_MAX_TESTS 16
+/* The search finishes a proposal started within its budget. A proposal
+ * tests each view it allows on every overlay at most, and then the whole
+ * state; the fake KMS has three overlays. */
+#define SEARCH_PROPOSAL_MAX_TESTS (3 * 3 + 1)
+
+/*
+ * The compositor is set up here rather than with the test harness: the
+ * benchmark needs the event loop to get the first frame on screen, which
+ * a plugin test running from an idle callback cannot do.
+ *
+ * The views show dmabuf buffers, so that they compete for the overlays.
+ * A client in the same process makes them, through linux-dmabuf. The
+ * Pixman-renderer can't import dmabufs, so the bench stands in for it:
+ * none of the buffers are composited, only their size matters to it.
+ */
+struct bench_client {
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct wl_compositor *compositor;
+	struct zwp_linux_dmabuf_v1 *dmabuf;
+	/* The compositor's end of the connection */
+	struct wl_client *server;
+};
+
+struct bench_view {
+	struct wl_surface *surface;
+	struct weston_view *view;
+	int x, y;
+	int width, height;
+};
+
+struct bench {
+	struct fake_kms *kms;
+	struct wl_display *display;
+	struct weston_log_context *log_ctx;
+	struct weston_compositor *compositor;
+	struct weston_output *output;
+	struct wl_listener frame_listener;
+	int frames;
+
+	/* The debug messages of the DRM-backend, see bench_log_drm() */
+	FILE *drm_log;
+	struct weston_log_subscriber *drm_log_subscriber;
+
+	struct bench_client client;
+	struct wl_buffer *buffers[BENCH_BUFFERS];
+	int n_buffers;
+
+	struct weston_layer layer;
+	/* Bottom to top */
+	struct bench_view views[BENCH_VIEWS];
+	int n_views;
+};
+
+static void (*pixman_attach)(struct weston_surface *surface,
+			     struct weston_buffer *buffer);
+static struct weston_drm_format_array bench_formats;
+
+struct bench_result {
+	int64_t nsec;
+	uint64_t tests;
+	uint64_t tests_failed;
+};
+
+static int
+bench_log(const char *fmt, va_list ap)
+{
+	return vfprintf(stderr, fmt, ap);
+}
+
+static bool
+bench_import_dmabuf(struct weston_compositor *compositor,
+		    struct linux_dmabuf_buffer *dmabuf)
+{
+	return true;
+}
+
+static const struct weston_drm_format_array *
+bench_get_supported_formats(struct weston_compositor *compositor)
+{
+	return &bench_formats;
+}
+
+/* What the GL-renderer would take from a dmabuf buffer */
+static void
+bench_attach(struct weston_surface *surface, struct weston_buffer *buffer)
+{
+	struct linux_dmabuf_buffer *dmabuf = NULL;
+
+	if (buffer)
+		dmabuf = linux_dmabuf_buffer_get(buffer->resource);
+	if (!dmabuf) {
+		pixman_attach(surface, buffer);
+		return;
+	}
+
+	pixman_attach(surface, NULL);
+	buffer->width = dmabuf->attributes.width;
+	buffer->height = dmabuf->attributes.height;
+	buffer->y_inverted = !(dmabuf->attributes.flags &
+			       ZWP_LINUX_BUFFER_PARAMS_V1_FLAGS_Y_INVERT);
+	surface->is_opaque = dmabuf->attributes.format == DRM_FORMAT_XRGB8888;
+}
+
+static void
+bench_renderer_init(struct bench *bench)
+{
+	struct weston_renderer *renderer = bench->compositor->renderer;
+	int ret;
+
+	assert(!renderer->import_dmabuf);
+	pixman_attach = renderer->attach;
+	renderer->attach = bench_attach;
+	renderer->import_dmabuf = bench_import_dmabuf;
+	renderer->get_supported_formats = bench_get_supported_formats;
+	weston_drm_format_array_init(&bench_formats);
+
+	ret = linux_dmabuf_setup(bench->compositor);
+	assert(ret == 0);
+}
+
+static void
+sync_done(void *data, struct wl_callback *callback, uint32_t serial)
+{
+	bool *done = data;
+
+	*done = true;
+	wl_callback_destroy(callback);
+}
+
+static const struct wl_callback_listener sync_listener = {
+	sync_done
+};
+
+/* Have the compositor handle all the client sent so far. Both run in
+ * this thread, so wl_display_roundtrip() would never return. */
+static void
+bench_client_roundtrip(struct bench *bench)
+{
+	struct wl_event_loop *loop = wl_display_get_event_loop(bench->display);
+	struct wl_callback *callback;
+	bool done = false;
+
+	callback = wl_display_sync(bench->client.display);
+	wl_callback_add_listener(callback, &sync_listener, &done);
+	while (!done) {
+		assert(wl_display_flush(bench->client.display) >= 0);
+		wl_event_loop_dispatch(loop, 0);
+		wl_display_flush_clients(bench->display);
+		assert(wl_display_dispatch(bench->client.display) >= 0);
+	}
+}
+
+static void
+registry_handle_global(void *data, struct wl_registry *registry,
+		       uint32_t name, const char *interface, uint32_t version)
+{
+	struct bench_client *client = data;
+
+	if (strcmp(interface, wl_compositor_interface.name) == 0) {
+		client->compositor =
+			wl_registry_bind(registry, name,
+					 &wl_compositor_interface, 4);
+	} else if (strcmp(interface,
+			  zwp_linux_dmabuf_v1_interface.name) == 0) {
+		client->dmabuf =
+			wl_registry_bind(registry, name,
+					 &zwp_linux_dmabuf_v1_interface, 3);
+	}
+}
+
+static void
+registry_handle_global_remove(void *data, struct wl_registry *registry,
+			      uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+	registry_handle_global,
+	registry_handle_global_remove
+};
+
+static void
+bench_client_init(struct bench *bench)
+{
+	struct bench_client *client = &bench->client;
+	int fds[2];
+	int ret;
+
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+	assert(ret == 0);
+
+	client->server = wl_client_create(bench->display, fds[0]);
+	assert(client->server);
+	client->display = wl_display_connect_to_fd(fds[1]);
+	assert(client->display);
+
+	client->registry = wl_display_get_registry(client->display);
+	wl_registry_add_listener(client->registry, &registry_listener, client);
+	bench_client_roundtrip(bench);
+	assert(client->compositor);
+	assert(client->dmabuf);
+}
+
+static void
+bench_client_fini(struct bench *bench)
+{
+	struct bench_client *client = &bench->client;
+
+	zwp_linux_dmabuf_v1_destroy(client->dmabuf);
+	wl_compositor_destroy(client->compositor);
+	wl_registry_destroy(client->registry);
+	wl_client_destroy(client->server);
+	wl_display_disconnect(client->display);
+}
+
+/* A linear XRGB8888 dmabuf buffer, backed by a memfd, destroyed by
+ * bench_fini() */
+static struct wl_buffer *
+bench_create_dmabuf(struct bench *bench, int width, int height)
+{
+	struct zwp_linux_buffer_params_v1 *params;
+	struct wl_buffer *buffer;
+	int stride = width * 4;
+	int fd;
+
+	assert(bench->n_buffers < BENCH_BUFFERS);
+
+	fd = os_create_anonymous_file(stride * height);
+	assert(fd >= 0);
+
+	params = zwp_linux_dmabuf_v1_create_params(bench->client.dmabuf);
+	zwp_linux_buffer_params_v1_add(params, fd, 0, 0, stride,
+				       DRM_FORMAT_MOD_LINEAR >> 32,
+				       DRM_FORMAT_MOD_LINEAR & 0xffffffff);
+	buffer = zwp_linux_buffer_params_v1_create_immed(params, width, height,
+							 DRM_FORMAT_XRGB8888,
+							 0);
+	zwp_linux_buffer_params_v1_destroy(params);
+	bench_client_roundtrip(bench);
+	close(fd);
+
+	bench->buffers[bench->n_buffers++] = buffer;
+	return buffer;
+}
+
+/* The compositor's surface of a client one */
+static struct weston_surface *
+bench_get_surface(struct bench *bench, struct wl_surface *surface)
+{
+	struct wl_resource *resource;
+
+	resource = wl_client_get_object(bench->client.server,
+					wl_proxy_get_id((struct wl_proxy *)
+							surface));
+	assert(resource);
+
+	return wl_resource_get_user_data(resource);
+}
+
+static void
+bench_frame_handler(struct wl_listener *listener, void *data)
+{
+	struct bench *bench = container_of(listener, struct bench,
+					   frame_listener);
+
+	bench->frames++;
+}
+
+static struct weston_output *
+bench_create_output(struct weston_compositor *compositor)
+{
+	const struct weston_drm_output_api *api;
+	struct weston_output *output;
+	struct weston_head *head;
+	int ret;
+
+	api = weston_drm_output_get_api(compositor);
+	assert(api);
+
+	head = weston_compositor_iterate_heads(compositor, NULL);
+	assert(head);
+
+	output = weston_compositor_create_output_with_head(compositor, head);
+	assert(output);
+
+	ret = api->set_mode(output, WESTON_DRM_BACKEND_OUTPUT_PREFERRED, NULL);
+	assert(ret == 0);
+	api->set_gbm_format(output, NULL);
+	api->set_seat(output, "");
+	weston_output_set_scale(output, 1);
+	weston_output_set_transform(output, WL_OUTPUT_TRANSFORM_NORMAL);
+	ret = weston_output_enable(output);
+	assert(ret == 0);
+
+	return output;
+}
+
+/* Run the compositor until the output has shown a frame and is idle. */
+static void
+bench_wait_idle(struct bench *bench)
+{
+	struct wl_event_loop *loop;
+	int frames = bench->frames;
+
+	loop = wl_display_get_event_loop(bench->display);
+	while (bench->frames == frames ||
+	       bench->output->repaint_status != REPAINT_NOT_SCHEDULED)
+		wl_event_loop_dispatch(loop, -1);
+}
+
+static void
+bench_init(struct bench *bench)
+{
+	struct weston_drm_backend_config config = {{ 0, }};
+	struct fake_kms_config kms_config;
+	int ret;
+
+	memset(bench, 0, sizeof *bench);
+
+	fake_kms_config_defaults(&kms_config);
+	bench->kms = fake_kms_create(&kms_config);
+
+	ret = setenv("WESTON_MODULE_MAP", WESTON_MODULE_MAP, 0);
+	assert(ret == 0);
+	weston_log_set_handler(bench_log, bench_log);
+
+	bench->display = wl_display_create();
+	assert(bench->display);
+	bench->log_ctx = weston_log_ctx_create();
+	assert(bench->log_ctx);
+	bench->compositor = weston_compositor_create(bench->display,
+						     bench->log_ctx,
+						     NULL, NULL);
+	assert(bench->compositor);
+	bench->compositor->require_input = false;
+
+	config.base.struct_version = WESTON_DRM_BACKEND_CONFIG_VERSION;
+	config.base.struct_size = sizeof config;
+	config.use_pixman = true;
+	config.seat_id = strdup("weston-test-seat");
+	config.specific_device = strdup(FAKE_KMS_DEVICE_PATH);
+	ret = weston_compositor_load_backend(bench->compositor,
+					     WESTON_BACKEND_DRM, &config.base);
+	free(config.seat_id);
+	free(config.specific_device);
+	assert(ret == 0);
+
+	bench->output = bench_create_output(bench->compositor);
+	bench->frame_listener.notify = bench_frame_handler;
+	wl_signal_add(&bench->output->frame_signal, &bench->frame_listener);
+
+	bench_renderer_init(bench);
+	bench_client_init(bench);
+
+	weston_layer_init(&bench->layer, bench->compositor);
+	weston_layer_set_position(&bench->layer,
+				  WESTON_LAYER_POSITION_NORMAL);
+}
+
+/* Have the debug messages of the DRM-backend written to a file, to see
+ * what the plane search did. */
+static void
+bench_log_drm(struct bench *bench)
+{
+	bench->drm_log = tmpfile();
+	assert(bench->drm_log);
+	bench->drm_log_subscriber =
+		weston_log_subscriber_create_log(bench->drm_log);
+	assert(bench->drm_log_subscriber);
+	weston_log_subscribe(bench->log_ctx, bench->drm_log_subscriber,
+			     "drm-backend");
+}
+
+/* Add a view showing buffer at x, y, above the ones added before. The
+ * views get on screen with bench_show(). */
+static struct bench_view *
+bench_add_view(struct bench *bench, struct wl_buffer *buffer,
+	       int width, int height, int x, int y)
+{
+	struct bench_view *view;
+
+	assert(bench->n_views < BENCH_VIEWS);
+	view = &bench->views[bench->n_views++];
+	view->surface = wl_compositor_create_surface(bench->client.compositor);
+	wl_surface_attach(view->surface, buffer, 0, 0);
+	wl_surface_damage(view->surface, 0, 0, width, height);
+	wl_surface_commit(view->surface);
+	view->x = x;
+	view->y = y;
+	view->width = width;
+	view->height = height;
+
+	return view;
+}
+
+static void
+bench_show(struct bench *bench)
+{
+	struct weston_surface *surface;
+	struct bench_view *view;
+	int i;
+
+	bench_client_roundtrip(bench);
+
+	for (i = 0; i < bench->n_views; i++) {
+		view = &bench->views[i];
+		surface = bench_get_surface(bench, view->surface);
+		assert(surface->width == view->width &&
+		       surface->height == view->height);
+		view->view = weston_view_create(surface);
+		assert(view->view);
+		weston_view_set_position(view->view, view->x, view->y);
+		weston_layer_entry_insert(&bench->layer.view_list,
+					  &view->view->layer_link);
+	}
+
+	/* The plane assignments are tested against the KMS state, which
+	 * only exists after the first commit, and mixed mode needs a
+	 * renderer buffer. */
+	weston_compositor_wake(bench->compositor);
+	bench_wait_idle(bench);
+}
+
+static void
+bench_fini(struct bench *bench)
+{
+	int i;
+
+	wl_list_remove(&bench->frame_listener.link);
+
+	for (i = 0; i < bench->n_views; i++) {
+		if (bench->views[i].view)
+			weston_view_destroy(bench->views[i].view);
+		wl_surface_destroy(bench->views[i].surface);
+	}
+	for (i = 0; i < bench->n_buffers; i++)
+		wl_buffer_destroy(bench->buffers[i]);
+	weston_layer_fini(&bench->layer);
+	bench_client_fini(bench);
+
+	if (bench->drm_log_subscriber) {
+		weston_log_subscriber_destroy(bench->drm_log_subscriber);
+		fclose(bench->drm_log);
+	}
+
+	weston_compositor_destroy(bench->compositor);
+	wl_display_destroy(bench->display);
+	weston_log_ctx_destroy(bench->log_ctx);
+	fake_kms_destroy(bench->kms);
+	weston_drm_format_array_fini(&bench_formats);
+}
+
+/* Do what a repaint does up to the plane assignment, which is where the
+ * views are walked and the atomic tests are done. Nothing gets committed,
+ * so the KMS state stays the one of the first frame. */
+static void
+assign_planes(struct bench *bench)
+{
+	struct weston_compositor *compositor = bench->compositor;
+	struct weston_output *output = bench->output;
+	void *repaint_data;
+
+	repaint_data = compositor->backend->repaint_begin(compositor);
+	weston_compositor_build_view_list(compositor, output);
+	output->assign_planes(output, repaint_data);
+	compositor->backend->repaint_cancel(compositor, repaint_data);
+}
+
+static void
+bench_assign_planes(struct bench *bench, struct weston_view *moving,
+		    struct bench_result *result)
+{
+	struct fake_kms_counters before, after;
+	struct timespec begin, end;
+	int i;
+
+	assert(bench->compositor->backend->repaint_begin);
+	assert(bench->compositor->backend->repaint_cancel);
+	assert(bench->output->assign_planes);
+
+	/* The scene on screen got its planes before there was a KMS state
+	 * to test against, so it is not cached yet. */
+	assign_planes(bench);
+
+	fake_kms_get_counters(bench->kms, &before);
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		if (moving)
+			weston_view_set_position(moving, i % BENCH_POSITIONS,
+						 0);
+		assign_planes(bench);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fake_kms_get_counters(bench->kms, &after);
+
+	result->nsec = timespec_sub_to_nsec(&end, &begin) / BENCH_ITERATIONS;
+	result->tests = after.tests - before.tests;
+	result->tests_failed = after.tests_failed - before.tests_failed;
+}
+
+static bool
+bench_view_on_plane(struct bench *bench, struct bench_view *view)
+{
+	return view->view->plane != &bench->compositor->primary_plane;
+}
+
+static int
+bench_views_on_planes(struct bench *bench)
+{
+	int i, n = 0;
+
+	for (i = 0; i < bench->n_views; i++)
+		n += bench_view_on_plane(bench, &bench->views[i]);
+
+	return n;
+}
+
+static void
+report(const char *what, const struct bench_result *result)
+{
+	testlog("%d views, %s: %lld ns, %.2f atomic tests "
+		"(%.2f failed) per frame\n",
+		BENCH_VIEWS, what, (long long)result->nsec,
+		(double)result->tests / BENCH_ITERATIONS,
+		(double)result->tests_failed / BENCH_ITERATIONS);
+}
+
+/* A client's many icons, all showing the same buffer */
+static void
+bench_init_icons(struct bench *bench)
+{
+	struct wl_buffer *buffer;
+	int i;
+
+	bench_init(bench);
+
+	buffer = bench_create_dmabuf(bench, 16, 16);
+	for (i = 0; i < BENCH_VIEWS; i++)
+		bench_add_view(bench, buffer, 16, 16,
+			       (i * 7) % 1200, (i * 13) % 700);
+	bench_show(bench);
+}
+
+TEST(drm_plane_assignment_cost)
+{
+	struct bench bench;
+	struct bench_result unchanged, changed;
+
+	bench_init_icons(&bench);
+
+	/* The same scene as on screen: assigned without testing. */
+	bench_assign_planes(&bench, NULL, &unchanged);
+	assert(unchanged.tests == 0);
+
+	/* Overlays went to some of the views, the others were left to the
+	 * renderer. */
+	assert(bench_views_on_planes(&bench) > 0);
+	assert(bench_views_on_planes(&bench) < BENCH_VIEWS);
+
+	/* A view moves every frame: assigned from scratch. */
+	bench_assign_planes(&bench, bench.views[BENCH_VIEWS / 2].view,
+			    &changed);
+	assert(changed.tests >= BENCH_ITERATIONS);
+	assert(changed.tests_failed == 0);
+
+	report("unchanged scene", &unchanged);
+	report("changed scene", &changed);
+
+	bench_fini(&bench);
+}
+
+static int
+reject_plane(const struct fake_kms_plane_state *state, void *data)
+{
+	return EINVAL;
+}
+
+TEST(drm_plane_assignment_cost_rejected)
+{
+	struct fake_kms_rules rules = { 0 };
+	struct bench bench;
+	struct bench_result unchanged, changed;
+
+	bench_init_icons(&bench);
+
+	/* Every test failing leaves renderer-only composition, after the
+	 * most expensive search. */
+	rules.check_plane = reject_plane;
+	fake_kms_set_rules(bench.kms, &rules);
+
+	bench_assign_planes(&bench, bench.views[BENCH_VIEWS / 2].view,
+			    &changed);
+	assert(changed.tests_failed >= BENCH_ITERATIONS);
+
+	/* The failed search is not repeated every frame for the same
+	 * scene, but it is once in a while: the failure may be transient. */
+	bench_assign_planes(&bench, NULL, &unchanged);
+	assert(unchanged.tests_failed > 0);
+	assert(unchanged.tests_failed < changed.tests_failed / 4);
+
+	report("changed scene, tests failing", &changed);
+	report("unchanged scene, tests failing", &unchanged);
+
+	memset(&rules, 0, sizeof rules);
+	fake_kms_set_rules(bench.kms, &rules);
+
+	bench_fini(&bench);
+}
+
+/* Assign the planes as assign_planes() does, and return the debug
+ * messages of the DRM-backend meanwhile. */
+static char *
+assign_planes_logged(struct bench *bench)
+{
+	long begin, end;
+	char *log;
+	ssize_t len;
+
+	fflush(bench->drm_log);
+	begin = ftell(bench->drm_log);
+	assign_planes(bench);
+	fflush(bench->drm_log);
+	end = ftell(bench->drm_log);
+	assert(begin >= 0 && end >= begin);
+
+	log = xzalloc(end - begin + 1);
+	len = pread(fileno(bench->drm_log), log, end - begin, begin);
+	assert(len == end - begin);
+
+	return log;
+}
+
+/* How many atomic tests the search found its state in, or -1 */
+static int
+search_tests(const char *log)
+{
+	const char *found;
+	unsigned int n;
+
+	found = strstr(log, "[search] found state saving");
+	if (!found ||
+	    sscanf(found, "[search] found state saving %*u B/s in %u atomic "
+		   "tests", &n) != 1)
+		return -1;
+
+	return n;
+}
+
+/*
+ * A fullscreen-ish video at the bottom, and small views on top, more than
+ * there are overlays for. The small views are to the right of the video:
+ * one left to the renderer above it would keep it off the overlays
+ * whatever the search chose.
+ */
+static struct bench_view *
+search_init(struct bench *bench, int n_small)
+{
+	struct bench_view *video;
+	struct wl_buffer *buffer;
+	int i;
+
+	bench_init(bench);
+	bench_log_drm(bench);
+
+	buffer = bench_create_dmabuf(bench, 960, 540);
+	video = bench_add_view(bench, buffer, 960, 540, 0, 0);
+
+	buffer = bench_create_dmabuf(bench, 16, 16);
+	for (i = 0; i < n_small; i++)
+		bench_add_view(bench, buffer, 16, 16,
+			       1000 + (i % 10) * 20, (i / 10) * 20);
+	bench_show(bench);
+
+	return video;
+}
+
+TEST(drm_plane_search_prefers_video)
+{
+	struct bench bench;
+	struct bench_view *video;
+	char *log;
+	int n;
+
+	/* Walking the views from the top, the small ones would take all
+	 * the overlays. */
+	video = search_init(&bench, 4);
+
+	log = assign_planes_logged(&bench);
+	n = search_tests(log);
+	testlog("search found a state in %d atomic tests\n", n);
+	assert(n > 0 && n <= SEARCH_MAX_TESTS);
+	assert(bench_view_on_plane(&bench, video));
+	assert(bench_views_on_planes(&bench) == 3);
+	free(log);
+
+	bench_fini(&bench);
+}
+
+static int
+reject_small_plane(const struct fake_kms_plane_state *state, void *data)
+{
+	return state->crtc_w == 16 ? EINVAL : 0;
+}
+
+TEST(drm_plane_search_budget)
+{
+	struct fake_kms_rules rules = { 0 };
+	struct bench bench;
+	struct bench_view *video;
+	char *log;
+	int n;
+
+	video = search_init(&bench, 40);
+
+	/* Every small view the search tries fails, so that it would try
+	 * them all in turn without a budget. */
+	rules.check_plane = reject_small_plane;
+	fake_kms_set_rules(bench.kms, &rules);
+
+	log = assign_planes_logged(&bench);
+	n = search_tests(log);
+	testlog("search found a state in %d atomic tests\n", n);
+	assert(strstr(log, "[search] atomic test budget spent"));
+	assert(n >= SEARCH_MAX_TESTS &&
+	       n < SEARCH_MAX_TESTS + SEARCH_PROPOSAL_MAX_TESTS);
+	assert(bench_view_on_plane(&bench, video));
+	free(log);
+
+	memset(&rules, 0, sizeof rules);
+	fake_kms_set_rules(bench.kms, &rules);
+
+	bench_fini(&bench);
+}
+
+static int
+reject_large_plane(const struct fake_kms_plane_state *state, void *data)
+{
+	if (state->type != DRM_PLANE_TYPE_OVERLAY)
+		return 0;
+
+	return state->crtc_w > 16 ? EINVAL : 0;
+}
+
+static int
+reject_primary_alone(int crtc, int n_planes, void *data)
+{
+	return n_planes < 2 ? EINVAL : 0;
+}
+
+TEST(drm_plane_search_falls_back)
+{
+	struct fake_kms_rules rules = { 0 };
+	struct bench bench;
+	struct bench_view *icons[2];
+	struct wl_buffer *buffer;
+	char *log;
+	int i;
+
+	/* The search goes for the video and the two 32x32 views, the
+	 * greedy walk for the 16x16 ones on top. */
+	bench_init(&bench);
+	bench_log_drm(&bench);
+
+	buffer = bench_create_dmabuf(&bench, 960, 540);
+	bench_add_view(&bench, buffer, 960, 540, 0, 0);
+	buffer = bench_create_dmabuf(&bench, 32, 32);
+	bench_add_view(&bench, buffer, 32, 32, 1000, 0);
+	bench_add_view(&bench, buffer, 32, 32, 1000, 40);
+	buffer = bench_create_dmabuf(&bench, 16, 16);
+	icons[0] = bench_add_view(&bench, buffer, 16, 16, 1100, 0);
+	icons[1] = bench_add_view(&bench, buffer, 16, 16, 1100, 40);
+	bench_show(&bench);
+
+	/* None of the views the search allows fits a plane, and a state
+	 * without any overlay fails, so every proposal fails. */
+	rules.check_plane = reject_large_plane;
+	rules.check_crtc = reject_primary_alone;
+	fake_kms_set_rules(bench.kms, &rules);
+
+	log = assign_planes_logged(&bench);
+	assert(strstr(log, "[search] no state found, falling back to the "
+			   "greedy assignment"));
+	assert(strstr(log, "Using mixed state composition"));
+	for (i = 0; i < 2; i++)
+		assert(bench_view_on_plane(&bench, icons[i]));
+	assert(bench_views_on_planes(&bench) == 2);
+	free(log);
+
+	memset(&rules, 0, sizeof rules);
+	fake_kms_set_rules(bench.kms, &rules);
+
+	bench_fini(&bench);
+}
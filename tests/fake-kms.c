@@ -0,0 +1,2209 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+/* The functions standing in for those of libc below must not get renamed
+ * or wrapped by the system headers. */
+#undef _FILE_OFFSET_BITS
+#undef _FORTIFY_SOURCE
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <wayland-util.h>
+
+#include "shared/helpers.h"
+#include "shared/os-compatibility.h"
+#include "shared/timespec-util.h"
+#include "shared/weston-drm-fourcc.h"
+#include "shared/xalloc.h"
+#include "fake-kms.h"
+
+#define CURSOR_SIZE 64
+
+#define ALIGN(v, a) (((v) + (a) - 1) & ~((uint64_t) (a) - 1))
+
+/* Properties by what they are for; the zpos properties are created per
+ * plane, as the kernel does for immutable ones. */
+enum prop_kind {
+	PROP_PLANE_TYPE = 0,
+	PROP_PLANE_SRC_X,
+	PROP_PLANE_SRC_Y,
+	PROP_PLANE_SRC_W,
+	PROP_PLANE_SRC_H,
+	PROP_PLANE_CRTC_X,
+	PROP_PLANE_CRTC_Y,
+	PROP_PLANE_CRTC_W,
+	PROP_PLANE_CRTC_H,
+	PROP_PLANE_FB_ID,
+	PROP_PLANE_CRTC_ID,
+	PROP_PLANE_IN_FORMATS,
+	PROP_PLANE_IN_FENCE_FD,
+	PROP_PLANE_FB_DAMAGE_CLIPS,
+	PROP_PLANE_ZPOS,
+	PROP_CONNECTOR_EDID,
+	PROP_CONNECTOR_DPMS,
+	PROP_CONNECTOR_CRTC_ID,
+	PROP_CRTC_MODE_ID,
+	PROP_CRTC_ACTIVE,
+	PROP__COUNT
+};
+
+enum prop_type {
+	PROP_RANGE,
+	PROP_SIGNED_RANGE,
+	PROP_ENUM,
+	PROP_OBJECT,
+	PROP_BLOB,
+};
+
+static const char * const plane_type_names[] = {
+	[DRM_PLANE_TYPE_OVERLAY] = "Overlay",
+	[DRM_PLANE_TYPE_PRIMARY] = "Primary",
+	[DRM_PLANE_TYPE_CURSOR] = "Cursor",
+	NULL
+};
+
+static const char * const dpms_names[] = {
+	[DRM_MODE_DPMS_ON] = "On",
+	[DRM_MODE_DPMS_STANDBY] = "Standby",
+	[DRM_MODE_DPMS_SUSPEND] = "Suspend",
+	[DRM_MODE_DPMS_OFF] = "Off",
+	NULL
+};
+
+struct prop {
+	uint32_t id;
+	const char *name;
+	enum prop_type type;
+	bool immutable;
+	bool atomic;
+	int64_t min, max;
+	uint32_t object_type;
+	const char * const *enums;
+};
+
+static const struct prop prop_templates[] = {
+	[PROP_PLANE_TYPE] = { 0, "type", PROP_ENUM, true, false,
+			      .enums = plane_type_names },
+	[PROP_PLANE_SRC_X] = { 0, "SRC_X", PROP_RANGE, false, true,
+			       0, UINT32_MAX },
+	[PROP_PLANE_SRC_Y] = { 0, "SRC_Y", PROP_RANGE, false, true,
+			       0, UINT32_MAX },
+	[PROP_PLANE_SRC_W] = { 0, "SRC_W", PROP_RANGE, false, true,
+			       0, UINT32_MAX },
+	[PROP_PLANE_SRC_H] = { 0, "SRC_H", PROP_RANGE, false, true,
+			       0, UINT32_MAX },
+	[PROP_PLANE_CRTC_X] = { 0, "CRTC_X", PROP_SIGNED_RANGE, false, true,
+				INT32_MIN, INT32_MAX },
+	[PROP_PLANE_CRTC_Y] = { 0, "CRTC_Y", PROP_SIGNED_RANGE, false, true,
+				INT32_MIN, INT32_MAX },
+	[PROP_PLANE_CRTC_W] = { 0, "CRTC_W", PROP_RANGE, false, true,
+				0, INT32_MAX },
+	[PROP_PLANE_CRTC_H] = { 0, "CRTC_H", PROP_RANGE, false, true,
+				0, INT32_MAX },
+	[PROP_PLANE_FB_ID] = { 0, "FB_ID", PROP_OBJECT, false, true,
+			       .object_type = DRM_MODE_OBJECT_FB },
+	[PROP_PLANE_CRTC_ID] = { 0, "CRTC_ID", PROP_OBJECT, false, true,
+				 .object_type = DRM_MODE_OBJECT_CRTC },
+	[PROP_PLANE_IN_FORMATS] = { 0, "IN_FORMATS", PROP_BLOB, true, false },
+	[PROP_PLANE_IN_FENCE_FD] = { 0, "IN_FENCE_FD", PROP_SIGNED_RANGE,
+				     false, true, -1, INT32_MAX },
+	[PROP_PLANE_FB_DAMAGE_CLIPS] = { 0, "FB_DAMAGE_CLIPS", PROP_BLOB,
+					 false, true },
+	[PROP_PLANE_ZPOS] = { 0, "zpos", PROP_RANGE, true, false },
+	[PROP_CONNECTOR_EDID] = { 0, "EDID", PROP_BLOB, true, false },
+	[PROP_CONNECTOR_DPMS] = { 0, "DPMS", PROP_ENUM, false, false,
+				  .enums = dpms_names },
+	[PROP_CONNECTOR_CRTC_ID] = { 0, "CRTC_ID", PROP_OBJECT, false, true,
+				     .object_type = DRM_MODE_OBJECT_CRTC },
+	[PROP_CRTC_MODE_ID] = { 0, "MODE_ID", PROP_BLOB, false, true },
+	[PROP_CRTC_ACTIVE] = { 0, "ACTIVE", PROP_RANGE, false, true, 0, 1 },
+};
+
+struct object {
+	uint32_t id;
+	uint32_t type;
+	/* Index among the objects of its type */
+	int index;
+	/* Index in fake_kms::objects */
+	int slot;
+	struct prop *props[PROP__COUNT];
+	uint64_t values[PROP__COUNT];
+};
+
+struct blob {
+	uint32_t id;
+	/* Created by the device rather than by the client */
+	bool internal;
+	/* Destroyed by the client, but maybe still in use */
+	bool removed;
+	void *data;
+	uint32_t length;
+	struct wl_list link;
+};
+
+struct fb {
+	uint32_t id;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;
+	uint64_t modifier;
+	struct wl_list link;
+};
+
+struct bo {
+	uint32_t handle;
+	int fd;
+	uint64_t size;
+	uint64_t offset;
+	struct wl_list link;
+};
+
+struct flip {
+	bool pending;
+	uint64_t user_data;
+	int64_t vblank;
+};
+
+#define MAX_OBJECTS (3 * FAKE_KMS_MAX_CRTCS + FAKE_KMS_MAX_PLANES)
+
+struct fake_kms {
+	struct fake_kms_config config;
+
+	/* Everything below is accessed under the mutex, from the thread
+	 * calling the ioctls and from the vblank thread. */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t vblank_thread;
+	bool quit;
+
+	/* The client's end of the socket pair, -1 while closed */
+	int fd;
+	/* Our end, where the events are written */
+	int event_fd;
+	bool atomic;
+
+	struct prop props[PROP__COUNT + FAKE_KMS_MAX_PLANES];
+	int n_props;
+	struct object crtcs[FAKE_KMS_MAX_CRTCS];
+	struct object encoders[FAKE_KMS_MAX_CRTCS];
+	struct object connectors[FAKE_KMS_MAX_CRTCS];
+	struct object planes[FAKE_KMS_MAX_PLANES];
+	struct object *objects[MAX_OBJECTS];
+	int n_objects;
+	uint32_t next_id;
+	uint32_t next_handle;
+
+	struct wl_list blob_list;
+	struct wl_list fb_list;
+	struct wl_list bo_list;
+
+	struct drm_mode_modeinfo mode;
+	struct timespec epoch;
+	int64_t period_nsec;
+	struct flip flips[FAKE_KMS_MAX_CRTCS];
+
+	struct fake_kms_counters counters;
+
+	/* Scratch state of an atomic commit */
+	uint64_t pending[MAX_OBJECTS][PROP__COUNT];
+};
+
+/* The one device of the test program */
+static struct fake_kms *device;
+
+static inline void *
+u64_to_ptr(uint64_t p)
+{
+	return (void *)(uintptr_t) p;
+}
+
+static struct blob *
+blob_create(struct fake_kms *kms, const void *data, uint32_t length,
+	    bool internal)
+{
+	struct blob *blob = xzalloc(sizeof *blob);
+
+	blob->id = kms->next_id++;
+	blob->internal = internal;
+	blob->data = xzalloc(length);
+	memcpy(blob->data, data, length);
+	blob->length = length;
+	wl_list_insert(kms->blob_list.prev, &blob->link);
+
+	return blob;
+}
+
+static void
+blob_destroy(struct blob *blob)
+{
+	wl_list_remove(&blob->link);
+	free(blob->data);
+	free(blob);
+}
+
+/* Blobs the client has destroyed are only found by the current state. */
+static struct blob *
+find_blob(struct fake_kms *kms, uint32_t id, bool include_removed)
+{
+	struct blob *blob;
+
+	wl_list_for_each(blob, &kms->blob_list, link) {
+		if (blob->id == id && (include_removed || !blob->removed))
+			return blob;
+	}
+
+	return NULL;
+}
+
+static bool
+blob_in_use(struct fake_kms *kms, struct blob *blob)
+{
+	int i, k;
+
+	for (i = 0; i < kms->n_objects; i++) {
+		for (k = 0; k < PROP__COUNT; k++) {
+			struct prop *prop = kms->objects[i]->props[k];
+
+			if (prop && prop->type == PROP_BLOB &&
+			    kms->objects[i]->values[k] == blob->id)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/* Free the destroyed blobs the current state no longer uses. */
+static void
+sweep_blobs(struct fake_kms *kms)
+{
+	struct blob *blob, *tmp;
+
+	wl_list_for_each_safe(blob, tmp, &kms->blob_list, link) {
+		if (blob->removed && !blob_in_use(kms, blob))
+			blob_destroy(blob);
+	}
+}
+
+static struct fb *
+find_fb(struct fake_kms *kms, uint32_t id)
+{
+	struct fb *fb;
+
+	wl_list_for_each(fb, &kms->fb_list, link) {
+		if (fb->id == id)
+			return fb;
+	}
+
+	return NULL;
+}
+
+static struct bo *
+find_bo(struct fake_kms *kms, uint32_t handle)
+{
+	struct bo *bo;
+
+	wl_list_for_each(bo, &kms->bo_list, link) {
+		if (bo->handle == handle)
+			return bo;
+	}
+
+	return NULL;
+}
+
+static void
+bo_destroy(struct bo *bo)
+{
+	wl_list_remove(&bo->link);
+	close(bo->fd);
+	free(bo);
+}
+
+static struct object *
+find_object(struct fake_kms *kms, uint32_t id, uint32_t type)
+{
+	int i;
+
+	for (i = 0; i < kms->n_objects; i++) {
+		struct object *obj = kms->objects[i];
+
+		if (obj->id == id &&
+		    (type == DRM_MODE_OBJECT_ANY || obj->type == type))
+			return obj;
+	}
+
+	return NULL;
+}
+
+static int
+find_prop_kind(struct object *obj, uint32_t prop_id)
+{
+	int k;
+
+	for (k = 0; k < PROP__COUNT; k++) {
+		if (obj->props[k] && obj->props[k]->id == prop_id)
+			return k;
+	}
+
+	return -1;
+}
+
+static struct prop *
+find_prop(struct fake_kms *kms, uint32_t prop_id)
+{
+	int i;
+
+	for (i = 0; i < kms->n_props; i++) {
+		if (kms->props[i].id == prop_id)
+			return &kms->props[i];
+	}
+
+	return NULL;
+}
+
+static void
+object_add(struct fake_kms *kms, struct object *obj, uint32_t type,
+	   int index)
+{
+	assert(kms->n_objects < MAX_OBJECTS);
+
+	obj->id = kms->next_id++;
+	obj->type = type;
+	obj->index = index;
+	obj->slot = kms->n_objects;
+	kms->objects[kms->n_objects++] = obj;
+}
+
+static void
+object_add_prop(struct fake_kms *kms, struct object *obj,
+		enum prop_kind kind)
+{
+	obj->props[kind] = &kms->props[kind];
+}
+
+static int
+crtc_index(struct fake_kms *kms, uint64_t crtc_id)
+{
+	struct object *crtc;
+
+	if (crtc_id == 0)
+		return -1;
+
+	crtc = find_object(kms, crtc_id, DRM_MODE_OBJECT_CRTC);
+	assert(crtc);
+
+	return crtc->index;
+}
+
+/* Put all objects into their initial state, everything off. */
+static void
+reset_state(struct fake_kms *kms)
+{
+	int i;
+
+	for (i = 0; i < kms->config.n_crtcs; i++) {
+		kms->crtcs[i].values[PROP_CRTC_MODE_ID] = 0;
+		kms->crtcs[i].values[PROP_CRTC_ACTIVE] = 0;
+		kms->connectors[i].values[PROP_CONNECTOR_CRTC_ID] = 0;
+		kms->connectors[i].values[PROP_CONNECTOR_DPMS] =
+			DRM_MODE_DPMS_OFF;
+		kms->flips[i].pending = false;
+	}
+
+	for (i = 0; i < kms->config.n_planes; i++) {
+		struct object *plane = &kms->planes[i];
+		int k;
+
+		for (k = PROP_PLANE_SRC_X; k <= PROP_PLANE_CRTC_ID; k++)
+			plane->values[k] = 0;
+		plane->values[PROP_PLANE_IN_FENCE_FD] = (uint64_t) -1;
+		plane->values[PROP_PLANE_FB_DAMAGE_CLIPS] = 0;
+	}
+}
+
+static void
+create_in_formats(struct fake_kms *kms, struct object *plane,
+		  const struct fake_kms_plane_config *config)
+{
+	struct drm_format_modifier_blob *header;
+	struct drm_format_modifier *mods;
+	uint32_t *formats;
+	uint32_t length;
+	struct blob *blob;
+	int i;
+
+	length = sizeof *header + config->n_formats * sizeof *formats;
+	length = ALIGN(length, 8);
+	length += config->n_modifiers * sizeof *mods;
+
+	header = xzalloc(length);
+	header->version = FORMAT_BLOB_CURRENT;
+	header->count_formats = config->n_formats;
+	header->formats_offset = sizeof *header;
+	header->count_modifiers = config->n_modifiers;
+	header->modifiers_offset =
+		ALIGN(sizeof *header + config->n_formats * sizeof *formats, 8);
+
+	formats = (uint32_t *) ((char *) header + header->formats_offset);
+	memcpy(formats, config->formats, config->n_formats * sizeof *formats);
+
+	/* Every modifier goes with every format. */
+	mods = (struct drm_format_modifier *)
+		((char *) header + header->modifiers_offset);
+	for (i = 0; i < config->n_modifiers; i++) {
+		mods[i].formats = (1ull << config->n_formats) - 1;
+		mods[i].offset = 0;
+		mods[i].modifier = config->modifiers[i];
+	}
+
+	blob = blob_create(kms, header, length, true);
+	free(header);
+
+	object_add_prop(kms, plane, PROP_PLANE_IN_FORMATS);
+	plane->values[PROP_PLANE_IN_FORMATS] = blob->id;
+}
+
+static void
+init_mode(struct fake_kms *kms)
+{
+	struct drm_mode_modeinfo *mode = &kms->mode;
+	const struct fake_kms_config *config = &kms->config;
+
+	/* Blanking that gives the refresh rate with a whole kHz clock */
+	mode->hdisplay = config->width;
+	mode->hsync_start = config->width + 48;
+	mode->hsync_end = config->width + 80;
+	mode->htotal = config->width + 160;
+	mode->vdisplay = config->height;
+	mode->vsync_start = config->height + 3;
+	mode->vsync_end = config->height + 8;
+	mode->vtotal = config->height + 30;
+	mode->clock = (int64_t) mode->htotal * mode->vtotal *
+		      config->refresh / 1000000;
+	mode->vrefresh = config->refresh / 1000;
+	mode->flags = DRM_MODE_FLAG_PHSYNC | DRM_MODE_FLAG_NVSYNC;
+	mode->type = DRM_MODE_TYPE_DRIVER | DRM_MODE_TYPE_PREFERRED;
+	snprintf(mode->name, sizeof mode->name, "%dx%d",
+		 config->width, config->height);
+
+	/* Page flips go by the clock the mode really has. */
+	kms->period_nsec = (int64_t) mode->htotal * mode->vtotal *
+			   1000000 / mode->clock;
+}
+
+static int64_t
+current_vblank(struct fake_kms *kms)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return timespec_sub_to_nsec(&now, &kms->epoch) / kms->period_nsec;
+}
+
+static void
+vblank_time(struct fake_kms *kms, int64_t vblank, struct timespec *ts)
+{
+	timespec_add_nsec(ts, &kms->epoch, vblank * kms->period_nsec);
+}
+
+/* Called with the mutex locked. */
+static void
+send_flip_event(struct fake_kms *kms, int crtc)
+{
+	struct flip *flip = &kms->flips[crtc];
+	struct drm_event_vblank event;
+	struct timespec ts;
+	ssize_t len;
+
+	vblank_time(kms, flip->vblank, &ts);
+
+	memset(&event, 0, sizeof event);
+	event.base.type = DRM_EVENT_FLIP_COMPLETE;
+	event.base.length = sizeof event;
+	event.user_data = flip->user_data;
+	event.tv_sec = ts.tv_sec;
+	event.tv_usec = ts.tv_nsec / 1000;
+	event.sequence = flip->vblank;
+	event.crtc_id = kms->crtcs[crtc].id;
+
+	flip->pending = false;
+	kms->counters.flips++;
+
+	if (kms->event_fd < 0)
+		return;
+
+	do {
+		len = write(kms->event_fd, &event, sizeof event);
+	} while (len < 0 && errno == EINTR);
+	assert(len == sizeof event);
+}
+
+/* Completes the page flips at their vblanks. */
+static void *
+vblank_thread(void *data)
+{
+	struct fake_kms *kms = data;
+	struct timespec due, now;
+	int64_t next;
+	int i;
+
+	pthread_mutex_lock(&kms->mutex);
+	while (!kms->quit) {
+		next = INT64_MAX;
+		for (i = 0; i < kms->config.n_crtcs; i++) {
+			if (kms->flips[i].pending &&
+			    kms->flips[i].vblank < next)
+				next = kms->flips[i].vblank;
+		}
+
+		if (next == INT64_MAX) {
+			pthread_cond_wait(&kms->cond, &kms->mutex);
+			continue;
+		}
+
+		vblank_time(kms, next, &due);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (timespec_sub_to_nsec(&due, &now) > 0) {
+			pthread_cond_timedwait(&kms->cond, &kms->mutex, &due);
+			continue;
+		}
+
+		for (i = 0; i < kms->config.n_crtcs; i++) {
+			if (kms->flips[i].pending &&
+			    kms->flips[i].vblank <= next)
+				send_flip_event(kms, i);
+		}
+
+		/* Wake up blocking commits waiting for the flips */
+		pthread_cond_broadcast(&kms->cond);
+	}
+	pthread_mutex_unlock(&kms->mutex);
+
+	return NULL;
+}
+
+static int
+copy_ids(uint64_t ptr, uint32_t count, struct object *objs, int n)
+{
+	uint32_t *ids = u64_to_ptr(ptr);
+	int i;
+
+	if (count < (uint32_t) n || !ids)
+		return 0;
+
+	for (i = 0; i < n; i++)
+		ids[i] = objs[i].id;
+
+	return 0;
+}
+
+static int
+get_resources(struct fake_kms *kms, struct drm_mode_card_res *res)
+{
+	int n = kms->config.n_crtcs;
+
+	copy_ids(res->crtc_id_ptr, res->count_crtcs, kms->crtcs, n);
+	copy_ids(res->encoder_id_ptr, res->count_encoders, kms->encoders, n);
+	copy_ids(res->connector_id_ptr, res->count_connectors,
+		 kms->connectors, n);
+
+	/* The framebuffers of the client are not listed. */
+	res->count_fbs = 0;
+	res->count_crtcs = n;
+	res->count_encoders = n;
+	res->count_connectors = n;
+	res->min_width = 1;
+	res->max_width = 8192;
+	res->min_height = 1;
+	res->max_height = 8192;
+
+	return 0;
+}
+
+static struct object *
+crtc_primary_plane(struct fake_kms *kms, struct object *crtc)
+{
+	int i;
+
+	for (i = 0; i < kms->config.n_planes; i++) {
+		struct object *plane = &kms->planes[i];
+
+		if (plane->values[PROP_PLANE_TYPE] == DRM_PLANE_TYPE_PRIMARY &&
+		    plane->values[PROP_PLANE_CRTC_ID] == crtc->id)
+			return plane;
+	}
+
+	return NULL;
+}
+
+static int
+get_crtc(struct fake_kms *kms, struct drm_mode_crtc *arg)
+{
+	struct object *crtc, *plane;
+	struct blob *blob;
+
+	crtc = find_object(kms, arg->crtc_id, DRM_MODE_OBJECT_CRTC);
+	if (!crtc)
+		return -ENOENT;
+
+	plane = crtc_primary_plane(kms, crtc);
+	arg->fb_id = plane ? plane->values[PROP_PLANE_FB_ID] : 0;
+	arg->x = plane ? plane->values[PROP_PLANE_SRC_X] >> 16 : 0;
+	arg->y = plane ? plane->values[PROP_PLANE_SRC_Y] >> 16 : 0;
+	arg->gamma_size = 0;
+
+	blob = find_blob(kms, crtc->values[PROP_CRTC_MODE_ID], true);
+	if (blob) {
+		memcpy(&arg->mode, blob->data, sizeof arg->mode);
+		arg->mode_valid = 1;
+	} else {
+		memset(&arg->mode, 0, sizeof arg->mode);
+		arg->mode_valid = 0;
+	}
+
+	return 0;
+}
+
+static int
+get_encoder(struct fake_kms *kms, struct drm_mode_get_encoder *arg)
+{
+	struct object *encoder;
+
+	encoder = find_object(kms, arg->encoder_id, DRM_MODE_OBJECT_ENCODER);
+	if (!encoder)
+		return -ENOENT;
+
+	arg->encoder_type = DRM_MODE_ENCODER_VIRTUAL;
+	arg->crtc_id =
+		kms->connectors[encoder->index].values[PROP_CONNECTOR_CRTC_ID];
+	arg->possible_crtcs = 1 << encoder->index;
+	arg->possible_clones = 0;
+
+	return 0;
+}
+
+static void
+copy_props(struct object *obj, uint64_t props_ptr, uint64_t values_ptr,
+	   uint32_t *count)
+{
+	uint32_t *props = u64_to_ptr(props_ptr);
+	uint64_t *values = u64_to_ptr(values_ptr);
+	uint32_t n = 0;
+	int k;
+
+	for (k = 0; k < PROP__COUNT; k++) {
+		if (obj->props[k])
+			n++;
+	}
+
+	if (*count >= n && props && values) {
+		n = 0;
+		for (k = 0; k < PROP__COUNT; k++) {
+			if (!obj->props[k])
+				continue;
+			props[n] = obj->props[k]->id;
+			values[n] = obj->values[k];
+			n++;
+		}
+	}
+
+	*count = n;
+}
+
+static int
+get_connector(struct fake_kms *kms, struct drm_mode_get_connector *arg)
+{
+	struct object *connector;
+	struct drm_mode_modeinfo *modes = u64_to_ptr(arg->modes_ptr);
+	uint32_t *encoders = u64_to_ptr(arg->encoders_ptr);
+
+	connector = find_object(kms, arg->connector_id,
+				DRM_MODE_OBJECT_CONNECTOR);
+	if (!connector)
+		return -ENOENT;
+
+	if (arg->count_modes >= 1 && modes)
+		modes[0] = kms->mode;
+	arg->count_modes = 1;
+
+	if (arg->count_encoders >= 1 && encoders)
+		encoders[0] = kms->encoders[connector->index].id;
+	arg->count_encoders = 1;
+
+	copy_props(connector, arg->props_ptr, arg->prop_values_ptr,
+		   &arg->count_props);
+
+	if (connector->values[PROP_CONNECTOR_CRTC_ID])
+		arg->encoder_id = kms->encoders[connector->index].id;
+	else
+		arg->encoder_id = 0;
+	arg->connector_type = DRM_MODE_CONNECTOR_VIRTUAL;
+	arg->connector_type_id = connector->index + 1;
+	arg->connection = DRM_MODE_CONNECTED;
+	/* 96 DPI */
+	arg->mm_width = kms->config.width * 254 / 960;
+	arg->mm_height = kms->config.height * 254 / 960;
+	arg->subpixel = DRM_MODE_SUBPIXEL_UNKNOWN;
+
+	return 0;
+}
+
+static int
+get_plane_resources(struct fake_kms *kms, struct drm_mode_get_plane_res *arg)
+{
+	copy_ids(arg->plane_id_ptr, arg->count_planes, kms->planes,
+		 kms->config.n_planes);
+	arg->count_planes = kms->config.n_planes;
+
+	return 0;
+}
+
+static int
+get_plane(struct fake_kms *kms, struct drm_mode_get_plane *arg)
+{
+	const struct fake_kms_plane_config *config;
+	uint32_t *formats = u64_to_ptr(arg->format_type_ptr);
+	struct object *plane;
+
+	plane = find_object(kms, arg->plane_id, DRM_MODE_OBJECT_PLANE);
+	if (!plane)
+		return -ENOENT;
+	config = &kms->config.planes[plane->index];
+
+	if (arg->count_format_types >= (uint32_t) config->n_formats && formats)
+		memcpy(formats, config->formats,
+		       config->n_formats * sizeof *formats);
+	arg->count_format_types = config->n_formats;
+
+	arg->crtc_id = plane->values[PROP_PLANE_CRTC_ID];
+	arg->fb_id = plane->values[PROP_PLANE_FB_ID];
+	arg->possible_crtcs = config->possible_crtcs;
+	arg->gamma_size = 0;
+
+	return 0;
+}
+
+static int
+get_object_properties(struct fake_kms *kms,
+		      struct drm_mode_obj_get_properties *arg)
+{
+	struct object *obj;
+
+	obj = find_object(kms, arg->obj_id, arg->obj_type);
+	if (!obj)
+		return -ENOENT;
+
+	copy_props(obj, arg->props_ptr, arg->prop_values_ptr,
+		   &arg->count_props);
+
+	return 0;
+}
+
+static int
+get_property(struct fake_kms *kms, struct drm_mode_get_property *arg)
+{
+	struct drm_mode_property_enum *enums = u64_to_ptr(arg->enum_blob_ptr);
+	uint64_t *values = u64_to_ptr(arg->values_ptr);
+	uint32_t n_values = 0, n_enums = 0;
+	struct prop *prop;
+	uint32_t i;
+
+	prop = find_prop(kms, arg->prop_id);
+	if (!prop)
+		return -ENOENT;
+
+	snprintf(arg->name, sizeof arg->name, "%s", prop->name);
+	arg->flags = prop->immutable ? DRM_MODE_PROP_IMMUTABLE : 0;
+	if (prop->atomic)
+		arg->flags |= DRM_MODE_PROP_ATOMIC;
+
+	switch (prop->type) {
+	case PROP_RANGE:
+	case PROP_SIGNED_RANGE:
+		arg->flags |= prop->type == PROP_RANGE ?
+			DRM_MODE_PROP_RANGE : DRM_MODE_PROP_SIGNED_RANGE;
+		n_values = 2;
+		if (arg->count_values >= n_values && values) {
+			values[0] = prop->min;
+			values[1] = prop->max;
+		}
+		break;
+	case PROP_ENUM:
+		arg->flags |= DRM_MODE_PROP_ENUM;
+		while (prop->enums[n_values])
+			n_values++;
+		n_enums = n_values;
+		if (arg->count_values >= n_values && values) {
+			for (i = 0; i < n_values; i++)
+				values[i] = i;
+		}
+		if (arg->count_enum_blobs >= n_enums && enums) {
+			for (i = 0; i < n_enums; i++) {
+				enums[i].value = i;
+				snprintf(enums[i].name, sizeof enums[i].name,
+					 "%s", prop->enums[i]);
+			}
+		}
+		break;
+	case PROP_OBJECT:
+		arg->flags |= DRM_MODE_PROP_OBJECT;
+		n_values = 1;
+		if (arg->count_values >= n_values && values)
+			values[0] = prop->object_type;
+		break;
+	case PROP_BLOB:
+		arg->flags |= DRM_MODE_PROP_BLOB;
+		break;
+	}
+
+	arg->count_values = n_values;
+	arg->count_enum_blobs = n_enums;
+
+	return 0;
+}
+
+static int
+get_property_blob(struct fake_kms *kms, struct drm_mode_get_blob *arg)
+{
+	struct blob *blob;
+
+	blob = find_blob(kms, arg->blob_id, false);
+	if (!blob)
+		return -ENOENT;
+
+	if (arg->length >= blob->length && arg->data)
+		memcpy(u64_to_ptr(arg->data), blob->data, blob->length);
+	arg->length = blob->length;
+
+	return 0;
+}
+
+static int
+create_property_blob(struct fake_kms *kms, struct drm_mode_create_blob *arg)
+{
+	struct blob *blob;
+
+	if (arg->length == 0 || !arg->data)
+		return -EINVAL;
+
+	blob = blob_create(kms, u64_to_ptr(arg->data), arg->length, false);
+	arg->blob_id = blob->id;
+
+	return 0;
+}
+
+static int
+destroy_property_blob(struct fake_kms *kms, struct drm_mode_destroy_blob *arg)
+{
+	struct blob *blob;
+
+	blob = find_blob(kms, arg->blob_id, false);
+	if (!blob || blob->internal)
+		return -ENOENT;
+
+	blob->removed = true;
+	sweep_blobs(kms);
+
+	return 0;
+}
+
+static int
+add_fb(struct fake_kms *kms, uint32_t width, uint32_t height,
+       uint32_t format, const uint32_t handles[4], uint64_t modifier,
+       uint32_t *fb_id)
+{
+	struct fb *fb;
+	int i;
+
+	if (width == 0 || height == 0 || !handles[0])
+		return -EINVAL;
+
+	for (i = 0; i < 4; i++) {
+		if (handles[i] && !find_bo(kms, handles[i]))
+			return -ENOENT;
+	}
+
+	fb = xzalloc(sizeof *fb);
+	fb->id = kms->next_id++;
+	fb->width = width;
+	fb->height = height;
+	fb->format = format;
+	fb->modifier = modifier;
+	wl_list_insert(kms->fb_list.prev, &fb->link);
+
+	*fb_id = fb->id;
+
+	return 0;
+}
+
+static int
+add_fb_legacy(struct fake_kms *kms, struct drm_mode_fb_cmd *arg)
+{
+	uint32_t handles[4] = { arg->handle };
+	uint32_t format;
+
+	if (arg->bpp == 32 && arg->depth == 24)
+		format = DRM_FORMAT_XRGB8888;
+	else if (arg->bpp == 32 && arg->depth == 32)
+		format = DRM_FORMAT_ARGB8888;
+	else if (arg->bpp == 32 && arg->depth == 30)
+		format = DRM_FORMAT_XRGB2101010;
+	else if (arg->bpp == 16 && arg->depth == 16)
+		format = DRM_FORMAT_RGB565;
+	else
+		return -EINVAL;
+
+	return add_fb(kms, arg->width, arg->height, format, handles,
+		      DRM_FORMAT_MOD_INVALID, &arg->fb_id);
+}
+
+static bool
+has_modifiers(struct fake_kms *kms)
+{
+	int i;
+
+	for (i = 0; i < kms->config.n_planes; i++) {
+		if (kms->config.planes[i].n_modifiers > 0)
+			return true;
+	}
+
+	return false;
+}
+
+static int
+add_fb2(struct fake_kms *kms, struct drm_mode_fb_cmd2 *arg)
+{
+	uint64_t modifier = DRM_FORMAT_MOD_INVALID;
+
+	if (arg->flags & ~DRM_MODE_FB_MODIFIERS)
+		return -EINVAL;
+
+	if (arg->flags & DRM_MODE_FB_MODIFIERS) {
+		if (!has_modifiers(kms))
+			return -EINVAL;
+		modifier = arg->modifier[0];
+	}
+
+	return add_fb(kms, arg->width, arg->height, arg->pixel_format,
+		      arg->handles, modifier, &arg->fb_id);
+}
+
+static int
+remove_fb(struct fake_kms *kms, uint32_t *fb_id)
+{
+	struct fb *fb;
+	int i;
+
+	fb = find_fb(kms, *fb_id);
+	if (!fb)
+		return -ENOENT;
+
+	/* Like the kernel, turn off the planes still showing it. */
+	for (i = 0; i < kms->config.n_planes; i++) {
+		if (kms->planes[i].values[PROP_PLANE_FB_ID] != fb->id)
+			continue;
+		kms->planes[i].values[PROP_PLANE_FB_ID] = 0;
+		kms->planes[i].values[PROP_PLANE_CRTC_ID] = 0;
+	}
+
+	wl_list_remove(&fb->link);
+	free(fb);
+
+	return 0;
+}
+
+static int
+create_dumb(struct fake_kms *kms, struct drm_mode_create_dumb *arg)
+{
+	struct bo *bo;
+	uint64_t size;
+	uint32_t pitch;
+	int fd;
+
+	if (arg->width == 0 || arg->height == 0 || arg->bpp == 0)
+		return -EINVAL;
+
+	pitch = ALIGN(arg->width * ((arg->bpp + 7) / 8), 64);
+	size = ALIGN((uint64_t) pitch * arg->height, 4096);
+
+	fd = os_create_anonymous_file(size);
+	if (fd < 0)
+		return -ENOMEM;
+
+	bo = xzalloc(sizeof *bo);
+	bo->handle = kms->next_handle++;
+	bo->fd = fd;
+	bo->size = size;
+	/* A fake offset to tell the buffers apart in mmap() */
+	bo->offset = (uint64_t) bo->handle << 20;
+	wl_list_insert(kms->bo_list.prev, &bo->link);
+
+	arg->handle = bo->handle;
+	arg->pitch = pitch;
+	arg->size = size;
+
+	return 0;
+}
+
+static int
+map_dumb(struct fake_kms *kms, struct drm_mode_map_dumb *arg)
+{
+	struct bo *bo;
+
+	bo = find_bo(kms, arg->handle);
+	if (!bo)
+		return -ENOENT;
+
+	arg->offset = bo->offset;
+
+	return 0;
+}
+
+static int
+destroy_dumb(struct fake_kms *kms, uint32_t handle)
+{
+	struct bo *bo;
+
+	bo = find_bo(kms, handle);
+	if (!bo)
+		return -ENOENT;
+
+	bo_destroy(bo);
+
+	return 0;
+}
+
+/* Any file can be imported as a dmabuf, such as a memfd holding the
+ * pixels. As with the kernel, importing the same one again gives the
+ * same handle. */
+static int
+prime_fd_to_handle(struct fake_kms *kms, struct drm_prime_handle *arg)
+{
+	struct stat st, bo_st;
+	struct bo *bo;
+	int fd;
+
+	if (fstat(arg->fd, &st) < 0)
+		return -EBADF;
+
+	wl_list_for_each(bo, &kms->bo_list, link) {
+		if (fstat(bo->fd, &bo_st) == 0 &&
+		    bo_st.st_dev == st.st_dev && bo_st.st_ino == st.st_ino) {
+			arg->handle = bo->handle;
+			return 0;
+		}
+	}
+
+	fd = fcntl(arg->fd, F_DUPFD_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	bo = xzalloc(sizeof *bo);
+	bo->handle = kms->next_handle++;
+	bo->fd = fd;
+	bo->size = st.st_size;
+	bo->offset = (uint64_t) bo->handle << 20;
+	wl_list_insert(kms->bo_list.prev, &bo->link);
+
+	arg->handle = bo->handle;
+
+	return 0;
+}
+
+static int
+get_cap(struct fake_kms *kms, struct drm_get_cap *arg)
+{
+	switch (arg->capability) {
+	case DRM_CAP_DUMB_BUFFER:
+	case DRM_CAP_TIMESTAMP_MONOTONIC:
+	case DRM_CAP_CRTC_IN_VBLANK_EVENT:
+		arg->value = 1;
+		return 0;
+	case DRM_CAP_CURSOR_WIDTH:
+	case DRM_CAP_CURSOR_HEIGHT:
+		arg->value = CURSOR_SIZE;
+		return 0;
+	case DRM_CAP_ADDFB2_MODIFIERS:
+		arg->value = has_modifiers(kms);
+		return 0;
+	case DRM_CAP_PRIME:
+		arg->value = DRM_PRIME_CAP_IMPORT;
+		return 0;
+	case DRM_CAP_ASYNC_PAGE_FLIP:
+		arg->value = 0;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int
+set_client_cap(struct fake_kms *kms, struct drm_set_client_cap *arg)
+{
+	if (arg->value > 1)
+		return -EINVAL;
+
+	switch (arg->capability) {
+	case DRM_CLIENT_CAP_UNIVERSAL_PLANES:
+	case DRM_CLIENT_CAP_ASPECT_RATIO:
+		return 0;
+	case DRM_CLIENT_CAP_ATOMIC:
+		kms->atomic = arg->value;
+		return 0;
+	case DRM_CLIENT_CAP_WRITEBACK_CONNECTORS:
+		return kms->atomic ? 0 : -EINVAL;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Only the query of the last vblank is supported, not waiting. */
+static int
+wait_vblank(struct fake_kms *kms, union drm_wait_vblank *arg)
+{
+	unsigned int type = arg->request.type;
+	struct timespec ts;
+	int64_t vblank;
+	int pipe;
+
+	if ((type & _DRM_VBLANK_TYPES_MASK) != _DRM_VBLANK_RELATIVE ||
+	    (type & (_DRM_VBLANK_EVENT | _DRM_VBLANK_SIGNAL)) ||
+	    arg->request.sequence != 0)
+		return -EINVAL;
+
+	if (type & _DRM_VBLANK_SECONDARY)
+		pipe = 1;
+	else
+		pipe = (type & _DRM_VBLANK_HIGH_CRTC_MASK) >>
+		       _DRM_VBLANK_HIGH_CRTC_SHIFT;
+
+	if (pipe >= kms->config.n_crtcs ||
+	    !kms->crtcs[pipe].values[PROP_CRTC_ACTIVE])
+		return -EINVAL;
+
+	vblank = current_vblank(kms);
+	vblank_time(kms, vblank, &ts);
+
+	arg->reply.type = type & _DRM_VBLANK_TYPES_MASK;
+	arg->reply.sequence = vblank;
+	arg->reply.tval_sec = ts.tv_sec;
+	arg->reply.tval_usec = ts.tv_nsec / 1000;
+
+	return 0;
+}
+
+static bool
+prop_value_valid(struct fake_kms *kms, const struct prop *prop,
+		 uint64_t value)
+{
+	int n;
+
+	switch (prop->type) {
+	case PROP_RANGE:
+		return value >= (uint64_t) prop->min &&
+		       value <= (uint64_t) prop->max;
+	case PROP_SIGNED_RANGE:
+		return (int64_t) value >= prop->min &&
+		       (int64_t) value <= prop->max;
+	case PROP_ENUM:
+		for (n = 0; prop->enums[n]; n++)
+			;
+		return value < (uint64_t) n;
+	case PROP_OBJECT:
+		if (value == 0)
+			return true;
+		if (prop->object_type == DRM_MODE_OBJECT_FB)
+			return find_fb(kms, value) != NULL;
+		return find_object(kms, value, prop->object_type) != NULL;
+	case PROP_BLOB:
+		return value == 0 || find_blob(kms, value, false) != NULL;
+	}
+
+	return false;
+}
+
+static bool
+plane_supports(const struct fake_kms_plane_config *config,
+	       uint32_t format, uint64_t modifier)
+{
+	int i;
+
+	for (i = 0; i < config->n_formats; i++) {
+		if (config->formats[i] == format)
+			break;
+	}
+	if (i == config->n_formats)
+		return false;
+
+	/* Implicit modifiers are the driver's business. */
+	if (modifier == DRM_FORMAT_MOD_INVALID)
+		return true;
+
+	for (i = 0; i < config->n_modifiers; i++) {
+		if (config->modifiers[i] == modifier)
+			return true;
+	}
+
+	return false;
+}
+
+static int
+check_plane(struct fake_kms *kms, struct object *plane, int *n_planes)
+{
+	const struct fake_kms_plane_config *config =
+		&kms->config.planes[plane->index];
+	const struct fake_kms_rules *rules = &kms->config.rules;
+	uint64_t *values = kms->pending[plane->slot];
+	struct fake_kms_plane_state state;
+	struct blob *damage;
+	struct fb *fb;
+	int crtc;
+
+	if (!values[PROP_PLANE_FB_ID] && !values[PROP_PLANE_CRTC_ID])
+		return 0;
+	if (!values[PROP_PLANE_FB_ID] || !values[PROP_PLANE_CRTC_ID])
+		return -EINVAL;
+
+	fb = find_fb(kms, values[PROP_PLANE_FB_ID]);
+	crtc = crtc_index(kms, values[PROP_PLANE_CRTC_ID]);
+	assert(fb);
+
+	if (!(config->possible_crtcs & (1 << crtc)) ||
+	    !kms->pending[kms->crtcs[crtc].slot][PROP_CRTC_MODE_ID])
+		return -EINVAL;
+
+	if (!plane_supports(config, fb->format, fb->modifier))
+		return -EINVAL;
+
+	state.plane = plane->index;
+	state.type = config->type;
+	state.crtc = crtc;
+	state.format = fb->format;
+	state.modifier = fb->modifier;
+	state.src_x = values[PROP_PLANE_SRC_X];
+	state.src_y = values[PROP_PLANE_SRC_Y];
+	state.src_w = values[PROP_PLANE_SRC_W];
+	state.src_h = values[PROP_PLANE_SRC_H];
+	state.crtc_x = (int64_t) values[PROP_PLANE_CRTC_X];
+	state.crtc_y = (int64_t) values[PROP_PLANE_CRTC_Y];
+	state.crtc_w = values[PROP_PLANE_CRTC_W];
+	state.crtc_h = values[PROP_PLANE_CRTC_H];
+	state.zpos = config->zpos;
+
+	if ((uint64_t) state.src_x + state.src_w >
+	    (uint64_t) fb->width << 16 ||
+	    (uint64_t) state.src_y + state.src_h >
+	    (uint64_t) fb->height << 16)
+		return -ENOSPC;
+
+	if (state.crtc_w == 0 || state.crtc_h == 0 ||
+	    state.src_w == 0 || state.src_h == 0)
+		return -EINVAL;
+
+	if (values[PROP_PLANE_FB_DAMAGE_CLIPS]) {
+		damage = find_blob(kms, values[PROP_PLANE_FB_DAMAGE_CLIPS],
+				   true);
+		if (damage->length % sizeof(struct drm_mode_rect) != 0)
+			return -EINVAL;
+	}
+
+	if (config->type == DRM_PLANE_TYPE_CURSOR &&
+	    (state.crtc_w > CURSOR_SIZE || state.crtc_h > CURSOR_SIZE ||
+	     state.src_w != state.crtc_w << 16 ||
+	     state.src_h != state.crtc_h << 16))
+		return -EINVAL;
+
+	if (rules->no_scaling &&
+	    (state.src_w != state.crtc_w << 16 ||
+	     state.src_h != state.crtc_h << 16))
+		return -EINVAL;
+
+	if (rules->primary_fullscreen &&
+	    config->type == DRM_PLANE_TYPE_PRIMARY &&
+	    (state.crtc_x != 0 || state.crtc_y != 0 ||
+	     state.crtc_w != kms->mode.hdisplay ||
+	     state.crtc_h != kms->mode.vdisplay))
+		return -EINVAL;
+
+	n_planes[crtc]++;
+	if (rules->max_planes_per_crtc > 0 &&
+	    n_planes[crtc] > rules->max_planes_per_crtc)
+		return -EINVAL;
+
+	if (rules->check_plane)
+		return -rules->check_plane(&state, rules->data);
+
+	return 0;
+}
+
+static bool
+modes_differ(struct fake_kms *kms, uint64_t a, uint64_t b)
+{
+	struct blob *blob_a, *blob_b;
+
+	if (a == b)
+		return false;
+	if (!a || !b)
+		return true;
+
+	blob_a = find_blob(kms, a, true);
+	blob_b = find_blob(kms, b, true);
+
+	return blob_a->length != blob_b->length ||
+	       memcmp(blob_a->data, blob_b->data, blob_a->length) != 0;
+}
+
+/* Check the pending state as the kernel and the driver would. */
+static int
+check_state(struct fake_kms *kms, uint32_t flags)
+{
+	const struct fake_kms_rules *rules = &kms->config.rules;
+	bool allow_modeset = flags & DRM_MODE_ATOMIC_ALLOW_MODESET;
+	int n_planes[FAKE_KMS_MAX_CRTCS] = { 0 };
+	int n_connectors[FAKE_KMS_MAX_CRTCS] = { 0 };
+	int i, ret;
+
+	for (i = 0; i < kms->config.n_crtcs; i++) {
+		struct object *connector = &kms->connectors[i];
+		uint64_t *values = kms->pending[connector->slot];
+		int crtc = crtc_index(kms, values[PROP_CONNECTOR_CRTC_ID]);
+
+		if (crtc >= 0 && crtc != connector->index)
+			return -EINVAL;
+		if (crtc >= 0)
+			n_connectors[crtc]++;
+
+		if (!allow_modeset &&
+		    values[PROP_CONNECTOR_CRTC_ID] !=
+		    connector->values[PROP_CONNECTOR_CRTC_ID])
+			return -EINVAL;
+	}
+
+	for (i = 0; i < kms->config.n_crtcs; i++) {
+		struct object *crtc = &kms->crtcs[i];
+		uint64_t *values = kms->pending[crtc->slot];
+		uint64_t mode_id = values[PROP_CRTC_MODE_ID];
+		struct blob *mode;
+
+		if (mode_id) {
+			mode = find_blob(kms, mode_id, true);
+			if (mode->length != sizeof(struct drm_mode_modeinfo))
+				return -EINVAL;
+		}
+
+		if (values[PROP_CRTC_ACTIVE] && !mode_id)
+			return -EINVAL;
+
+		/* An enabled CRTC needs a connector, and only that. */
+		if (!!mode_id != (n_connectors[i] > 0))
+			return -EINVAL;
+
+		if (!allow_modeset &&
+		    (values[PROP_CRTC_ACTIVE] !=
+		     crtc->values[PROP_CRTC_ACTIVE] ||
+		     modes_differ(kms, mode_id,
+				  crtc->values[PROP_CRTC_MODE_ID])))
+			return -EINVAL;
+	}
+
+	for (i = 0; i < kms->config.n_planes; i++) {
+		ret = check_plane(kms, &kms->planes[i], n_planes);
+		if (ret != 0)
+			return ret;
+	}
+
+	for (i = 0; i < kms->config.n_crtcs; i++) {
+		if (!rules->check_crtc ||
+		    !kms->pending[kms->crtcs[i].slot][PROP_CRTC_MODE_ID])
+			continue;
+
+		ret = -rules->check_crtc(i, n_planes[i], rules->data);
+		if (ret != 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+static uint32_t
+crtc_bit(struct fake_kms *kms, uint64_t crtc_id)
+{
+	int crtc = crtc_index(kms, crtc_id);
+
+	return crtc >= 0 ? 1 << crtc : 0;
+}
+
+/* The CRTCs whose state an object in the commit is part of */
+static uint32_t
+affected_crtcs(struct fake_kms *kms, struct object *obj)
+{
+	uint64_t *pending = kms->pending[obj->slot];
+
+	switch (obj->type) {
+	case DRM_MODE_OBJECT_CRTC:
+		return 1 << obj->index;
+	case DRM_MODE_OBJECT_PLANE:
+		return crtc_bit(kms, obj->values[PROP_PLANE_CRTC_ID]) |
+		       crtc_bit(kms, pending[PROP_PLANE_CRTC_ID]);
+	case DRM_MODE_OBJECT_CONNECTOR:
+		return crtc_bit(kms, obj->values[PROP_CONNECTOR_CRTC_ID]) |
+		       crtc_bit(kms, pending[PROP_CONNECTOR_CRTC_ID]);
+	default:
+		return 0;
+	}
+}
+
+static bool
+flips_pending(struct fake_kms *kms, uint32_t crtcs)
+{
+	int i;
+
+	for (i = 0; i < kms->config.n_crtcs; i++) {
+		if ((crtcs & (1 << i)) && kms->flips[i].pending)
+			return true;
+	}
+
+	return false;
+}
+
+static int
+atomic_commit(struct fake_kms *kms, struct drm_mode_atomic *arg)
+{
+	const uint32_t *objs = u64_to_ptr(arg->objs_ptr);
+	const uint32_t *count_props = u64_to_ptr(arg->count_props_ptr);
+	const uint32_t *props = u64_to_ptr(arg->props_ptr);
+	const uint64_t *values = u64_to_ptr(arg->prop_values_ptr);
+	struct object *changed[MAX_OBJECTS];
+	uint32_t crtcs = 0;
+	uint32_t i, j, n = 0;
+	int64_t vblank;
+	int c, k, ret;
+
+	if (!kms->atomic)
+		return -EOPNOTSUPP;
+
+	if ((arg->flags & ~DRM_MODE_ATOMIC_FLAGS) || arg->reserved ||
+	    (arg->flags & DRM_MODE_PAGE_FLIP_ASYNC))
+		return -EINVAL;
+
+	if ((arg->flags & DRM_MODE_ATOMIC_TEST_ONLY) &&
+	    (arg->flags & DRM_MODE_PAGE_FLIP_EVENT))
+		return -EINVAL;
+
+	for (i = 0; i < (uint32_t) kms->n_objects; i++)
+		memcpy(kms->pending[i], kms->objects[i]->values,
+		       sizeof kms->pending[i]);
+
+	for (i = 0; i < arg->count_objs; i++) {
+		struct object *obj = find_object(kms, objs[i],
+						 DRM_MODE_OBJECT_ANY);
+
+		if (!obj)
+			return -ENOENT;
+		if (n < MAX_OBJECTS)
+			changed[n++] = obj;
+
+		for (j = 0; j < count_props[i]; j++, props++, values++) {
+			k = find_prop_kind(obj, *props);
+			if (k < 0 || obj->props[k]->immutable ||
+			    !prop_value_valid(kms, obj->props[k], *values))
+				return -EINVAL;
+
+			kms->pending[obj->slot][k] = *values;
+		}
+	}
+
+	ret = check_state(kms, arg->flags);
+	if (ret != 0)
+		return ret;
+
+	if (arg->flags & DRM_MODE_ATOMIC_TEST_ONLY)
+		return 0;
+
+	for (i = 0; i < n; i++)
+		crtcs |= affected_crtcs(kms, changed[i]);
+
+	/* Events only come from CRTCs that are or were on. */
+	if (arg->flags & DRM_MODE_PAGE_FLIP_EVENT) {
+		if (crtcs == 0)
+			return -EINVAL;
+		for (c = 0; c < kms->config.n_crtcs; c++) {
+			if ((crtcs & (1 << c)) &&
+			    !kms->crtcs[c].values[PROP_CRTC_ACTIVE] &&
+			    !kms->pending[kms->crtcs[c].slot][PROP_CRTC_ACTIVE])
+				return -EINVAL;
+		}
+	}
+
+	/* A non-blocking commit cannot be queued behind another one, a
+	 * blocking one waits for the previous one to complete. */
+	if (flips_pending(kms, crtcs)) {
+		if (arg->flags & DRM_MODE_ATOMIC_NONBLOCK)
+			return -EBUSY;
+		while (flips_pending(kms, crtcs))
+			pthread_cond_wait(&kms->cond, &kms->mutex);
+	}
+
+	for (i = 0; i < (uint32_t) kms->n_objects; i++)
+		memcpy(kms->objects[i]->values, kms->pending[i],
+		       sizeof kms->pending[i]);
+	sweep_blobs(kms);
+
+	if (arg->flags & DRM_MODE_PAGE_FLIP_EVENT) {
+		vblank = current_vblank(kms) + 1;
+		for (c = 0; c < kms->config.n_crtcs; c++) {
+			if (!(crtcs & (1 << c)))
+				continue;
+			kms->flips[c].pending = true;
+			kms->flips[c].user_data = arg->user_data;
+			kms->flips[c].vblank = vblank;
+		}
+		pthread_cond_broadcast(&kms->cond);
+	}
+
+	return 0;
+}
+
+static int
+fake_kms_ioctl(struct fake_kms *kms, unsigned long request, void *arg)
+{
+	bool test_only;
+	int ret;
+
+	pthread_mutex_lock(&kms->mutex);
+
+	switch (request) {
+	case DRM_IOCTL_GET_CAP:
+		ret = get_cap(kms, arg);
+		break;
+	case DRM_IOCTL_SET_CLIENT_CAP:
+		ret = set_client_cap(kms, arg);
+		break;
+	case DRM_IOCTL_SET_MASTER:
+	case DRM_IOCTL_DROP_MASTER:
+		ret = 0;
+		break;
+	case DRM_IOCTL_WAIT_VBLANK:
+		ret = wait_vblank(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_GETRESOURCES:
+		ret = get_resources(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_GETCRTC:
+		ret = get_crtc(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_GETENCODER:
+		ret = get_encoder(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_GETCONNECTOR:
+		ret = get_connector(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_GETPLANERESOURCES:
+		ret = get_plane_resources(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_GETPLANE:
+		ret = get_plane(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_OBJ_GETPROPERTIES:
+		ret = get_object_properties(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_GETPROPERTY:
+		ret = get_property(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_GETPROPBLOB:
+		ret = get_property_blob(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_CREATEPROPBLOB:
+		ret = create_property_blob(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_DESTROYPROPBLOB:
+		ret = destroy_property_blob(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_ADDFB:
+		ret = add_fb_legacy(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_ADDFB2:
+		ret = add_fb2(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_RMFB:
+		ret = remove_fb(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_CREATE_DUMB:
+		ret = create_dumb(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_MAP_DUMB:
+		ret = map_dumb(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_DESTROY_DUMB:
+		ret = destroy_dumb(kms,
+				   ((struct drm_mode_destroy_dumb *) arg)->handle);
+		break;
+	case DRM_IOCTL_GEM_CLOSE:
+		ret = destroy_dumb(kms, ((struct drm_gem_close *) arg)->handle);
+		break;
+	case DRM_IOCTL_PRIME_FD_TO_HANDLE:
+		ret = prime_fd_to_handle(kms, arg);
+		break;
+	case DRM_IOCTL_MODE_ATOMIC:
+		test_only = ((struct drm_mode_atomic *) arg)->flags &
+			    DRM_MODE_ATOMIC_TEST_ONLY;
+		ret = atomic_commit(kms, arg);
+		if (test_only) {
+			kms->counters.tests++;
+			kms->counters.tests_failed += ret != 0;
+		} else {
+			kms->counters.commits++;
+			kms->counters.commits_failed += ret != 0;
+		}
+		break;
+	default:
+		/* Legacy modesetting is not there, as on atomic-only
+		 * drivers. */
+		ret = -EINVAL;
+		break;
+	}
+
+	pthread_mutex_unlock(&kms->mutex);
+
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
+static int
+fake_kms_open(struct fake_kms *kms, int flags)
+{
+	int fds[2];
+	int ret;
+
+	pthread_mutex_lock(&kms->mutex);
+
+	if (kms->fd >= 0) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+		ret = -errno;
+		goto out;
+	}
+
+	if (!(flags & O_CLOEXEC))
+		fcntl(fds[0], F_SETFD, 0);
+	if (flags & O_NONBLOCK)
+		fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+	kms->fd = fds[0];
+	kms->event_fd = fds[1];
+	kms->atomic = false;
+	ret = kms->fd;
+
+out:
+	pthread_mutex_unlock(&kms->mutex);
+
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
+/* Closing the device frees what the client created and turns everything
+ * off, as the last close of a real device does. */
+static void
+fake_kms_release(struct fake_kms *kms)
+{
+	struct blob *blob, *blob_tmp;
+	struct fb *fb, *fb_tmp;
+	struct bo *bo, *bo_tmp;
+
+	pthread_mutex_lock(&kms->mutex);
+
+	close(kms->event_fd);
+	kms->event_fd = -1;
+	kms->fd = -1;
+
+	reset_state(kms);
+
+	wl_list_for_each_safe(fb, fb_tmp, &kms->fb_list, link) {
+		wl_list_remove(&fb->link);
+		free(fb);
+	}
+	wl_list_for_each_safe(bo, bo_tmp, &kms->bo_list, link)
+		bo_destroy(bo);
+	wl_list_for_each_safe(blob, blob_tmp, &kms->blob_list, link) {
+		if (!blob->internal)
+			blob_destroy(blob);
+	}
+
+	pthread_mutex_unlock(&kms->mutex);
+}
+
+static struct fake_kms *
+device_for_fd(int fd)
+{
+	struct fake_kms *kms = device;
+
+	if (kms && fd >= 0 && fd == kms->fd)
+		return kms;
+
+	return NULL;
+}
+
+static bool
+is_device_path(const char *path)
+{
+	return device && path && strcmp(path, FAKE_KMS_DEVICE_PATH) == 0;
+}
+
+static void *
+real_function(const char *name)
+{
+	void *func = dlsym(RTLD_NEXT, name);
+
+	assert(func);
+
+	return func;
+}
+
+/* The replacements of the libc functions; the test program exports them
+ * so that they are also used by the libraries it loads. */
+
+int
+__open_2(const char *path, int flags);
+int
+__open64_2(const char *path, int flags);
+void *
+mmap64(void *addr, size_t length, int prot, int flags, int fd,
+       off64_t offset);
+
+int
+open(const char *path, int flags, ...)
+{
+	static int (*real_open)(const char *, int, ...);
+	mode_t mode = 0;
+	va_list ap;
+
+	if (flags & O_CREAT || (flags & O_TMPFILE) == O_TMPFILE) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+
+	if (is_device_path(path))
+		return fake_kms_open(device, flags);
+
+	if (!real_open)
+		real_open = real_function("open");
+
+	return real_open(path, flags, mode);
+}
+
+int
+open64(const char *path, int flags, ...)
+{
+	static int (*real_open64)(const char *, int, ...);
+	mode_t mode = 0;
+	va_list ap;
+
+	if (flags & O_CREAT || (flags & O_TMPFILE) == O_TMPFILE) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+
+	if (is_device_path(path))
+		return fake_kms_open(device, flags);
+
+	if (!real_open64)
+		real_open64 = real_function("open64");
+
+	return real_open64(path, flags, mode);
+}
+
+int
+__open_2(const char *path, int flags)
+{
+	static int (*real_open_2)(const char *, int);
+
+	if (is_device_path(path))
+		return fake_kms_open(device, flags);
+
+	if (!real_open_2)
+		real_open_2 = real_function("__open_2");
+
+	return real_open_2(path, flags);
+}
+
+int
+__open64_2(const char *path, int flags)
+{
+	static int (*real_open64_2)(const char *, int);
+
+	if (is_device_path(path))
+		return fake_kms_open(device, flags);
+
+	if (!real_open64_2)
+		real_open64_2 = real_function("__open64_2");
+
+	return real_open64_2(path, flags);
+}
+
+int
+close(int fd)
+{
+	static int (*real_close)(int);
+	struct fake_kms *kms = device_for_fd(fd);
+
+	if (kms)
+		fake_kms_release(kms);
+
+	if (!real_close)
+		real_close = real_function("close");
+
+	return real_close(fd);
+}
+
+int
+ioctl(int fd, unsigned long request, ...)
+{
+	static int (*real_ioctl)(int, unsigned long, ...);
+	struct fake_kms *kms = device_for_fd(fd);
+	va_list ap;
+	void *arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (kms)
+		return fake_kms_ioctl(kms, request, arg);
+
+	if (!real_ioctl)
+		real_ioctl = real_function("ioctl");
+
+	return real_ioctl(fd, request, arg);
+}
+
+static void *
+map_bo(struct fake_kms *kms, void *addr, size_t length, int prot,
+       int flags, uint64_t offset)
+{
+	static void *(*real_mmap)(void *, size_t, int, int, int, off_t);
+	struct bo *bo;
+	int fd = -1;
+
+	pthread_mutex_lock(&kms->mutex);
+	wl_list_for_each(bo, &kms->bo_list, link) {
+		if (bo->offset == offset && length <= bo->size) {
+			fd = bo->fd;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&kms->mutex);
+
+	if (fd < 0) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
+	if (!real_mmap)
+		real_mmap = real_function("mmap");
+
+	return real_mmap(addr, length, prot, flags, fd, 0);
+}
+
+void *
+mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+	static void *(*real_mmap)(void *, size_t, int, int, int, off_t);
+	struct fake_kms *kms = device_for_fd(fd);
+
+	if (kms)
+		return map_bo(kms, addr, length, prot, flags, offset);
+
+	if (!real_mmap)
+		real_mmap = real_function("mmap");
+
+	return real_mmap(addr, length, prot, flags, fd, offset);
+}
+
+void *
+mmap64(void *addr, size_t length, int prot, int flags, int fd,
+       off64_t offset)
+{
+	static void *(*real_mmap64)(void *, size_t, int, int, int, off64_t);
+	struct fake_kms *kms = device_for_fd(fd);
+
+	if (kms)
+		return map_bo(kms, addr, length, prot, flags, offset);
+
+	if (!real_mmap64)
+		real_mmap64 = real_function("mmap64");
+
+	return real_mmap64(addr, length, prot, flags, fd, offset);
+}
+
+static void
+default_plane(struct fake_kms_plane_config *plane, uint32_t type,
+	      int crtc, int zpos)
+{
+	static const uint32_t formats[] = {
+		DRM_FORMAT_XRGB8888,
+		DRM_FORMAT_ARGB8888,
+		DRM_FORMAT_XBGR8888,
+		DRM_FORMAT_ABGR8888,
+		DRM_FORMAT_RGB565,
+		DRM_FORMAT_NV12,
+	};
+
+	memset(plane, 0, sizeof *plane);
+	plane->type = type;
+	plane->possible_crtcs = 1 << crtc;
+	plane->zpos = zpos;
+
+	if (type == DRM_PLANE_TYPE_CURSOR) {
+		plane->formats[plane->n_formats++] = DRM_FORMAT_ARGB8888;
+	} else {
+		memcpy(plane->formats, formats, sizeof formats);
+		plane->n_formats = ARRAY_LENGTH(formats);
+	}
+
+	plane->modifiers[plane->n_modifiers++] = DRM_FORMAT_MOD_LINEAR;
+}
+
+/** Initialize a fake KMS configuration to defaults
+ *
+ * \param config The configuration to initialize.
+ *
+ * The defaults are one CRTC with a 1280x720 mode at 60 Hz, and a primary,
+ * three overlay and a cursor plane, stacked in that order, taking linear
+ * RGB and NV12 buffers. No commit rules are imposed.
+ *
+ * \ingroup testharness
+ */
+void
+fake_kms_config_defaults(struct fake_kms_config *config)
+{
+	int i;
+
+	memset(config, 0, sizeof *config);
+	config->n_crtcs = 1;
+	config->width = 1280;
+	config->height = 720;
+	config->refresh = 60000;
+
+	default_plane(&config->planes[config->n_planes++],
+		      DRM_PLANE_TYPE_PRIMARY, 0, 0);
+	for (i = 1; i <= 3; i++)
+		default_plane(&config->planes[config->n_planes++],
+			      DRM_PLANE_TYPE_OVERLAY, 0, i);
+	default_plane(&config->planes[config->n_planes++],
+		      DRM_PLANE_TYPE_CURSOR, 0, 4);
+}
+
+/** Create the fake KMS device
+ *
+ * \param config The configuration, see fake_kms_config_defaults().
+ * \return The device. Only one can exist at a time.
+ *
+ * Opening FAKE_KMS_DEVICE_PATH opens the device until it is destroyed.
+ *
+ * \ingroup testharness
+ */
+struct fake_kms *
+fake_kms_create(const struct fake_kms_config *config)
+{
+	struct fake_kms *kms;
+	pthread_condattr_t attr;
+	int i, k;
+
+	assert(!device);
+	assert(config->n_crtcs > 0 && config->n_crtcs <= FAKE_KMS_MAX_CRTCS);
+	assert(config->n_planes > 0 &&
+	       config->n_planes <= FAKE_KMS_MAX_PLANES);
+	assert(config->width > 0 && config->height > 0 &&
+	       config->refresh > 0);
+
+	kms = xzalloc(sizeof *kms);
+	kms->config = *config;
+	kms->fd = -1;
+	kms->event_fd = -1;
+	kms->next_handle = 1;
+	wl_list_init(&kms->blob_list);
+	wl_list_init(&kms->fb_list);
+	wl_list_init(&kms->bo_list);
+
+	pthread_mutex_init(&kms->mutex, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&kms->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	/* Property IDs come first, then the objects. */
+	for (k = 0; k < PROP__COUNT; k++) {
+		kms->props[k] = prop_templates[k];
+		kms->props[k].id = ++kms->n_props;
+	}
+	kms->next_id = kms->n_props + 1;
+
+	for (i = 0; i < config->n_crtcs; i++) {
+		struct object *crtc = &kms->crtcs[i];
+		struct object *connector = &kms->connectors[i];
+
+		object_add(kms, crtc, DRM_MODE_OBJECT_CRTC, i);
+		object_add_prop(kms, crtc, PROP_CRTC_MODE_ID);
+		object_add_prop(kms, crtc, PROP_CRTC_ACTIVE);
+
+		object_add(kms, &kms->encoders[i], DRM_MODE_OBJECT_ENCODER, i);
+
+		object_add(kms, connector, DRM_MODE_OBJECT_CONNECTOR, i);
+		object_add_prop(kms, connector, PROP_CONNECTOR_EDID);
+		object_add_prop(kms, connector, PROP_CONNECTOR_DPMS);
+		object_add_prop(kms, connector, PROP_CONNECTOR_CRTC_ID);
+	}
+
+	for (i = 0; i < config->n_planes; i++) {
+		const struct fake_kms_plane_config *pconf = &config->planes[i];
+		struct object *plane = &kms->planes[i];
+		struct prop *zpos;
+
+		assert(pconf->n_formats > 0 &&
+		       pconf->n_formats <= FAKE_KMS_MAX_FORMATS);
+
+		object_add(kms, plane, DRM_MODE_OBJECT_PLANE, i);
+		for (k = PROP_PLANE_TYPE; k <= PROP_PLANE_CRTC_ID; k++)
+			object_add_prop(kms, plane, k);
+		object_add_prop(kms, plane, PROP_PLANE_IN_FENCE_FD);
+		object_add_prop(kms, plane, PROP_PLANE_FB_DAMAGE_CLIPS);
+		plane->values[PROP_PLANE_TYPE] = pconf->type;
+
+		if (pconf->n_modifiers > 0)
+			create_in_formats(kms, plane, pconf);
+
+		if (pconf->zpos >= 0) {
+			zpos = &kms->props[kms->n_props++];
+			*zpos = prop_templates[PROP_PLANE_ZPOS];
+			zpos->id = kms->next_id++;
+			zpos->min = pconf->zpos;
+			zpos->max = pconf->zpos;
+			plane->props[PROP_PLANE_ZPOS] = zpos;
+			plane->values[PROP_PLANE_ZPOS] = pconf->zpos;
+		}
+	}
+
+	reset_state(kms);
+	init_mode(kms);
+	clock_gettime(CLOCK_MONOTONIC, &kms->epoch);
+
+	pthread_create(&kms->vblank_thread, NULL, vblank_thread, kms);
+
+	device = kms;
+
+	return kms;
+}
+
+/** Destroy the fake KMS device
+ *
+ * \param kms The device, which must have been closed.
+ *
+ * \ingroup testharness
+ */
+void
+fake_kms_destroy(struct fake_kms *kms)
+{
+	struct blob *blob, *tmp;
+
+	assert(kms == device);
+	assert(kms->fd < 0);
+
+	device = NULL;
+
+	pthread_mutex_lock(&kms->mutex);
+	kms->quit = true;
+	pthread_cond_broadcast(&kms->cond);
+	pthread_mutex_unlock(&kms->mutex);
+	pthread_join(kms->vblank_thread, NULL);
+
+	wl_list_for_each_safe(blob, tmp, &kms->blob_list, link)
+		blob_destroy(blob);
+
+	pthread_cond_destroy(&kms->cond);
+	pthread_mutex_destroy(&kms->mutex);
+	free(kms);
+}
+
+/** Change the rules atomic commits must follow
+ *
+ * \param kms The device.
+ * \param rules The new rules, taking effect with the next commit.
+ *
+ * \ingroup testharness
+ */
+void
+fake_kms_set_rules(struct fake_kms *kms, const struct fake_kms_rules *rules)
+{
+	pthread_mutex_lock(&kms->mutex);
+	kms->config.rules = *rules;
+	pthread_mutex_unlock(&kms->mutex);
+}
+
+/** Get the counts of what the device has done
+ *
+ * \param kms The device.
+ * \param counters Filled in with the counts since creation.
+ *
+ * \ingroup testharness
+ */
+void
+fake_kms_get_counters(struct fake_kms *kms,
+		      struct fake_kms_counters *counters)
+{
+	pthread_mutex_lock(&kms->mutex);
+	*counters = kms->counters;
+	pthread_mutex_unlock(&kms->mutex);
+}
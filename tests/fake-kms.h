@@ -0,0 +1,165 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FAKE_KMS_H
+#define FAKE_KMS_H
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** A KMS device emulated in userspace
+ *
+ * The fake device answers the KMS ioctls of the DRM-backend, so that the
+ * backend can run in the test program without a real card: test programs
+ * linking it replace open(), ioctl(), mmap() and close() for the device
+ * node FAKE_KMS_DEVICE_PATH and pass everything else on to libc.
+ *
+ * It has one connector and encoder per CRTC, always connected with a
+ * single mode, and planes with the formats, modifiers and zpos given in
+ * struct fake_kms_config. Atomic commits are checked like the kernel
+ * checks them, plus the rules of struct fake_kms_rules. Page flips
+ * complete at the next vblank of the mode's refresh rate, counted from
+ * the creation of the device.
+ *
+ * Dumb buffers are backed by memory, so the Pixman-renderer works. Any
+ * file, like a memfd, can be imported as a dmabuf with
+ * DRM_IOCTL_PRIME_FD_TO_HANDLE, which the backend does for dmabuf client
+ * buffers when it has no GBM device. There is no GBM device, so nothing
+ * else gets put on overlay or cursor planes when the backend goes through
+ * GBM for it.
+ *
+ * \ingroup testharness
+ */
+struct fake_kms;
+
+/** Path of the fake device node, to pass as the DRM device */
+#define FAKE_KMS_DEVICE_PATH "/dev/dri/weston-fake-kms"
+
+#define FAKE_KMS_MAX_CRTCS 4
+#define FAKE_KMS_MAX_PLANES 16
+#define FAKE_KMS_MAX_FORMATS 16
+#define FAKE_KMS_MAX_MODIFIERS 4
+
+struct fake_kms_plane_config {
+	/** DRM_PLANE_TYPE_PRIMARY, DRM_PLANE_TYPE_OVERLAY or
+	 * DRM_PLANE_TYPE_CURSOR */
+	uint32_t type;
+	/** Bit mask of the indices of the CRTCs the plane can be used on */
+	uint32_t possible_crtcs;
+	/** DRM_FORMAT_* codes of the supported formats */
+	uint32_t formats[FAKE_KMS_MAX_FORMATS];
+	int n_formats;
+	/** Modifiers supported with every format; without any, the plane
+	 * has no IN_FORMATS property and takes only implicit modifiers. */
+	uint64_t modifiers[FAKE_KMS_MAX_MODIFIERS];
+	int n_modifiers;
+	/** The immutable zpos, or -1 for no zpos property */
+	int zpos;
+};
+
+/** An enabled plane in an atomic commit, as given to
+ * fake_kms_rules::check_plane */
+struct fake_kms_plane_state {
+	/** Index in fake_kms_config::planes */
+	int plane;
+	uint32_t type;
+	/** Index of the CRTC */
+	int crtc;
+	uint32_t format;
+	uint64_t modifier;
+	int32_t crtc_x, crtc_y;
+	uint32_t crtc_w, crtc_h;
+	/** Source rectangle in 16.16 fixed point */
+	uint32_t src_x, src_y, src_w, src_h;
+	int zpos;
+};
+
+/** Hardware limitations imposed on atomic commits
+ *
+ * A commit breaking any of these fails with EINVAL, or with the error
+ * returned by check_plane or check_crtc.
+ */
+struct fake_kms_rules {
+	/** Most planes enabled on one CRTC, or 0 for no limit */
+	int max_planes_per_crtc;
+	/** Whether planes must not scale */
+	bool no_scaling;
+	/** Whether the primary plane must cover the whole CRTC */
+	bool primary_fullscreen;
+	/** Called for every enabled plane, returns 0 to accept it or an
+	 * errno value to fail the commit with. */
+	int (*check_plane)(const struct fake_kms_plane_state *state,
+			   void *data);
+	/** Called for every enabled CRTC once all its planes were accepted,
+	 * with how many are enabled on it; returns 0 or an errno value as
+	 * check_plane does. */
+	int (*check_crtc)(int crtc, int n_planes, void *data);
+	void *data;
+};
+
+struct fake_kms_config {
+	/** Number of CRTCs, each with a connector of its own */
+	int n_crtcs;
+	/** The only mode of the connectors */
+	int width;
+	int height;
+	/** Refresh rate of the mode in mHz */
+	int refresh;
+	struct fake_kms_plane_config planes[FAKE_KMS_MAX_PLANES];
+	int n_planes;
+	struct fake_kms_rules rules;
+};
+
+/** What the fake device has done since it was created */
+struct fake_kms_counters {
+	/** Atomic commits with DRM_MODE_ATOMIC_TEST_ONLY */
+	uint64_t tests;
+	uint64_t tests_failed;
+	/** Atomic commits to apply */
+	uint64_t commits;
+	uint64_t commits_failed;
+	/** Page flip events sent */
+	uint64_t flips;
+};
+
+void
+fake_kms_config_defaults(struct fake_kms_config *config);
+
+struct fake_kms *
+fake_kms_create(const struct fake_kms_config *config);
+
+void
+fake_kms_destroy(struct fake_kms *kms);
+
+void
+fake_kms_set_rules(struct fake_kms *kms, const struct fake_kms_rules *rules);
+
+void
+fake_kms_get_counters(struct fake_kms *kms,
+		      struct fake_kms_counters *counters);
+
+#endif /* FAKE_KMS_H */
@@ -0,0 +1,245 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <libweston/libweston.h>
+#include <libweston/weston-log.h>
+#include "weston-test-runner.h"
+#include "weston-test-fixture-compositor.h"
+
+#define N_LINES 20000
+#define RING_SIZE 4096
+/* Few enough to fit in the ring */
+#define N_CRASH_LINES 100
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+
+	return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+/* Logs N_LINES numbered lines and a message larger than the ring through
+ * an asynchronous subscriber, and returns how many lines made it out, in
+ * order, plus how many messages were reported dropped. */
+static int
+log_lines(struct weston_compositor *compositor,
+	  enum weston_log_async_policy policy, bool *big_seen)
+{
+	struct weston_log_subscriber *subscriber;
+	struct weston_log_scope *scope;
+	char *big, *line = NULL;
+	size_t line_len = 0;
+	int next = 0, seen = 0, dropped = 0;
+	int n, i;
+	FILE *fp;
+
+	fp = tmpfile();
+	assert(fp);
+
+	scope = weston_compositor_add_log_scope(compositor, "test-async",
+						"Asynchronous log test\n",
+						NULL, NULL, NULL);
+	assert(scope);
+	subscriber = weston_log_subscriber_create_log_async(fp, RING_SIZE,
+							    policy);
+	assert(subscriber);
+	weston_log_subscribe(compositor->weston_log_ctx, subscriber,
+			     "test-async");
+
+	for (i = 0; i < N_LINES; i++)
+		weston_log_scope_printf(scope, "line %d %*s\n", i, i % 100, "");
+
+	big = malloc(RING_SIZE * 3);
+	assert(big);
+	memset(big, 'b', RING_SIZE * 3 - 1);
+	big[RING_SIZE * 3 - 1] = '\0';
+	weston_log_scope_printf(scope, "%s\n", big);
+
+	/* Writes out everything queued. */
+	weston_log_subscriber_destroy(subscriber);
+	weston_log_scope_destroy(scope);
+
+	*big_seen = false;
+	rewind(fp);
+	while (getline(&line, &line_len, fp) > 0) {
+		if (sscanf(line, "line %d", &i) == 1) {
+			assert(i >= next);
+			next = i + 1;
+			seen++;
+		} else if (sscanf(line, "[log: %d messages dropped", &n) == 1) {
+			dropped += n;
+		} else {
+			assert(strcmp(line + RING_SIZE * 3 - 1, "\n") == 0);
+			assert(strspn(line, "b") == RING_SIZE * 3 - 1);
+			*big_seen = true;
+		}
+	}
+
+	free(line);
+	free(big);
+	fclose(fp);
+
+	return seen + dropped;
+}
+
+PLUGIN_TEST(async_log_block_keeps_everything)
+{
+	/* struct weston_compositor *compositor; */
+	bool big_seen;
+
+	assert(log_lines(compositor, WESTON_LOG_ASYNC_BLOCK, &big_seen) ==
+	       N_LINES);
+	assert(big_seen);
+}
+
+PLUGIN_TEST(async_log_drop_counts_losses)
+{
+	/* struct weston_compositor *compositor; */
+	bool big_seen;
+
+	/* The message larger than the ring can never fit. */
+	assert(log_lines(compositor, WESTON_LOG_ASYNC_DROP, &big_seen) ==
+	       N_LINES + 1);
+	assert(!big_seen);
+}
+
+/* Makes writing to the pipe block, until someone reads from it. */
+static void
+fill_pipe(int fd)
+{
+	char buf[4096];
+	int flags;
+
+	memset(buf, 'f', sizeof buf);
+	flags = fcntl(fd, F_GETFL);
+	assert(fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0);
+	while (write(fd, buf, sizeof buf) > 0)
+		;
+	while (write(fd, buf, 1) > 0)
+		;
+	assert(errno == EAGAIN);
+	assert(fcntl(fd, F_SETFL, flags) == 0);
+}
+
+static void *
+drain_pipe(void *data)
+{
+	int fd = *(int *)data;
+	char buf[4096];
+	ssize_t ret;
+
+	do {
+		ret = read(fd, buf, sizeof buf);
+	} while (ret > 0 || (ret < 0 && errno == EINTR));
+
+	return NULL;
+}
+
+PLUGIN_TEST(async_log_flush_on_crash_writes_everything)
+{
+	/* struct weston_compositor *compositor; */
+	struct weston_log_subscriber *subscriber;
+	struct weston_log_scope *scope;
+	pthread_t drainer;
+	char *line = NULL;
+	size_t line_len = 0;
+	int fds[2];
+	FILE *fp, *crash_fp;
+	pid_t pid;
+	int status, next = 0, i;
+
+	/* The writer thread takes the lines out of the ring into the
+	 * FILE's buffer, and blocks writing them to the full pipe. */
+	assert(pipe(fds) == 0);
+	fill_pipe(fds[1]);
+	fp = fdopen(fds[1], "w");
+	assert(fp);
+	assert(setvbuf(fp, NULL, _IOFBF, RING_SIZE * 4) == 0);
+
+	scope = weston_compositor_add_log_scope(compositor, "test-async",
+						"Asynchronous log test\n",
+						NULL, NULL, NULL);
+	assert(scope);
+	subscriber = weston_log_subscriber_create_log_async(fp, RING_SIZE,
+							    WESTON_LOG_ASYNC_BLOCK);
+	assert(subscriber);
+	weston_log_subscribe(compositor->weston_log_ctx, subscriber,
+			     "test-async");
+
+	for (i = 0; i < N_CRASH_LINES; i++)
+		weston_log_scope_printf(scope, "line %d\n", i);
+	usleep(100000);
+
+	/* The crash: the child has no writer thread, and its FILE buffer
+	 * goes away with it. What the writer had not written to the pipe
+	 * must be written by the crash flush, here into another file. */
+	crash_fp = tmpfile();
+	assert(crash_fp);
+	pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		if (dup2(fileno(crash_fp), fds[1]) < 0)
+			_exit(1);
+		weston_log_async_flush_on_crash();
+		_exit(0);
+	}
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	/* Let the writer thread finish, the pipe content does not matter. */
+	assert(pthread_create(&drainer, NULL, drain_pipe, &fds[0]) == 0);
+	weston_log_subscriber_destroy(subscriber);
+	weston_log_scope_destroy(scope);
+	fclose(fp);
+	pthread_join(drainer, NULL);
+	close(fds[0]);
+
+	rewind(crash_fp);
+	while (getline(&line, &line_len, crash_fp) > 0) {
+		assert(sscanf(line, "line %d", &i) == 1);
+		assert(i == next);
+		next++;
+	}
+	assert(next == N_CRASH_LINES);
+
+	free(line);
+	fclose(crash_fp);
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "weston-test-client-helper.h"
+#include "weston-test-fixture-compositor.h"
+#include "shared/timespec-util.h"
+
+/* The occluded-frame-interval */
+#define INTERVAL_MSEC 500
+
+struct setup_args {
+	struct fixture_metadata meta;
+	enum renderer_type renderer;
+};
+
+static const struct setup_args my_setup_args[] = {
+	{
+		.renderer = RENDERER_PIXMAN,
+		.meta.name = "pixman"
+	},
+	{
+		.renderer = RENDERER_GL,
+		.meta.name = "GL"
+	},
+};
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness, const struct setup_args *arg)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+	setup.renderer = arg->renderer;
+	setup.width = 320;
+	setup.height = 240;
+	setup.shell = SHELL_TEST_DESKTOP;
+	weston_ini_setup(&setup,
+			 cfgln("[core]"),
+			 cfgln("occluded-frame-interval=%d", INTERVAL_MSEC));
+
+	return weston_test_harness_execute_as_client(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP_WITH_ARG(fixture_setup, my_setup_args, meta);
+
+static void
+fill_surface(struct surface *surface, uint8_t r, uint8_t g, uint8_t b)
+{
+	pixman_color_t color;
+
+	fill_image_with_color(surface->buffer->image,
+			      color_rgb888(&color, r, g, b));
+}
+
+/* Commit the whole of the surface's buffer again, and return how long its
+ * frame callback took to come. */
+static int64_t
+commit_and_time_frame(struct client *client, struct surface *surface)
+{
+	struct timespec begin, end;
+	int done;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	wl_surface_attach(surface->wl_surface, surface->buffer->proxy, 0, 0);
+	wl_surface_damage(surface->wl_surface, 0, 0, surface->width,
+			  surface->height);
+	frame_callback_set(surface->wl_surface, &done);
+	wl_surface_commit(surface->wl_surface);
+	frame_callback_wait(client, &done);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return timespec_sub_to_msec(&end, &begin);
+}
+
+/* An opaque surface over the whole output, above the client's surface */
+static struct surface *
+create_cover(struct client *client)
+{
+	struct surface *cover;
+	struct wl_region *region;
+
+	cover = create_test_surface(client);
+	cover->width = client->output->width;
+	cover->height = client->output->height;
+	cover->buffer = create_shm_buffer_a8r8g8b8(client, cover->width,
+						   cover->height);
+	fill_surface(cover, 0, 0, 255);
+
+	region = wl_compositor_create_region(client->wl_compositor);
+	wl_region_add(region, 0, 0, cover->width, cover->height);
+	wl_surface_set_opaque_region(cover->wl_surface, region);
+	wl_region_destroy(region);
+
+	weston_test_move_surface(client->test->weston_test, cover->wl_surface,
+				 0, 0);
+	commit_and_time_frame(client, cover);
+
+	return cover;
+}
+
+static uint32_t
+pixel_at(struct buffer *shot, int x, int y)
+{
+	uint32_t *data = pixman_image_get_data(shot->image);
+	int stride = pixman_image_get_stride(shot->image) / sizeof *data;
+
+	return data[y * stride + x] & 0xffffff;
+}
+
+TEST(occluded_surface_frames_throttled)
+{
+	struct client *client;
+	struct surface *cover;
+	struct buffer *shot;
+	int64_t msec;
+	int i;
+
+	client = create_client_and_test_surface(40, 40, 100, 100);
+	fill_surface(client->surface, 255, 0, 0);
+
+	/* Visible: a frame callback every repaint. */
+	msec = commit_and_time_frame(client, client->surface);
+	testlog("visible: frame callback in %" PRId64 " ms\n", msec);
+	assert(msec < INTERVAL_MSEC / 2);
+
+	/* Covered: a frame callback every interval at most. Leave some
+	 * slack for the client seeing them late. */
+	cover = create_cover(client);
+	for (i = 0; i < 3; i++) {
+		msec = commit_and_time_frame(client, client->surface);
+		testlog("covered: frame callback in %" PRId64 " ms\n", msec);
+		assert(msec >= INTERVAL_MSEC / 2);
+	}
+
+	/* New content while covered, which the GL-renderer does not upload
+	 * yet. */
+	fill_surface(client->surface, 0, 255, 0);
+	commit_and_time_frame(client, client->surface);
+
+	/* Uncovered: the surface shows its latest content without being
+	 * committed again, and gets frame callbacks every repaint again. */
+	surface_destroy(cover);
+	shot = capture_screenshot_of_output(client);
+	assert(pixel_at(shot, 90, 90) == 0x00ff00);
+	assert(pixel_at(shot, 200, 200) != 0x0000ff);
+	buffer_destroy(shot);
+
+	msec = commit_and_time_frame(client, client->surface);
+	testlog("uncovered: frame callback in %" PRId64 " ms\n", msec);
+	assert(msec < INTERVAL_MSEC / 2);
+
+	client_destroy(client);
+}
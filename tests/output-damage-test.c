@@ -41,6 +41,15 @@
 		.gl_shadow_fb = false,					\
 		.meta.name = "pixman " #s " " #t,			\
 	},								\
+	{								\
+		.renderer = RENDERER_PIXMAN,				\
+		.scale = s,						\
+		.transform = WL_OUTPUT_TRANSFORM_ ## t,			\
+		.transform_name = #t,					\
+		.gl_shadow_fb = false,					\
+		.pixman_threads = 4,					\
+		.meta.name = "pixman threaded " #s " " #t,		\
+	},								\
 	{								\
 		.renderer = RENDERER_GL,				\
 		.scale = s,						\
@@ -65,6 +74,7 @@ struct setup_args {
 	enum wl_output_transform transform;
 	const char *transform_name;
 	bool gl_shadow_fb;
+	int pixman_threads;
 };
 
 static const struct setup_args my_setup_args[] = {
@@ -149,6 +159,13 @@ fixture_setup(struct weston_test_harness *harness, const struct setup_args *arg)
 		setup.test_quirks.required_capabilities = WESTON_CAP_COLOR_OPS;
 	}
 
+	if (arg->pixman_threads > 0) {
+		/* Composited in bands must look the same as in one go. */
+		weston_ini_setup(&setup,
+				 cfgln("[core]"),
+				 cfgln("pixman-threads=%d", arg->pixman_threads));
+	}
+
 	return weston_test_harness_execute_as_client(harness, &setup);
 }
 DECLARE_FIXTURE_SETUP_WITH_ARG(fixture_setup, my_setup_args, meta);
@@ -0,0 +1,175 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <libweston/libweston.h>
+#include <libweston/windowed-output-api.h>
+#include "libweston-internal.h"
+#include "compositor/weston.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+#include "weston-test-runner.h"
+#include "weston-test-fixture-compositor.h"
+
+#define BENCH_OUTPUTS 6
+#define BENCH_VIEWS_PER_OUTPUT 100
+#define BENCH_ITERATIONS 100
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+
+	return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+static int
+count_z_order_list(struct weston_output *output)
+{
+	struct weston_paint_node *pnode;
+	int n = 0;
+
+	wl_list_for_each(pnode, &output->paint_node_z_order_list,
+			 z_order_link) {
+		assert(pnode->view->output_mask & (1u << output->id));
+		n++;
+	}
+
+	return n;
+}
+
+static int
+count_views_on_output(struct weston_compositor *compositor,
+		      struct weston_output *output)
+{
+	struct weston_view *view;
+	int n = 0;
+
+	wl_list_for_each(view, &compositor->view_list, link) {
+		if (view->output_mask & (1u << output->id))
+			n++;
+	}
+
+	return n;
+}
+
+PLUGIN_TEST(z_order_list_contains_only_output_views)
+{
+	/* struct weston_compositor *compositor; */
+	const struct weston_windowed_output_api *api;
+	struct weston_output *output;
+	struct weston_layer layer;
+	struct weston_view *views[BENCH_OUTPUTS * BENCH_VIEWS_PER_OUTPUT];
+	struct weston_view *restack;
+	struct timespec begin, end;
+	int64_t frame_nsec;
+	int n_outputs = 0;
+	int n_views = 0;
+	int n_nodes = 0;
+	int i;
+
+	api = weston_windowed_output_get_api(compositor);
+	assert(api);
+
+	for (i = 1; i < BENCH_OUTPUTS; i++) {
+		char name[32];
+
+		snprintf(name, sizeof name, "headless-%d", i);
+		assert(api->create_head(compositor, name) == 0);
+	}
+	weston_compositor_flush_heads_changed(compositor);
+
+	weston_layer_init(&layer, compositor);
+	weston_layer_set_position(&layer, WESTON_LAYER_POSITION_NORMAL);
+
+	/* Spread the views evenly, each fully inside one output. */
+	wl_list_for_each(output, &compositor->output_list, link) {
+		n_outputs++;
+
+		for (i = 0; i < BENCH_VIEWS_PER_OUTPUT &&
+			    n_views < (int)ARRAY_LENGTH(views); i++) {
+			struct weston_surface *surface;
+			struct weston_view *view;
+
+			surface = weston_surface_create(compositor);
+			assert(surface);
+			weston_surface_set_size(surface, 16, 16);
+			view = weston_view_create(surface);
+			assert(view);
+			weston_view_set_position(view,
+				output->x + (i * 7) % (output->width - 16),
+				output->y + (i * 13) % (output->height - 16));
+			weston_layer_entry_insert(&layer.view_list,
+						  &view->layer_link);
+			views[n_views++] = view;
+		}
+	}
+	assert(n_outputs == BENCH_OUTPUTS);
+	restack = views[n_views / 2];
+
+	/* One frame repaints every output with a scene graph change,
+	 * forcing all z-order lists to be rebuilt. */
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		weston_layer_entry_remove(&restack->layer_link);
+		weston_layer_entry_insert(&layer.view_list,
+					  &restack->layer_link);
+
+		wl_list_for_each(output, &compositor->output_list, link)
+			weston_compositor_build_view_list(compositor, output);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	frame_nsec = timespec_sub_to_nsec(&end, &begin) / BENCH_ITERATIONS;
+
+	wl_list_for_each(output, &compositor->output_list, link) {
+		int n = count_z_order_list(output);
+
+		assert(n == count_views_on_output(compositor, output));
+		assert(n < n_views);
+		n_nodes += n;
+	}
+
+	testlog("%d outputs, %d views: %d paint nodes in z-order lists "
+		"(%d unpruned), %lld ns per frame\n",
+		n_outputs, n_views, n_nodes, n_views * n_outputs,
+		(long long)frame_nsec);
+
+	for (i = 0; i < n_views; i++) {
+		struct weston_surface *surface = views[i]->surface;
+
+		weston_view_destroy(views[i]);
+		weston_surface_destroy(surface);
+	}
+	weston_layer_fini(&layer);
+}
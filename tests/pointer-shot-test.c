@@ -36,6 +36,7 @@
 struct setup_args {
 	struct fixture_metadata meta;
 	enum renderer_type renderer;
+	bool cursor_plane;
 };
 
 static const struct setup_args my_setup_args[] = {
@@ -47,6 +48,11 @@ static const struct setup_args my_setup_args[] = {
 		.renderer = RENDERER_GL,
 		.meta.name = "GL"
 	},
+	{
+		.renderer = RENDERER_GL,
+		.cursor_plane = true,
+		.meta.name = "GL, cursor plane"
+	},
 };
 
 static enum test_result_code
@@ -60,6 +66,10 @@ fixture_setup(struct weston_test_harness *harness, const struct setup_args *arg)
 	setup.height = 240;
 	setup.shell = SHELL_TEST_DESKTOP;
 
+	/* The screenshots capture the cursor from a plane the renderer
+	 * has not been drawing. */
+	setup.test_quirks.headless_cursor_plane = arg->cursor_plane;
+
 	return weston_test_harness_execute_as_client(harness, &setup);
 }
 DECLARE_FIXTURE_SETUP_WITH_ARG(fixture_setup, my_setup_args, meta);
@@ -0,0 +1,123 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "weston-test-runner.h"
+
+#include "repaint-profiler.h"
+
+#define PHASE WESTON_REPAINT_PHASE_RENDER
+
+TEST(percentile_needs_samples)
+{
+	struct weston_repaint_profiler *prof;
+
+	prof = weston_repaint_profiler_create();
+	assert(prof);
+
+	assert(weston_repaint_profiler_percentile(prof, PHASE, 50) == -1);
+
+	weston_repaint_profiler_record(prof, PHASE, 1000);
+	assert(weston_repaint_profiler_percentile(prof, PHASE, 50) == 1000);
+	assert(weston_repaint_profiler_percentile(prof,
+			WESTON_REPAINT_PHASE_FLUSH, 50) == -1);
+
+	weston_repaint_profiler_destroy(prof);
+}
+
+TEST(percentile_exact_for_small_values)
+{
+	struct weston_repaint_profiler *prof;
+	int i;
+
+	prof = weston_repaint_profiler_create();
+	assert(prof);
+
+	/* Below 8 ns every value has a bucket of its own. */
+	for (i = 0; i < 7; i++)
+		weston_repaint_profiler_record(prof, PHASE, (i * 3) % 7 + 1);
+
+	assert(weston_repaint_profiler_percentile(prof, PHASE, 1) == 1);
+	assert(weston_repaint_profiler_percentile(prof, PHASE, 50) == 4);
+	assert(weston_repaint_profiler_percentile(prof, PHASE, 100) == 7);
+
+	weston_repaint_profiler_destroy(prof);
+}
+
+static void
+assert_within_error(int64_t value, int64_t exact)
+{
+	assert(value >= exact);
+	assert(value <= exact + exact / 8);
+}
+
+TEST(percentile_relative_error)
+{
+	struct weston_repaint_profiler *prof;
+	int i;
+
+	prof = weston_repaint_profiler_create();
+	assert(prof);
+
+	/* 1..1000 us in scrambled order */
+	for (i = 0; i < 1000; i++)
+		weston_repaint_profiler_record(prof, PHASE,
+					       ((i * 37) % 1000 + 1) * 1000);
+
+	assert_within_error(weston_repaint_profiler_percentile(prof, PHASE, 50),
+			    500000);
+	assert_within_error(weston_repaint_profiler_percentile(prof, PHASE, 99),
+			    990000);
+
+	/* The extremes are exact. */
+	assert(weston_repaint_profiler_percentile(prof, PHASE, 1) >= 10000);
+	assert(weston_repaint_profiler_percentile(prof, PHASE, 100) ==
+	       1000000);
+
+	weston_repaint_profiler_destroy(prof);
+}
+
+TEST(percentile_clamped_to_max)
+{
+	struct weston_repaint_profiler *prof;
+
+	prof = weston_repaint_profiler_create();
+	assert(prof);
+
+	/* Beyond the last bucket */
+	weston_repaint_profiler_record(prof, PHASE, 1000);
+	weston_repaint_profiler_record(prof, PHASE, INT64_C(1) << 50);
+
+	assert_within_error(weston_repaint_profiler_percentile(prof, PHASE, 50),
+			    1000);
+	assert(weston_repaint_profiler_percentile(prof, PHASE, 100) ==
+	       INT64_C(1) << 50);
+
+	weston_repaint_profiler_destroy(prof);
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "weston-test-runner.h"
+
+#include "repaint-window.h"
+
+TEST(percentile_needs_samples)
+{
+	struct weston_repaint_window *rw;
+	int i;
+
+	rw = weston_repaint_window_create();
+	assert(rw);
+
+	assert(weston_repaint_window_percentile(rw, 50) == -1);
+
+	for (i = 0; i < 200; i++)
+		weston_repaint_window_add_sample(rw, 1000);
+	assert(weston_repaint_window_percentile(rw, 50) == 1000);
+
+	weston_repaint_window_destroy(rw);
+}
+
+TEST(percentile_nearest_rank)
+{
+	struct weston_repaint_window *rw;
+	int i;
+
+	rw = weston_repaint_window_create();
+	assert(rw);
+
+	/* 1..100 in scrambled order */
+	for (i = 0; i < 100; i++)
+		weston_repaint_window_add_sample(rw, (i * 37) % 100 + 1);
+
+	assert(weston_repaint_window_percentile(rw, 1) == 1);
+	assert(weston_repaint_window_percentile(rw, 50) == 50);
+	assert(weston_repaint_window_percentile(rw, 99) == 99);
+	assert(weston_repaint_window_percentile(rw, 100) == 100);
+
+	weston_repaint_window_destroy(rw);
+}
+
+TEST(percentile_forgets_old_samples)
+{
+	struct weston_repaint_window *rw;
+	int i;
+
+	rw = weston_repaint_window_create();
+	assert(rw);
+
+	/* A slow spell followed by a long fast run */
+	for (i = 0; i < 50; i++)
+		weston_repaint_window_add_sample(rw, 9000000);
+	assert(weston_repaint_window_percentile(rw, 99) == 9000000);
+
+	for (i = 0; i < 1000; i++)
+		weston_repaint_window_add_sample(rw, 2000000);
+	assert(weston_repaint_window_percentile(rw, 99) == 2000000);
+
+	weston_repaint_window_destroy(rw);
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <libweston/libweston.h>
+#include <libweston/weston-log.h>
+#include "libweston-internal.h"
+#include "stats.h"
+#include "shared/helpers.h"
+#include "weston-test-runner.h"
+#include "weston-test-fixture-compositor.h"
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+
+	return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+struct stats_log {
+	struct weston_log_subscriber *subscriber;
+	FILE *fp;
+};
+
+static void
+stats_log_start(struct weston_compositor *compositor, struct stats_log *log)
+{
+	log->fp = tmpfile();
+	assert(log->fp);
+
+	/* Subscribing prints a snapshot right away. */
+	log->subscriber = weston_log_subscriber_create_log(log->fp);
+	assert(log->subscriber);
+	weston_log_subscribe(compositor->weston_log_ctx, log->subscriber,
+			     "stats");
+}
+
+/* Returns the value of key in the last line starting with what, or -1. */
+static int64_t
+stats_log_find(struct stats_log *log, const char *what, const char *key)
+{
+	char *line = NULL, *p;
+	size_t line_len = 0;
+	char pattern[64];
+	int64_t value = -1;
+
+	snprintf(pattern, sizeof pattern, " %s=", key);
+
+	fflush(log->fp);
+	rewind(log->fp);
+	while (getline(&line, &line_len, log->fp) > 0) {
+		assert(line[strlen(line) - 1] == '\n');
+
+		/* <sec>.<nsec> <what> key=value ... */
+		p = strchr(line, ' ');
+		assert(p && p[-1] != ' ' && strchr(line, '.') < p);
+		if (strncmp(p + 1, what, strlen(what)) != 0 ||
+		    p[1 + strlen(what)] != ' ')
+			continue;
+
+		p = strstr(p, pattern);
+		if (p)
+			value = strtoll(p + strlen(pattern), NULL, 10);
+	}
+	free(line);
+
+	return value;
+}
+
+static void
+stats_log_stop(struct stats_log *log)
+{
+	weston_log_subscriber_destroy(log->subscriber);
+	fclose(log->fp);
+}
+
+PLUGIN_TEST(output_counters_are_reported)
+{
+	/* struct weston_compositor *compositor; */
+	struct weston_output *output;
+	struct stats_log log;
+	char what[64];
+
+	output = container_of(compositor->output_list.next,
+			      struct weston_output, link);
+	snprintf(what, sizeof what, "output %s", output->name);
+
+	weston_output_count(output, WESTON_OUTPUT_DAMAGED_PIXELS, 320 * 240);
+	weston_output_count(output, WESTON_OUTPUT_VIEWS_OVERLAY, 2);
+	weston_output_count(output, WESTON_OUTPUT_VIEWS_OVERLAY, 1);
+
+	stats_log_start(compositor, &log);
+	assert(stats_log_find(&log, what, "damaged_pixels") >= 320 * 240);
+	assert(stats_log_find(&log, what, "views_overlay") == 3);
+	assert(stats_log_find(&log, what, "views_cursor") == 0);
+	assert(stats_log_find(&log, what, "missed_deadlines") >= 0);
+	stats_log_stop(&log);
+}
+
+PLUGIN_TEST(client_counters_are_reported)
+{
+	/* struct weston_compositor *compositor; */
+	struct wl_client *client;
+	struct stats_log log;
+	int fds[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+	client = wl_client_create(compositor->wl_display, fds[0]);
+	assert(client);
+
+	weston_client_count(compositor, client, WESTON_CLIENT_COMMITS, 5);
+	weston_client_count(compositor, client, WESTON_CLIENT_SHM_BYTES, 4096);
+	weston_client_count(compositor, client, WESTON_CLIENT_COMMITS, 1);
+
+	stats_log_start(compositor, &log);
+	assert(stats_log_find(&log, "client", "pid") == getpid());
+	assert(stats_log_find(&log, "client", "commits") == 6);
+	assert(stats_log_find(&log, "client", "shm_bytes") == 4096);
+	assert(stats_log_find(&log, "client", "dmabuf_imports") == 0);
+
+	/* Disconnecting prints the final counts. */
+	weston_client_count(compositor, client, WESTON_CLIENT_COMMITS, 1);
+	wl_client_destroy(client);
+	assert(stats_log_find(&log, "client", "commits") == 7);
+
+	stats_log_stop(&log);
+	close(fds[1]);
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libweston/libweston.h>
+#include <libweston/weston-log.h>
+#include "libweston-internal.h"
+#include "timeline.h"
+#include "shared/helpers.h"
+#include "shared/timeline-binary.h"
+#include "weston-test-runner.h"
+#include "weston-test-fixture-compositor.h"
+
+#define N_POINTS 3
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+
+	return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+PLUGIN_TEST(binary_stream_records_points)
+{
+	/* struct weston_compositor *compositor; */
+	struct weston_output *output;
+	struct weston_log_subscriber *subscriber;
+	struct timespec vblank = { .tv_sec = 12, .tv_nsec = 345 };
+	const struct timeline_binary_header *header;
+	char *data = NULL;
+	size_t len = 0;
+	size_t pos;
+	uint32_t output_id = 0;
+	int names = 0, outputs = 0, points = 0;
+	FILE *fp;
+	int i;
+
+	output = container_of(compositor->output_list.next,
+			      struct weston_output, link);
+
+	fp = open_memstream(&data, &len);
+	assert(fp);
+	subscriber = weston_log_subscriber_create_log(fp);
+	assert(subscriber);
+	weston_log_subscribe(compositor->weston_log_ctx, subscriber,
+			     "timeline-binary");
+	assert(weston_log_scope_is_enabled(compositor->timeline_binary));
+
+	for (i = 0; i < N_POINTS; i++)
+		TL_POINT(compositor, "test_point", TLP_OUTPUT(output),
+			 TLP_VBLANK(&vblank), TLP_END);
+
+	/* Unsubscribing writes out what is still buffered. */
+	weston_log_subscriber_destroy(subscriber);
+	fclose(fp);
+
+	assert(len >= sizeof(*header));
+	header = (const struct timeline_binary_header *)data;
+	assert(header->magic == TIMELINE_BINARY_MAGIC);
+	assert(header->version == TIMELINE_BINARY_VERSION);
+
+	for (pos = sizeof(*header); pos < len; ) {
+		const struct timeline_binary_record *rec =
+			(const struct timeline_binary_record *)(data + pos);
+		const char *payload = (const char *)(rec + 1);
+		const struct timeline_binary_point *point;
+
+		assert(pos + sizeof(*rec) <= len);
+		assert(rec->size % 8 == 0);
+		assert(pos + rec->size <= len);
+
+		switch (rec->type) {
+		case TIMELINE_BINARY_NAME:
+			assert(strcmp(payload, "test_point") == 0);
+			assert(rec->id == 1);
+			names++;
+			break;
+		case TIMELINE_BINARY_OUTPUT:
+			assert(strcmp(payload, output->name) == 0);
+			output_id = rec->id;
+			outputs++;
+			break;
+		case TIMELINE_BINARY_POINT:
+			point = (const struct timeline_binary_point *)payload;
+			assert(rec->id == 1);
+			assert(point->n_args == 2);
+			assert(point->args[0].type ==
+			       TIMELINE_BINARY_ARG_OUTPUT);
+			assert(point->args[0].value == output_id);
+			assert(point->args[1].type ==
+			       TIMELINE_BINARY_ARG_VBLANK);
+			assert(point->args[1].tv_sec == 12);
+			assert(point->args[1].value == 345);
+			points++;
+			break;
+		default:
+			assert(0 && "unexpected record");
+		}
+
+		pos += rec->size;
+	}
+
+	/* Names and objects are described once. */
+	assert(names == 1);
+	assert(outputs == 1);
+	assert(points == N_POINTS);
+
+	free(data);
+}
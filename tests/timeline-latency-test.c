@@ -0,0 +1,328 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "shared/timespec-util.h"
+#include "shared/timeline-binary.h"
+#include "shared/timeline-latency.h"
+#include "weston-test-client-helper.h"
+#include "weston-test-fixture-compositor.h"
+#include "weston-debug-client-protocol.h"
+
+#define N_EVENTS 5
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+
+	return weston_test_harness_execute_as_client(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+/* Show new content and wait until it has been repainted. */
+static void
+redraw(struct client *client)
+{
+	struct surface *surface = client->surface;
+	int done;
+
+	wl_surface_attach(surface->wl_surface, surface->buffer->proxy, 0, 0);
+	wl_surface_damage(surface->wl_surface, 0, 0, surface->width,
+			  surface->height);
+	frame_callback_set(surface->wl_surface, &done);
+	wl_surface_commit(surface->wl_surface);
+	frame_callback_wait(client, &done);
+}
+
+static struct timeline_latency *
+analyse_stream(FILE *fp)
+{
+	struct timeline_binary_header header;
+	struct timeline_binary_record rec;
+	uint64_t payload[65536 / sizeof(uint64_t)];
+	struct timeline_latency *lat;
+
+	lat = timeline_latency_create();
+	assert(lat);
+
+	rewind(fp);
+	assert(fread(&header, sizeof(header), 1, fp) == 1);
+	assert(header.magic == TIMELINE_BINARY_MAGIC);
+	assert(header.version == TIMELINE_BINARY_VERSION);
+
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		assert(rec.size >= sizeof(rec) && rec.size % 8 == 0);
+		if (rec.size > sizeof(rec))
+			assert(fread(payload, rec.size - sizeof(rec), 1, fp) == 1);
+		assert(timeline_latency_add_record(lat, &rec, payload) == 0);
+	}
+
+	return lat;
+}
+
+TEST(motion_to_present_latency)
+{
+	const struct timeline_latency_event *ev;
+	struct weston_debug_v1 *debug;
+	struct weston_debug_stream_v1 *stream;
+	struct timeline_latency *lat;
+	struct client *client;
+	struct timespec now;
+	uint32_t tv_sec_hi, tv_sec_lo, tv_nsec;
+	unsigned int i;
+	FILE *fp;
+
+	client = create_client_and_test_surface(100, 100, 100, 100);
+	assert(client);
+
+	fp = tmpfile();
+	assert(fp);
+	debug = bind_to_singleton_global(client, &weston_debug_v1_interface, 1);
+	stream = weston_debug_v1_subscribe(debug, "timeline-binary",
+					   fileno(fp));
+	client_roundtrip(client);
+
+	/* Every motion over the surface is answered with a new frame. */
+	for (i = 0; i < N_EVENTS; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timespec_to_proto(&now, &tv_sec_hi, &tv_sec_lo, &tv_nsec);
+		weston_test_move_pointer(client->test->weston_test, tv_sec_hi,
+					 tv_sec_lo, tv_nsec, 150 + i, 150);
+		client_roundtrip(client);
+		assert(client->input->pointer->focus == client->surface);
+
+		redraw(client);
+	}
+
+	/* The frame callback comes before the repaint finishes. Another
+	 * frame makes sure the last answer has been presented, and the
+	 * roundtrip that the recording has been written out. */
+	redraw(client);
+	client_roundtrip(client);
+
+	lat = analyse_stream(fp);
+
+	ev = timeline_latency_get_event(lat, 0);
+	assert(ev);
+	assert(strcmp(ev->name, "core_input_motion") == 0);
+	assert(ev->to_commit.count == N_EVENTS);
+	assert(ev->to_present.count == N_EVENTS);
+	for (i = 0; i < N_EVENTS; i++) {
+		assert(ev->to_commit.nsec[i] >= 0);
+		assert(ev->to_present.nsec[i] >= ev->to_commit.nsec[i]);
+	}
+	testlog("input to present: min %lld us, median %lld us, "
+		"max %lld us\n",
+		(long long)(ev->to_present.nsec[0] / 1000),
+		(long long)(timeline_latency_percentile(ev->to_present.nsec,
+							N_EVENTS, 50) / 1000),
+		(long long)(ev->to_present.nsec[N_EVENTS - 1] / 1000));
+
+	assert(!timeline_latency_get_event(lat, 1));
+	assert(timeline_latency_get_dropped(lat) == 0);
+
+	timeline_latency_destroy(lat);
+	weston_debug_stream_v1_destroy(stream);
+	weston_debug_v1_destroy(debug);
+	fclose(fp);
+	client_destroy(client);
+}
+
+TEST(name_id_out_of_range)
+{
+	struct timeline_binary_record rec;
+	uint64_t payload[2];
+	struct timeline_latency *lat;
+
+	lat = timeline_latency_create();
+	assert(lat);
+
+	memset(payload, 0, sizeof(payload));
+	strcpy((char *)payload, "core_commit");
+	rec.type = TIMELINE_BINARY_NAME;
+	rec.size = timeline_binary_record_size(sizeof(payload));
+
+	rec.id = TIMELINE_BINARY_MAX_NAMES;
+	assert(timeline_latency_add_record(lat, &rec, payload) == 0);
+
+	rec.id = 0;
+	assert(timeline_latency_add_record(lat, &rec, payload) < 0);
+	rec.id = TIMELINE_BINARY_MAX_NAMES + 1;
+	assert(timeline_latency_add_record(lat, &rec, payload) < 0);
+	rec.id = UINT32_MAX;
+	assert(timeline_latency_add_record(lat, &rec, payload) < 0);
+
+	/* A name that is not terminated within the record */
+	memset(payload, 'x', sizeof(payload));
+	rec.id = 1;
+	assert(timeline_latency_add_record(lat, &rec, payload) < 0);
+
+	timeline_latency_destroy(lat);
+}
+
+enum {
+	NAME_INPUT_KEY = 1,
+	NAME_COMMIT,
+	NAME_ASSIGN_PLANE,
+	NAME_FLUSH_DAMAGE,
+	NAME_KMS_COMMIT,
+	NAME_REPAINT_FINISHED,
+};
+
+#define MSEC(ms) ((ms) * 1000000LL)
+#define TEST_OUTPUT 3
+#define TEST_SURFACE 7
+
+static void
+feed_name(struct timeline_latency *lat, uint32_t id, const char *name)
+{
+	struct timeline_binary_record rec = {
+		.type = TIMELINE_BINARY_NAME,
+		.id = id,
+	};
+	uint64_t payload[8] = {};
+
+	assert(strlen(name) < sizeof(payload));
+	strcpy((char *)payload, name);
+	rec.size = timeline_binary_record_size(strlen(name) + 1);
+
+	assert(timeline_latency_add_record(lat, &rec, payload) == 0);
+}
+
+/* A point at time nsec, with an output or surface argument, or a
+ * timestamp of the given type */
+static void
+feed_point(struct timeline_latency *lat, uint32_t name, int64_t nsec,
+	   uint32_t output, uint32_t surface, uint32_t stamp_type,
+	   int64_t stamp_nsec)
+{
+	struct {
+		struct timeline_binary_point point;
+		struct timeline_binary_arg args[3];
+	} payload = {};
+	struct timeline_binary_record rec = {
+		.type = TIMELINE_BINARY_POINT,
+		.id = name,
+	};
+	struct timeline_binary_arg *arg = payload.args;
+
+	payload.point.tv_sec = nsec / MSEC(1000);
+	payload.point.tv_nsec = nsec % MSEC(1000);
+	if (output)
+		*arg++ = (struct timeline_binary_arg) {
+			.type = TIMELINE_BINARY_ARG_OUTPUT,
+			.value = output,
+		};
+	if (surface)
+		*arg++ = (struct timeline_binary_arg) {
+			.type = TIMELINE_BINARY_ARG_SURFACE,
+			.value = surface,
+		};
+	if (stamp_type)
+		*arg++ = (struct timeline_binary_arg) {
+			.type = stamp_type,
+			.value = stamp_nsec % MSEC(1000),
+			.tv_sec = stamp_nsec / MSEC(1000),
+		};
+	payload.point.n_args = arg - payload.args;
+	rec.size = timeline_binary_record_size(sizeof(payload.point) +
+					       payload.point.n_args *
+					       sizeof(payload.args[0]));
+
+	assert(timeline_latency_add_record(lat, &rec, &payload) == 0);
+}
+
+/* A key press answered at t0 + 1 ms, shown from a plane if on_plane */
+static void
+feed_key_response(struct timeline_latency *lat, int64_t t0, bool on_plane)
+{
+	feed_point(lat, NAME_INPUT_KEY, t0 + MSEC(1), 0, TEST_SURFACE,
+		   TIMELINE_BINARY_ARG_INPUT, t0);
+	feed_point(lat, NAME_COMMIT, t0 + MSEC(2), 0, TEST_SURFACE, 0, 0);
+	if (on_plane)
+		feed_point(lat, NAME_ASSIGN_PLANE, t0 + MSEC(4), TEST_OUTPUT,
+			   TEST_SURFACE, 0, 0);
+	feed_point(lat, NAME_FLUSH_DAMAGE, t0 + MSEC(5), TEST_OUTPUT,
+		   TEST_SURFACE, 0, 0);
+	feed_point(lat, NAME_KMS_COMMIT, t0 + MSEC(7), TEST_OUTPUT, 0, 0, 0);
+	/* A later commit must not count as the one showing the response. */
+	feed_point(lat, NAME_KMS_COMMIT, t0 + MSEC(9), TEST_OUTPUT, 0, 0, 0);
+	feed_point(lat, NAME_REPAINT_FINISHED, t0 + MSEC(20), TEST_OUTPUT, 0,
+		   TIMELINE_BINARY_ARG_VBLANK, t0 + MSEC(16));
+}
+
+TEST(drm_stage_latency)
+{
+	const struct timeline_latency_event *ev;
+	struct timeline_latency *lat;
+
+	lat = timeline_latency_create();
+	assert(lat);
+
+	feed_name(lat, NAME_INPUT_KEY, "core_input_key");
+	feed_name(lat, NAME_COMMIT, "core_commit");
+	feed_name(lat, NAME_ASSIGN_PLANE, "drm_assign_plane");
+	feed_name(lat, NAME_FLUSH_DAMAGE, "core_flush_damage");
+	feed_name(lat, NAME_KMS_COMMIT, "drm_kms_commit");
+	feed_name(lat, NAME_REPAINT_FINISHED, "core_repaint_finished");
+
+	feed_key_response(lat, MSEC(1000), true);
+	feed_key_response(lat, MSEC(1100), false);
+
+	ev = timeline_latency_get_event(lat, 0);
+	assert(ev);
+	assert(strcmp(ev->name, "core_input_key") == 0);
+
+	assert(ev->to_commit.count == 2);
+	assert(ev->to_commit.nsec[0] == MSEC(2));
+	assert(ev->to_commit.nsec[1] == MSEC(2));
+
+	/* Only the first response was on a plane. */
+	assert(ev->to_plane.count == 1);
+	assert(ev->to_plane.nsec[0] == MSEC(4));
+
+	assert(ev->to_kms.count == 2);
+	assert(ev->to_kms.nsec[0] == MSEC(7));
+	assert(ev->to_kms.nsec[1] == MSEC(7));
+
+	assert(ev->to_present.count == 2);
+	assert(ev->to_present.nsec[0] == MSEC(16));
+	assert(ev->to_present.nsec[1] == MSEC(16));
+
+	assert(!timeline_latency_get_event(lat, 1));
+	assert(timeline_latency_get_dropped(lat) == 0);
+
+	timeline_latency_destroy(lat);
+}
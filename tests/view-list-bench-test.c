@@ -0,0 +1,160 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <libweston/libweston.h>
+#include "libweston-internal.h"
+#include "compositor/weston.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+#include "weston-test-runner.h"
+#include "weston-test-fixture-compositor.h"
+
+#define BENCH_VIEWS 500
+#define BENCH_ITERATIONS 200
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+
+	return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+static int
+count_z_order_list(struct weston_output *output)
+{
+	struct weston_paint_node *pnode;
+	int n = 0;
+
+	wl_list_for_each(pnode, &output->paint_node_z_order_list, z_order_link)
+		n++;
+
+	return n;
+}
+
+static int64_t
+bench_build_view_list(struct weston_compositor *compositor,
+		      struct weston_output *output,
+		      struct weston_view *restack)
+{
+	struct timespec begin, end;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		/* Re-inserting a view in place is a scene graph change
+		 * that leaves the resulting stacking order intact. */
+		if (restack) {
+			struct weston_layer_entry *prev =
+				container_of(restack->layer_link.link.prev,
+					     struct weston_layer_entry, link);
+
+			weston_layer_entry_remove(&restack->layer_link);
+			weston_layer_entry_insert(prev, &restack->layer_link);
+		}
+		weston_compositor_build_view_list(compositor, output);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return timespec_sub_to_nsec(&end, &begin) / BENCH_ITERATIONS;
+}
+
+PLUGIN_TEST(view_list_rebuild_only_when_dirty)
+{
+	/* struct weston_compositor *compositor; */
+	struct weston_output *output;
+	struct weston_layer layer;
+	struct weston_view *views[BENCH_VIEWS];
+	struct weston_view *first;
+	uint32_t generation;
+	int64_t clean_nsec, dirty_nsec;
+	int n_nodes;
+	int i;
+
+	assert(!wl_list_empty(&compositor->output_list));
+	output = container_of(compositor->output_list.next,
+			      struct weston_output, link);
+
+	weston_layer_init(&layer, compositor);
+	weston_layer_set_position(&layer, WESTON_LAYER_POSITION_NORMAL);
+
+	for (i = 0; i < BENCH_VIEWS; i++) {
+		struct weston_surface *surface;
+
+		surface = weston_surface_create(compositor);
+		assert(surface);
+		weston_surface_set_size(surface, 16, 16);
+		views[i] = weston_view_create(surface);
+		assert(views[i]);
+		weston_view_set_position(views[i], (i * 7) % 300,
+					 (i * 13) % 220);
+		weston_layer_entry_insert(&layer.view_list,
+					  &views[i]->layer_link);
+	}
+
+	weston_compositor_build_view_list(compositor, output);
+	generation = compositor->view_list_generation;
+	assert(output->z_order_list_generation == generation);
+	n_nodes = count_z_order_list(output);
+	assert(n_nodes >= BENCH_VIEWS);
+	first = container_of(compositor->view_list.next,
+			     struct weston_view, link);
+
+	/* Unchanged scene: the lists must be reused untouched. */
+	clean_nsec = bench_build_view_list(compositor, output, NULL);
+	assert(compositor->view_list_generation == generation);
+	assert(count_z_order_list(output) == n_nodes);
+	assert(first == container_of(compositor->view_list.next,
+				     struct weston_view, link));
+
+	/* Every iteration mutates the scene graph: full rebuilds. */
+	dirty_nsec = bench_build_view_list(compositor, output,
+					   views[BENCH_VIEWS / 2]);
+	assert(compositor->view_list_generation != generation);
+	assert(output->z_order_list_generation ==
+	       compositor->view_list_generation);
+	assert(count_z_order_list(output) == n_nodes);
+
+	testlog("%d views: unchanged frame %lld ns, "
+		"changed frame %lld ns per view list build\n",
+		BENCH_VIEWS, (long long)clean_nsec, (long long)dirty_nsec);
+
+	for (i = 0; i < BENCH_VIEWS; i++) {
+		struct weston_surface *surface = views[i]->surface;
+
+		weston_view_destroy(views[i]);
+		weston_surface_destroy(surface);
+	}
+	weston_layer_fini(&layer);
+}
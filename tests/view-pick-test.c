@@ -0,0 +1,180 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <libweston/libweston.h>
+#include "libweston-internal.h"
+#include "compositor/weston.h"
+#include "shared/helpers.h"
+#include "weston-test-runner.h"
+#include "weston-test-fixture-compositor.h"
+
+#define N_VIEWS 200
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+	/* for the clip masks */
+	setup.renderer = RENDERER_PIXMAN;
+
+	return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+/* The plain view list walk weston_compositor_pick_view() must agree with. */
+static struct weston_view *
+reference_pick_view(struct weston_compositor *compositor,
+		    wl_fixed_t x, wl_fixed_t y)
+{
+	struct weston_view *view;
+	wl_fixed_t view_x, view_y;
+	int view_ix, view_iy;
+	int ix = wl_fixed_to_int(x);
+	int iy = wl_fixed_to_int(y);
+
+	wl_list_for_each(view, &compositor->view_list, link) {
+		if (!pixman_region32_contains_point(
+				&view->transform.boundingbox, ix, iy, NULL))
+			continue;
+
+		weston_view_from_global_fixed(view, x, y, &view_x, &view_y);
+		view_ix = wl_fixed_to_int(view_x);
+		view_iy = wl_fixed_to_int(view_y);
+		if (!pixman_region32_contains_point(&view->surface->input,
+						    view_ix, view_iy, NULL))
+			continue;
+
+		if (view->geometry.scissor_enabled &&
+		    !pixman_region32_contains_point(&view->geometry.scissor,
+						    view_ix, view_iy, NULL))
+			continue;
+
+		return view;
+	}
+
+	return NULL;
+}
+
+static int
+compare_picks(struct weston_compositor *compositor)
+{
+	struct weston_view *view;
+	wl_fixed_t vx, vy;
+	int x, y;
+	int hits = 0;
+
+	/* Cover the output and a margin around it. */
+	for (y = -50; y < 300; y += 3) {
+		for (x = -50; x < 380; x += 3) {
+			wl_fixed_t fx = wl_fixed_from_int(x);
+			wl_fixed_t fy = wl_fixed_from_int(y);
+
+			view = weston_compositor_pick_view(compositor, fx, fy,
+							   &vx, &vy);
+			assert(view == reference_pick_view(compositor, fx, fy));
+			if (view)
+				hits++;
+		}
+	}
+
+	return hits;
+}
+
+PLUGIN_TEST(pick_view_matches_view_list_walk)
+{
+	/* struct weston_compositor *compositor; */
+	struct weston_output *output;
+	struct weston_layer layer;
+	struct weston_view *views[N_VIEWS];
+	int i;
+
+	output = container_of(compositor->output_list.next,
+			      struct weston_output, link);
+
+	weston_layer_init(&layer, compositor);
+	weston_layer_set_position(&layer, WESTON_LAYER_POSITION_NORMAL);
+
+	for (i = 0; i < N_VIEWS; i++) {
+		struct weston_surface *surface;
+		int w = 10 + (i * 37) % 150;
+		int h = 10 + (i * 53) % 120;
+
+		surface = weston_surface_create(compositor);
+		assert(surface);
+		weston_surface_set_size(surface, w, h);
+
+		/* Some surfaces only take input in their top-left quarter. */
+		if (i % 3 == 0) {
+			pixman_region32_fini(&surface->input);
+			pixman_region32_init_rect(&surface->input, 0, 0,
+						  w / 2, h / 2);
+		}
+
+		views[i] = weston_view_create(surface);
+		assert(views[i]);
+		weston_view_set_position(views[i], (i * 71) % 400 - 40,
+					 (i * 29) % 300 - 30);
+
+		/* Some views are clipped to their middle. */
+		if (i % 5 == 1)
+			weston_view_set_mask(views[i], w / 4, h / 4,
+					     w / 2, h / 2);
+		weston_layer_entry_insert(&layer.view_list,
+					  &views[i]->layer_link);
+	}
+
+	weston_compositor_build_view_list(compositor, output);
+	assert(compare_picks(compositor) > 0);
+
+	/* Views moving around must be reflected without a list rebuild. */
+	for (i = 0; i < N_VIEWS; i += 4) {
+		weston_view_set_position(views[i], views[i]->geometry.x + 33,
+					 views[i]->geometry.y - 17);
+		weston_view_update_transform(views[i]);
+	}
+	assert(compare_picks(compositor) > 0);
+
+	/* Restacking rebuilds the list. */
+	weston_layer_entry_remove(&views[N_VIEWS - 1]->layer_link);
+	weston_layer_entry_insert(&layer.view_list,
+				  &views[N_VIEWS - 1]->layer_link);
+	weston_compositor_build_view_list(compositor, output);
+	assert(compare_picks(compositor) > 0);
+
+	for (i = 0; i < N_VIEWS; i++) {
+		struct weston_surface *surface = views[i]->surface;
+
+		weston_view_destroy(views[i]);
+		weston_surface_destroy(surface);
+	}
+	weston_layer_fini(&layer);
+}
@@ -0,0 +1,497 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "weston-test-runner.h"
+
+#include "shared/wcap-decode.h"
+#include "shared/wcap-rle.h"
+#include "recorder-encode.h"
+
+#define WIDTH 61
+#define HEIGHT 17
+#define N_PIXELS (WIDTH * HEIGHT)
+#define N_FRAMES 10
+#define KEY_INTERVAL 4
+
+struct stream {
+	uint8_t *data;
+	size_t size;
+};
+
+static void
+stream_append(struct stream *stream, const void *data, size_t len)
+{
+	stream->data = realloc(stream->data, stream->size + len);
+	assert(stream->data);
+	memcpy(stream->data + stream->size, data, len);
+	stream->size += len;
+}
+
+static uint32_t
+next_random(uint32_t *state)
+{
+	/* xorshift32 */
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+/* Frames where a band of rows changes from one frame to the next */
+static uint32_t *
+make_frames(void)
+{
+	uint32_t *frames = malloc(N_FRAMES * N_PIXELS * sizeof *frames);
+	uint32_t state = 1;
+	int f, i;
+
+	assert(frames);
+
+	for (i = 0; i < N_PIXELS; i++)
+		frames[i] = next_random(&state) & 0x00ffffff;
+
+	for (f = 1; f < N_FRAMES; f++) {
+		uint32_t *frame = frames + f * N_PIXELS;
+		int band = (f * 5 % HEIGHT) * WIDTH;
+
+		memcpy(frame, frame - N_PIXELS, N_PIXELS * sizeof *frame);
+		for (i = band; i < band + 3 * WIDTH && i < N_PIXELS; i++)
+			frame[i] = next_random(&state) & 0x00ffffff;
+	}
+
+	return frames;
+}
+
+/* Append a frame covering the whole screen, the way the recorder
+ * encodes it: against ref, or against black for key frames. */
+static void
+append_frame(struct stream *stream, uint32_t version, const uint32_t *next,
+	     uint32_t *ref, bool key, uint32_t msecs)
+{
+	const struct wcap_kernels *kernels = wcap_kernels_get();
+	struct wcap_rectangle rect = { 0, 0, WIDTH, HEIGHT };
+	struct wcap_run run;
+	uint32_t *out = malloc((N_PIXELS + 1) * sizeof *out);
+	uint32_t *p = out;
+	int j;
+
+	assert(out);
+
+	if (version == 2) {
+		struct wcap_frame_header_v2 header = {
+			.msecs = msecs,
+			.nrects = 1,
+			.flags = key ? WCAP_FRAME_KEY : 0,
+		};
+		stream_append(stream, &header, sizeof header);
+	} else {
+		struct wcap_frame_header header = {
+			.msecs = msecs,
+			.nrects = 1,
+		};
+		stream_append(stream, &header, sizeof header);
+	}
+	stream_append(stream, &rect, sizeof rect);
+
+	wcap_run_init(&run);
+	for (j = HEIGHT - 1; j >= 0; j--)
+		p = kernels->encode(p, next + WIDTH * j,
+				    key ? NULL : ref + WIDTH * j, WIDTH, &run);
+	p = wcap_run_flush(p, &run);
+	if (key)
+		memcpy(ref, next, N_PIXELS * sizeof *ref);
+
+	stream_append(stream, out, (p - out) * sizeof *out);
+	free(out);
+}
+
+/* Returns the offset of the footer, or 0 if there is no index. */
+static size_t
+make_stream(struct stream *stream, uint32_t version, bool with_index,
+	    const uint32_t *frames)
+{
+	struct wcap_header header = {
+		.magic = version == 2 ? WCAP_HEADER_MAGIC_V2 :
+					WCAP_HEADER_MAGIC,
+		.format = WCAP_FORMAT_XRGB8888,
+		.width = WIDTH,
+		.height = HEIGHT,
+	};
+	struct wcap_index_entry index[N_FRAMES];
+	struct wcap_index_footer footer;
+	static const uint8_t padding[sizeof(uint64_t)];
+	uint32_t ref[N_PIXELS];
+	bool key;
+	int f;
+
+	memset(stream, 0, sizeof *stream);
+	memset(ref, 0, sizeof ref);
+	stream_append(stream, &header, sizeof header);
+
+	for (f = 0; f < N_FRAMES; f++) {
+		key = version == 2 && f % KEY_INTERVAL == 0;
+		index[f].offset = stream->size;
+		index[f].msecs = f * 16;
+		index[f].flags = key ? WCAP_FRAME_KEY : 0;
+		append_frame(stream, version, frames + f * N_PIXELS, ref, key,
+			     f * 16);
+	}
+
+	if (!with_index)
+		return 0;
+
+	if (stream->size % sizeof(uint64_t))
+		stream_append(stream, padding,
+			      sizeof(uint64_t) -
+			      stream->size % sizeof(uint64_t));
+	footer.magic = WCAP_INDEX_MAGIC;
+	footer.nframes = N_FRAMES;
+	footer.offset = stream->size;
+	stream_append(stream, index, sizeof index);
+	stream_append(stream, &footer, sizeof footer);
+
+	return stream->size - sizeof footer;
+}
+
+static struct wcap_decoder *
+open_stream(const struct stream *stream)
+{
+	struct wcap_decoder *decoder;
+	char path[] = "/tmp/weston-wcap-decode-test-XXXXXX";
+	int fd;
+
+	fd = mkstemp(path);
+	assert(fd >= 0);
+	assert(write(fd, stream->data, stream->size) ==
+	       (ssize_t) stream->size);
+	close(fd);
+
+	decoder = wcap_decoder_create(path);
+	unlink(path);
+	assert(decoder);
+
+	return decoder;
+}
+
+static void
+assert_frame(const struct wcap_decoder *decoder, const uint32_t *frames,
+	     uint32_t n)
+{
+	const uint32_t *expected = frames + n * N_PIXELS;
+	int i;
+
+	assert(decoder->count == n + 1);
+	for (i = 0; i < N_PIXELS; i++)
+		assert(decoder->frame[i] == (expected[i] | 0xff000000));
+}
+
+/* Forwards, backwards, to the same frame, across key frames */
+static const uint32_t seeks[] = { 5, 9, 9, 2, 0, 7, 4, 3, 8, 1, 6 };
+
+static void
+assert_seeking(struct wcap_decoder *decoder, const uint32_t *frames)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_LENGTH(seeks); i++) {
+		assert(wcap_decoder_seek(decoder, seeks[i]));
+		assert_frame(decoder, frames, seeks[i]);
+	}
+}
+
+static void
+assert_sequential(struct wcap_decoder *decoder, const uint32_t *frames)
+{
+	uint32_t f;
+
+	for (f = 0; f < N_FRAMES; f++) {
+		assert(wcap_decoder_get_frame(decoder));
+		assert(decoder->msecs == f * 16);
+		assert_frame(decoder, frames, f);
+	}
+}
+
+TEST(v2_seek_matches_sequential_replay)
+{
+	uint32_t *frames = make_frames();
+	struct wcap_decoder *decoder;
+	struct stream stream;
+
+	make_stream(&stream, 2, true, frames);
+
+	decoder = open_stream(&stream);
+	assert(decoder->version == 2);
+	assert(decoder->index);
+	assert(decoder->nframes == N_FRAMES);
+	assert_sequential(decoder, frames);
+	/* The index is not taken for a frame. */
+	assert(!wcap_decoder_get_frame(decoder));
+	wcap_decoder_destroy(decoder);
+
+	decoder = open_stream(&stream);
+	assert_seeking(decoder, frames);
+	assert(!wcap_decoder_seek(decoder, N_FRAMES));
+	wcap_decoder_destroy(decoder);
+
+	free(stream.data);
+	free(frames);
+}
+
+TEST(v2_without_index_is_replayed)
+{
+	uint32_t *frames = make_frames();
+	struct wcap_decoder *decoder;
+	struct stream stream;
+
+	/* As left by a capture that was not stopped cleanly */
+	make_stream(&stream, 2, false, frames);
+
+	decoder = open_stream(&stream);
+	assert(decoder->version == 2);
+	assert(!decoder->index);
+	assert_seeking(decoder, frames);
+	assert(!wcap_decoder_seek(decoder, N_FRAMES));
+	wcap_decoder_destroy(decoder);
+
+	free(stream.data);
+	free(frames);
+}
+
+TEST(v1_is_replayed)
+{
+	uint32_t *frames = make_frames();
+	struct wcap_decoder *decoder;
+	struct stream stream;
+
+	make_stream(&stream, 1, false, frames);
+
+	decoder = open_stream(&stream);
+	assert(decoder->version == 1);
+	assert(!decoder->index);
+	assert_sequential(decoder, frames);
+	assert(!wcap_decoder_get_frame(decoder));
+	wcap_decoder_destroy(decoder);
+
+	decoder = open_stream(&stream);
+	assert_seeking(decoder, frames);
+	wcap_decoder_destroy(decoder);
+
+	free(stream.data);
+	free(frames);
+}
+
+enum corruption {
+	CORRUPT_MAGIC,
+	CORRUPT_NO_FRAMES,
+	CORRUPT_TOO_MANY_FRAMES,
+	CORRUPT_OFFSET_PAST_END,
+	CORRUPT_OFFSET_UNALIGNED,
+	CORRUPT_OFFSET_IN_HEADER,
+	CORRUPT_ENTRY_PAST_INDEX,
+	CORRUPT_ENTRIES_OUT_OF_ORDER,
+	CORRUPT_TRUNCATED,
+};
+
+static const enum corruption corruptions[] = {
+	CORRUPT_MAGIC,
+	CORRUPT_NO_FRAMES,
+	CORRUPT_TOO_MANY_FRAMES,
+	CORRUPT_OFFSET_PAST_END,
+	CORRUPT_OFFSET_UNALIGNED,
+	CORRUPT_OFFSET_IN_HEADER,
+	CORRUPT_ENTRY_PAST_INDEX,
+	CORRUPT_ENTRIES_OUT_OF_ORDER,
+	CORRUPT_TRUNCATED,
+};
+
+/* A damaged index is not used: the frames are replayed instead, and
+ * nothing is read from where the index claims to be. */
+TEST_P(v2_corrupt_index_is_ignored, corruptions)
+{
+	const enum corruption *corruption = data;
+	uint32_t *frames = make_frames();
+	struct wcap_decoder *decoder;
+	struct wcap_index_footer *footer;
+	struct wcap_index_entry *index;
+	struct stream stream;
+	size_t footer_offset;
+
+	footer_offset = make_stream(&stream, 2, true, frames);
+	footer = (void *) (stream.data + footer_offset);
+	index = (void *) (stream.data + footer->offset);
+
+	switch (*corruption) {
+	case CORRUPT_MAGIC:
+		footer->magic = WCAP_HEADER_MAGIC_V2;
+		break;
+	case CORRUPT_NO_FRAMES:
+		footer->nframes = 0;
+		break;
+	case CORRUPT_TOO_MANY_FRAMES:
+		footer->nframes = N_FRAMES + 1;
+		break;
+	case CORRUPT_OFFSET_PAST_END:
+		footer->offset = stream.size;
+		break;
+	case CORRUPT_OFFSET_UNALIGNED:
+		footer->offset += 4;
+		break;
+	case CORRUPT_OFFSET_IN_HEADER:
+		footer->offset = 0;
+		break;
+	case CORRUPT_ENTRY_PAST_INDEX:
+		index[N_FRAMES - 1].offset = footer->offset;
+		break;
+	case CORRUPT_ENTRIES_OUT_OF_ORDER:
+		index[3].offset = index[2].offset;
+		break;
+	case CORRUPT_TRUNCATED:
+		stream.size -= 4;
+		break;
+	}
+
+	decoder = open_stream(&stream);
+	assert(decoder->version == 2);
+	assert(!decoder->index);
+	assert_seeking(decoder, frames);
+	wcap_decoder_destroy(decoder);
+
+	free(stream.data);
+	free(frames);
+}
+
+/* The rows of a frame that changed from the previous one, or all of the
+ * first frame, and a corner that did not change, as a renderer might
+ * damage more than what changed */
+static void
+frame_damage(pixman_region32_t *damage, int f)
+{
+	int band = f * 5 % HEIGHT;
+
+	if (f == 0) {
+		pixman_region32_init_rect(damage, 0, 0, WIDTH, HEIGHT);
+		return;
+	}
+
+	pixman_region32_init_rect(damage, 0, band, WIDTH,
+				  MIN(3, HEIGHT - band));
+	pixman_region32_union_rect(damage, damage, WIDTH - 7, 0, 7, 2);
+}
+
+/* The damaged pixels of a frame, as the recorder reads them back */
+static uint32_t *
+read_back(const uint32_t *frame, pixman_region32_t *damage, bool yflip)
+{
+	uint32_t *pixels = malloc(N_PIXELS * sizeof *pixels);
+	uint32_t *p = pixels;
+	pixman_box32_t *r;
+	int i, n, width, y;
+
+	assert(pixels);
+
+	r = pixman_region32_rectangles(damage, &n);
+	for (i = 0; i < n; i++) {
+		width = r[i].x2 - r[i].x1;
+		for (y = r[i].y1; y < r[i].y2; y++) {
+			int row = yflip ? r[i].y2 - 1 - (y - r[i].y1) : y;
+
+			memcpy(p, frame + row * WIDTH + r[i].x1,
+			       width * sizeof *p);
+			p += width;
+		}
+	}
+
+	return pixels;
+}
+
+static const bool yflips[] = { false, true };
+
+/* What the recorder writes is what the decoder reads back, frame by
+ * frame and when seeking. */
+TEST_P(recorder_stream_round_trip, yflips)
+{
+	const bool *yflip = data;
+	uint32_t *frames = make_frames();
+	struct weston_recorder_encoder encoder;
+	struct wcap_decoder *decoder;
+	char path[] = "/tmp/weston-wcap-decode-test-XXXXXX";
+	pixman_region32_t damage;
+	uint32_t *pixels;
+	int f, fd;
+
+	fd = mkstemp(path);
+	assert(fd >= 0);
+
+	assert(weston_recorder_encoder_init(&encoder, fd, WIDTH, HEIGHT,
+					    *yflip) == 0);
+	encoder.keyframe_interval = KEY_INTERVAL;
+	assert(weston_recorder_write_header(&encoder,
+					    WCAP_FORMAT_XRGB8888) == 0);
+
+	for (f = 0; f < N_FRAMES; f++) {
+		frame_damage(&damage, f);
+		pixels = read_back(frames + f * N_PIXELS, &damage, *yflip);
+		weston_recorder_encode_capture(&encoder, f * 16, &damage,
+					       pixels);
+		pixman_region32_fini(&damage);
+		free(pixels);
+	}
+	weston_recorder_encode_index(&encoder);
+	weston_recorder_write_out(&encoder);
+
+	assert(encoder.write_errno == 0);
+	assert(encoder.count == N_FRAMES);
+	weston_recorder_encoder_fini(&encoder);
+	close(fd);
+
+	decoder = wcap_decoder_create(path);
+	assert(decoder);
+	assert(decoder->version == 2);
+	assert(decoder->width == WIDTH && decoder->height == HEIGHT);
+	assert(decoder->index);
+	assert(decoder->nframes == N_FRAMES);
+	assert_sequential(decoder, frames);
+	assert(!wcap_decoder_get_frame(decoder));
+	wcap_decoder_destroy(decoder);
+
+	decoder = wcap_decoder_create(path);
+	assert(decoder);
+	assert_seeking(decoder, frames);
+	wcap_decoder_destroy(decoder);
+
+	unlink(path);
+	free(frames);
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright © 2026 agent
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "weston-test-runner.h"
+#include "shared/timespec-util.h"
+
+#include "shared/wcap-rle.h"
+
+#define WIDTH 203
+#define HEIGHT 37
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+#define BENCH_ITERATIONS 20
+
+static uint32_t
+next_random(uint32_t *state)
+{
+	/* xorshift32 */
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+/* A previous and a next frame with unchanged areas, flat color changes,
+ * noise and runs longer than one run length word covers. */
+static void
+fill_frames(uint32_t *prev, uint32_t *next, int width, int height,
+	    uint32_t seed)
+{
+	uint32_t state = seed;
+	int i, n = width * height;
+
+	for (i = 0; i < n; i++)
+		prev[i] = next_random(&state);
+
+	memcpy(next, prev, n * sizeof *next);
+	for (i = 0; i < n; i++) {
+		switch ((i / 97) % 5) {
+		case 0:
+			break;
+		case 1:
+			next[i] = prev[i] + 0x00010203;
+			break;
+		case 2:
+			next[i] = next_random(&state);
+			break;
+		case 3:
+			next[i] = 0xff336699;
+			break;
+		case 4:
+			/* Only X changes, which is no change */
+			next[i] = prev[i] ^ 0xff000000;
+			break;
+		}
+	}
+
+	for (i = n / 3; i < n / 3 + 600 && i < n; i++)
+		next[i] = prev[i];
+}
+
+/* Encode a frame the way the recorder encodes a rectangle, bottom row
+ * first, and return the number of words. */
+static size_t
+encode_frame(const struct wcap_kernels *kernels, uint32_t *out,
+	     const uint32_t *next, uint32_t *ref, int width, int height)
+{
+	struct wcap_run run;
+	uint32_t *p = out;
+	int j;
+
+	wcap_run_init(&run);
+	for (j = height - 1; j >= 0; j--)
+		p = kernels->encode(p, next + width * j,
+				    ref ? ref + width * j : NULL, width, &run);
+	p = wcap_run_flush(p, &run);
+
+	return p - out;
+}
+
+/* Decode a frame the way wcap-decode decodes a rectangle. */
+static void
+decode_frame(const struct wcap_kernels *kernels, uint32_t *frame,
+	     const uint32_t *in, size_t len, int width, int height)
+{
+	uint32_t *d = frame + (height - 1) * width;
+	int x = 0, rows = 0, j, k, l;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		l = in[i] >> 24;
+		j = l < 0xe0 ? l + 1 : 1 << (l - 0xe0 + 7);
+
+		while (j > 0) {
+			k = width - x < j ? width - x : j;
+			kernels->apply(d + x, in[i], k);
+			x += k;
+			j -= k;
+			if (x == width) {
+				x = 0;
+				d -= width;
+				rows++;
+			}
+		}
+	}
+
+	assert(x == 0 && rows == height);
+}
+
+TEST(encode_is_bit_exact)
+{
+	const struct wcap_kernels *scalar = NULL, *kernels;
+	int n = WIDTH * HEIGHT;
+	uint32_t *prev = malloc(n * sizeof *prev);
+	uint32_t *next = malloc(n * sizeof *next);
+	uint32_t *ref = malloc(n * sizeof *ref);
+	uint32_t *ref_scalar = malloc(n * sizeof *ref);
+	uint32_t *out = malloc(n * sizeof *out);
+	uint32_t *out_scalar = malloc(n * sizeof *out);
+	size_t len, len_scalar;
+	uint32_t seed;
+	int i;
+
+	assert(prev && next && ref && ref_scalar && out && out_scalar);
+
+	for (i = 0; (kernels = wcap_kernels_enumerate(i)); i++)
+		scalar = kernels;
+	assert(strcmp(scalar->name, "scalar") == 0);
+
+	for (i = 0; (kernels = wcap_kernels_enumerate(i)); i++) {
+		testlog("checking %s\n", kernels->name);
+
+		for (seed = 1; seed < 20; seed++) {
+			fill_frames(prev, next, WIDTH, HEIGHT, seed);
+
+			memcpy(ref_scalar, prev, n * sizeof *prev);
+			len_scalar = encode_frame(scalar, out_scalar, next,
+						  ref_scalar, WIDTH, HEIGHT);
+			memcpy(ref, prev, n * sizeof *prev);
+			len = encode_frame(kernels, out, next, ref,
+					   WIDTH, HEIGHT);
+
+			assert(len == len_scalar);
+			assert(memcmp(out, out_scalar, len * 4) == 0);
+			assert(memcmp(ref, ref_scalar, n * 4) == 0);
+			assert(memcmp(ref, next, n * 4) == 0);
+
+			/* Against black, as for key frames */
+			len_scalar = encode_frame(scalar, out_scalar, next,
+						  NULL, WIDTH, HEIGHT);
+			len = encode_frame(kernels, out, next, NULL,
+					   WIDTH, HEIGHT);
+			assert(len == len_scalar);
+			assert(memcmp(out, out_scalar, len * 4) == 0);
+		}
+	}
+
+	free(prev);
+	free(next);
+	free(ref);
+	free(ref_scalar);
+	free(out);
+	free(out_scalar);
+}
+
+TEST(round_trip)
+{
+	const struct wcap_kernels *encoder, *decoder;
+	int n = WIDTH * HEIGHT;
+	uint32_t *prev = malloc(n * sizeof *prev);
+	uint32_t *next = malloc(n * sizeof *next);
+	uint32_t *ref = malloc(n * sizeof *ref);
+	uint32_t *frame = malloc(n * sizeof *frame);
+	uint32_t *out = malloc(n * sizeof *out);
+	size_t len;
+	int i, j, k;
+
+	assert(prev && next && ref && frame && out);
+
+	for (i = 0; (encoder = wcap_kernels_enumerate(i)); i++) {
+		for (j = 0; (decoder = wcap_kernels_enumerate(j)); j++) {
+			fill_frames(prev, next, WIDTH, HEIGHT, 7 + i * 13 + j);
+
+			memcpy(ref, prev, n * sizeof *prev);
+			len = encode_frame(encoder, out, next, ref,
+					   WIDTH, HEIGHT);
+
+			memcpy(frame, prev, n * sizeof *prev);
+			decode_frame(decoder, frame, out, len, WIDTH, HEIGHT);
+			for (k = 0; k < n; k++)
+				assert(frame[k] == (next[k] | 0xff000000));
+
+			len = encode_frame(encoder, out, next, NULL,
+					   WIDTH, HEIGHT);
+			memset(frame, 0, n * sizeof *frame);
+			decode_frame(decoder, frame, out, len, WIDTH, HEIGHT);
+			for (k = 0; k < n; k++)
+				assert(frame[k] == (next[k] | 0xff000000));
+		}
+	}
+
+	free(prev);
+	free(next);
+	free(ref);
+	free(frame);
+	free(out);
+}
+
+/* A desktop frame where a window moved: a tenth of the pixels change. */
+TEST(benchmark)
+{
+	const struct wcap_kernels *kernels;
+	int n = BENCH_WIDTH * BENCH_HEIGHT;
+	uint32_t *prev = malloc(n * sizeof *prev);
+	uint32_t *next = malloc(n * sizeof *next);
+	uint32_t *ref = malloc(n * sizeof *ref);
+	uint32_t *out = malloc(n * sizeof *out);
+	struct timespec begin, end;
+	int64_t encode_nsec, decode_nsec;
+	uint32_t state = 1;
+	size_t len = 0;
+	int i, k;
+
+	assert(prev && next && ref && out);
+
+	for (k = 0; k < n; k++)
+		prev[k] = 0xff202020 + (k / BENCH_WIDTH / 64) * 0x010101;
+	memcpy(next, prev, n * sizeof *next);
+	for (k = 0; k < n / 10; k++)
+		next[n / 2 + k] = next_random(&state);
+
+	for (i = 0; (kernels = wcap_kernels_enumerate(i)); i++) {
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		for (k = 0; k < BENCH_ITERATIONS; k++) {
+			memcpy(ref, prev, n * sizeof *prev);
+			len = encode_frame(kernels, out, next, ref,
+					   BENCH_WIDTH, BENCH_HEIGHT);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		encode_nsec = timespec_sub_to_nsec(&end, &begin) /
+			      BENCH_ITERATIONS;
+
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		for (k = 0; k < BENCH_ITERATIONS; k++) {
+			memcpy(ref, prev, n * sizeof *prev);
+			decode_frame(kernels, ref, out, len,
+				     BENCH_WIDTH, BENCH_HEIGHT);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		decode_nsec = timespec_sub_to_nsec(&end, &begin) /
+			      BENCH_ITERATIONS;
+
+		testlog("%s: %dx%d frame, encode %lld us, decode %lld us, "
+			"%zu words\n", kernels->name, BENCH_WIDTH,
+			BENCH_HEIGHT, (long long)(encode_nsec / 1000),
+			(long long)(decode_nsec / 1000), len);
+	}
+
+	free(prev);
+	free(next);
+	free(ref);
+	free(out);
+}
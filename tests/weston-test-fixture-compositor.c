@@ -190,6 +190,7 @@ compositor_setup_defaults_(struct compositor_setup *setup,
 		.config_file = NULL,
 		.extra_module = NULL,
 		.logging_scopes = NULL,
+		.drm_device = NULL,
 		.testset_name = testset_name,
 	};
 }
@@ -352,7 +353,9 @@ execute_compositor(const struct compositor_setup *setup,
 
 	if (setup->backend == WESTON_BACKEND_DRM) {
 
-		drm_device = getenv("WESTON_TEST_SUITE_DRM_DEVICE");
+		drm_device = setup->drm_device;
+		if (!drm_device)
+			drm_device = getenv("WESTON_TEST_SUITE_DRM_DEVICE");
 		if (!drm_device) {
 			fprintf(stderr, "Skipping DRM-backend tests because " \
 				"WESTON_TEST_SUITE_DRM_DEVICE is not set. " \
@@ -367,9 +370,12 @@ execute_compositor(const struct compositor_setup *setup,
 
 		prog_args_take(&args, strdup("--continue-without-input"));
 
-		lock_fd = wait_for_lock();
-		if (lock_fd == -1)
-			return RESULT_FAIL;
+		/* A device of the test's own is not shared with others. */
+		if (!setup->drm_device) {
+			lock_fd = wait_for_lock();
+			if (lock_fd == -1)
+				return RESULT_FAIL;
+		}
 	}
 
 	/* Test suite needs the debug protocol to be able to take screenshots */
@@ -98,6 +98,9 @@ struct compositor_setup {
 	/** Debug scopes for the compositor log,
 	 * or NULL for compositor defaults. */
 	const char *logging_scopes;
+	/** The DRM device for the DRM-backend, like the path of a fake KMS
+	 * device, or NULL for \c WESTON_TEST_SUITE_DRM_DEVICE . */
+	const char *drm_device;
 	/** The name of this test program, used as a unique identifier. */
 	const char *testset_name;
 };
@@ -122,6 +125,7 @@ compositor_setup_defaults_(struct compositor_setup *setup,
  * - config_file: none
  * - extra_module: none
  * - logging_scopes: compositor defaults
+ * - drm_device: from \c WESTON_TEST_SUITE_DRM_DEVICE
  * - testset_name: the test name from meson.build
  *
  * \ingroup testharness
@@ -39,7 +39,7 @@
 
 #include <cairo.h>
 
-#include "wcap-decode.h"
+#include "shared/wcap-decode.h"
 
 static void
 write_png(struct wcap_decoder *decoder, const char *filename)
@@ -193,6 +193,32 @@ output_yuv_frame(struct wcap_decoder *decoder, int depth)
 	fwrite(out, 1, size, stdout);
 }
 
+/* Step through the frame timestamps of an indexed file the same way the
+ * main loop steps through the frames at the replay rate, without decoding
+ * anything. Returns the number of output frames and the file frame shown
+ * as the given output frame, or -1 if there is no such output frame. */
+static int
+walk_output_frames(struct wcap_decoder *decoder, uint32_t frame_time,
+		   int output_frame, int *file_frame)
+{
+	const struct wcap_index_entry *index = decoder->index;
+	uint32_t current = 0, msecs = index[0].msecs;
+	int i = 0;
+
+	*file_frame = -1;
+	for (;;) {
+		if (i == output_frame)
+			*file_frame = current;
+		i++;
+		msecs += frame_time;
+		while (index[current].msecs < msecs) {
+			if (current + 1 == decoder->nframes)
+				return i;
+			current++;
+		}
+	}
+}
+
 static void
 usage(int exit_code)
 {
@@ -215,6 +241,7 @@ int main(int argc, char *argv[])
 	struct wcap_decoder *decoder;
 	int i, j, output_frame = -1, yuv4mpeg2 = 0, all = 0, has_frame;
 	int num = 30, denom = 1;
+	int file_frame;
 	char filename[200];
 	char *mode;
 	uint32_t msecs, frame_time;
@@ -279,10 +306,31 @@ int main(int argc, char *argv[])
 		fflush(stdout);
 	}
 
+	frame_time = 1000 * denom / num;
+
+	/* A single frame can be decoded from the closest key frame. */
+	if (decoder->index && output_frame >= 0 && !all && !yuv4mpeg2) {
+		i = walk_output_frames(decoder, frame_time, output_frame,
+				       &file_frame);
+		if (file_frame >= 0 &&
+		    wcap_decoder_seek(decoder, file_frame)) {
+			snprintf(filename, sizeof filename,
+				 "wcap-frame-%d.png", output_frame);
+			write_png(decoder, filename);
+			fprintf(stderr, "wrote %s\n", filename);
+		}
+
+		fprintf(stderr, "wcap file: size %dx%d, %d frames\n",
+			decoder->width, decoder->height, i);
+
+		wcap_decoder_destroy(decoder);
+
+		return EXIT_SUCCESS;
+	}
+
 	i = 0;
 	has_frame = wcap_decoder_get_frame(decoder);
 	msecs = decoder->msecs;
-	frame_time = 1000 * denom / num;
 	while (has_frame) {
 		if (all || i == output_frame) {
 			snprintf(filename, sizeof filename,